@@ -0,0 +1,519 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Data channel microbenchmark.
+ *
+ * Measures packets per second and nanoseconds per packet of the data
+ * channel, for each cipher of the default --data-ciphers list (or of
+ * --ciphers) and each payload size of --sizes:
+ *
+ *   crypto        openvpn_encrypt() / openvpn_decrypt(), the latter
+ *                 including the replay check
+ *   encrypt_sign  the whole sending path of forward.c, encrypt_sign(),
+ *                 into an in-memory link
+ *   lz4, lzo      encrypt_sign() with that compression framing, and
+ *                 decryption followed by decompression; the sender does
+ *                 not compress anymore, so this is the cost of the framing
+ *   fragment      encrypt_sign() with --fragment BENCH_FRAGMENT_SIZE, and
+ *                 decryption followed by reassembly
+ *
+ * The packets are sent in batches of BENCH_BATCH into the in-memory
+ * link, which are then received, so the "send" and "recv" columns time
+ * each direction separately.  Each packet received is then compared
+ * with the payload sent, outside the timed section.  Payloads are the same on every
+ * run, and so are the results of each size, path and cipher within the
+ * noise of the machine.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "syshead.h"
+
+#include "crypto.h"
+#include "comp.h"
+#include "fragment.h"
+#include "forward.h"
+#include "init.h"
+#include "openvpn.h"
+#include "options.h"
+#include "ssl_ncp.h"
+
+#include "bench.h"
+
+#include "memdbg.h"
+
+#define BENCH_BATCH         256
+#define BENCH_FRAGMENT_SIZE 512
+#define BENCH_MAX_SIZE      9000
+
+/* packets sent per measurement, by default */
+#define BENCH_PACKETS 200000
+
+enum bench_path
+{
+    BENCH_CRYPTO,
+    BENCH_ENCRYPT_SIGN,
+    BENCH_LZ4,
+    BENCH_LZO,
+    BENCH_FRAGMENT,
+    BENCH_PATHS
+};
+
+static const char *const bench_path_names[BENCH_PATHS] = {
+    "crypto", "encrypt_sign", "lz4", "lzo", "fragment",
+};
+
+/* the datagrams between the two ends */
+struct bench_link
+{
+    int size;  /* number of slots */
+    int count; /* datagrams sent */
+    struct buffer *pkts;
+
+    /* work buffers of each packet of a batch, so that the payloads
+     * received can all be checked once it is timed */
+    struct buffer *decrypt_bufs;
+    struct buffer *decompress_bufs;
+    struct buffer *payloads;
+};
+
+/* the receiving end */
+struct bench_peer
+{
+    struct crypto_options co;
+    struct compress_context *comp;
+    struct fragment_master *fragment;
+};
+
+struct bench_result
+{
+    uint64_t packets;
+    uint64_t send_ns;
+    uint64_t recv_ns;
+};
+
+/* the sending end: the context encrypt_sign() works on */
+static struct context sender;
+
+static void
+bench_payload_fill(uint8_t *p, int len)
+{
+    uint32_t x = BENCH_SEED;
+
+    for (int i = 0; i < len; i++)
+    {
+        p[i] = (uint8_t)bench_xorshift(&x);
+    }
+}
+
+/*
+ * Buffers large enough for every path at max_size: the headroom takes
+ * the opcode, the crypto, fragment and compression headers; the
+ * tailroom the compression worst case and a cipher block.
+ */
+static void
+bench_frame_init(struct frame *frame, int max_size)
+{
+    CLEAR(*frame);
+    frame->buf.payload_size = max_size;
+    frame->buf.headroom = 128;
+    frame->buf.tailroom = COMP_EXTRA_BUFFER(max_size) + OPENVPN_MAX_CIPHER_BLOCK_SIZE;
+    frame->tun_mtu = max_size;
+}
+
+static void
+bench_crypto_init(struct crypto_options *co, const struct key2 *key2, int key_direction,
+                  const struct key_type *kt)
+{
+    CLEAR(*co);
+    init_key_ctx_bi(&co->key_ctx_bi, key2, key_direction, kt, "bench");
+    packet_id_init(&co->packet_id, 64, 15, "bench", 0);
+}
+
+static void
+bench_crypto_free(struct crypto_options *co)
+{
+    free_key_ctx_bi(&co->key_ctx_bi);
+    packet_id_free(&co->packet_id);
+}
+
+static void
+bench_sender_init(const struct frame *frame)
+{
+    static struct link_socket_addr lsa;
+    static struct link_socket_info lsi;
+    static struct link_socket_info *lsis[1];
+
+    CLEAR(sender);
+    sender.options.disable_dco = true;
+    sender.c2.frame = *frame;
+    sender.c2.buffers = init_context_buffers(frame);
+
+    /* encrypt_sign() sends to the address the peer was last seen at */
+    lsa.actual.dest.addr.in4.sin_family = AF_INET;
+    lsa.actual.dest.addr.in4.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    lsa.actual.dest.addr.in4.sin_port = htons(1194);
+    lsi.lsa = &lsa;
+    lsis[0] = &lsi;
+    sender.c2.link_socket_infos = lsis;
+}
+
+/* the path of the test for sender and peer */
+static void
+bench_path_set(struct bench_peer *peer, enum bench_path path)
+{
+    struct compress_options copt = { 0 };
+
+    comp_uninit(sender.c2.comp_context);
+    comp_uninit(peer->comp);
+    sender.c2.comp_context = peer->comp = NULL;
+    if (sender.c2.fragment)
+    {
+        fragment_free(sender.c2.fragment);
+        fragment_free(peer->fragment);
+        sender.c2.fragment = peer->fragment = NULL;
+    }
+
+    switch (path)
+    {
+        case BENCH_LZ4:
+            copt.alg = COMP_ALG_LZ4;
+            copt.flags = COMP_F_SWAP;
+            break;
+
+        case BENCH_LZO:
+            copt.alg = COMP_ALG_LZO;
+            break;
+
+        case BENCH_FRAGMENT:
+            sender.c2.frame_fragment = sender.c2.frame;
+            sender.c2.frame_fragment.max_fragment_size = BENCH_FRAGMENT_SIZE;
+            sender.c2.fragment = fragment_init(&sender.c2.frame);
+            fragment_frame_init(sender.c2.fragment, &sender.c2.frame_fragment);
+            peer->fragment = fragment_init(&sender.c2.frame);
+            fragment_frame_init(peer->fragment, &sender.c2.frame_fragment);
+            break;
+
+        default:
+            break;
+    }
+
+    if (copt.alg != COMP_ALG_UNDEF)
+    {
+        sender.c2.comp_context = comp_init(&copt);
+        peer->comp = comp_init(&copt);
+    }
+}
+
+static void
+bench_link_put(struct bench_link *link, const struct buffer *buf)
+{
+    ASSERT(link->count < link->size);
+    struct buffer *pkt = &link->pkts[link->count++];
+    ASSERT(buf_init(pkt, sender.c2.frame.buf.headroom));
+    ASSERT(buf_copy(pkt, buf));
+}
+
+/* send one packet of payload through path into link */
+static void
+bench_send(struct bench_link *link, enum bench_path path, const uint8_t *payload, int len)
+{
+    struct context *c = &sender;
+
+    c->c2.buf = c->c2.buffers->read_tun_buf;
+    ASSERT(buf_init(&c->c2.buf, c->c2.frame.buf.headroom));
+    ASSERT(buf_write(&c->c2.buf, payload, len));
+
+    if (path == BENCH_CRYPTO)
+    {
+        ASSERT(buf_init(&c->c2.buffers->encrypt_buf, c->c2.frame.buf.headroom));
+        openvpn_encrypt(&c->c2.buf, c->c2.buffers->encrypt_buf, &c->c2.crypto_options);
+        bench_link_put(link, &c->c2.buf);
+        return;
+    }
+
+    encrypt_sign(c, true);
+    bench_link_put(link, &c->c2.to_link);
+
+    /* the other fragments, as check_fragment() sends them */
+    while (c->c2.fragment && fragment_outgoing_defined(c->c2.fragment))
+    {
+        ASSERT(fragment_ready_to_send(c->c2.fragment, &c->c2.buf, &c->c2.frame_fragment));
+        encrypt_sign(c, false);
+        bench_link_put(link, &c->c2.to_link);
+    }
+}
+
+/* receive pkt like process_incoming_link() does, with the work buffers
+ * decrypt_buf and decompress_buf; returns the payload once a whole
+ * packet is in, or an empty buffer */
+static struct buffer
+bench_recv(struct bench_peer *peer, struct buffer *pkt, struct buffer decrypt_buf,
+           struct buffer decompress_buf)
+{
+    struct buffer buf = *pkt;
+
+    if (!openvpn_decrypt(&buf, decrypt_buf, &peer->co, &sender.c2.frame, BPTR(&buf)))
+    {
+        msg(M_FATAL, "BENCH: decryption failed");
+    }
+    if (peer->fragment)
+    {
+        fragment_incoming(peer->fragment, &buf, &sender.c2.frame_fragment);
+    }
+    if (peer->comp && buf.len > 0)
+    {
+        (*peer->comp->alg.decompress)(&buf, decompress_buf, peer->comp, &sender.c2.frame);
+    }
+    return buf;
+}
+
+static void
+bench_run(struct bench_peer *peer, enum bench_path path, int len, int packets,
+          struct bench_result *res)
+{
+    uint8_t payload[BENCH_MAX_SIZE];
+    struct bench_link link;
+    struct gc_arena gc = gc_new();
+
+    /* a reassembled packet stays in the buffers of the fragment master
+     * until the N_FRAG_BUF-th packet after it */
+    const int batch_max = path == BENCH_FRAGMENT ? N_FRAG_BUF - 1 : BENCH_BATCH;
+
+    bench_payload_fill(payload, len);
+
+    link.size = BENCH_BATCH * (len / BENCH_FRAGMENT_SIZE + 2);
+    link.pkts = gc_malloc(link.size * sizeof(struct buffer), false, &gc);
+    for (int i = 0; i < link.size; i++)
+    {
+        link.pkts[i] = alloc_buf_gc(BUF_SIZE(&sender.c2.frame), &gc);
+    }
+    link.decrypt_bufs = gc_malloc(BENCH_BATCH * sizeof(struct buffer), false, &gc);
+    link.decompress_bufs = gc_malloc(BENCH_BATCH * sizeof(struct buffer), false, &gc);
+    link.payloads = gc_malloc(BENCH_BATCH * sizeof(struct buffer), false, &gc);
+    for (int i = 0; i < BENCH_BATCH; i++)
+    {
+        link.decrypt_bufs[i] = alloc_buf_gc(BUF_SIZE(&sender.c2.frame), &gc);
+        link.decompress_bufs[i] = alloc_buf_gc(BUF_SIZE(&sender.c2.frame), &gc);
+    }
+
+    bench_path_set(peer, path);
+    CLEAR(*res);
+
+    while (res->packets < (uint64_t)packets)
+    {
+        const int batch = min_int(batch_max, packets - (int)res->packets);
+        int received = 0;
+
+        update_time();
+        link.count = 0;
+
+        uint64_t t0 = bench_now_ns();
+        for (int i = 0; i < batch; i++)
+        {
+            bench_send(&link, path, payload, len);
+        }
+        uint64_t t1 = bench_now_ns();
+        for (int i = 0; i < link.count; i++)
+        {
+            const int j = min_int(received, BENCH_BATCH - 1);
+            link.payloads[j] = bench_recv(peer, &link.pkts[i], link.decrypt_bufs[j],
+                                          link.decompress_bufs[j]);
+            if (BLEN(&link.payloads[j]))
+            {
+                received++;
+            }
+        }
+        uint64_t t2 = bench_now_ns();
+
+        if (received != batch)
+        {
+            msg(M_FATAL, "BENCH: %s: sent %d packets, received %d", bench_path_names[path], batch,
+                received);
+        }
+        for (int i = 0; i < received; i++)
+        {
+            const struct buffer *got = &link.payloads[i];
+            if (BLEN(got) != len || memcmp(BPTR(got), payload, len))
+            {
+                msg(M_FATAL, "BENCH: %s: packet %d of a batch differs from the one sent (%d bytes, "
+                    "received %d)", bench_path_names[path], i, len, BLEN(got));
+            }
+        }
+
+        res->packets += batch;
+        res->send_ns += t1 - t0;
+        res->recv_ns += t2 - t1;
+    }
+
+    gc_free(&gc);
+}
+
+static void
+bench_print(const char *cipher, int len, enum bench_path path, const struct bench_result *res)
+{
+    const double send_ns = (double)res->send_ns / (double)res->packets;
+    const double recv_ns = (double)res->recv_ns / (double)res->packets;
+
+    printf("%-20s %6d  %-12s %12.0f %10.1f %12.0f %10.1f\n", cipher, len, bench_path_names[path],
+           1e9 / send_ns, send_ns, 1e9 / recv_ns, recv_ns);
+    fflush(stdout);
+}
+
+static void
+bench_cipher(const char *cipher, const int *sizes, int n_sizes, int packets, int max_size)
+{
+    struct key_type kt;
+    struct key2 key2 = { .n = 2 };
+    struct bench_peer peer;
+    struct frame frame;
+
+    init_key_type(&kt, cipher, "SHA256", true, false);
+    for (int i = 0; i < key2.n; i++)
+    {
+        ASSERT(rand_bytes(key2.keys[i].cipher, sizeof(key2.keys[i].cipher)));
+        ASSERT(rand_bytes(key2.keys[i].hmac, sizeof(key2.keys[i].hmac)));
+    }
+
+    bench_frame_init(&frame, max_size);
+    bench_sender_init(&frame);
+    bench_crypto_init(&sender.c2.crypto_options, &key2, KEY_DIRECTION_NORMAL, &kt);
+
+    CLEAR(peer);
+    bench_crypto_init(&peer.co, &key2, KEY_DIRECTION_INVERSE, &kt);
+
+    for (int s = 0; s < n_sizes; s++)
+    {
+        for (int path = 0; path < BENCH_PATHS; path++)
+        {
+            struct bench_result res;
+
+            /* warm up the caches and the branch predictors */
+            bench_run(&peer, path, sizes[s], BENCH_BATCH, &res);
+            bench_run(&peer, path, sizes[s], packets, &res);
+            bench_print(cipher, sizes[s], path, &res);
+        }
+    }
+
+    bench_path_set(&peer, BENCH_CRYPTO);
+    bench_crypto_free(&peer.co);
+    bench_crypto_free(&sender.c2.crypto_options);
+    free_context_buffers(sender.c2.buffers);
+    CLEAR(key2);
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "usage: openvpn-crypto-bench [--ciphers list] [--sizes list] [--packets n]\n"
+            "\n"
+            "--ciphers list : Colon separated ciphers, default: those of --data-ciphers.\n"
+            "--sizes list   : Comma separated payload sizes, default: 64,512,1400.\n"
+            "--packets n    : Packets per measurement, default: %d.\n",
+            BENCH_PACKETS);
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char *ciphers = NULL;
+    const char *size_list = "64,512,1400";
+    int packets = BENCH_PACKETS;
+    int sizes[16];
+    int n_sizes = 0;
+    int max_size = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--ciphers") && i + 1 < argc)
+        {
+            ciphers = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--sizes") && i + 1 < argc)
+        {
+            size_list = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--packets") && i + 1 < argc)
+        {
+            packets = atoi(argv[++i]);
+        }
+        else
+        {
+            usage();
+        }
+    }
+
+    char *sizes_copy = string_alloc(size_list, NULL);
+    char *saveptr = NULL;
+    for (const char *p = strtok_r(sizes_copy, ",", &saveptr); p && n_sizes < (int)SIZE(sizes);
+         p = strtok_r(NULL, ",", &saveptr))
+    {
+        const int size = atoi(p);
+        if (size < 1 || size > BENCH_MAX_SIZE)
+        {
+            fprintf(stderr, "payload sizes must be between 1 and %d\n", BENCH_MAX_SIZE);
+            return 1;
+        }
+        sizes[n_sizes++] = size;
+        max_size = max_int(max_size, size);
+    }
+    free(sizes_copy);
+    if (packets < 1 || !n_sizes)
+    {
+        usage();
+    }
+
+    if (!init_static())
+    {
+        return 1;
+    }
+
+    struct options o;
+    init_options(&o, true);
+    if (ciphers)
+    {
+        o.ncp_ciphers = ciphers;
+    }
+    options_postprocess_setdefault_ncpciphers(&o);
+
+    printf("%-20s %6s  %-12s %12s %10s %12s %10s\n", "cipher", "bytes", "path", "send pkt/s",
+           "ns/pkt", "recv pkt/s", "ns/pkt");
+
+    char *list = string_alloc(o.ncp_ciphers, NULL);
+    saveptr = NULL;
+    for (const char *cipher = strtok_r(list, ":", &saveptr); cipher;
+         cipher = strtok_r(NULL, ":", &saveptr))
+    {
+        bench_cipher(cipher, sizes, n_sizes, packets, max_size);
+    }
+    free(list);
+
+    uninit_options(&o);
+    uninit_static();
+
+    return 0;
+}
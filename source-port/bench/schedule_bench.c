@@ -0,0 +1,260 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Scheduler microbenchmark.
+ *
+ * Compares the treap and the timing wheel of schedule.c (--server-scheduler)
+ * for each number of clients of --clients, with the wakeups of multi.c:
+ * half of them within a second, the others within ten seconds, and the
+ * sigma of compute_wakeup_sigma().
+ *
+ *   insert      schedule_add_entry() of every client
+ *   reschedule  schedule_add_entry() of a random client, as for a packet
+ *   loop        an iteration of the event loop: multi_get_timeout(), the
+ *               client found serviced and rescheduled if it is due, and a
+ *               reschedule as above
+ *   remove      schedule_remove_entry() of every client
+ *
+ * At the end of the loop, the earliest wakeup returned is checked against
+ * the least one of all clients.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "syshead.h"
+
+#include "schedule.h"
+
+#include "bench.h"
+
+#include "memdbg.h"
+
+/* operations per measurement, by default */
+#define BENCH_OPS 1000000
+
+struct bench_result
+{
+    double insert_ns;
+    double reschedule_ns;
+    double loop_ns;
+    double remove_ns;
+};
+
+static uint32_t bench_rand_state = BENCH_SEED;
+
+static uint32_t
+bench_rand(void)
+{
+    return bench_xorshift(&bench_rand_state);
+}
+
+/* the wakeup delta of a client, as the timers of a context would give */
+static void
+bench_delta(struct timeval *delta)
+{
+    if (bench_rand() & 1)
+    {
+        delta->tv_sec = 0;
+        delta->tv_usec = bench_rand() % 1000000;
+    }
+    else
+    {
+        delta->tv_sec = 1 + bench_rand() % 9;
+        delta->tv_usec = bench_rand() % 1000000;
+    }
+}
+
+/* the same as compute_wakeup_sigma() of multi.c */
+static unsigned int
+bench_sigma(const struct timeval *delta)
+{
+    if (delta->tv_sec < 1)
+    {
+        return delta->tv_usec >> 3;
+    }
+    else if (delta->tv_sec < 600)
+    {
+        return delta->tv_sec << 17;
+    }
+    return 120000000;
+}
+
+static void
+bench_schedule(struct schedule *s, struct schedule_entry *e, bool sigma)
+{
+    struct timeval delta, tv;
+
+    bench_delta(&delta);
+    openvpn_gettimeofday(&tv, NULL);
+    tv_add(&tv, &delta);
+    schedule_add_entry(s, e, &tv, sigma ? bench_sigma(&delta) : 0);
+}
+
+static bool
+bench_check(struct schedule *s, struct schedule_entry *entries, int clients)
+{
+    struct schedule_entry *least = NULL;
+    struct timeval wakeup, diff;
+
+    for (int i = 0; i < clients; i++)
+    {
+        if (!least || tv_lt(&entries[i].tv, &least->tv))
+        {
+            least = &entries[i];
+        }
+    }
+    if (!schedule_get_earliest_wakeup(s, &wakeup))
+    {
+        return false;
+    }
+
+    /* the wheel has a resolution of 1 ms */
+    tv_delta(&diff, &least->tv, &wakeup);
+    return diff.tv_sec == 0 && diff.tv_usec < 1000;
+}
+
+static bool
+bench_run(int type, int clients, int ops, struct bench_result *res)
+{
+    struct schedule *s = schedule_init(type);
+    struct schedule_entry *entries;
+    uint64_t t0;
+    bool ok;
+
+    ALLOC_ARRAY_CLEAR(entries, struct schedule_entry, clients);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < clients; i++)
+    {
+        bench_schedule(s, &entries[i], false);
+    }
+    res->insert_ns = (double)(bench_now_ns() - t0) / clients;
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        bench_schedule(s, &entries[bench_rand() % clients], true);
+    }
+    res->reschedule_ns = (double)(bench_now_ns() - t0) / ops;
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < ops; i++)
+    {
+        struct timeval wakeup, now_tv;
+        struct schedule_entry *e = schedule_get_earliest_wakeup(s, &wakeup);
+
+        openvpn_gettimeofday(&now_tv, NULL);
+        if (e && tv_le(&wakeup, &now_tv))
+        {
+            bench_schedule(s, e, true);
+        }
+        bench_schedule(s, &entries[bench_rand() % clients], true);
+    }
+    res->loop_ns = (double)(bench_now_ns() - t0) / ops;
+
+    ok = bench_check(s, entries, clients);
+
+    t0 = bench_now_ns();
+    for (int i = 0; i < clients; i++)
+    {
+        schedule_remove_entry(s, &entries[i]);
+    }
+    res->remove_ns = (double)(bench_now_ns() - t0) / clients;
+
+    free(entries);
+    schedule_free(s);
+    return ok;
+}
+
+static void
+usage(void)
+{
+    fprintf(stderr,
+            "usage: openvpn-schedule-bench [--clients list] [--ops n]\n"
+            "\n"
+            "--clients list : Comma separated numbers of clients, default: 10000,50000.\n"
+            "--ops n        : Operations per measurement, default: %d.\n",
+            BENCH_OPS);
+    exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+    static const char *names[] = { "treap", "wheel" };
+    const char *client_list = "10000,50000";
+    int ops = BENCH_OPS;
+    int ret = 0;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--clients") && i + 1 < argc)
+        {
+            client_list = argv[++i];
+        }
+        else if (!strcmp(argv[i], "--ops") && i + 1 < argc)
+        {
+            ops = atoi(argv[++i]);
+        }
+        else
+        {
+            usage();
+        }
+    }
+    if (ops < 1)
+    {
+        usage();
+    }
+
+    printf("%-8s %8s %12s %14s %10s %12s\n", "sched", "clients", "insert ns", "reschedule ns",
+           "loop ns", "remove ns");
+
+    char *list = string_alloc(client_list, NULL);
+    char *saveptr = NULL;
+    for (const char *p = strtok_r(list, ",", &saveptr); p; p = strtok_r(NULL, ",", &saveptr))
+    {
+        const int clients = atoi(p);
+        if (clients < 1)
+        {
+            usage();
+        }
+        for (int type = SCHEDULE_TREAP; type <= SCHEDULE_WHEEL; type++)
+        {
+            struct bench_result res;
+
+            if (!bench_run(type, clients, ops, &res))
+            {
+                fprintf(stderr, "%s: wrong earliest wakeup with %d clients\n", names[type],
+                        clients);
+                ret = 1;
+            }
+            printf("%-8s %8d %12.1f %14.1f %10.1f %12.1f\n", names[type], clients, res.insert_ns,
+                   res.reschedule_ns, res.loop_ns, res.remove_ns);
+        }
+    }
+    free(list);
+
+    return ret;
+}
@@ -1,6 +1,7 @@
 # Define source files
 set(OPENVPN_CORE_SOURCES
     lib-src/argv.c
+    lib-src/auth_helper.c
     lib-src/auth_token.c
     lib-src/base64.c
     lib-src/buffer.c
@@ -37,8 +38,12 @@ set(OPENVPN_CORE_SOURCES
     lib-src/lzo.c
     lib-src/manage.c
     lib-src/mbuf.c
+    lib-src/mcrypto.c
     lib-src/misc.c
+    lib-src/mproc.c
     lib-src/mroute.c
+    lib-src/msg_async.c
+    lib-src/mshard.c
     lib-src/mss.c
     lib-src/mstats.c
     lib-src/mtcp.c
@@ -56,6 +61,7 @@ set(OPENVPN_CORE_SOURCES
     lib-src/pkcs11.c
     lib-src/pkcs11_mbedtls.c
     lib-src/pkcs11_openssl.c
+    lib-src/pktpool.c
     lib-src/platform.c
     lib-src/plugin.c
     lib-src/pool.c
@@ -75,7 +81,9 @@ set(OPENVPN_CORE_SOURCES
     lib-src/ssl.c
     lib-src/ssl_backend.h
     lib-src/ssl_common.h
+    lib-src/ssl_crl.c
     lib-src/ssl_mbedtls.c
+    lib-src/ssl_offload.c
     lib-src/ssl_openssl.c
     lib-src/ssl_pkt.c
     lib-src/ssl_util.c
@@ -94,6 +102,7 @@ set(OPENVPN_CORE_SOURCES
     lib-src/options_util.c
     lib-src/push_util.c
     lib-src/tun.c
+    lib-src/tun_queue.c
     lib-src/win32.c
     lib-src/xkey_helper.c
     lib-src/xkey_provider.c
@@ -111,6 +120,7 @@ set(COMPAT_SOURCES
 # OpenVPN Library Headers
 set(OPENVPN_HEADERS
     lib-src/argv.h
+    lib-src/auth_helper.h
     lib-src/auth_token.h
     lib-src/base64.h
     lib-src/basic.h
@@ -156,9 +166,13 @@ set(OPENVPN_HEADERS
     lib-src/manage.h
     lib-src/mbedtls_compat.h
     lib-src/mbuf.h
+    lib-src/mcrypto.h
     lib-src/memdbg.h
     lib-src/misc.h
+    lib-src/mproc.h
     lib-src/mroute.h
+    lib-src/msg_async.h
+    lib-src/mshard.h
     lib-src/mss.h
     lib-src/mstats.h
     lib-src/mtcp.h
@@ -176,6 +190,7 @@ set(OPENVPN_HEADERS
     lib-src/ping.h
     lib-src/pkcs11.h
     lib-src/pkcs11_backend.h
+    lib-src/pktpool.h
     lib-src/platform.h
     lib-src/plugin.h
     lib-src/pool.h
@@ -196,7 +211,9 @@ set(OPENVPN_HEADERS
     lib-src/ssl.h
     lib-src/ssl_backend.h
     lib-src/ssl_common.h
+    lib-src/ssl_crl.h
     lib-src/ssl_mbedtls.h
+    lib-src/ssl_offload.h
     lib-src/ssl_openssl.h
     lib-src/ssl_pkt.h
     lib-src/ssl_util.h
@@ -206,6 +223,7 @@ set(OPENVPN_HEADERS
     lib-src/syshead.h
     lib-src/tls_crypt.h
     lib-src/tun.h
+    lib-src/tun_queue.h
     lib-src/win32.h
     lib-src/xkey_common.h
     lib-src/xkey_helper.h
@@ -233,6 +251,17 @@ set(SERVER_API_SOURCES
     apis/openvpn_server_api.c    
 )
 
+# Benchmark source files
+set(CRYPTO_BENCH_SOURCES
+    bench/bench.h
+    bench/crypto_bench.c
+)
+
+set(SCHEDULE_BENCH_SOURCES
+    bench/bench.h
+    bench/schedule_bench.c
+)
+
 # Set source directory for sources
 foreach(source ${OPENVPN_CORE_SOURCES})
     if(EXISTS "${CMAKE_SOURCE_DIR}/src/openvpn/${source}")
@@ -93,6 +93,38 @@ target_compile_definitions(openvpn_exe PRIVATE
     $<$<NOT:$<PLATFORM_ID:Windows>>:_GNU_SOURCE>
 )
 
+# Create data channel benchmark executable
+add_executable(openvpn_crypto_bench ${CRYPTO_BENCH_SOURCES})
+set_target_properties(openvpn_crypto_bench PROPERTIES OUTPUT_NAME openvpn-crypto-bench)
+target_include_directories(openvpn_crypto_bench PRIVATE
+    ${CMAKE_SOURCE_DIR}/lib-src
+)
+target_link_libraries(openvpn_crypto_bench
+    openvpn_static
+)
+target_compile_definitions(openvpn_crypto_bench PRIVATE
+    HAVE_CONFIG_H
+    $<$<PLATFORM_ID:Windows>:_WIN32>
+    $<$<PLATFORM_ID:Windows>:WIN32>
+    $<$<NOT:$<PLATFORM_ID:Windows>>:_GNU_SOURCE>
+)
+
+# Create scheduler benchmark executable
+add_executable(openvpn_schedule_bench ${SCHEDULE_BENCH_SOURCES})
+set_target_properties(openvpn_schedule_bench PROPERTIES OUTPUT_NAME openvpn-schedule-bench)
+target_include_directories(openvpn_schedule_bench PRIVATE
+    ${CMAKE_SOURCE_DIR}/lib-src
+)
+target_link_libraries(openvpn_schedule_bench
+    openvpn_static
+)
+target_compile_definitions(openvpn_schedule_bench PRIVATE
+    HAVE_CONFIG_H
+    $<$<PLATFORM_ID:Windows>:_WIN32>
+    $<$<PLATFORM_ID:Windows>:WIN32>
+    $<$<NOT:$<PLATFORM_ID:Windows>>:_GNU_SOURCE>
+)
+
 # Create client API executable
 add_executable(ovpn-client-api ${CLIENT_API_SOURCES} )
 target_include_directories(ovpn-client-api PRIVATE
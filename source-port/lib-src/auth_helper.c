@@ -0,0 +1,692 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "syshead.h"
+
+#if ENABLE_AUTH_HELPERS
+
+#include <sys/wait.h>
+
+#include "argv.h"
+#include "buffer.h"
+#include "env_set.h"
+#include "event.h"
+#include "fdmisc.h"
+#include "otime.h"
+#include "platform.h"
+#include "run_command.h"
+#include "auth_helper.h"
+
+#include "memdbg.h"
+
+/* the longest response line we accept */
+#define AUTH_HELPER_LINE_MAX 64
+
+/* how long to wait before starting a helper that stopped again */
+#define AUTH_HELPER_RESTART_DELAY 1
+
+/* how long the helpers get to exit on shutdown, in milliseconds */
+#define AUTH_HELPER_EXIT_WAIT 1000
+
+/* the script_type of the requests */
+static const char *const auth_helper_script_type[AUTH_HELPER_TYPES] = {
+    "user-pass-verify", "client-connect", "client-crresponse"
+};
+
+/* the option of the command, for the log */
+static const char *const auth_helper_option[AUTH_HELPER_TYPES] = {
+    "--auth-user-pass-verify", "--client-connect", "--client-crresponse"
+};
+
+struct auth_helper_request
+{
+    unsigned int id;
+    enum auth_helper_type type;
+    struct tls_multi *owner;
+    uint32_t peer_id;
+    struct auth_helper_key key;
+    char *status_file;
+    char *text_file;
+    int status; /* of the response, 0 if the helper stopped */
+    struct auth_helper_request *next;
+};
+
+struct auth_helper
+{
+    pid_t pid; /* 0 if not running */
+    int to_helper;
+    int from_helper;
+    time_t started;
+
+    struct buffer_list *out; /* the requests not written yet */
+    struct buffer in;        /* the responses read, not yet complete */
+
+    /* the requests without a response, and how many */
+    struct auth_helper_request *pending;
+    int n_pending;
+};
+
+struct auth_helper_pool
+{
+    enum auth_helper_type type;
+    struct argv argv;
+    int n_helpers;
+    struct auth_helper *helpers;
+};
+
+struct auth_helpers
+{
+    struct gc_arena gc;
+    const char **envp; /* of the helpers */
+    struct auth_helper_pool pools[AUTH_HELPER_TYPES];
+    unsigned int next_id;
+
+    /* the requests done, not yet retired */
+    struct auth_helper_request *done;
+
+    /* pipes of stopped helpers, closed once out of the event set */
+    int *closing;
+    int n_closing;
+};
+
+static void
+auth_helper_request_free(struct auth_helper_request *req)
+{
+    free(req->status_file);
+    free(req->text_file);
+    free(req);
+}
+
+/* copy the environment of the helpers, as es may change later */
+static const char **
+auth_helpers_copy_env(const struct env_set *es, struct gc_arena *gc)
+{
+    struct gc_arena tmp = gc_new();
+    const char **env = make_env_array(es, true, &tmp);
+    int n = 0;
+
+    while (env[n])
+    {
+        n++;
+    }
+
+    const char **ret;
+    ALLOC_ARRAY_CLEAR_GC(ret, const char *, n + 1, gc);
+    for (int i = 0; i < n; i++)
+    {
+        ret[i] = string_alloc(env[i], gc);
+    }
+
+    gc_free(&tmp);
+    return ret;
+}
+
+static void
+auth_helper_start(struct auth_helpers *ah, struct auth_helper_pool *pool, struct auth_helper *h)
+{
+    int to_helper[2];
+    int from_helper[2];
+
+    h->started = now;
+
+    if (pipe(to_helper) != 0)
+    {
+        msg(M_WARN | M_ERRNO, "auth-helper: could not create a pipe");
+        return;
+    }
+    if (pipe(from_helper) != 0)
+    {
+        msg(M_WARN | M_ERRNO, "auth-helper: could not create a pipe");
+        close(to_helper[0]);
+        close(to_helper[1]);
+        return;
+    }
+
+    pid_t pid = fork();
+    if (pid == (pid_t)0) /* child side */
+    {
+        dup2(to_helper[0], 0);
+        dup2(from_helper[1], 1);
+        close(to_helper[0]);
+        close(to_helper[1]);
+        close(from_helper[0]);
+        close(from_helper[1]);
+        execve(pool->argv.argv[0], pool->argv.argv, (char *const *)ah->envp);
+        exit(OPENVPN_EXECVE_FAILURE);
+    }
+
+    close(to_helper[0]);
+    close(from_helper[1]);
+    if (pid < (pid_t)0)
+    {
+        msg(M_WARN | M_ERRNO, "auth-helper: unable to fork %s", pool->argv.argv[0]);
+        close(to_helper[1]);
+        close(from_helper[0]);
+        return;
+    }
+
+    h->pid = pid;
+    h->to_helper = to_helper[1];
+    h->from_helper = from_helper[0];
+    set_nonblock(h->to_helper);
+    set_cloexec(h->to_helper);
+    set_nonblock(h->from_helper);
+    set_cloexec(h->from_helper);
+
+    msg(D_LOW, "auth-helper: started %s for %s, pid %d", pool->argv.argv[0],
+        auth_helper_option[pool->type], (int)pid);
+}
+
+/* drop the queued requests, wiping them first */
+static void
+auth_helper_out_clear(struct buffer_list *out)
+{
+    for (struct buffer_entry *e = out->head; e; e = e->next)
+    {
+        buf_clear(&e->buf);
+    }
+    buffer_list_reset(out);
+}
+
+/*
+ * Stop a helper that exited or misbehaved, failing its requests.
+ * It is started again by the next request, after a while.
+ */
+static void
+auth_helper_stop(struct auth_helpers *ah, struct auth_helper_pool *pool, struct auth_helper *h,
+                 const char *reason)
+{
+    msg(M_WARN, "auth-helper: %s for %s, pid %d, stopped: %s, %d request(s) failed",
+        pool->argv.argv[0], auth_helper_option[pool->type], (int)h->pid, reason, h->n_pending);
+
+    ah->closing = realloc(ah->closing, array_mult_safe(sizeof(*ah->closing), ah->n_closing + 2, 0));
+    check_malloc_return(ah->closing);
+    ah->closing[ah->n_closing++] = h->to_helper;
+    ah->closing[ah->n_closing++] = h->from_helper;
+    kill(h->pid, SIGKILL);
+    waitpid(h->pid, NULL, 0);
+    h->pid = 0;
+
+    auth_helper_out_clear(h->out);
+    buf_init(&h->in, 0);
+
+    while (h->pending)
+    {
+        struct auth_helper_request *req = h->pending;
+        h->pending = req->next;
+
+        if (req->status_file)
+        {
+            int fd = platform_open(req->status_file, O_WRONLY | O_TRUNC, 0);
+            if (fd >= 0)
+            {
+                ssize_t unused = write(fd, "0", 1);
+                (void)unused;
+                close(fd);
+            }
+        }
+        req->status = 0;
+        req->next = ah->done;
+        ah->done = req;
+    }
+    h->n_pending = 0;
+}
+
+/*
+ * Write what a response says to a file of the request.  The file is not
+ * created: if it is gone, so is the client.
+ */
+static void
+auth_helper_write_file(const char *file, const uint8_t *data, int len)
+{
+    int fd = platform_open(file, O_WRONLY | O_TRUNC, 0);
+    if (fd < 0)
+    {
+        return;
+    }
+    if (write(fd, data, len) != len)
+    {
+        msg(D_TLS_ERRORS | M_ERRNO, "auth-helper: could not write to %s", file);
+    }
+    close(fd);
+}
+
+/* write the queued requests, as far as the pipe takes them; each one
+ * is wiped once written, since it may hold a password */
+static bool
+auth_helper_flush(struct auth_helper *h)
+{
+    struct buffer *buf;
+
+    while ((buf = buffer_list_peek(h->out)))
+    {
+        ssize_t n = write(h->to_helper, BPTR(buf), BLEN(buf));
+        if (n < 0)
+        {
+            return errno == EAGAIN || errno == EINTR;
+        }
+        if (n < BLEN(buf))
+        {
+            buffer_list_advance(h->out, (int)n);
+        }
+        else
+        {
+            buf_clear(buf);
+            buffer_list_pop(h->out);
+        }
+    }
+    return true;
+}
+
+/*
+ * Act on the response of h with the header id, status, len and the
+ * text at data.
+ */
+static void
+auth_helper_response(struct auth_helpers *ah, struct auth_helper *h, unsigned int id, int status,
+                     const uint8_t *data, int len)
+{
+    struct auth_helper_request **p = &h->pending;
+    while (*p && (*p)->id != id)
+    {
+        p = &(*p)->next;
+    }
+
+    struct auth_helper_request *req = *p;
+    if (!req)
+    {
+        msg(D_TLS_ERRORS, "auth-helper: response to an unknown request %u", id);
+        return;
+    }
+    *p = req->next;
+    h->n_pending--;
+
+    if (status != 2)
+    {
+        /* the text first, it is read once the status is there */
+        if (req->text_file && len > 0)
+        {
+            auth_helper_write_file(req->text_file, data, len);
+        }
+        if (req->status_file)
+        {
+            auth_helper_write_file(req->status_file, (const uint8_t *)(status ? "1" : "0"), 1);
+        }
+    }
+
+    req->status = status;
+    req->next = ah->done;
+    ah->done = req;
+}
+
+/*
+ * Read the responses of h.
+ *
+ * @return NULL, or why the helper is to be stopped.
+ */
+static const char *
+auth_helper_read(struct auth_helpers *ah, struct auth_helper *h)
+{
+    while (true)
+    {
+        if (h->in.offset)
+        {
+            memmove(h->in.data, BPTR(&h->in), BLEN(&h->in));
+            h->in.offset = 0;
+        }
+
+        ssize_t n = read(h->from_helper, BEND(&h->in), buf_forward_capacity(&h->in));
+        if (n == 0)
+        {
+            return "exited";
+        }
+        else if (n < 0)
+        {
+            if (errno == EAGAIN || errno == EINTR)
+            {
+                return NULL;
+            }
+            return strerror(errno);
+        }
+        h->in.len += (int)n;
+
+        /* the complete responses */
+        while (BLEN(&h->in))
+        {
+            const uint8_t *line = BPTR(&h->in);
+            const uint8_t *eol = memchr(line, '\n', BLEN(&h->in));
+            if (!eol)
+            {
+                if (BLEN(&h->in) > AUTH_HELPER_LINE_MAX)
+                {
+                    return "response line too long";
+                }
+                break;
+            }
+
+            char header[AUTH_HELPER_LINE_MAX + 1];
+            const int header_len = (int)(eol - line) + 1;
+            if (header_len > AUTH_HELPER_LINE_MAX)
+            {
+                return "response line too long";
+            }
+            memcpy(header, line, header_len - 1);
+            header[header_len - 1] = '\0';
+
+            unsigned int id;
+            int status, len;
+            char extra;
+            if (sscanf(header, "%u %d %d%c", &id, &status, &len, &extra) != 3 || status < 0
+                || status > 2 || len < 0 || len > AUTH_HELPER_TEXT_MAX)
+            {
+                return "bad response line";
+            }
+            if (BLEN(&h->in) < header_len + len)
+            {
+                break;
+            }
+
+            auth_helper_response(ah, h, id, status, line + header_len, len);
+            buf_advance(&h->in, header_len + len);
+        }
+    }
+}
+
+struct auth_helpers *
+auth_helpers_new(const char *const commands[AUTH_HELPER_TYPES], int n_helpers,
+                 const struct env_set *es)
+{
+    if (!openvpn_execve_allowed(S_SCRIPT))
+    {
+        msg(M_WARN, SCRIPT_SECURITY_WARNING);
+        return NULL;
+    }
+
+    struct auth_helpers *ah;
+    ALLOC_OBJ_CLEAR(ah, struct auth_helpers);
+    ah->gc = gc_new();
+    ah->envp = auth_helpers_copy_env(es, &ah->gc);
+
+    for (int t = 0; t < AUTH_HELPER_TYPES; t++)
+    {
+        struct auth_helper_pool *pool = &ah->pools[t];
+        pool->type = t;
+        pool->argv = argv_new();
+        if (!commands[t])
+        {
+            continue;
+        }
+
+        argv_parse_cmd(&pool->argv, commands[t]);
+        pool->n_helpers = n_helpers;
+        ALLOC_ARRAY_CLEAR(pool->helpers, struct auth_helper, n_helpers);
+        for (int i = 0; i < n_helpers; i++)
+        {
+            struct auth_helper *h = &pool->helpers[i];
+            h->out = buffer_list_new();
+            h->in = alloc_buf(AUTH_HELPER_LINE_MAX + AUTH_HELPER_TEXT_MAX);
+            auth_helper_start(ah, pool, h);
+        }
+    }
+
+    return ah;
+}
+
+void
+auth_helpers_free(struct auth_helpers *ah)
+{
+    if (!ah)
+    {
+        return;
+    }
+
+    /* a helper exits on the end of its input, or on SIGTERM */
+    for (int t = 0; t < AUTH_HELPER_TYPES; t++)
+    {
+        struct auth_helper_pool *pool = &ah->pools[t];
+        for (int i = 0; i < pool->n_helpers; i++)
+        {
+            struct auth_helper *h = &pool->helpers[i];
+            if (h->pid)
+            {
+                close(h->to_helper);
+                close(h->from_helper);
+                kill(h->pid, SIGTERM);
+            }
+        }
+    }
+    for (int i = 0; i < ah->n_closing; i++)
+    {
+        close(ah->closing[i]);
+    }
+    free(ah->closing);
+
+    for (int t = 0; t < AUTH_HELPER_TYPES; t++)
+    {
+        struct auth_helper_pool *pool = &ah->pools[t];
+        for (int i = 0; i < pool->n_helpers; i++)
+        {
+            struct auth_helper *h = &pool->helpers[i];
+            int waited = 0;
+
+            while (h->pid && waitpid(h->pid, NULL, WNOHANG) == 0)
+            {
+                if (waited >= AUTH_HELPER_EXIT_WAIT)
+                {
+                    kill(h->pid, SIGKILL);
+                    waitpid(h->pid, NULL, 0);
+                    break;
+                }
+                platform_sleep_milliseconds(10);
+                waited += 10;
+            }
+
+            while (h->pending)
+            {
+                struct auth_helper_request *req = h->pending;
+                h->pending = req->next;
+                auth_helper_request_free(req);
+            }
+            auth_helper_out_clear(h->out);
+            buffer_list_free(h->out);
+            free_buf(&h->in);
+        }
+        free(pool->helpers);
+        argv_free(&pool->argv);
+    }
+
+    while (ah->done)
+    {
+        struct auth_helper_request *req = ah->done;
+        ah->done = req->next;
+        auth_helper_request_free(req);
+    }
+
+    gc_free(&ah->gc);
+    free(ah);
+}
+
+bool
+auth_helpers_defined(const struct auth_helpers *ah, enum auth_helper_type type)
+{
+    return ah && ah->pools[type].n_helpers > 0;
+}
+
+bool
+auth_helpers_request(struct auth_helpers *ah, enum auth_helper_type type,
+                     const struct env_set *es, const char *const *secrets,
+                     const char *status_file, const char *text_file, struct tls_multi *owner,
+                     uint32_t peer_id, const struct auth_helper_key *key)
+{
+    struct auth_helper_pool *pool = &ah->pools[type];
+    struct auth_helper *h = NULL;
+
+    /* the running helper with the fewest requests */
+    for (int i = 0; i < pool->n_helpers; i++)
+    {
+        struct auth_helper *c = &pool->helpers[i];
+        if (!c->pid && now >= c->started + AUTH_HELPER_RESTART_DELAY)
+        {
+            auth_helper_start(ah, pool, c);
+        }
+        if (c->pid && (!h || c->n_pending < h->n_pending))
+        {
+            h = c;
+        }
+    }
+    if (!h)
+    {
+        msg(D_TLS_ERRORS, "auth-helper: no helper for %s is running", auth_helper_option[type]);
+        return false;
+    }
+
+    struct gc_arena gc = gc_new();
+    const char **env = make_env_array(es, true, &gc);
+    size_t len = 0;
+
+    for (int i = 0; env[i]; i++)
+    {
+        len += strlen(env[i]) + 1;
+    }
+    for (int i = 0; secrets && secrets[i]; i++)
+    {
+        len += strlen(secrets[i]) + 1;
+    }
+
+    struct auth_helper_request *req;
+    ALLOC_OBJ_CLEAR(req, struct auth_helper_request);
+    req->id = ah->next_id++;
+    req->type = type;
+    req->owner = owner;
+    req->peer_id = peer_id;
+    req->key = *key;
+    req->status_file = status_file ? string_alloc(status_file, NULL) : NULL;
+    req->text_file = text_file ? string_alloc(text_file, NULL) : NULL;
+
+    struct buffer buf = alloc_buf_gc(AUTH_HELPER_LINE_MAX + len, &gc);
+    buf_printf(&buf, "%u %s %zu\n", req->id, auth_helper_script_type[type], len);
+    for (int i = 0; env[i]; i++)
+    {
+        buf_write(&buf, env[i], strlen(env[i]) + 1);
+    }
+    for (int i = 0; secrets && secrets[i]; i++)
+    {
+        buf_write(&buf, secrets[i], strlen(secrets[i]) + 1);
+    }
+    buffer_list_push_data(h->out, BPTR(&buf), BLEN(&buf));
+    secure_memzero(BPTR(&buf), BLEN(&buf));
+    gc_free(&gc);
+
+    req->next = h->pending;
+    h->pending = req;
+    h->n_pending++;
+
+    if (!auth_helper_flush(h))
+    {
+        auth_helper_stop(ah, pool, h, strerror(errno));
+    }
+    return true;
+}
+
+void
+auth_helpers_event_set(struct auth_helpers *ah, struct event_set *es, void *arg)
+{
+    for (int i = 0; i < ah->n_closing; i++)
+    {
+        event_del(es, ah->closing[i]);
+        close(ah->closing[i]);
+    }
+    ah->n_closing = 0;
+
+    for (int t = 0; t < AUTH_HELPER_TYPES; t++)
+    {
+        struct auth_helper_pool *pool = &ah->pools[t];
+        for (int i = 0; i < pool->n_helpers; i++)
+        {
+            struct auth_helper *h = &pool->helpers[i];
+            if (h->pid)
+            {
+                event_ctl(es, h->from_helper, EVENT_READ, arg);
+                event_ctl(es, h->to_helper, buffer_list_defined(h->out) ? EVENT_WRITE : 0, arg);
+            }
+        }
+    }
+}
+
+void
+auth_helpers_io(struct auth_helpers *ah)
+{
+    for (int t = 0; t < AUTH_HELPER_TYPES; t++)
+    {
+        struct auth_helper_pool *pool = &ah->pools[t];
+        for (int i = 0; i < pool->n_helpers; i++)
+        {
+            struct auth_helper *h = &pool->helpers[i];
+            if (!h->pid)
+            {
+                continue;
+            }
+
+            const char *error = NULL;
+            if (!auth_helper_flush(h))
+            {
+                error = strerror(errno);
+            }
+            else
+            {
+                error = auth_helper_read(ah, h);
+            }
+            if (error)
+            {
+                auth_helper_stop(ah, pool, h, error);
+            }
+        }
+    }
+}
+
+int
+auth_helpers_retire(struct auth_helpers *ah, struct auth_helper_result *results, int max)
+{
+    int n = 0;
+
+    while (ah->done && n < max)
+    {
+        struct auth_helper_request *req = ah->done;
+        ah->done = req->next;
+
+        results[n].owner = req->owner;
+        results[n].peer_id = req->peer_id;
+        results[n].key = req->key;
+        results[n].type = req->type;
+        results[n].status = req->status;
+        n++;
+
+        auth_helper_request_free(req);
+    }
+    return n;
+}
+
+#endif /* ENABLE_AUTH_HELPERS */
@@ -0,0 +1,171 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Long-lived helpers for the --auth-user-pass-verify, --client-connect
+ * and --client-crresponse scripts of --mode server (--auth-helpers n).
+ *
+ * Instead of a process per event, n processes of each of these commands
+ * are started once, and the events are sent to them as requests: to the
+ * one with the fewest requests outstanding.  A helper reads the requests
+ * on its standard input and writes the responses on its standard output,
+ * in any order.  The event loop does not wait for them: to the rest of
+ * OpenVPN, each request is a deferred script, and the response is written
+ * to the files a deferred script would write.
+ *
+ * A request is a line, followed by the environment the script would have
+ * been run with:
+ *
+ *     <id> <script_type> <length>\n
+ *     <length> bytes: "name=value" strings, each ended by a NUL byte
+ *
+ * The secrets that a script gets in a file are in the environment of the
+ * request: "username" and "password" for user-pass-verify and
+ * "crresponse" for client-crresponse.
+ *
+ * A response is a line, followed by some text:
+ *
+ *     <id> <status> <length>\n
+ *     <length> bytes of text, at most AUTH_HELPER_TEXT_MAX
+ *
+ * where <id> is the one of the request, and <status> is 1 for success, 0
+ * for failure, or 2 if the helper writes the result to the files named in
+ * the request (auth_control_file, client_connect_deferred_file, ...)
+ * later itself, like a deferred script.  For a successful client-connect,
+ * the text holds the configuration lines the script would have written to
+ * client_connect_config_file.  For a failed user-pass-verify, it is the
+ * reason sent to the client, as in auth_failed_reason_file.  Otherwise it
+ * is ignored.
+ *
+ * A helper that exits, or breaks the protocol, is restarted; its
+ * outstanding requests fail.
+ */
+
+#ifndef AUTH_HELPER_H
+#define AUTH_HELPER_H
+
+#if ENABLE_AUTH_HELPERS
+
+#include "session_id.h"
+
+#define AUTH_HELPERS_MAX 64
+
+/** The maximum length of the text of a response */
+#define AUTH_HELPER_TEXT_MAX 65536
+
+struct auth_helpers;
+struct env_set;
+struct event_set;
+struct tls_multi;
+
+/** The scripts that can run as helpers */
+enum auth_helper_type
+{
+    AUTH_HELPER_USER_PASS_VERIFY,
+    AUTH_HELPER_CLIENT_CONNECT,
+    AUTH_HELPER_CLIENT_CRRESPONSE,
+    AUTH_HELPER_TYPES
+};
+
+/** The key state of a request, which may be gone by the response */
+struct auth_helper_key
+{
+    struct session_id session_id; /**< of the TLS session, which moves */
+    int key_id;
+};
+
+/** A request that got its response, or failed */
+struct auth_helper_result
+{
+    /** The client of the request, which may be gone by now: only to be
+     *  compared with the one of \c peer_id */
+    struct tls_multi *owner;
+    uint32_t peer_id;
+    struct auth_helper_key key;
+    enum auth_helper_type type;
+    int status; /**< of the response, 0 if the helper stopped */
+};
+
+/**
+ * Start \a n_helpers helpers for each of the \a commands that is not
+ * NULL, with the environment \a es.
+ *
+ * @return the helpers, or NULL if --script-security does not allow it.
+ */
+struct auth_helpers *auth_helpers_new(const char *const commands[AUTH_HELPER_TYPES],
+                                      int n_helpers, const struct env_set *es);
+
+/**
+ * Stop the helpers.  Requests still outstanding are dropped.
+ */
+void auth_helpers_free(struct auth_helpers *ah);
+
+/**
+ * Are there helpers for the scripts of \a type ?
+ */
+bool auth_helpers_defined(const struct auth_helpers *ah, enum auth_helper_type type);
+
+/**
+ * Send a request to a helper for the script of \a type.
+ *
+ * @param es            The environment of the script.
+ * @param secrets       More "name=value" strings for the request,
+ *                      NULL-terminated, or NULL.
+ * @param status_file   Where to write the status to, as '1' or '0',
+ *                      or NULL.
+ * @param text_file     Where to write the text of the response to, or
+ *                      NULL.
+ * @param owner         The client of the request.
+ * @param peer_id       Its peer-id.
+ * @param key           The key state of the request.
+ *
+ * @return false if no helper could take the request.
+ */
+bool auth_helpers_request(struct auth_helpers *ah, enum auth_helper_type type,
+                          const struct env_set *es, const char *const *secrets,
+                          const char *status_file, const char *text_file,
+                          struct tls_multi *owner, uint32_t peer_id,
+                          const struct auth_helper_key *key);
+
+/**
+ * Add the pipes of the helpers to the event set \a es, with \a arg.
+ * The pipes of helpers stopped since are deleted from it and closed.
+ */
+void auth_helpers_event_set(struct auth_helpers *ah, struct event_set *es, void *arg);
+
+/**
+ * Write the requests and read the responses the pipes of the helpers are
+ * ready for.  The files of a request are written once its response is
+ * read.
+ */
+void auth_helpers_io(struct auth_helpers *ah);
+
+/**
+ * Collect the requests that are done, at most \a max.
+ *
+ * @return the number of requests stored in \a results
+ */
+int auth_helpers_retire(struct auth_helpers *ah, struct auth_helper_result *results, int max);
+
+#endif /* ENABLE_AUTH_HELPERS */
+
+#endif /* AUTH_HELPER_H */
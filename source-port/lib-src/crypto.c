@@ -62,20 +62,21 @@
  * happen unless the frame parameters are wrong.
  */
 
-static void
-openvpn_encrypt_aead(struct buffer *buf, struct buffer work, struct crypto_options *opt)
+/*
+ * Everything openvpn_encrypt_aead() does before the cipher runs: write
+ * the packet ID to work as the additional data, count the plaintext
+ * blocks and lay out where the ciphertext and the tag go in work.  The
+ * epoch send key must have been iterated already.  Sets buf->len to 0
+ * and returns false on error.
+ */
+static bool
+openvpn_encrypt_aead_setup(struct buffer *buf, struct buffer *work, struct crypto_options *opt,
+                           struct cipher_aead_packet *p)
 {
     struct gc_arena gc;
-    int outlen = 0;
     const bool use_epoch_data_format = opt->flags & CO_EPOCH_DATA_KEY_FORMAT;
 
-    if (use_epoch_data_format)
-    {
-        epoch_check_send_iterate(opt);
-    }
-
-    const struct key_ctx *ctx = &opt->key_ctx_bi.encrypt;
-    uint8_t *mac_out = NULL;
+    struct key_ctx *ctx = &opt->key_ctx_bi.encrypt;
     const int mac_len = OPENVPN_AEAD_TAG_LENGTH;
 
     /* IV, packet-ID and implicit IV required for this mode. */
@@ -87,11 +88,12 @@ openvpn_encrypt_aead(struct buffer *buf, struct buffer work, struct crypto_optio
     /* Prepare IV */
     {
         struct buffer iv_buffer;
-        uint8_t iv[OPENVPN_MAX_IV_LENGTH] = { 0 };
+        uint8_t *iv = p->iv;
         const int iv_len = cipher_ctx_iv_length(ctx->cipher);
 
         ASSERT(iv_len >= OPENVPN_AEAD_MIN_IV_LEN && iv_len <= OPENVPN_MAX_IV_LENGTH);
 
+        CLEAR(p->iv);
         buf_set_write(&iv_buffer, iv, iv_len);
 
         /* IV starts with packet id to make the IV unique for packet */
@@ -112,7 +114,7 @@ openvpn_encrypt_aead(struct buffer *buf, struct buffer work, struct crypto_optio
             }
         }
         /* Write packet id part of IV to work buffer */
-        ASSERT(buf_write(&work, iv, buf_len(&iv_buffer)));
+        ASSERT(buf_write(work, iv, buf_len(&iv_buffer)));
 
         /* This generates the IV by XORing the implicit part of the IV
          * with the packet id already written to the iv buffer */
@@ -122,68 +124,96 @@ openvpn_encrypt_aead(struct buffer *buf, struct buffer work, struct crypto_optio
         }
 
         dmsg(D_PACKET_CONTENT, "ENCRYPT IV: %s", format_hex(iv, iv_len, 0, &gc));
-
-        /* Init cipher_ctx with IV.  key & keylen are already initialized */
-        ASSERT(cipher_ctx_reset(ctx->cipher, iv));
     }
 
     dmsg(D_PACKET_CONTENT, "ENCRYPT FROM: %s", format_hex(BPTR(buf), BLEN(buf), 80, &gc));
 
     /* Buffer overflow check */
-    if (!buf_safe(&work, buf->len + mac_len + cipher_ctx_block_size(ctx->cipher)))
+    if (!buf_safe(work, buf->len + mac_len + cipher_ctx_block_size(ctx->cipher)))
     {
         msg(D_CRYPT_ERRORS, "ENCRYPT: buffer size error, bc=%d bo=%d bl=%d wc=%d wo=%d wl=%d",
-            buf->capacity, buf->offset, buf->len, work.capacity, work.offset, work.len);
+            buf->capacity, buf->offset, buf->len, work->capacity, work->offset, work->len);
         goto err;
     }
 
     /* For AEAD ciphers, authenticate Additional Data, including opcode */
-    ASSERT(cipher_ctx_update_ad(ctx->cipher, BPTR(&work), BLEN(&work)));
-    dmsg(D_PACKET_CONTENT, "ENCRYPT AD: %s", format_hex(BPTR(&work), BLEN(&work), 0, &gc));
+    p->ad = BPTR(work);
+    p->ad_len = BLEN(work);
+    dmsg(D_PACKET_CONTENT, "ENCRYPT AD: %s", format_hex(BPTR(work), BLEN(work), 0, &gc));
 
     if (!use_epoch_data_format)
     {
         /* Reserve space for authentication tag */
-        mac_out = buf_write_alloc(&work, mac_len);
-        ASSERT(mac_out);
+        p->tag = buf_write_alloc(work, mac_len);
+        ASSERT(p->tag);
     }
 
-    /* Encrypt packet ID, payload */
-    ASSERT(cipher_ctx_update(ctx->cipher, BEND(&work), &outlen, BPTR(buf), BLEN(buf)));
-    ASSERT(buf_inc_len(&work, outlen));
+    /* Encrypt packet ID, payload.  AEAD ciphers do not pad, so with the
+     * epoch data format the tag follows right after the ciphertext */
+    p->src = BPTR(buf);
+    p->src_len = BLEN(buf);
+    p->dst = BEND(work);
+    if (use_epoch_data_format)
+    {
+        p->tag = p->dst + p->src_len;
+    }
 
     /* update number of plaintext blocks encrypted. Use the (x + (n-1))/n trick
      * to round up the result to the number of blocks used */
     const int blocksize = AEAD_LIMIT_BLOCKSIZE;
-    opt->key_ctx_bi.encrypt.plaintext_blocks += (outlen + (blocksize - 1)) / blocksize;
+    ctx->plaintext_blocks += (p->src_len + (blocksize - 1)) / blocksize;
 
-    /* Flush the encryption buffer */
-    ASSERT(cipher_ctx_final(ctx->cipher, BEND(&work), &outlen));
-    ASSERT(buf_inc_len(&work, outlen));
+    gc_free(&gc);
+    return true;
 
-    /* if the tag is at end the end, allocate it now */
-    if (use_epoch_data_format)
+err:
+    crypto_clear_error();
+    buf->len = 0;
+    gc_free(&gc);
+    return false;
+}
+
+/*
+ * Put the packet encrypted by the cipher into buf.
+ */
+static void
+openvpn_encrypt_aead_finish(struct buffer *buf, struct buffer *work,
+                            const struct cipher_aead_packet *p)
+{
+    ASSERT(p->ok && p->dst_len == p->src_len);
+    ASSERT(buf_inc_len(work, p->dst_len));
+
+    /* the tag at the end was written right after the ciphertext */
+    if (p->tag == BEND(work))
     {
-        /* Reserve space for authentication tag */
-        mac_out = buf_write_alloc(&work, mac_len);
-        ASSERT(mac_out);
+        ASSERT(buf_inc_len(work, OPENVPN_AEAD_TAG_LENGTH));
     }
 
-    /* Write authentication tag */
-    ASSERT(cipher_ctx_get_tag(ctx->cipher, mac_out, mac_len));
+    *buf = *work;
 
-    *buf = work;
+    if (check_debug_level(D_PACKET_CONTENT))
+    {
+        struct gc_arena gc = gc_new();
+        dmsg(D_PACKET_CONTENT, "ENCRYPT TO: %s", format_hex(BPTR(buf), BLEN(buf), 80, &gc));
+        gc_free(&gc);
+    }
+}
 
-    dmsg(D_PACKET_CONTENT, "ENCRYPT TO: %s", format_hex(BPTR(buf), BLEN(buf), 80, &gc));
+static void
+openvpn_encrypt_aead(struct buffer *buf, struct buffer work, struct crypto_options *opt)
+{
+    struct cipher_aead_packet p;
 
-    gc_free(&gc);
-    return;
+    if ((opt->flags & CO_EPOCH_DATA_KEY_FORMAT) && !(opt->flags & CO_SEND_RESERVED))
+    {
+        epoch_check_send_iterate(opt);
+    }
 
-err:
-    crypto_clear_error();
-    buf->len = 0;
-    gc_free(&gc);
-    return;
+    if (openvpn_encrypt_aead_setup(buf, &work, opt, &p))
+    {
+        cipher_ctx_aead_batch(opt->key_ctx_bi.encrypt.cipher, &p, 1, OPENVPN_OP_ENCRYPT);
+        openvpn_encrypt_aead_finish(buf, &work, &p);
+    }
 }
 
 static void
@@ -334,6 +364,145 @@ openvpn_encrypt(struct buffer *buf, struct buffer work, struct crypto_options *o
     }
 }
 
+/*
+ * Run the queued AEAD packets through the cipher and finish them.
+ */
+static void
+openvpn_encrypt_aead_flush(cipher_ctx_t *cipher, struct crypto_batch_packet **queued,
+                           struct cipher_aead_packet *aead, int *n_queued)
+{
+    if (*n_queued)
+    {
+        cipher_ctx_aead_batch(cipher, aead, *n_queued, OPENVPN_OP_ENCRYPT);
+        for (int i = 0; i < *n_queued; i++)
+        {
+            openvpn_encrypt_aead_finish(queued[i]->buf, &queued[i]->work, &aead[i]);
+        }
+        *n_queued = 0;
+    }
+}
+
+void
+openvpn_encrypt_batch(struct crypto_batch_packet *pkts, int n)
+{
+    struct cipher_aead_packet aead[CRYPTO_BATCH_MAX];
+    struct crypto_batch_packet *queued[CRYPTO_BATCH_MAX];
+    cipher_ctx_t *cipher = NULL;
+    int n_queued = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        struct crypto_batch_packet *pkt = &pkts[i];
+        struct crypto_options *opt = pkt->opt;
+
+        if (pkt->buf->len <= 0 || !opt)
+        {
+            continue;
+        }
+        if (!cipher_ctx_mode_aead(opt->key_ctx_bi.encrypt.cipher))
+        {
+            openvpn_encrypt_v1(pkt->buf, pkt->work, opt);
+            continue;
+        }
+
+        /* moving on to the next epoch key frees the current cipher */
+        if ((opt->flags & CO_EPOCH_DATA_KEY_FORMAT) && !(opt->flags & CO_SEND_RESERVED))
+        {
+            openvpn_encrypt_aead_flush(cipher, queued, aead, &n_queued);
+            epoch_check_send_iterate(opt);
+        }
+
+        if (opt->key_ctx_bi.encrypt.cipher != cipher || n_queued == CRYPTO_BATCH_MAX)
+        {
+            openvpn_encrypt_aead_flush(cipher, queued, aead, &n_queued);
+            cipher = opt->key_ctx_bi.encrypt.cipher;
+        }
+
+        if (openvpn_encrypt_aead_setup(pkt->buf, &pkt->work, opt, &aead[n_queued]))
+        {
+            queued[n_queued++] = pkt;
+        }
+    }
+
+    openvpn_encrypt_aead_flush(cipher, queued, aead, &n_queued);
+}
+
+bool
+openvpn_encrypt_reserve(struct crypto_options *opt, struct crypto_options *snap, int len)
+{
+    uint8_t scratch[sizeof(uint64_t)];
+    struct buffer id_buf;
+
+    ASSERT(cipher_ctx_mode_aead(opt->key_ctx_bi.encrypt.cipher));
+
+    if (opt->flags & CO_EPOCH_DATA_KEY_FORMAT)
+    {
+        epoch_check_send_iterate(opt);
+    }
+
+    *snap = *opt;
+    snap->flags |= CO_SEND_RESERVED;
+
+    /* advance the shared packet ID past the one snap is going to use */
+    buf_set_write(&id_buf, scratch, sizeof(scratch));
+    if (opt->flags & CO_EPOCH_DATA_KEY_FORMAT)
+    {
+        if (!packet_id_write_epoch(&opt->packet_id.send, opt->key_ctx_bi.encrypt.epoch, &id_buf))
+        {
+            return false;
+        }
+    }
+    else if (!packet_id_write(&opt->packet_id.send, &id_buf, false, false))
+    {
+        return false;
+    }
+
+    /* AEAD ciphers used here do not pad, so this is what
+     * openvpn_encrypt_aead() will count */
+    opt->key_ctx_bi.encrypt.plaintext_blocks +=
+        (len + (AEAD_LIMIT_BLOCKSIZE - 1)) / AEAD_LIMIT_BLOCKSIZE;
+
+    return true;
+}
+
+bool
+cipher_copy_matches(const struct cipher_copy *cc, const struct key_ctx *ctx)
+{
+    return cc->cipher && cc->src == ctx->cipher && cc->epoch == ctx->epoch
+           && memcmp(cc->implicit_iv, ctx->implicit_iv, sizeof(cc->implicit_iv)) == 0;
+}
+
+cipher_ctx_t *
+cipher_copy_get(struct cipher_copy *cc, const struct key_ctx *ctx)
+{
+    if (cipher_copy_matches(cc, ctx))
+    {
+        return cc->cipher;
+    }
+    if (cc->busy)
+    {
+        return NULL;
+    }
+
+    cipher_copy_free(cc);
+    cc->cipher = cipher_ctx_dup(ctx->cipher);
+    cc->src = ctx->cipher;
+    cc->epoch = ctx->epoch;
+    memcpy(cc->implicit_iv, ctx->implicit_iv, sizeof(cc->implicit_iv));
+
+    return cc->cipher;
+}
+
+void
+cipher_copy_free(struct cipher_copy *cc)
+{
+    if (cc->cipher)
+    {
+        cipher_ctx_free(cc->cipher);
+    }
+    CLEAR(*cc);
+}
+
 uint64_t
 cipher_get_aead_limits(const char *ciphername)
 {
@@ -416,34 +585,45 @@ crypto_check_replay(struct crypto_options *opt, const struct packet_id_net *pin,
     return ret;
 }
 
-/**
- * Unwrap (authenticate, decrypt and check replay protection) AEAD-mode data
- * channel packets.
- *
- * Set buf->len to 0 and return false on decrypt error.
- *
- * On success, buf is set to point to plaintext, true is returned.
+/*
+ * Record why an AEAD packet was dropped, for the caller to log.
  */
-static bool
-openvpn_decrypt_aead(struct buffer *buf, struct buffer work, struct crypto_options *opt,
-                     const struct frame *frame, const uint8_t *ad_start)
+#define AEAD_ERROR_EXIT(flags, reason) \
+    do                                 \
+    {                                  \
+        d->error = reason;             \
+        d->error_flags = flags;        \
+        goto error_exit;               \
+    } while (false)
+
+#define AEAD_ERROR(reason) AEAD_ERROR_EXIT(D_CRYPT_ERRORS, reason)
+#define AEAD_DROP(reason)  AEAD_ERROR_EXIT(D_MULTI_DROPPED, reason)
+
+/*
+ * Everything openvpn_decrypt_aead_unwrap() does before the cipher runs:
+ * read the packet ID, pick the key and lay out the packet for the
+ * cipher.  The key is looked up in opt, or, if opt is NULL, taken from
+ * d->key.  Returns the key, or NULL with d->error set on failure.
+ */
+static struct key_ctx *
+openvpn_decrypt_aead_setup(struct buffer *buf, struct buffer *work, struct crypto_options *opt,
+                           const struct frame *frame, const uint8_t *ad_start,
+                           struct crypto_detached *d, struct cipher_aead_packet *p)
 {
-    static const char error_prefix[] = "AEAD Decrypt error";
-    struct packet_id_net pin = { 0 };
     struct gc_arena gc;
     gc_init(&gc);
 
-    struct key_ctx *ctx = &opt->key_ctx_bi.decrypt;
-    const bool use_epoch_data_format = opt->flags & CO_EPOCH_DATA_KEY_FORMAT;
+    struct key_ctx *ctx = opt ? &opt->key_ctx_bi.decrypt : &d->key;
+    const unsigned int flags = opt ? opt->flags : d->flags;
+    const bool use_epoch_data_format = flags & CO_EPOCH_DATA_KEY_FORMAT;
     if (!use_epoch_data_format && cipher_decrypt_verify_fail_exceeded(ctx))
     {
-        CRYPT_DROP("Decryption failed verification limit reached.");
+        AEAD_DROP("Decryption failed verification limit reached.");
     }
 
     const int tag_size = OPENVPN_AEAD_TAG_LENGTH;
 
 
-    ASSERT(opt);
     ASSERT(frame);
     ASSERT(buf->len > 0);
     ASSERT(ctx->cipher);
@@ -452,10 +632,10 @@ openvpn_decrypt_aead(struct buffer *buf, struct buffer work, struct crypto_optio
 
     ASSERT(ad_start >= buf->data && ad_start <= BPTR(buf));
 
-    ASSERT(buf_init(&work, frame->buf.headroom));
+    ASSERT(buf_init(work, frame->buf.headroom));
 
     /* IV and Packet ID required for this mode */
-    ASSERT(packet_id_initialized(&opt->packet_id));
+    ASSERT(!opt || packet_id_initialized(&opt->packet_id));
 
     /* Ensure that the packet size is long enough */
     int min_packet_len = packet_id_size(false) + tag_size + 1;
@@ -467,15 +647,17 @@ openvpn_decrypt_aead(struct buffer *buf, struct buffer work, struct crypto_optio
 
     if (buf->len < min_packet_len)
     {
-        CRYPT_ERROR("missing IV info, missing tag or no payload");
+        AEAD_ERROR("missing IV info, missing tag or no payload");
     }
 
-    uint16_t epoch = 0;
+    d->epoch = 0;
     /* Combine IV from explicit part from packet and implicit part from context */
     {
-        uint8_t iv[OPENVPN_MAX_IV_LENGTH] = { 0 };
+        uint8_t *iv = p->iv;
         const int iv_len = cipher_ctx_iv_length(ctx->cipher);
 
+        CLEAR(p->iv);
+
         /* Read packet id. For epoch data format also lookup the epoch key
          * to be able to use the implicit IV of the correct decryption key */
         if (use_epoch_data_format)
@@ -486,19 +668,26 @@ openvpn_decrypt_aead(struct buffer *buf, struct buffer work, struct crypto_optio
             /* copy the epoch-counter part into the IV */
             memcpy(iv, BPTR(buf), packet_iv_len);
 
-            epoch = packet_id_read_epoch(&pin, buf);
-            if (epoch == 0)
+            d->epoch = packet_id_read_epoch(&d->pin, buf);
+            if (d->epoch == 0)
+            {
+                AEAD_ERROR("error reading packet-id");
+            }
+            if (opt)
+            {
+                ctx = epoch_lookup_decrypt_key(opt, d->epoch);
+            }
+            else if (d->key.epoch != d->epoch)
             {
-                CRYPT_ERROR("error reading packet-id");
+                ctx = NULL;
             }
-            ctx = epoch_lookup_decrypt_key(opt, epoch);
             if (!ctx)
             {
-                CRYPT_ERROR("data packet with unknown epoch");
+                AEAD_ERROR("data packet with unknown epoch");
             }
             else if (cipher_decrypt_verify_fail_exceeded(ctx))
             {
-                CRYPT_DROP("Decryption failed verification limit reached");
+                AEAD_DROP("Decryption failed verification limit reached");
             }
         }
         else
@@ -506,9 +695,9 @@ openvpn_decrypt_aead(struct buffer *buf, struct buffer work, struct crypto_optio
             const size_t packet_iv_len = packet_id_size(false);
             /* Packet ID form is a 32 bit packet counter */
             memcpy(iv, BPTR(buf), packet_iv_len);
-            if (!packet_id_read(&pin, buf, false))
+            if (!packet_id_read(&d->pin, buf, false))
             {
-                CRYPT_ERROR("error reading packet-id");
+                AEAD_ERROR("error reading packet-id");
             }
         }
 
@@ -520,12 +709,6 @@ openvpn_decrypt_aead(struct buffer *buf, struct buffer work, struct crypto_optio
         }
 
         dmsg(D_PACKET_CONTENT, "DECRYPT IV: %s", format_hex(iv, iv_len, 0, &gc));
-
-        /* Load IV, ctx->cipher was already initialized with key & keylen */
-        if (!cipher_ctx_reset(ctx->cipher, iv))
-        {
-            CRYPT_ERROR("cipher init failed");
-        }
     }
 
     const int ad_size = BPTR(buf) - ad_start;
@@ -549,33 +732,109 @@ openvpn_decrypt_aead(struct buffer *buf, struct buffer work, struct crypto_optio
     dmsg(D_PACKET_CONTENT, "DECRYPT FROM: %s", format_hex(BPTR(buf), BLEN(buf), 0, &gc));
 
     /* Buffer overflow check (should never fail) */
-    if (!buf_safe(&work, buf->len + cipher_ctx_block_size(ctx->cipher)))
+    if (!buf_safe(work, buf->len + cipher_ctx_block_size(ctx->cipher)))
     {
-        CRYPT_ERROR("potential buffer overflow");
+        AEAD_ERROR("potential buffer overflow");
     }
 
     /* feed in tag and the authenticated data */
-    ASSERT(cipher_ctx_update_ad(ctx->cipher, ad_start, ad_size));
+    p->ad = ad_start;
+    p->ad_len = ad_size;
     dmsg(D_PACKET_CONTENT, "DECRYPT AD: %s", format_hex(ad_start, ad_size, 0, &gc));
 
-    /* Decrypt and authenticate packet */
-    int outlen;
-    if (!cipher_ctx_update(ctx->cipher, BPTR(&work), &outlen, BPTR(buf), data_len))
+    p->src = BPTR(buf);
+    p->src_len = data_len;
+    p->dst = BPTR(work);
+    p->tag = tag_ptr;
+
+    gc_free(&gc);
+    return ctx;
+
+error_exit:
+    crypto_clear_error();
+    gc_free(&gc);
+    return NULL;
+}
+
+/*
+ * Check the outcome of the cipher for a packet set up by
+ * openvpn_decrypt_aead_setup() with the key ctx.  Sets d->plaintext_len
+ * on success, d->error on failure.
+ */
+static bool
+openvpn_decrypt_aead_finish(struct buffer *work, struct key_ctx *ctx, struct crypto_detached *d,
+                            const struct cipher_aead_packet *p)
+{
+    if (!p->ok)
     {
-        CRYPT_ERROR("packet decryption failed");
+        ctx->failed_verifications++;
+        AEAD_DROP("packet tag authentication failed");
     }
+    ASSERT(buf_inc_len(work, p->dst_len));
 
-    ASSERT(buf_inc_len(&work, outlen));
-    if (!cipher_ctx_final_check_tag(ctx->cipher, BPTR(&work) + outlen, &outlen, tag_ptr, tag_size))
+    if (check_debug_level(D_PACKET_CONTENT))
     {
-        ctx->failed_verifications++;
-        CRYPT_DROP("packet tag authentication failed");
+        struct gc_arena gc = gc_new();
+        dmsg(D_PACKET_CONTENT, "DECRYPT TO: %s", format_hex(BPTR(work), BLEN(work), 80, &gc));
+        gc_free(&gc);
+    }
+
+    d->plaintext_len = p->dst_len;
+    return true;
+
+error_exit:
+    crypto_clear_error();
+    return false;
+}
+
+/*
+ * Authenticate and decrypt an AEAD-mode data channel packet into work,
+ * without touching the replay state.  The key is looked up in opt, or,
+ * if opt is NULL, taken from d->key.  Sets d->pin, d->epoch and
+ * d->plaintext_len on success, d->error on failure.
+ */
+static bool
+openvpn_decrypt_aead_unwrap(struct buffer *buf, struct buffer *work, struct crypto_options *opt,
+                            const struct frame *frame, const uint8_t *ad_start,
+                            struct crypto_detached *d)
+{
+    struct cipher_aead_packet p;
+    struct key_ctx *ctx = openvpn_decrypt_aead_setup(buf, work, opt, frame, ad_start, d, &p);
+
+    if (!ctx)
+    {
+        return false;
     }
-    ASSERT(buf_inc_len(&work, outlen));
+    cipher_ctx_aead_batch(ctx->cipher, &p, 1, OPENVPN_OP_DECRYPT);
+    return openvpn_decrypt_aead_finish(work, ctx, d, &p);
+}
+
+/**
+ * Unwrap (authenticate, decrypt and check replay protection) AEAD-mode data
+ * channel packets.
+ *
+ * Set buf->len to 0 and return false on decrypt error.
+ *
+ * On success, buf is set to point to plaintext, true is returned.
+ */
+static bool
+openvpn_decrypt_aead(struct buffer *buf, struct buffer work, struct crypto_options *opt,
+                     const struct frame *frame, const uint8_t *ad_start)
+{
+    static const char error_prefix[] = "AEAD Decrypt error";
+    struct crypto_detached d = { 0 };
+    struct gc_arena gc;
+    gc_init(&gc);
 
-    dmsg(D_PACKET_CONTENT, "DECRYPT TO: %s", format_hex(BPTR(&work), BLEN(&work), 80, &gc));
+    ASSERT(opt);
 
-    if (!crypto_check_replay(opt, &pin, epoch, error_prefix, &gc))
+    if (!openvpn_decrypt_aead_unwrap(buf, &work, opt, frame, ad_start, &d))
+    {
+        msg(d.error_flags, "%s: %s", error_prefix, d.error);
+        goto error_exit;
+    }
+
+    if (!crypto_check_replay(opt, &d.pin, d.epoch, error_prefix, &gc))
     {
         goto error_exit;
     }
@@ -584,7 +843,7 @@ openvpn_decrypt_aead(struct buffer *buf, struct buffer work, struct crypto_optio
     /* update number of plaintext blocks decrypted. Use the (x + (n-1))/n trick
      * to round up the result to the number of blocks used. */
     const int blocksize = AEAD_LIMIT_BLOCKSIZE;
-    opt->key_ctx_bi.decrypt.plaintext_blocks += (outlen + (blocksize - 1)) / blocksize;
+    opt->key_ctx_bi.decrypt.plaintext_blocks += (d.plaintext_len + (blocksize - 1)) / blocksize;
 
     *buf = work;
 
@@ -592,7 +851,169 @@ openvpn_decrypt_aead(struct buffer *buf, struct buffer work, struct crypto_optio
     return true;
 
 error_exit:
-    crypto_clear_error();
+    buf->len = 0;
+    gc_free(&gc);
+    return false;
+}
+
+bool
+openvpn_decrypt_prepare(struct crypto_options *opt, const struct buffer *buf,
+                        struct cipher_copy *cc, struct crypto_detached *d)
+{
+    /* packet dumps go through msg(), which needs the lock */
+    if (!opt || buf->len <= 0 || check_debug_level(D_PACKET_CONTENT))
+    {
+        return false;
+    }
+
+    struct key_ctx *ctx = &opt->key_ctx_bi.decrypt;
+    if (!ctx->cipher || !cipher_ctx_mode_aead(ctx->cipher))
+    {
+        return false;
+    }
+
+    if (opt->flags & CO_EPOCH_DATA_KEY_FORMAT)
+    {
+        /* peek at the epoch, the leading 16 bits of the packet ID */
+        if (BLEN(buf) < (int)sizeof(uint16_t))
+        {
+            return false;
+        }
+        const uint16_t epoch = (BPTR(buf)[0] << 8) | BPTR(buf)[1];
+        ctx = epoch_lookup_decrypt_key(opt, epoch);
+        if (!ctx)
+        {
+            return false;
+        }
+    }
+
+    CLEAR(*d);
+    d->key = *ctx;
+    d->key.cipher = cipher_copy_get(cc, ctx);
+    d->key.hmac = NULL;
+    d->key_src = ctx->cipher;
+    d->flags = opt->flags;
+
+    return d->key.cipher != NULL;
+}
+
+bool
+openvpn_decrypt_detached(struct buffer *buf, struct buffer work, struct crypto_detached *d,
+                         const struct frame *frame, const uint8_t *ad_start)
+{
+    if (!openvpn_decrypt_aead_unwrap(buf, &work, NULL, frame, ad_start, d))
+    {
+        buf->len = 0;
+        return false;
+    }
+
+    *buf = work;
+    return true;
+}
+
+/*
+ * Run the queued packets through the cipher of their detached key and
+ * finish them.
+ */
+static void
+openvpn_decrypt_detached_flush(struct crypto_batch_packet **queued,
+                               struct cipher_aead_packet *aead, int *n_queued)
+{
+    if (*n_queued)
+    {
+        cipher_ctx_aead_batch(queued[0]->d->key.cipher, aead, *n_queued, OPENVPN_OP_DECRYPT);
+        for (int i = 0; i < *n_queued; i++)
+        {
+            struct crypto_batch_packet *pkt = queued[i];
+            if (openvpn_decrypt_aead_finish(&pkt->work, &pkt->d->key, pkt->d, &aead[i]))
+            {
+                *pkt->buf = pkt->work;
+            }
+            else
+            {
+                pkt->buf->len = 0;
+            }
+        }
+        *n_queued = 0;
+    }
+}
+
+void
+openvpn_decrypt_detached_batch(struct crypto_batch_packet *pkts, int n)
+{
+    struct cipher_aead_packet aead[CRYPTO_BATCH_MAX];
+    struct crypto_batch_packet *queued[CRYPTO_BATCH_MAX];
+    int n_queued = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        struct crypto_batch_packet *pkt = &pkts[i];
+
+        if (pkt->buf->len <= 0)
+        {
+            continue;
+        }
+        if (n_queued
+            && (n_queued == CRYPTO_BATCH_MAX || pkt->d->key.cipher != queued[0]->d->key.cipher))
+        {
+            openvpn_decrypt_detached_flush(queued, aead, &n_queued);
+        }
+
+        if (openvpn_decrypt_aead_setup(pkt->buf, &pkt->work, NULL, pkt->frame, pkt->ad_start,
+                                       pkt->d, &aead[n_queued]))
+        {
+            queued[n_queued++] = pkt;
+        }
+        else
+        {
+            pkt->buf->len = 0;
+        }
+    }
+
+    openvpn_decrypt_detached_flush(queued, aead, &n_queued);
+}
+
+bool
+openvpn_decrypt_commit(struct crypto_options *opt, struct crypto_detached *d, struct buffer *buf)
+{
+    static const char error_prefix[] = "AEAD Decrypt error";
+    struct gc_arena gc = gc_new();
+
+    /* the key the packet was decrypted with, if it is still there */
+    struct key_ctx *ctx = &opt->key_ctx_bi.decrypt;
+    if (d->flags & CO_EPOCH_DATA_KEY_FORMAT)
+    {
+        ctx = epoch_lookup_decrypt_key(opt, d->key.epoch);
+    }
+    if (!ctx || ctx->cipher != d->key_src || ctx->epoch != d->key.epoch
+        || memcmp(ctx->implicit_iv, d->key.implicit_iv, sizeof(ctx->implicit_iv)) != 0)
+    {
+        dmsg(D_MULTI_DROPPED, "%s: key changed during decryption", error_prefix);
+        goto error_exit;
+    }
+
+    if (d->error)
+    {
+        if (d->key.failed_verifications > ctx->failed_verifications)
+        {
+            ctx->failed_verifications = d->key.failed_verifications;
+        }
+        msg(d->error_flags, "%s: %s", error_prefix, d->error);
+        goto error_exit;
+    }
+
+    if (!crypto_check_replay(opt, &d->pin, d->epoch, error_prefix, &gc))
+    {
+        goto error_exit;
+    }
+
+    const int blocksize = AEAD_LIMIT_BLOCKSIZE;
+    opt->key_ctx_bi.decrypt.plaintext_blocks += (d->plaintext_len + (blocksize - 1)) / blocksize;
+
+    gc_free(&gc);
+    return true;
+
+error_exit:
     buf->len = 0;
     gc_free(&gc);
     return false;
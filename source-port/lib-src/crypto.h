@@ -296,7 +296,8 @@ struct crypto_options
      *   both sending and receiving
      *   directions. */
 
-    /** last epoch_key used for generation of the current send data keys.
+    /** last epoch_key used for generation of send data keys: the one of
+     * the current send key, or of the last one in \c epoch_data_keys_send.
      * As invariant, the epoch of epoch_key_send is always kept >= the epoch of
      * epoch_key_recv */
     struct epoch_key epoch_key_send;
@@ -315,15 +316,23 @@ struct crypto_options
     /** Keeps the future epoch data keys for decryption. The current one
      * that is expected to be used is stored in key_ctx_bi.
      *
-     * for encryption keys this is not needed as we only need the current
-     * and move to another key by iteration and we never need to go back
-     * to an older key.
+     * for encryption keys we only need the current and move to another
+     * key by iteration and we never need to go back to an older key, see
+     * \c epoch_data_keys_send.
      */
     struct key_ctx *epoch_data_keys_future;
 
     /** number of keys stored in \c epoch_data_keys_future */
     uint16_t epoch_data_keys_future_count;
 
+    /** Ring of the send data keys of the epochs following the current
+     * send key, derived ahead of time by epoch_precompute_keys(), so that
+     * moving on to the next epoch does not derive keys on the data path.
+     * Has \c EPOCH_SEND_KEYS_AHEAD slots. */
+    struct key_ctx *epoch_data_keys_send;
+    uint16_t epoch_data_keys_send_head;  /**< slot of the next key */
+    uint16_t epoch_data_keys_send_count; /**< number of keys in the ring */
+
     /** The old key before the sender switched to a new epoch data key */
     struct key_ctx epoch_retiring_data_receive_key;
     struct packet_id_rec epoch_retiring_key_pid_recv;
@@ -380,11 +389,73 @@ struct crypto_options
      * 64-bit packet id that is split into a 16 bit epoch and 48 bit
      * epoch counter
      */
+#define CO_SEND_RESERVED               (1 << 9)
+    /**< Bit-flag indicating that this is a private copy made by
+     * \c openvpn_encrypt_reserve(), which already did the epoch
+     * key bookkeeping on the original.
+     */
 
     unsigned int flags; /**< Bit-flags determining behavior of
                          *   security operation functions. */
 };
 
+/**
+ * Private copy of the cipher of a shared \c key_ctx, for a thread that
+ * encrypts or decrypts without holding the lock protecting the key.
+ */
+struct cipher_copy
+{
+    cipher_ctx_t *cipher;     /**< The copy, or NULL. */
+    const cipher_ctx_t *src;  /**< The shared cipher it was copied from. */
+    uint8_t implicit_iv[OPENVPN_MAX_IV_LENGTH];
+    /**< Implicit IV of the key it was copied from.  It is unique per key,
+     *   so it tells a new key apart from an old one that reused the
+     *   memory of \c src. */
+    uint16_t epoch;           /**< Epoch of the key it was copied from. */
+    bool busy;                /**< A packet using the copy is in flight, so
+                               *   \c cipher_copy_get() must not replace it. */
+};
+
+/**
+ * State of an AEAD data channel packet that is decrypted without holding
+ * the lock protecting its \c crypto_options, see
+ * \c openvpn_decrypt_prepare().
+ */
+struct crypto_detached
+{
+    struct key_ctx key;         /**< Copy of the decrypt key, with a
+                                 *   private cipher. */
+    const cipher_ctx_t *key_src; /**< Cipher of the shared key. */
+    unsigned int flags;         /**< \c crypto_options flags. */
+
+    /* filled in by openvpn_decrypt_detached() */
+    struct packet_id_net pin;   /**< Packet ID, for the replay check. */
+    uint16_t epoch;             /**< Epoch of the packet, or 0. */
+    int plaintext_len;
+    const char *error;          /**< Why the packet was dropped, or NULL. */
+    unsigned int error_flags;   /**< \c msg() flags for \c error. */
+};
+
+/** Maximum number of packets handed to the cipher backend in one call. */
+#define CRYPTO_BATCH_MAX 32
+
+/**
+ * A data channel packet for \c openvpn_encrypt_batch() or
+ * \c openvpn_decrypt_detached_batch().
+ */
+struct crypto_batch_packet
+{
+    struct buffer *buf;          /**< The packet; on return the result,
+                                  *   or empty if it failed. */
+    struct buffer work;          /**< Working buffer for the packet. */
+    struct crypto_options *opt;  /**< Encryption: the security parameters. */
+    struct crypto_detached *d;   /**< Decryption: state set up by
+                                  *   \c openvpn_decrypt_prepare(). */
+    const struct frame *frame;   /**< Decryption: packet geometry. */
+    const uint8_t *ad_start;     /**< Decryption: start of the additional
+                                  *   data in \c buf. */
+};
+
 #define CRYPT_ERROR_EXIT(flags, format)          \
     do                                           \
     {                                            \
@@ -480,6 +551,59 @@ void free_key_ctx_bi(struct key_ctx_bi *ctx);
  */
 void openvpn_encrypt(struct buffer *buf, struct buffer work, struct crypto_options *opt);
 
+/**
+ * Encrypt \a n packets like \c openvpn_encrypt() does, one after the
+ * other.  Consecutive AEAD packets with the same send cipher go to the
+ * crypto library in one call, so the per packet cost of the cipher
+ * setup is paid once per batch.  Each packet has its own result and
+ * is accounted for separately in \c plaintext_blocks.
+ * @ingroup data_crypto
+ *
+ * @param pkts         - The packets, with \c buf, \c work and \c opt set.
+ * @param n            - Number of packets.
+ */
+void openvpn_encrypt_batch(struct crypto_batch_packet *pkts, int n);
+
+/**
+ * Reserve a packet ID for encrypting one AEAD packet outside of the
+ * thread owning \a opt.
+ * @ingroup data_crypto
+ *
+ * This does the send side bookkeeping \c openvpn_encrypt() would do on
+ * \a opt (epoch key iteration, packet ID, AEAD usage counter) and
+ * fills \a snap with a copy of \a opt that, passed to
+ * \c openvpn_encrypt(), produces the packet with the reserved ID.
+ * Before that, the caller replaces the send cipher of \a snap with a
+ * private copy of the one in \a opt, made with \c cipher_ctx_dup().
+ *
+ * @param opt          - The shared security parameter state.
+ * @param snap         - Returns the private copy.
+ * @param len          - Length of the plaintext to encrypt.
+ *
+ * @return false if the packet ID rolled over and the packet must be
+ *     dropped.
+ */
+bool openvpn_encrypt_reserve(struct crypto_options *opt, struct crypto_options *snap, int len);
+
+/**
+ * Return the private copy of the cipher of \a ctx kept in \a cc, making
+ * a new copy if there is none yet or the key changed.
+ *
+ * @return the copy, or NULL if the crypto library cannot copy the cipher
+ *     or the old copy is still busy.
+ */
+cipher_ctx_t *cipher_copy_get(struct cipher_copy *cc, const struct key_ctx *ctx);
+
+/**
+ * Return true if \a cc is a copy of the cipher \a ctx currently holds.
+ */
+bool cipher_copy_matches(const struct cipher_copy *cc, const struct key_ctx *ctx);
+
+/**
+ * Free the private cipher copy in \a cc.
+ */
+void cipher_copy_free(struct cipher_copy *cc);
+
 
 /**
  * HMAC verify and decrypt a data channel packet received from a remote
@@ -517,6 +641,68 @@ void openvpn_encrypt(struct buffer *buf, struct buffer work, struct crypto_optio
 bool openvpn_decrypt(struct buffer *buf, struct buffer work, struct crypto_options *opt,
                      const struct frame *frame, const uint8_t *ad_start);
 
+/**
+ * Prepare decrypting an AEAD data channel packet outside of the lock
+ * that protects \a opt.
+ * @ingroup data_crypto
+ *
+ * The packet is decrypted in three steps: this function, called with the
+ * lock held, picks the key by the epoch in the packet and fills \a d
+ * with a copy of it using the private cipher in \a cc.
+ * \c openvpn_decrypt_detached() then authenticates and decrypts the
+ * packet without the lock, and \c openvpn_decrypt_commit(), again with
+ * the lock held, does the replay check and accounting on \a opt.
+ *
+ * @param opt          - The security parameter state, as returned by
+ *                       \c tls_pre_decrypt().
+ * @param buf          - The packet, starting at the packet ID.
+ * @param cc           - Private cipher copy kept by the caller.
+ * @param d            - Returns the state of the packet.
+ *
+ * @return false if the packet cannot be decrypted this way (no AEAD
+ *     cipher, unknown epoch, packet dumps requested, or the crypto
+ *     library cannot copy the cipher); the caller falls back to
+ *     \c openvpn_decrypt() then.
+ */
+bool openvpn_decrypt_prepare(struct crypto_options *opt, const struct buffer *buf,
+                             struct cipher_copy *cc, struct crypto_detached *d);
+
+/**
+ * Authenticate and decrypt a packet prepared by
+ * \c openvpn_decrypt_prepare().  Does not log anything; errors are left
+ * in \a d for \c openvpn_decrypt_commit().
+ * @ingroup data_crypto
+ *
+ * @return false with \a buf set to empty if the packet must be dropped.
+ */
+bool openvpn_decrypt_detached(struct buffer *buf, struct buffer work, struct crypto_detached *d,
+                              const struct frame *frame, const uint8_t *ad_start);
+
+/**
+ * Authenticate and decrypt \a n packets prepared by
+ * \c openvpn_decrypt_prepare(), like \c openvpn_decrypt_detached() does
+ * for each of them.  Consecutive packets with the same private cipher go
+ * to the crypto library in one call.  Each packet still has to be
+ * passed to \c openvpn_decrypt_commit().
+ * @ingroup data_crypto
+ *
+ * @param pkts         - The packets, with \c buf, \c work, \c d,
+ *                       \c frame and \c ad_start set.
+ * @param n            - Number of packets.
+ */
+void openvpn_decrypt_detached_batch(struct crypto_batch_packet *pkts, int n);
+
+/**
+ * Finish a packet decrypted by \c openvpn_decrypt_detached(): log its
+ * error, or check it for replay and account for it.  Packets decrypted
+ * with a key that changed in the meantime are dropped.
+ * @ingroup data_crypto
+ *
+ * @return false with \a buf set to empty if the packet must be dropped.
+ */
+bool openvpn_decrypt_commit(struct crypto_options *opt, struct crypto_detached *d,
+                            struct buffer *buf);
+
 /** @} name Functions for performing security operations on data channel packets */
 
 /**
@@ -330,6 +330,18 @@ cipher_ctx_t *cipher_ctx_new(void);
  */
 void cipher_ctx_free(cipher_ctx_t *ctx);
 
+/**
+ * Allocate a copy of an initialised cipher context, including its key
+ * schedule, so that the copy can be used independently of the original
+ * (e.g. from another thread).
+ *
+ * @param ctx           Cipher context to copy.
+ *
+ * @return              the new cipher context, or \c NULL if the crypto
+ *                      library cannot copy it.
+ */
+cipher_ctx_t *cipher_ctx_dup(const cipher_ctx_t *ctx);
+
 /**
  * Initialise a cipher context, based on the given key and key type.
  *
@@ -478,6 +490,46 @@ int cipher_ctx_final(cipher_ctx_t *ctx, uint8_t *dst, int *dst_len);
 int cipher_ctx_final_check_tag(cipher_ctx_t *ctx, uint8_t *dst, int *dst_len, uint8_t *tag,
                                size_t tag_len);
 
+/**
+ * One packet for \c cipher_ctx_aead_batch().
+ */
+struct cipher_aead_packet
+{
+    uint8_t iv[OPENVPN_MAX_IV_LENGTH]; /**< Complete IV of the packet. */
+    const uint8_t *ad;                 /**< Additional authenticated data. */
+    int ad_len;
+    uint8_t *src;                      /**< Plaintext or ciphertext. */
+    int src_len;
+    uint8_t *dst;                      /**< Output, with room for \c src_len
+                                        *   bytes plus one block. */
+    uint8_t *tag;                      /**< \c OPENVPN_AEAD_TAG_LENGTH bytes,
+                                        *   written when encrypting, checked
+                                        *   when decrypting. */
+    int dst_len;                       /**< Set to the length of the output. */
+    bool ok;                           /**< Set to false if the packet failed,
+                                        *   e.g. because its tag did not
+                                        *   match. */
+};
+
+/**
+ * Encrypt or decrypt several packets with the same AEAD cipher context,
+ * back to back.  For each packet this does what \c cipher_ctx_reset(),
+ * \c cipher_ctx_update_ad(), \c cipher_ctx_update() and
+ * \c cipher_ctx_final() followed by \c cipher_ctx_get_tag() or
+ * \c cipher_ctx_final_check_tag() would do, and reports the result in
+ * the packet's \c ok and \c dst_len.  A failed packet does not affect
+ * the others.
+ *
+ * @param ctx           AEAD cipher's context, initialised for \a enc.
+ * @param pkts          The packets.
+ * @param n             Number of packets.
+ * @param enc           \c OPENVPN_OP_ENCRYPT or \c OPENVPN_OP_DECRYPT, as
+ *                      \a ctx was initialised.
+ *
+ * @return              The number of packets that succeeded.
+ */
+int cipher_ctx_aead_batch(cipher_ctx_t *ctx, struct cipher_aead_packet *pkts, int n, int enc);
+
 
 /*
  *
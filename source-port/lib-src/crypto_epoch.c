@@ -164,12 +164,8 @@ epoch_data_key_derive(struct key_parameters *key, const struct epoch_key *epoch_
 }
 
 static void
-epoch_init_send_key_ctx(struct crypto_options *co)
+epoch_init_send_key(struct key_ctx *ctx, struct crypto_options *co)
 {
-    /* Ensure that we are NEVER regenerating the same key that has already
-     * been generated. Since we also reset the packet ID counter this would be
-     * catastrophic as we would do IV reuse which breaks ciphers like AES-GCM */
-    ASSERT(co->key_ctx_bi.encrypt.epoch != co->epoch_key_send.epoch);
     char name[32] = { 0 };
     snprintf(name, sizeof(name), "Epoch Data key %" PRIu16, co->epoch_key_send.epoch);
 
@@ -177,8 +173,7 @@ epoch_init_send_key_ctx(struct crypto_options *co)
 
     epoch_data_key_derive(&send_key, &co->epoch_key_send, &co->epoch_key_type);
 
-    init_key_bi_ctx_send(&co->key_ctx_bi.encrypt, &send_key, &co->epoch_key_type, name);
-    reset_packet_id_send(&co->packet_id.send);
+    init_key_bi_ctx_send(ctx, &send_key, &co->epoch_key_type, name);
     CLEAR(send_key);
 }
 
@@ -197,75 +192,151 @@ epoch_init_recv_key(struct key_ctx *ctx, struct crypto_options *co)
     CLEAR(recv_key);
 }
 
-void
-epoch_generate_future_receive_keys(struct crypto_options *co)
+/*
+ * Drop the future receive keys that are older than the current decryption
+ * key and move the others to the front of epoch_data_keys_future.  The
+ * slots at the end are left empty (epoch 0) for
+ * epoch_fill_future_receive_keys().
+ */
+static void
+epoch_shift_future_receive_keys(struct crypto_options *co)
 {
-    /* We want the future receive keys to start just after the epoch of
-     * the currently used decryption key. */
-    ASSERT(co->key_ctx_bi.initialized);
     uint16_t current_decrypt_epoch = co->key_ctx_bi.decrypt.epoch;
+    uint16_t n = 0;
 
-    /* Either we have not generated any future keys yet (first initialisation)
-     * or the last index is the same as our current epoch key
-     * (last generated receive epoch key should match the epoch key) */
-    struct key_ctx *highest_future_key =
-        &co->epoch_data_keys_future[co->epoch_data_keys_future_count - 1];
-
-    ASSERT(co->epoch_key_recv.epoch == 1 || highest_future_key->epoch == co->epoch_key_recv.epoch);
-
-    /* free the keys that are not used anymore */
     for (uint16_t i = 0; i < co->epoch_data_keys_future_count; i++)
     {
+        struct key_ctx *key = &co->epoch_data_keys_future[i];
+
         /* Keys in future keys are always epoch > 1 if initialised */
-        if (co->epoch_data_keys_future[i].epoch > 0
-            && co->epoch_data_keys_future[i].epoch < current_decrypt_epoch)
+        if (key->epoch == 0)
+        {
+            continue;
+        }
+        if (key->epoch < current_decrypt_epoch)
         {
             /* Key is old, free it */
-            free_key_ctx(&co->epoch_data_keys_future[i]);
+            free_key_ctx(key);
+            continue;
         }
-    }
 
-    /* Calculate the number of keys that need to be generated,
-     * if no keys have been generated assume only the first key is defined */
-    uint16_t current_highest_key = highest_future_key->epoch ? highest_future_key->epoch : 1;
-    uint16_t desired_highest_key = current_decrypt_epoch + co->epoch_data_keys_future_count;
-    uint16_t num_keys_generate = desired_highest_key - current_highest_key;
-
-
-    /* Move the old keys out of the way so the order of keys stays strictly
-     * monotonic and consecutive. */
-    /* first check that the destination we are going to overwrite is freed */
-    for (uint16_t i = 0; i < num_keys_generate; i++)
-    {
-        ASSERT(co->epoch_data_keys_future[i].epoch == 0);
+        /* keep the keys strictly monotonic and consecutive */
+        ASSERT(n == 0 || co->epoch_data_keys_future[n - 1].epoch + 1 == key->epoch);
+        if (i != n)
+        {
+            co->epoch_data_keys_future[n] = *key;
+            /* moved, so zero instead of free_key_ctx */
+            memset(key, 0, sizeof(struct key_ctx));
+        }
+        n++;
     }
-    memmove(co->epoch_data_keys_future, co->epoch_data_keys_future + num_keys_generate,
-            (co->epoch_data_keys_future_count - num_keys_generate) * sizeof(struct key_ctx));
+}
 
-    /* Clear and regenerate the array elements at the end */
-    for (uint16_t i = co->epoch_data_keys_future_count - num_keys_generate;
-         i < co->epoch_data_keys_future_count; i++)
+/*
+ * Derive the receive keys for the empty slots at the end of
+ * epoch_data_keys_future, continuing from epoch_key_recv.
+ */
+static void
+epoch_fill_future_receive_keys(struct crypto_options *co)
+{
+    for (uint16_t i = 0; i < co->epoch_data_keys_future_count; i++)
     {
-        CLEAR(co->epoch_data_keys_future[i]);
+        if (co->epoch_data_keys_future[i].epoch > 0)
+        {
+            continue;
+        }
         epoch_key_iterate(&co->epoch_key_recv);
-
         epoch_init_recv_key(&co->epoch_data_keys_future[i], co);
     }
+}
+
+void
+epoch_generate_future_receive_keys(struct crypto_options *co)
+{
+    /* We want the future receive keys to start just after the epoch of
+     * the currently used decryption key. */
+    ASSERT(co->key_ctx_bi.initialized);
+
+    epoch_shift_future_receive_keys(co);
+    epoch_fill_future_receive_keys(co);
 
     /* Assert that all keys are initialised */
     for (uint16_t i = 0; i < co->epoch_data_keys_future_count; i++)
     {
         ASSERT(co->epoch_data_keys_future[i].epoch > 0);
     }
+    ASSERT(co->epoch_data_keys_future[0].epoch == co->key_ctx_bi.decrypt.epoch + 1);
+}
+
+/*
+ * Make the key of epoch the send key, taking it from the keys derived
+ * ahead by epoch_precompute_keys() if it is there, and derive it otherwise.
+ */
+static void
+epoch_switch_send_key(struct crypto_options *co, uint16_t epoch)
+{
+    /* Ensure that we are NEVER regenerating the same key that has already
+     * been used. Since we also reset the packet ID counter this would be
+     * catastrophic as we would do IV reuse which breaks ciphers like AES-GCM */
+    ASSERT(epoch > co->key_ctx_bi.encrypt.epoch);
+    free_key_ctx(&co->key_ctx_bi.encrypt);
+
+    bool found = false;
+    while (co->epoch_data_keys_send_count > 0 && !found)
+    {
+        struct key_ctx *key = &co->epoch_data_keys_send[co->epoch_data_keys_send_head];
+        co->epoch_data_keys_send_head = (co->epoch_data_keys_send_head + 1) % EPOCH_SEND_KEYS_AHEAD;
+        co->epoch_data_keys_send_count--;
+
+        if (key->epoch == epoch)
+        {
+            co->key_ctx_bi.encrypt = *key;
+            memset(key, 0, sizeof(struct key_ctx));
+            found = true;
+        }
+        else
+        {
+            ASSERT(key->epoch < epoch);
+            free_key_ctx(key);
+        }
+    }
+
+    if (!found)
+    {
+        /* epoch_key_send is the one of the highest key derived so far,
+         * which is older than epoch now */
+        while (co->epoch_key_send.epoch < epoch)
+        {
+            epoch_key_iterate(&co->epoch_key_send);
+        }
+        epoch_init_send_key(&co->key_ctx_bi.encrypt, co);
+    }
+    reset_packet_id_send(&co->packet_id.send);
 }
 
 void
 epoch_iterate_send_key(struct crypto_options *co)
 {
-    ASSERT(co->epoch_key_send.epoch < UINT16_MAX);
-    epoch_key_iterate(&co->epoch_key_send);
-    free_key_ctx(&co->key_ctx_bi.encrypt);
-    epoch_init_send_key_ctx(co);
+    ASSERT(co->key_ctx_bi.encrypt.epoch < UINT16_MAX);
+    epoch_switch_send_key(co, co->key_ctx_bi.encrypt.epoch + 1);
+}
+
+void
+epoch_precompute_keys(struct crypto_options *co)
+{
+    ASSERT(co->key_ctx_bi.initialized);
+
+    epoch_fill_future_receive_keys(co);
+
+    while (co->epoch_data_keys_send_count < EPOCH_SEND_KEYS_AHEAD
+           && co->epoch_key_send.epoch < UINT16_MAX)
+    {
+        const int i = (co->epoch_data_keys_send_head + co->epoch_data_keys_send_count)
+                      % EPOCH_SEND_KEYS_AHEAD;
+        epoch_key_iterate(&co->epoch_key_send);
+        epoch_init_send_key(&co->epoch_data_keys_send[i], co);
+        co->epoch_data_keys_send_count++;
+    }
 }
 
 void
@@ -292,18 +363,12 @@ epoch_replace_update_recv_key(struct crypto_options *co, uint16_t new_epoch)
      * yes we will replace the send key as well */
     if (co->key_ctx_bi.encrypt.epoch < new_epoch)
     {
-        free_key_ctx(&co->key_ctx_bi.encrypt);
-
-        /* Update the epoch_key for send to match the current key being used.
-         * This is a bit of extra work but since we are a maximum of 16
-         * keys behind, a maximum 16 HMAC invocations are a small price to
-         * pay for not keeping all the old epoch keys around in future_keys
-         * array */
-        while (co->epoch_key_send.epoch < new_epoch)
-        {
-            epoch_key_iterate(&co->epoch_key_send);
-        }
-        epoch_init_send_key_ctx(co);
+        /* If the keys derived ahead do not reach new_epoch, this updates
+         * the epoch_key for send to match.  This is a bit of extra work but
+         * since we are a maximum of 16 keys behind, a maximum 16 HMAC
+         * invocations are a small price to pay for not keeping all the old
+         * epoch keys around in future_keys array */
+        epoch_switch_send_key(co, new_epoch);
     }
 
     /* Replace receive key */
@@ -317,8 +382,9 @@ epoch_replace_update_recv_key(struct crypto_options *co, uint16_t new_epoch)
      * and do not want to free the pointers in the old place */
     memset(new_ctx, 0, sizeof(struct key_ctx));
 
-    /* Generate new future keys */
-    epoch_generate_future_receive_keys(co);
+    /* Only make room for the new future key here; deriving it is left to
+     * epoch_precompute_keys(), off the data path */
+    epoch_shift_future_receive_keys(co);
 }
 
 void
@@ -330,8 +396,14 @@ free_epoch_key_ctx(struct crypto_options *co)
     }
 
     free(co->epoch_data_keys_future);
+    for (uint16_t i = 0; i < co->epoch_data_keys_send_count; i++)
+    {
+        free_key_ctx(&co->epoch_data_keys_send[(co->epoch_data_keys_send_head + i)
+                                               % EPOCH_SEND_KEYS_AHEAD]);
+    }
+    free(co->epoch_data_keys_send);
     free_key_ctx(&co->epoch_retiring_data_receive_key);
-    free(co->epoch_retiring_key_pid_recv.seq_list);
+    free(co->epoch_retiring_key_pid_recv.window);
     CLEAR(co->epoch_key_recv);
     CLEAR(co->epoch_key_send);
 }
@@ -348,13 +420,18 @@ epoch_init_key_ctx(struct crypto_options *co, const struct key_type *key_type,
     co->epoch_key_type = *key_type;
     co->aead_usage_limit = cipher_get_aead_limits(key_type->cipher);
 
-    epoch_init_send_key_ctx(co);
+    epoch_init_send_key(&co->key_ctx_bi.encrypt, co);
+    reset_packet_id_send(&co->packet_id.send);
     epoch_init_recv_key(&co->key_ctx_bi.decrypt, co);
     co->key_ctx_bi.initialized = true;
 
     co->epoch_data_keys_future_count = future_key_count;
     ALLOC_ARRAY_CLEAR(co->epoch_data_keys_future, struct key_ctx, co->epoch_data_keys_future_count);
     epoch_generate_future_receive_keys(co);
+
+    ALLOC_ARRAY_CLEAR(co->epoch_data_keys_send, struct key_ctx, EPOCH_SEND_KEYS_AHEAD);
+    co->epoch_data_keys_send_head = 0;
+    co->epoch_data_keys_send_count = 0;
 }
 
 struct key_ctx *
@@ -384,6 +461,12 @@ epoch_lookup_decrypt_key(struct crypto_options *opt, uint16_t epoch)
         {
             return NULL;
         }
+        /* The last keys may not have been derived yet, after the
+         * receive key moved on (epoch_replace_update_recv_key) */
+        else if (opt->epoch_data_keys_future[index].epoch != epoch)
+        {
+            return NULL;
+        }
         else
         {
             return &opt->epoch_data_keys_future[index];
@@ -399,7 +482,7 @@ epoch_lookup_decrypt_key(struct crypto_options *opt, uint16_t epoch)
 void
 epoch_check_send_iterate(struct crypto_options *opt)
 {
-    if (opt->epoch_key_send.epoch == UINT16_MAX)
+    if (opt->key_ctx_bi.encrypt.epoch == UINT16_MAX)
     {
         /* limit of epoch keys reached, cannot move to a newer key anymore */
         return;
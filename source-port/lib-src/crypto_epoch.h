@@ -25,6 +25,9 @@
 #ifndef CRYPTO_EPOCH_H
 #define CRYPTO_EPOCH_H
 
+/** The number of send data keys derived ahead of the current one */
+#define EPOCH_SEND_KEYS_AHEAD 2
+
 /**
  * Implementation of the RFC5869 HKDF-Expand function with the following
  * restrictions
@@ -102,6 +105,17 @@ void epoch_replace_update_recv_key(struct crypto_options *co, uint16_t new_epoch
  * use the next epoch */
 void epoch_iterate_send_key(struct crypto_options *co);
 
+/**
+ * Derives the data keys that will be needed after the current epoch ahead
+ * of time: the future receive keys missing since the receive key last
+ * moved on, and up to \c EPOCH_SEND_KEYS_AHEAD send keys.  Switching to
+ * one of these keys is then a copy of the key context.
+ *
+ * Meant to be called from timer processing, so that the key derivation
+ * does not happen in the middle of encrypting or decrypting a packet.
+ */
+void epoch_precompute_keys(struct crypto_options *co);
+
 /**
  * Frees the extra data structures used by epoch keys in \c crypto_options
  */
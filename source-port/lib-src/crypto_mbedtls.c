@@ -566,6 +566,13 @@ cipher_ctx_free(mbedtls_cipher_context_t *ctx)
     free(ctx);
 }
 
+mbedtls_cipher_context_t *
+cipher_ctx_dup(const mbedtls_cipher_context_t *ctx)
+{
+    /* mbed TLS has no API to copy a cipher context */
+    return NULL;
+}
+
 void
 cipher_ctx_init(mbedtls_cipher_context_t *ctx, const uint8_t *key, const char *ciphername,
                 crypto_operation_t enc)
@@ -760,6 +767,37 @@ cipher_ctx_final_check_tag(mbedtls_cipher_context_t *ctx, uint8_t *dst, int *dst
     return 1;
 }
 
+int
+cipher_ctx_aead_batch(mbedtls_cipher_context_t *ctx, struct cipher_aead_packet *pkts, int n,
+                      int enc)
+{
+    int n_ok = 0;
+
+    /* mbed TLS has no multi-buffer interface, run the packets in turn */
+    for (int i = 0; i < n; i++)
+    {
+        struct cipher_aead_packet *p = &pkts[i];
+        int len = 0, final_len = 0;
+
+        p->ok = cipher_ctx_reset(ctx, p->iv) && cipher_ctx_update_ad(ctx, p->ad, p->ad_len)
+                && cipher_ctx_update(ctx, p->dst, &len, p->src, p->src_len);
+        if (p->ok && enc == OPENVPN_OP_ENCRYPT)
+        {
+            p->ok = cipher_ctx_final(ctx, p->dst + len, &final_len)
+                    && cipher_ctx_get_tag(ctx, p->tag, OPENVPN_AEAD_TAG_LENGTH);
+        }
+        else if (p->ok)
+        {
+            p->ok = cipher_ctx_final_check_tag(ctx, p->dst + len, &final_len, p->tag,
+                                               OPENVPN_AEAD_TAG_LENGTH);
+        }
+        p->dst_len = p->ok ? len + final_len : 0;
+        n_ok += p->ok;
+    }
+
+    return n_ok;
+}
+
 
 /*
  *
@@ -226,6 +226,40 @@ crypto_clear_error(void)
     ERR_clear_error();
 }
 
+void
+crypto_print_openssl_error(const unsigned int flags, unsigned long err, const char *file,
+                           int line, const char *func, const char *data)
+{
+    /* Be more clear about frequently occurring "no shared cipher" error */
+    if (ERR_GET_REASON(err) == SSL_R_NO_SHARED_CIPHER)
+    {
+        msg(D_CRYPT_ERRORS, "TLS error: The server has no TLS ciphersuites "
+                            "in common with the client. Your --tls-cipher setting might be "
+                            "too restrictive.");
+    }
+    else if (ERR_GET_REASON(err) == SSL_R_UNSUPPORTED_PROTOCOL)
+    {
+        msg(D_CRYPT_ERRORS,
+            "TLS error: Unsupported protocol. This typically "
+            "indicates that client and server have no common TLS version enabled. "
+            "This can be caused by mismatched tls-version-min and tls-version-max "
+            "options on client and server. "
+            "If your OpenVPN client is between v2.3.6 and v2.3.2 try adding "
+            "tls-version-min 1.0 to the client configuration to use TLS 1.0+ "
+            "instead of TLS 1.0 only");
+    }
+
+    /* print file and line if verb >=8 */
+    if (!check_debug_level(D_TLS_DEBUG_MED))
+    {
+        msg(flags, "OpenSSL: %s:%s", ERR_error_string(err, NULL), data);
+    }
+    else
+    {
+        msg(flags, "OpenSSL: %s:%s:%s:%d:%s", ERR_error_string(err, NULL), data, file, line, func);
+    }
+}
+
 void
 crypto_print_openssl_errors(const unsigned int flags)
 {
@@ -240,35 +274,7 @@ crypto_print_openssl_errors(const unsigned int flags)
             data = "";
         }
 
-        /* Be more clear about frequently occurring "no shared cipher" error */
-        if (ERR_GET_REASON(err) == SSL_R_NO_SHARED_CIPHER)
-        {
-            msg(D_CRYPT_ERRORS, "TLS error: The server has no TLS ciphersuites "
-                                "in common with the client. Your --tls-cipher setting might be "
-                                "too restrictive.");
-        }
-        else if (ERR_GET_REASON(err) == SSL_R_UNSUPPORTED_PROTOCOL)
-        {
-            msg(D_CRYPT_ERRORS,
-                "TLS error: Unsupported protocol. This typically "
-                "indicates that client and server have no common TLS version enabled. "
-                "This can be caused by mismatched tls-version-min and tls-version-max "
-                "options on client and server. "
-                "If your OpenVPN client is between v2.3.6 and v2.3.2 try adding "
-                "tls-version-min 1.0 to the client configuration to use TLS 1.0+ "
-                "instead of TLS 1.0 only");
-        }
-
-        /* print file and line if verb >=8 */
-        if (!check_debug_level(D_TLS_DEBUG_MED))
-        {
-            msg(flags, "OpenSSL: %s:%s", ERR_error_string(err, NULL), data);
-        }
-        else
-        {
-            msg(flags, "OpenSSL: %s:%s:%s:%d:%s", ERR_error_string(err, NULL), data, file, line,
-                func);
-        }
+        crypto_print_openssl_error(flags, err, file, line, func, data);
     }
 }
 
@@ -853,6 +859,20 @@ cipher_ctx_free(EVP_CIPHER_CTX *ctx)
     EVP_CIPHER_CTX_free(ctx);
 }
 
+EVP_CIPHER_CTX *
+cipher_ctx_dup(const EVP_CIPHER_CTX *ctx)
+{
+    EVP_CIPHER_CTX *dup = EVP_CIPHER_CTX_new();
+    check_malloc_return(dup);
+    if (!EVP_CIPHER_CTX_copy(dup, ctx))
+    {
+        crypto_clear_error();
+        EVP_CIPHER_CTX_free(dup);
+        return NULL;
+    }
+    return dup;
+}
+
 void
 cipher_ctx_init(EVP_CIPHER_CTX *ctx, const uint8_t *key, const char *ciphername,
                 crypto_operation_t enc)
@@ -999,6 +1019,39 @@ cipher_ctx_final_check_tag(EVP_CIPHER_CTX *ctx, uint8_t *dst, int *dst_len, uint
     return cipher_ctx_final(ctx, dst, dst_len);
 }
 
+int
+cipher_ctx_aead_batch(EVP_CIPHER_CTX *ctx, struct cipher_aead_packet *pkts, int n, int enc)
+{
+    int n_ok = 0;
+
+    /*
+     * EVP only pipelines the stitched TLS record ciphers of some engines,
+     * with the AAD handed over through EVP_CTRL_AEAD_TLS1_AAD, so there is
+     * nothing to gain for GCM or ChaCha20-Poly1305 there.  Run the packets
+     * in turn, straight on the EVP context.
+     */
+    for (int i = 0; i < n; i++)
+    {
+        struct cipher_aead_packet *p = &pkts[i];
+        int len = 0, final_len = 0, ad_len = 0;
+
+        p->ok = EVP_CipherInit_ex(ctx, NULL, NULL, NULL, p->iv, -1)
+                && (enc == OPENVPN_OP_ENCRYPT
+                    || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_SET_TAG, OPENVPN_AEAD_TAG_LENGTH,
+                                           p->tag))
+                && EVP_CipherUpdate(ctx, NULL, &ad_len, p->ad, p->ad_len)
+                && EVP_CipherUpdate(ctx, p->dst, &len, p->src, p->src_len)
+                && EVP_CipherFinal(ctx, p->dst + len, &final_len)
+                && (enc != OPENVPN_OP_ENCRYPT
+                    || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_AEAD_GET_TAG, OPENVPN_AEAD_TAG_LENGTH,
+                                           p->tag));
+        p->dst_len = p->ok ? len + final_len : 0;
+        n_ok += p->ok;
+    }
+
+    return n_ok;
+}
+
 
 /*
  *
@@ -105,6 +105,20 @@ typedef int crypto_operation_t;
  */
 void crypto_print_openssl_errors(const unsigned int flags);
 
+/**
+ * Print one OpenSSL error the way crypto_print_openssl_errors() does,
+ * for errors that were taken off the error queue of another thread.
+ *
+ * @param flags         Flags to indicate error type and priority.
+ * @param err           The error code.
+ * @param file          Source file, line and function that raised it.
+ * @param line
+ * @param func
+ * @param data          Additional error data, "" if there is none.
+ */
+void crypto_print_openssl_error(const unsigned int flags, unsigned long err, const char *file,
+                                int line, const char *func, const char *data);
+
 /**
  * Retrieve any OpenSSL errors, then print the supplied error message.
  *
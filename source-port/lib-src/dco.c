@@ -329,6 +329,12 @@ dco_check_startup_option(int msglevel, const struct options *o)
         return false;
     }
 
+    if (o->server_processes > 1)
+    {
+        msg(msglevel, "Note: --server-processes used, disabling data channel offload");
+        return false;
+    }
+
     if (o->connection_list)
     {
         const struct connection_list *l = o->connection_list;
@@ -39,6 +39,7 @@
 #include "integer.h"
 #include "ps.h"
 #include "mstats.h"
+#include "msg_async.h"
 
 
 #if SYSLOG_CAPABILITY
@@ -234,12 +235,79 @@ openvpn_strerror(int err, bool crt_error, struct gc_arena *gc)
     return strerror(err);
 }
 
+#if ENABLE_ASYNC_LOG
+/*
+ * Queue a line for the writer thread of --log-async, formatted in m2
+ * as x_msg_va() would write it.
+ */
+static void
+x_msg_async(struct msg_async_ring *ring, const unsigned int flags, const int level,
+            const char *prefix, const char *prefix_sep, const char *m1, char *m2,
+            struct gc_arena *gc)
+{
+    const bool to_syslog = use_syslog && !std_redir && SYSLOG_CAPABILITY;
+    FILE *fp = to_syslog ? NULL : msg_fp(flags);
+    const unsigned int lost = msg_async_lost(ring);
+    int len;
+
+    if (lost)
+    {
+        char note[128];
+
+        if (to_syslog || suppress_timestamps)
+        {
+            len = snprintf(note, sizeof(note), "NOTE: %u message(s) dropped by --log-async%s",
+                           lost, to_syslog ? "" : "\n");
+        }
+        else
+        {
+            len = snprintf(note, sizeof(note), "%s NOTE: %u message(s) dropped by --log-async\n",
+                           time_string(0, 0, false, gc), lost);
+        }
+        msg_async_put(ring, fp, level, note, min_int(len, (int)sizeof(note) - 1));
+    }
+
+    if (to_syslog)
+    {
+        len = snprintf(m2, ERR_BUF_SIZE, "%s%s%s", prefix, prefix_sep, m1);
+    }
+    else if (machine_readable_output)
+    {
+        struct timeval tv;
+        gettimeofday(&tv, NULL);
+
+        len = snprintf(m2, ERR_BUF_SIZE, "%" PRIi64 ".%06ld %x %s%s%s%s", (int64_t)tv.tv_sec,
+                       (long)tv.tv_usec, flags, prefix, prefix_sep, m1, "\n");
+    }
+    else if ((flags & M_NOPREFIX) || suppress_timestamps)
+    {
+        len = snprintf(m2, ERR_BUF_SIZE, "%s%s%s%s", prefix, prefix_sep, m1,
+                       (flags & M_NOLF) ? "" : "\n");
+    }
+    else
+    {
+        const bool show_usec = check_debug_level(DEBUG_LEVEL_USEC_TIME);
+
+        len = snprintf(m2, ERR_BUF_SIZE, "%s %s%s%s%s", time_string(0, 0, show_usec, gc), prefix,
+                       prefix_sep, m1, (flags & M_NOLF) ? "" : "\n");
+    }
+    if (!to_syslog)
+    {
+        ++x_msg_line_num;
+    }
+    msg_async_put(ring, fp, level, m2, min_int(len, ERR_BUF_SIZE - 1));
+}
+#endif /* ENABLE_ASYNC_LOG */
+
 void
 x_msg_va(const unsigned int flags, const char *format, va_list arglist)
 {
     struct gc_arena gc;
-#if SYSLOG_CAPABILITY
-    int level;
+#if SYSLOG_CAPABILITY || ENABLE_ASYNC_LOG
+    int level = 0;
+#endif
+#if ENABLE_ASYNC_LOG
+    struct msg_async_ring *ring = NULL;
 #endif
     char *m1;
     char *m2;
@@ -270,8 +338,22 @@ x_msg_va(const unsigned int flags, const char *format, va_list arglist)
 
     gc_init(&gc);
 
-    m1 = (char *)gc_malloc(ERR_BUF_SIZE, false, &gc);
-    m2 = (char *)gc_malloc(ERR_BUF_SIZE, false, &gc);
+#if ENABLE_ASYNC_LOG
+    /* what is queued goes out before the exit */
+    if (flags & M_FATAL)
+    {
+        msg_async_stop();
+    }
+    if (!forked)
+    {
+        ring = msg_async_acquire(&m1, &m2);
+    }
+    if (!ring)
+#endif
+    {
+        m1 = (char *)gc_malloc(ERR_BUF_SIZE, false, &gc);
+        m2 = (char *)gc_malloc(ERR_BUF_SIZE, false, &gc);
+    }
 
     vsnprintf(m1, ERR_BUF_SIZE, format, arglist);
     m1[ERR_BUF_SIZE - 1] = 0; /* windows vsnprintf needs this */
@@ -331,6 +413,13 @@ x_msg_va(const unsigned int flags, const char *format, va_list arglist)
 
     if (!(flags & M_MSG_VIRT_OUT))
     {
+#if ENABLE_ASYNC_LOG
+        if (ring)
+        {
+            x_msg_async(ring, flags, level, prefix, prefix_sep, m1, m2, &gc);
+        }
+        else
+#endif
         if (use_syslog && !std_redir && !forked)
         {
 #if SYSLOG_CAPABILITY
@@ -364,6 +453,13 @@ x_msg_va(const unsigned int flags, const char *format, va_list arglist)
         }
     }
 
+#if ENABLE_ASYNC_LOG
+    if (ring)
+    {
+        msg_async_release(ring);
+    }
+#endif
+
     if (flags & M_FATAL)
     {
         msg(M_INFO, "Exiting due to fatal error");
@@ -706,6 +802,9 @@ openvpn_exit(const int status)
 {
     if (!forked)
     {
+#if ENABLE_ASYNC_LOG
+        msg_async_stop();
+#endif
         tun_abort();
 
 #ifdef _WIN32
@@ -36,6 +36,11 @@
 #include <sys/epoll.h>
 #endif
 
+#if IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
 #include "memdbg.h"
 
 /*
@@ -508,6 +513,15 @@ we_init(int *maxevents, unsigned int flags)
 
 #if EPOLL
 
+/* what an fd is registered with, to skip epoll_ctl when it did not
+ * change */
+struct ep_fd
+{
+    bool added;
+    uint32_t events;
+    void *arg;
+};
+
 struct ep_set
 {
     struct event_set_functions func;
@@ -515,6 +529,8 @@ struct ep_set
     int epfd;
     int maxevents;
     struct epoll_event *events;
+    struct ep_fd *fds; /* indexed by fd, not with fast */
+    int n_fds;
 };
 
 static void
@@ -523,6 +539,7 @@ ep_free(struct event_set *es)
     struct ep_set *eps = (struct ep_set *)es;
     close(eps->epfd);
     free(eps->events);
+    free(eps->fds);
     free(eps);
 }
 
@@ -542,6 +559,11 @@ ep_del(struct event_set *es, event_t event)
     dmsg(D_EVENT_WAIT, "EP_DEL ev=%d", (int)event);
 
     ASSERT(!eps->fast);
+    if (event < 0 || event >= eps->n_fds || !eps->fds[event].added)
+    {
+        return;
+    }
+    CLEAR(eps->fds[event]);
     CLEAR(ev);
     if (epoll_ctl(eps->epfd, EPOLL_CTL_DEL, event, &ev) < 0)
     {
@@ -566,6 +588,31 @@ ep_ctl(struct event_set *es, event_t event, unsigned int rwflags, void *arg)
     {
         ev.events |= EPOLLOUT;
     }
+    if (rwflags & EVENT_EDGE)
+    {
+        ev.events |= EPOLLET;
+    }
+
+    /* the event loop sets most fds again on every pass, mostly unchanged.
+     * Without fast, fds are deleted before they are closed, so what was
+     * set last is what is registered. */
+    if (!eps->fast && event >= 0)
+    {
+        if (event >= eps->n_fds)
+        {
+            const int n = max_int(event + 1, eps->n_fds * 2);
+
+            eps->fds = realloc(eps->fds, array_mult_safe(sizeof(*eps->fds), n, 0));
+            check_malloc_return(eps->fds);
+            memset(&eps->fds[eps->n_fds], 0, (n - eps->n_fds) * sizeof(*eps->fds));
+            eps->n_fds = n;
+        }
+        if (eps->fds[event].added && eps->fds[event].events == ev.events
+            && eps->fds[event].arg == arg)
+        {
+            return;
+        }
+    }
 
     dmsg(D_EVENT_WAIT, "EP_CTL fd=%d rwflags=0x%04x ev=0x%08x arg=" ptr_format, (int)event, rwflags,
          (unsigned int)ev.events, (ptr_type)ev.data.ptr);
@@ -584,6 +631,12 @@ ep_ctl(struct event_set *es, event_t event, unsigned int rwflags, void *arg)
             msg(M_ERR, "EVENT: epoll_ctl EPOLL_CTL_MOD failed, sd=%d", (int)event);
         }
     }
+    if (!eps->fast && event >= 0)
+    {
+        eps->fds[event].added = true;
+        eps->fds[event].events = ev.events;
+        eps->fds[event].arg = arg;
+    }
 }
 
 static int
@@ -670,6 +723,512 @@ ep_init(int *maxevents, unsigned int flags)
 }
 #endif /* EPOLL */
 
+#if IO_URING
+
+/*
+ * The io_uring method watches each fd with a multishot poll, which is
+ * armed once and changed only when the events wanted for the fd change.
+ * The changes of a round and its wait are then a single io_uring_enter().
+ *
+ * A multishot poll reports an fd when it becomes ready, not while it
+ * stays ready, so the fds reported by a wait also get a oneshot poll
+ * at the next one, which completes at once if they are still ready.
+ * Kernels without multishot polls get oneshot polls only, armed again
+ * once they complete.
+ */
+
+#define UR_ENTRIES 256
+
+/* the user data of a poll is (gen << 32 | fd), that of a oneshot check
+ * has UR_CHECK in gen too */
+#define UR_CHECK  1u
+#define UR_IGNORE (~(uint64_t)0)
+
+struct ur_fd
+{
+    void *arg;
+    unsigned int rwflags; /* events wanted */
+    unsigned int armed;   /* events of the poll armed */
+    unsigned int ready;   /* events to return */
+    uint32_t gen;         /* generation of the polls, even */
+    int active;           /* index in active + 1, or 0 */
+    bool checking;        /* oneshot check armed */
+    bool edge;            /* EVENT_EDGE, no check */
+    bool reported;        /* returned by the last wait */
+    bool marked;          /* set by ctl since the last reset */
+    bool listed;          /* in ready */
+};
+
+struct ur_set
+{
+    struct event_set_functions func;
+    bool fast;
+    bool oneshot; /* no multishot polls */
+    int ring_fd;
+    int maxevents;
+
+    void *ring;
+    size_t ring_size;
+    struct io_uring_sqe *sqes;
+    size_t sqes_size;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int sq_pending; /* queued, not submitted yet */
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+
+    struct ur_fd *fds; /* indexed by fd */
+    int n_fds;
+    int *active; /* fds with polls wanted or armed */
+    int n_active;
+    int *ready; /* fds with events to return */
+    int n_ready;
+};
+
+static int
+ur_enter(struct ur_set *urs, unsigned int min_complete, const struct timeval *tv)
+{
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    unsigned int flags = 0;
+    int ret;
+
+    CLEAR(arg);
+    if (min_complete)
+    {
+        ts.tv_sec = tv->tv_sec;
+        ts.tv_nsec = tv->tv_usec * 1000;
+        arg.sigmask_sz = _NSIG / 8;
+        arg.ts = (uint64_t)(uintptr_t)&ts;
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+
+    ret = (int)syscall(__NR_io_uring_enter, urs->ring_fd, urs->sq_pending, min_complete, flags,
+                       min_complete ? &arg : NULL, min_complete ? sizeof(arg) : 0);
+    if (ret >= 0)
+    {
+        urs->sq_pending -= min_uint(ret, urs->sq_pending);
+    }
+    return ret;
+}
+
+static void
+ur_queue(struct ur_set *urs, uint8_t opcode, int fd, unsigned int rwflags, unsigned int len,
+         uint64_t addr, uint64_t user_data)
+{
+    struct io_uring_sqe *sqe;
+    unsigned int tail = *urs->sq_tail;
+    uint32_t events = 0;
+
+    if (urs->sq_pending == urs->sq_entries && ur_enter(urs, 0, NULL) < 0)
+    {
+        msg(M_ERR, "EVENT: io_uring_enter failed");
+    }
+
+    if (rwflags & EVENT_READ)
+    {
+        events |= POLLIN;
+    }
+    if (rwflags & EVENT_WRITE)
+    {
+        events |= POLLOUT;
+    }
+#if __BYTE_ORDER == __BIG_ENDIAN
+    events = events << 16 | events >> 16;
+#endif
+
+    sqe = &urs->sqes[tail & urs->sq_mask];
+    CLEAR(*sqe);
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->addr = addr;
+    sqe->len = len;
+    sqe->poll32_events = events;
+    sqe->user_data = user_data;
+
+    __atomic_store_n(urs->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++urs->sq_pending;
+}
+
+static inline uint64_t
+ur_user_data(int fd, uint32_t gen)
+{
+    return (uint64_t)gen << 32 | (uint32_t)fd;
+}
+
+/* cancel the polls of fd */
+static void
+ur_disarm(struct ur_set *urs, int fd, struct ur_fd *f)
+{
+    if (f->armed)
+    {
+        ur_queue(urs, IORING_OP_POLL_REMOVE, -1, 0, 0, ur_user_data(fd, f->gen), UR_IGNORE);
+    }
+    if (f->checking)
+    {
+        ur_queue(urs, IORING_OP_POLL_REMOVE, -1, 0, 0, ur_user_data(fd, f->gen | UR_CHECK),
+                 UR_IGNORE);
+    }
+    f->gen += 2;
+    f->armed = 0;
+    f->checking = false;
+}
+
+/* queue the polls that fd needs for this round */
+static void
+ur_sync(struct ur_set *urs, int fd, struct ur_fd *f)
+{
+    if ((f->armed || f->checking) && (f->armed != f->rwflags || !f->rwflags))
+    {
+        ur_disarm(urs, fd, f);
+    }
+    if (f->rwflags && !f->armed)
+    {
+        ur_queue(urs, IORING_OP_POLL_ADD, fd, f->rwflags, urs->oneshot ? 0 : IORING_POLL_ADD_MULTI,
+                 0, ur_user_data(fd, f->gen));
+        f->armed = f->rwflags;
+    }
+    else if (f->rwflags && f->reported && !f->checking && !f->edge && !urs->oneshot)
+    {
+        ur_queue(urs, IORING_OP_POLL_ADD, fd, f->rwflags, 0, 0,
+                 ur_user_data(fd, f->gen | UR_CHECK));
+        f->checking = true;
+    }
+    f->reported = false;
+}
+
+static void
+ur_active_del(struct ur_set *urs, struct ur_fd *f)
+{
+    const int i = f->active - 1;
+    const int last = urs->active[--urs->n_active];
+
+    urs->active[i] = last;
+    urs->fds[last].active = i + 1;
+    f->active = 0;
+}
+
+static void
+ur_complete(struct ur_set *urs, const struct io_uring_cqe *cqe)
+{
+    const int fd = (int)(uint32_t)cqe->user_data;
+    const uint32_t gen = (uint32_t)(cqe->user_data >> 32);
+    struct ur_fd *f;
+
+    if (cqe->user_data == UR_IGNORE || fd >= urs->n_fds)
+    {
+        return;
+    }
+    f = &urs->fds[fd];
+    if ((gen & ~UR_CHECK) != f->gen)
+    {
+        return; /* of a poll cancelled since */
+    }
+
+    if (gen & UR_CHECK)
+    {
+        f->checking = false;
+    }
+    else if (!(cqe->flags & IORING_CQE_F_MORE))
+    {
+        /* the poll is done, arm it again at the next wait */
+        f->armed = 0;
+        if (cqe->res == -EINVAL && !urs->oneshot)
+        {
+            msg(M_INFO, "Note: io_uring has no multishot polls, using oneshot polls");
+            urs->oneshot = true;
+        }
+    }
+
+    if (cqe->res > 0)
+    {
+        if (cqe->res & (POLLIN | POLLPRI | POLLERR | POLLHUP))
+        {
+            f->ready |= EVENT_READ;
+        }
+        if (cqe->res & POLLOUT)
+        {
+            f->ready |= EVENT_WRITE;
+        }
+        if (!f->listed)
+        {
+            urs->ready[urs->n_ready++] = fd;
+            f->listed = true;
+        }
+    }
+}
+
+static void
+ur_reap(struct ur_set *urs)
+{
+    unsigned int head = *urs->cq_head;
+    const unsigned int tail = __atomic_load_n(urs->cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail)
+    {
+        ur_complete(urs, &urs->cqes[head & urs->cq_mask]);
+        ++head;
+    }
+    __atomic_store_n(urs->cq_head, head, __ATOMIC_RELEASE);
+}
+
+static void
+ur_free(struct event_set *es)
+{
+    struct ur_set *urs = (struct ur_set *)es;
+    munmap(urs->sqes, urs->sqes_size);
+    munmap(urs->ring, urs->ring_size);
+    close(urs->ring_fd);
+    free(urs->fds);
+    free(urs->active);
+    free(urs->ready);
+    free(urs);
+}
+
+static void
+ur_reset(struct event_set *es)
+{
+    struct ur_set *urs = (struct ur_set *)es;
+    int i;
+
+    ASSERT(urs->fast);
+    for (i = 0; i < urs->n_active; ++i)
+    {
+        urs->fds[urs->active[i]].marked = false;
+    }
+}
+
+static void
+ur_del(struct event_set *es, event_t event)
+{
+    struct ur_set *urs = (struct ur_set *)es;
+    struct ur_fd *f;
+
+    dmsg(D_EVENT_WAIT, "UR_DEL ev=%d", (int)event);
+
+    if (event < 0 || event >= urs->n_fds || !urs->fds[event].active)
+    {
+        return;
+    }
+    f = &urs->fds[event];
+    f->rwflags = 0;
+    f->ready = 0;
+    f->reported = false;
+    if (f->armed || f->checking)
+    {
+        /* cancel now, the poll holds the file open until then */
+        ur_disarm(urs, event, f);
+        if (ur_enter(urs, 0, NULL) < 0)
+        {
+            msg(M_WARN | M_ERRNO, "EVENT: io_uring_enter failed, sd=%d", (int)event);
+        }
+    }
+    ur_active_del(urs, f);
+}
+
+static void
+ur_ctl(struct event_set *es, event_t event, unsigned int rwflags, void *arg)
+{
+    struct ur_set *urs = (struct ur_set *)es;
+    struct ur_fd *f;
+
+    dmsg(D_EVENT_WAIT, "UR_CTL fd=%d rwflags=0x%04x arg=" ptr_format, (int)event, rwflags,
+         (ptr_type)arg);
+
+    ASSERT(event >= 0);
+    if (event >= urs->n_fds)
+    {
+        const int n = max_int(event + 1, urs->n_fds * 2);
+
+        urs->fds = realloc(urs->fds, array_mult_safe(sizeof(*urs->fds), n, 0));
+        urs->active = realloc(urs->active, array_mult_safe(sizeof(*urs->active), n, 0));
+        urs->ready = realloc(urs->ready, array_mult_safe(sizeof(*urs->ready), n, 0));
+        check_malloc_return(urs->fds);
+        check_malloc_return(urs->active);
+        check_malloc_return(urs->ready);
+        memset(&urs->fds[urs->n_fds], 0, (n - urs->n_fds) * sizeof(*urs->fds));
+        urs->n_fds = n;
+    }
+
+    f = &urs->fds[event];
+    f->arg = arg;
+    f->rwflags = rwflags & (EVENT_READ | EVENT_WRITE);
+    f->edge = (rwflags & EVENT_EDGE) != 0;
+    f->marked = true;
+    if (!f->active)
+    {
+        urs->active[urs->n_active++] = event;
+        f->active = urs->n_active;
+    }
+}
+
+static int
+ur_wait(struct event_set *es, const struct timeval *tv, struct event_set_return *out, int outlen)
+{
+    struct ur_set *urs = (struct ur_set *)es;
+    unsigned int min_complete = 1;
+    int i, j, n = 0;
+
+    if (outlen > urs->maxevents)
+    {
+        outlen = urs->maxevents;
+    }
+
+    for (i = 0; i < urs->n_active;)
+    {
+        const int fd = urs->active[i];
+        struct ur_fd *f = &urs->fds[fd];
+
+        if (urs->fast && !f->marked)
+        {
+            f->rwflags = 0;
+        }
+        ur_sync(urs, fd, f);
+        if (!f->rwflags)
+        {
+            ur_active_del(urs, f);
+            continue;
+        }
+        ++i;
+    }
+
+    if (urs->n_ready || (!tv->tv_sec && !tv->tv_usec)
+        || *urs->cq_head != __atomic_load_n(urs->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        min_complete = 0;
+    }
+    if ((min_complete || urs->sq_pending) && ur_enter(urs, min_complete, tv) < 0)
+    {
+        if (errno == EINTR)
+        {
+            return -1;
+        }
+        if (errno != ETIME && errno != EBUSY && errno != EAGAIN)
+        {
+            msg(M_WARN | M_ERRNO, "EVENT: io_uring_enter failed");
+            return -1;
+        }
+    }
+
+    ur_reap(urs);
+
+    for (i = j = 0; i < urs->n_ready; ++i)
+    {
+        const int fd = urs->ready[i];
+        struct ur_fd *f = &urs->fds[fd];
+        const unsigned int rwflags = f->ready & f->rwflags;
+
+        if (rwflags && n == outlen)
+        {
+            urs->ready[j++] = fd; /* for the next wait */
+            continue;
+        }
+        f->ready = 0;
+        f->listed = false;
+        if (rwflags)
+        {
+            out[n].rwflags = rwflags;
+            out[n].arg = f->arg;
+            f->reported = true;
+            dmsg(D_EVENT_WAIT, "UR_WAIT[%d] rwflags=0x%04x arg=" ptr_format, n, rwflags,
+                 (ptr_type)f->arg);
+            ++n;
+        }
+    }
+    urs->n_ready = j;
+
+    return n;
+}
+
+static struct event_set *
+ur_init(int *maxevents, unsigned int flags)
+{
+    struct io_uring_params p;
+    struct ur_set *urs;
+    void *ring, *sqes;
+    size_t ring_size, sqes_size;
+    unsigned int *sq_array;
+    unsigned int i;
+    int fd;
+
+    dmsg(D_EVENT_WAIT, "UR_INIT maxevents=%d flags=0x%08x", *maxevents, flags);
+
+    CLEAR(p);
+    fd = (int)syscall(__NR_io_uring_setup, UR_ENTRIES, &p);
+    if (fd < 0)
+    {
+        return NULL;
+    }
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_SINGLE_MMAP))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    ring_size = max_uint(p.sq_off.array + p.sq_entries * sizeof(unsigned int),
+                         p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe));
+    ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                IORING_OFF_SQ_RING);
+    if (ring == MAP_FAILED)
+    {
+        close(fd);
+        return NULL;
+    }
+    sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = mmap(NULL, sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+                IORING_OFF_SQES);
+    if (sqes == MAP_FAILED)
+    {
+        munmap(ring, ring_size);
+        close(fd);
+        return NULL;
+    }
+
+    set_cloexec(fd);
+
+    ALLOC_OBJ_CLEAR(urs, struct ur_set);
+
+    /* set dispatch functions */
+    urs->func.free = ur_free;
+    urs->func.reset = ur_reset;
+    urs->func.del = ur_del;
+    urs->func.ctl = ur_ctl;
+    urs->func.wait = ur_wait;
+
+    if (flags & EVENT_METHOD_FAST)
+    {
+        urs->fast = true;
+    }
+
+    ASSERT(*maxevents > 0);
+    urs->maxevents = *maxevents;
+    urs->ring_fd = fd;
+    urs->ring = ring;
+    urs->ring_size = ring_size;
+    urs->sqes = sqes;
+    urs->sqes_size = sqes_size;
+    urs->sq_tail = (unsigned int *)((uint8_t *)ring + p.sq_off.tail);
+    urs->sq_mask = *(unsigned int *)((uint8_t *)ring + p.sq_off.ring_mask);
+    urs->sq_entries = p.sq_entries;
+    urs->cq_head = (unsigned int *)((uint8_t *)ring + p.cq_off.head);
+    urs->cq_tail = (unsigned int *)((uint8_t *)ring + p.cq_off.tail);
+    urs->cq_mask = *(unsigned int *)((uint8_t *)ring + p.cq_off.ring_mask);
+    urs->cqes = (struct io_uring_cqe *)((uint8_t *)ring + p.cq_off.cqes);
+
+    /* the sqes are used in order */
+    sq_array = (unsigned int *)((uint8_t *)ring + p.sq_off.array);
+    for (i = 0; i < p.sq_entries; ++i)
+    {
+        sq_array[i] = i;
+    }
+
+    return (struct event_set *)urs;
+}
+#endif /* IO_URING */
+
 #if POLL
 
 struct po_set
@@ -1166,6 +1725,17 @@ event_set_init_scalable(int *maxevents, unsigned int flags)
 struct event_set *
 event_set_init(int *maxevents, unsigned int flags)
 {
+#if IO_URING
+    if (flags & EVENT_METHOD_IO_URING)
+    {
+        struct event_set *ret = ur_init(maxevents, flags);
+        if (ret)
+        {
+            return ret;
+        }
+        msg(M_WARN, "Note: io_uring is unavailable, falling back to the default event API");
+    }
+#endif
     if (flags & EVENT_METHOD_FAST)
     {
         return event_set_init_simple(maxevents, flags);
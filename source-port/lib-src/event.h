@@ -38,6 +38,11 @@
 #define EVENT_READ  (1 << READ_SHIFT)
 #define EVENT_WRITE (1 << WRITE_SHIFT)
 
+/* passed to event_ctl only: report the fd when it becomes ready, not
+ * as long as it is, if the method can (epoll, io_uring).  The caller
+ * has to read until EAGAIN before waiting for it again. */
+#define EVENT_EDGE (1 << 3)
+
 /* event flags returned by io_wait.
  *
  * All these events are defined as bits in a bitfield.
@@ -80,6 +85,7 @@
  */
 #define EVENT_METHOD_US_TIMEOUT (1 << 0)
 #define EVENT_METHOD_FAST       (1 << 1)
+#define EVENT_METHOD_IO_URING   (1 << 2)
 
 /*
  * The following constant is used as boundary between integer value
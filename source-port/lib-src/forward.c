@@ -41,6 +41,7 @@
 #include "dco.h"
 #include "auth_token.h"
 #include "tun_afunix.h"
+#include "tun_queue.h"
 
 #include "memdbg.h"
 
@@ -694,6 +695,114 @@ encrypt_sign(struct context *c, bool comp_frag)
     buffer_turnover(orig_buf, &c->c2.to_link, &c->c2.buf, &b->read_tun_buf);
 }
 
+void
+encrypt_sign_prepare(struct context *c, struct buffer *buf, struct buffer *work,
+                     struct buffer compress_buf, struct cipher_copy *cc,
+                     struct encrypt_detached *e)
+{
+    struct crypto_options *co = NULL;
+
+    e->pending = false;
+    e->opcode_v1 = false;
+    e->key_id = 0;
+    e->ks = NULL;
+
+    if (c->c2.tls_multi && c->c2.tls_multi->multi_state < CAS_CONNECT_DONE)
+    {
+        buf->len = 0;
+    }
+
+#ifdef USE_COMP
+    if (buf->len > 0 && c->c2.comp_context)
+    {
+        (*c->c2.comp_context->alg.compress)(buf, compress_buf, c->c2.comp_context, &c->c2.frame);
+    }
+#endif
+
+    ASSERT(buf_init(work, c->c2.frame.buf.headroom));
+
+    if (c->c2.tls_multi)
+    {
+        tls_pre_encrypt(c->c2.tls_multi, buf, &co);
+        e->ks = c->c2.tls_multi->save_ks;
+        if (buf->len > 0 && c->c2.tls_multi->use_peer_id)
+        {
+            tls_prepend_opcode_v2(c->c2.tls_multi, work);
+        }
+        e->opcode_v1 = !c->c2.tls_multi->use_peer_id;
+        e->key_id = e->ks ? e->ks->key_id : 0;
+        /* tls_post_encrypt() for this packet is done by
+         * link_write_detached_accounting() */
+        c->c2.tls_multi->save_ks = NULL;
+    }
+    else
+    {
+        co = &c->c2.crypto_options;
+    }
+
+    if (buf->len > 0 && co && cipher_ctx_mode_aead(co->key_ctx_bi.encrypt.cipher))
+    {
+        if (!openvpn_encrypt_reserve(co, &e->snap, BLEN(buf)))
+        {
+            msg(D_CRYPT_ERRORS, "ENCRYPT ERROR: packet ID roll over");
+            buf->len = 0;
+        }
+        else
+        {
+            /* packet dumps go through msg(), which needs the lock */
+            if (!check_debug_level(D_PACKET_CONTENT))
+            {
+                e->snap.key_ctx_bi.encrypt.cipher = cipher_copy_get(cc, &co->key_ctx_bi.encrypt);
+                e->pending = e->snap.key_ctx_bi.encrypt.cipher != NULL;
+            }
+            if (!e->pending)
+            {
+                /* encrypt with the shared cipher while we hold the lock */
+                e->snap.key_ctx_bi.encrypt.cipher = co->key_ctx_bi.encrypt.cipher;
+                openvpn_encrypt(buf, *work, &e->snap);
+            }
+        }
+    }
+    else
+    {
+        openvpn_encrypt(buf, *work, co);
+    }
+
+    if (buf->len > 0)
+    {
+        struct link_socket_actual *to_addr = NULL;
+        link_socket_get_outgoing_addr(buf, get_link_socket_info(c), &to_addr);
+        if (to_addr)
+        {
+            e->to = *to_addr;
+        }
+        else
+        {
+            buf->len = 0;
+        }
+    }
+}
+
+void
+encrypt_sign_detached(struct buffer *buf, struct buffer work, struct encrypt_detached *e)
+{
+    if (e->pending)
+    {
+        openvpn_encrypt(buf, work, &e->snap);
+    }
+    encrypt_sign_detached_finish(buf, e);
+}
+
+void
+encrypt_sign_detached_finish(struct buffer *buf, const struct encrypt_detached *e)
+{
+    if (buf->len > 0 && e->opcode_v1)
+    {
+        uint8_t op = (P_DATA_V1 << P_OPCODE_SHIFT) | e->key_id;
+        ASSERT(buf_write_prepend(buf, &op, 1));
+    }
+}
+
 /*
  * Should we exit due to session timeout?
  */
@@ -981,6 +1090,28 @@ read_incoming_link(struct context *c, struct link_socket *sock)
     perf_pop();
 }
 
+void
+link_read_accounting(struct context *c, int size)
+{
+    c->c2.link_read_bytes += size;
+    link_read_bytes_global += size;
+#ifdef ENABLE_MEMSTATS
+    if (mmap_stats)
+    {
+        mmap_stats->link_read_bytes = link_read_bytes_global;
+    }
+#endif
+    c->c2.original_recv_size = size;
+#ifdef ENABLE_MANAGEMENT
+    if (management)
+    {
+        management_bytes_client(management, size, 0);
+        management_bytes_server(management, &c->c2.link_read_bytes, &c->c2.link_write_bytes,
+                                &c->c2.mda_context);
+    }
+#endif
+}
+
 bool
 process_incoming_link_part1(struct context *c, struct link_socket_info *lsi, bool floated)
 {
@@ -989,23 +1120,7 @@ process_incoming_link_part1(struct context *c, struct link_socket_info *lsi, boo
 
     if (c->c2.buf.len > 0)
     {
-        c->c2.link_read_bytes += c->c2.buf.len;
-        link_read_bytes_global += c->c2.buf.len;
-#ifdef ENABLE_MEMSTATS
-        if (mmap_stats)
-        {
-            mmap_stats->link_read_bytes = link_read_bytes_global;
-        }
-#endif
-        c->c2.original_recv_size = c->c2.buf.len;
-#ifdef ENABLE_MANAGEMENT
-        if (management)
-        {
-            management_bytes_client(management, c->c2.buf.len, 0);
-            management_bytes_server(management, &c->c2.link_read_bytes, &c->c2.link_write_bytes,
-                                    &c->c2.mda_context);
-        }
-#endif
+        link_read_accounting(c, c->c2.buf.len);
     }
     else
     {
@@ -1350,6 +1465,7 @@ read_incoming_tun(struct context *c)
     {
         c->c2.buf.len = read_tun(c->c1.tuntap, BPTR(&c->c2.buf), c->c2.frame.buf.payload_size);
     }
+    c->c1.tuntap->read_drained = c->c2.buf.len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
 #endif /* ifdef _WIN32 */
 
 #ifdef PACKET_TRUNCATION_CHECK
@@ -1390,7 +1506,7 @@ read_incoming_tun(struct context *c)
  * When packet is sent to tun, it comes to openvpn, encapsulated
  * and sent to routing table, which sends it again to tun.
  */
-static void
+void
 drop_if_recursive_routing(struct context *c, struct buffer *buf)
 {
     bool drop = false;
@@ -1740,6 +1856,55 @@ process_ip_header(struct context *c, unsigned int flags, struct buffer *buf,
  * Input: c->c2.to_link
  */
 
+void
+link_write_accounting(struct context *c, int size)
+{
+    c->c2.max_send_size_local = max_int(size, c->c2.max_send_size_local);
+    c->c2.link_write_bytes += size;
+    link_write_bytes_global += size;
+#ifdef ENABLE_MEMSTATS
+    if (mmap_stats)
+    {
+        mmap_stats->link_write_bytes = link_write_bytes_global;
+    }
+#endif
+#ifdef ENABLE_MANAGEMENT
+    if (management)
+    {
+        management_bytes_client(management, 0, size);
+        management_bytes_server(management, &c->c2.link_read_bytes, &c->c2.link_write_bytes,
+                                &c->c2.mda_context);
+    }
+#endif
+}
+
+void
+link_write_detached_accounting(struct context *c, struct link_socket *sock,
+                               const struct encrypt_detached *e, const struct cipher_copy *cc,
+                               int len, int size, int err)
+{
+    if (size > 0)
+    {
+        link_write_accounting(c, size);
+    }
+    errno = err;
+    check_status(size, "write", sock, NULL);
+
+    /* same as tls_post_encrypt(), unless the key went away meanwhile */
+    struct key_state *ks = e->ks;
+    if (ks && ks->crypto_options.key_ctx_bi.encrypt.cipher == cc->src)
+    {
+        ++ks->n_packets;
+        ks->n_bytes += len;
+    }
+
+    if (c->options.ping_send_timeout)
+    {
+        event_timeout_reset(&c->c2.ping_send_interval);
+    }
+    register_activity(c, size);
+}
+
 void
 process_outgoing_link(struct context *c, struct link_socket *sock)
 {
@@ -1814,23 +1979,7 @@ process_outgoing_link(struct context *c, struct link_socket *sock)
 
             if (size > 0)
             {
-                c->c2.max_send_size_local = max_int(size, c->c2.max_send_size_local);
-                c->c2.link_write_bytes += size;
-                link_write_bytes_global += size;
-#ifdef ENABLE_MEMSTATS
-                if (mmap_stats)
-                {
-                    mmap_stats->link_write_bytes = link_write_bytes_global;
-                }
-#endif
-#ifdef ENABLE_MANAGEMENT
-                if (management)
-                {
-                    management_bytes_client(management, 0, size);
-                    management_bytes_server(management, &c->c2.link_read_bytes,
-                                            &c->c2.link_write_bytes, &c->c2.mda_context);
-                }
-#endif
+                link_write_accounting(c, size);
             }
         }
 
@@ -1891,6 +2040,31 @@ process_outgoing_link(struct context *c, struct link_socket *sock)
  * Input: c->c2.to_tun
  */
 
+void
+tun_write_accounting(struct context *c, int len, int size)
+{
+    if (size > 0)
+    {
+        c->c2.tun_write_bytes += size;
+    }
+    check_status(size, "write to TUN/TAP", NULL, c->c1.tuntap);
+
+    /* check written packet size */
+    if (size > 0)
+    {
+        /* Did we write a different size packet than we intended? */
+        if (size != len)
+        {
+            msg(D_LINK_ERRORS,
+                "TUN/TAP packet was destructively fragmented on write to %s (tried=%d,actual=%d)",
+                c->c1.tuntap->actual_name, len, size);
+        }
+
+        /* indicate activity regarding --inactive parameter */
+        register_activity(c, size);
+    }
+}
+
 void
 process_outgoing_tun(struct context *c, struct link_socket *in_sock)
 {
@@ -1945,26 +2119,7 @@ process_outgoing_tun(struct context *c, struct link_socket *in_sock)
         }
 #endif
 
-        if (size > 0)
-        {
-            c->c2.tun_write_bytes += size;
-        }
-        check_status(size, "write to TUN/TAP", NULL, c->c1.tuntap);
-
-        /* check written packet size */
-        if (size > 0)
-        {
-            /* Did we write a different size packet than we intended? */
-            if (size != BLEN(&c->c2.to_tun))
-            {
-                msg(D_LINK_ERRORS,
-                    "TUN/TAP packet was destructively fragmented on write to %s (tried=%d,actual=%d)",
-                    c->c1.tuntap->actual_name, BLEN(&c->c2.to_tun), size);
-            }
-
-            /* indicate activity regarding --inactive parameter */
-            register_activity(c, size);
-        }
+        tun_write_accounting(c, BLEN(&c->c2.to_tun), size);
     }
     else
     {
@@ -2196,6 +2351,62 @@ get_io_flags_udp(struct context *c, struct multi_io *multi_io, const unsigned in
     }
 }
 
+/*
+ * Returns true if there is link input which has already been read but
+ * not processed yet, so that io_wait_dowork() must not block.  Datagrams
+ * left over from a batched read are only handed out once all pending
+ * output has been written.
+ */
+static bool
+io_wait_input_pending(const struct context *c, const unsigned int flags)
+{
+    if (!(flags & IOW_CHECK_RESIDUAL))
+    {
+        return false;
+    }
+    return sockets_read_residual(c)
+           || (!(flags & (IOW_TO_LINK | IOW_TO_TUN)) && sockets_read_batched(c));
+}
+
+int
+io_event_wait(struct context *c, struct event_set *es, struct event_set_return *esr, int outlen)
+{
+#if ENABLE_BUSY_POLL
+    struct timeval *tv = &c->c2.timeval;
+    const int64_t timeout = (int64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+
+    if (c->options.busy_poll > 0 && timeout > 0)
+    {
+        const struct timeval zero = { 0, 0 };
+        const int64_t budget = timeout < c->options.busy_poll ? timeout : c->options.busy_poll;
+        struct timespec start, now;
+        int64_t spun;
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        do
+        {
+            const int status = event_wait(es, &zero, esr, outlen);
+            if (status != 0 || c->sig->signal_received)
+            {
+                return status;
+            }
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            spun = (int64_t)(now.tv_sec - start.tv_sec) * 1000000
+                   + (now.tv_nsec - start.tv_nsec) / 1000;
+        } while (spun < budget);
+
+        /* sleep for the rest of the timeout */
+        if (spun >= timeout)
+        {
+            return 0;
+        }
+        tv->tv_sec = (timeout - spun) / 1000000;
+        tv->tv_usec = (timeout - spun) % 1000000;
+    }
+#endif
+    return event_wait(es, &c->c2.timeval, esr, outlen);
+}
+
 void
 io_wait_dowork(struct context *c, const unsigned int flags)
 {
@@ -2259,7 +2470,7 @@ io_wait_dowork(struct context *c, const unsigned int flags)
 
     if (!c->sig->signal_received)
     {
-        if (!(flags & IOW_CHECK_RESIDUAL) || !sockets_read_residual(c))
+        if (!io_wait_input_pending(c, flags))
         {
             int status;
 
@@ -2273,7 +2484,13 @@ io_wait_dowork(struct context *c, const unsigned int flags)
             /*
              * Wait for something to happen.
              */
-            status = event_wait(c->c2.event_set, &c->c2.timeval, esr, SIZE(esr));
+#if ENABLE_TUN_QUEUES
+            tun_queues_unlock(c);
+#endif
+            status = io_event_wait(c, c->c2.event_set, esr, SIZE(esr));
+#if ENABLE_TUN_QUEUES
+            tun_queues_lock(c);
+#endif
 
             check_status(status, "event_wait", NULL, NULL);
 
@@ -73,6 +73,15 @@ void get_io_flags_dowork_udp(struct context *c, struct multi_io *multi_io,
 
 void get_io_flags_udp(struct context *c, struct multi_io *multi_io, const unsigned int flags);
 
+/**
+ * event_wait() on \a es with the timeout of \a c.  With --busy-poll, the
+ * event set is first polled without a timeout, for up to as many
+ * microseconds, so that a packet arriving meanwhile does not wait for the
+ * thread to be woken up.
+ */
+int io_event_wait(struct context *c, struct event_set *es, struct event_set_return *esr,
+                  int outlen);
+
 void io_wait_dowork(struct context *c, const unsigned int flags);
 
 void pre_select(struct context *c);
@@ -115,6 +124,54 @@ void process_io(struct context *c, struct link_socket *sock);
  */
 void encrypt_sign(struct context *c, bool comp_frag);
 
+/**
+ * A data channel packet that \c encrypt_sign_prepare() set up for
+ * encryption outside of the lock protecting its context.
+ */
+struct encrypt_detached
+{
+    struct crypto_options snap;   /**< Send key with the reserved packet ID. */
+    bool pending;                 /**< Encryption is left to
+                                   *   \c encrypt_sign_detached(). */
+    bool opcode_v1;               /**< Prepend a P_DATA_V1 opcode afterwards. */
+    int key_id;
+    struct key_state *ks;         /**< Key used, for the accounting. */
+    struct link_socket_actual to; /**< Where to send the packet. */
+};
+
+/**
+ * Variant of \c encrypt_sign() for threads that do not own \a c.
+ *
+ * Called with the lock protecting \a c held, this does everything
+ * \c encrypt_sign() does except encrypting an AEAD packet, which
+ * \c encrypt_sign_detached() does afterwards without the lock using the
+ * private cipher copy in \a cc.  Other packets are encrypted right away.
+ * The packet is not fragmented and not placed in \c c->c2.to_link.
+ *
+ * @param c            - The context structure of the VPN tunnel.
+ * @param buf          - The plaintext packet.
+ * @param work         - Work buffer the packet is encrypted into.
+ * @param compress_buf - Work buffer for compression.
+ * @param cc           - Private send cipher copy kept by the caller.
+ * @param e            - Returns the state of the packet.
+ */
+void encrypt_sign_prepare(struct context *c, struct buffer *buf, struct buffer *work,
+                          struct buffer compress_buf, struct cipher_copy *cc,
+                          struct encrypt_detached *e);
+
+/**
+ * Finish a packet set up by \c encrypt_sign_prepare(), without the lock.
+ * Afterwards, \a buf holds the packet to send to \c e->to.
+ */
+void encrypt_sign_detached(struct buffer *buf, struct buffer work, struct encrypt_detached *e);
+
+/**
+ * The part of \c encrypt_sign_detached() after the encryption, for
+ * callers that encrypt several packets at once with
+ * \c openvpn_encrypt_batch() on \c e->snap.
+ */
+void encrypt_sign_detached_finish(struct buffer *buf, const struct encrypt_detached *e);
+
 int get_server_poll_remaining_time(struct event_timeout *server_poll_timeout);
 
 /**********************************************************************/
@@ -224,6 +281,41 @@ void extract_dco_float_peer_addr(sa_family_t socket_family, struct openvpn_socka
  */
 void process_outgoing_link(struct context *c, struct link_socket *sock);
 
+/**
+ * Update the link write statistics after \a size bytes of a packet
+ * were sent to the remote peer.
+ *
+ * @param c     The context structure of the VPN tunnel.
+ * @param size  Number of bytes written.
+ */
+void link_write_accounting(struct context *c, int size);
+
+/**
+ * Account for a packet prepared by \c encrypt_sign_prepare() and sent by
+ * another thread, as \c process_outgoing_link() and
+ * \c tls_post_encrypt() would have done.  Called with the lock held.
+ *
+ * @param c     The context structure of the VPN tunnel.
+ * @param sock  The socket the packet was sent on.
+ * @param e     The packet.
+ * @param cc    The send cipher copy it was encrypted with.
+ * @param len   Length of the packet.
+ * @param size  Return value of the write.
+ * @param err   \c errno after the write.
+ */
+void link_write_detached_accounting(struct context *c, struct link_socket *sock,
+                                    const struct encrypt_detached *e,
+                                    const struct cipher_copy *cc, int len, int size, int err);
+
+/**
+ * Update the link read statistics for a packet of \a size bytes
+ * received from the remote peer.
+ *
+ * @param c     The context structure of the VPN tunnel.
+ * @param size  Number of bytes read.
+ */
+void link_read_accounting(struct context *c, int size);
+
 
 /**************************************************************************/
 /**
@@ -257,6 +349,15 @@ void read_incoming_tun(struct context *c);
  */
 void process_incoming_tun(struct context *c, struct link_socket *out_sock);
 
+/**
+ * Drop a packet read from the tun/tap device if it would be routed
+ * into the tunnel again, i.e. if it is addressed to the remote peer.
+ *
+ * @param c     The context structure of the VPN tunnel.
+ * @param buf   The packet; its length is set to 0 if it is dropped.
+ */
+void drop_if_recursive_routing(struct context *c, struct buffer *buf);
+
 
 /**
  * Write a packet to the virtual tun/tap network interface.
@@ -273,6 +374,17 @@ void process_incoming_tun(struct context *c, struct link_socket *out_sock);
  */
 void process_outgoing_tun(struct context *c, struct link_socket *in_sock);
 
+/**
+ * Update the statistics and log errors for a packet written to the
+ * tun/tap device, as \c process_outgoing_tun() does.  \c errno must still
+ * be the one of the write.
+ *
+ * @param c     The context structure of the VPN tunnel.
+ * @param len   Length of the packet.
+ * @param size  Return value of the write.
+ */
+void tun_write_accounting(struct context *c, int len, int size);
+
 
 /**************************************************************************/
 
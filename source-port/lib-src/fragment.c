@@ -31,6 +31,7 @@
 #include "crypto.h"
 #include "misc.h"
 #include "fragment.h"
+#include "pktpool.h"
 #include "integer.h"
 #include "memdbg.h"
 
@@ -46,7 +47,7 @@ fragment_list_buf_init(struct fragment_list *list, const struct frame *frame)
     int i;
     for (i = 0; i < N_FRAG_BUF; ++i)
     {
-        list->fragments[i].buf = alloc_buf(BUF_SIZE(frame));
+        list->fragments[i].buf = pktpool_alloc_buf(BUF_SIZE(frame));
     }
 }
 
@@ -56,7 +57,7 @@ fragment_list_buf_free(struct fragment_list *list)
     int i;
     for (i = 0; i < N_FRAG_BUF; ++i)
     {
-        free_buf(&list->fragments[i].buf);
+        pktpool_free_buf(&list->fragments[i].buf);
     }
 }
 
@@ -116,8 +117,8 @@ void
 fragment_free(struct fragment_master *f)
 {
     fragment_list_buf_free(&f->incoming);
-    free_buf(&f->outgoing);
-    free_buf(&f->outgoing_return);
+    pktpool_free_buf(&f->outgoing);
+    pktpool_free_buf(&f->outgoing_return);
     free(f);
 }
 
@@ -125,8 +126,8 @@ void
 fragment_frame_init(struct fragment_master *f, const struct frame *frame)
 {
     fragment_list_buf_init(&f->incoming, frame);
-    f->outgoing = alloc_buf(BUF_SIZE(frame));
-    f->outgoing_return = alloc_buf(BUF_SIZE(frame));
+    f->outgoing = pktpool_alloc_buf(BUF_SIZE(frame));
+    f->outgoing_return = pktpool_alloc_buf(BUF_SIZE(frame));
 }
 
 /*
@@ -54,6 +54,7 @@
 #include "mudp.h"
 #include "dco.h"
 #include "tun_afunix.h"
+#include "pktpool.h"
 
 #include "memdbg.h"
 
@@ -938,6 +939,8 @@ uninit_static(void)
 #if defined(MEASURE_TLS_HANDSHAKE_STATS)
     show_tls_performance_stats();
 #endif
+
+    pktpool_drain();
 }
 
 void
@@ -3676,17 +3679,17 @@ init_context_buffers(const struct frame *frame)
 
     size_t buf_size = BUF_SIZE(frame);
 
-    b->read_link_buf = alloc_buf(buf_size);
-    b->read_tun_buf = alloc_buf(buf_size);
+    b->read_link_buf = pktpool_alloc_buf(buf_size);
+    b->read_tun_buf = pktpool_alloc_buf(buf_size);
 
-    b->aux_buf = alloc_buf(buf_size);
+    b->aux_buf = pktpool_alloc_buf(buf_size);
 
-    b->encrypt_buf = alloc_buf(buf_size);
-    b->decrypt_buf = alloc_buf(buf_size);
+    b->encrypt_buf = pktpool_alloc_buf(buf_size);
+    b->decrypt_buf = pktpool_alloc_buf(buf_size);
 
 #ifdef USE_COMP
-    b->compress_buf = alloc_buf(buf_size);
-    b->decompress_buf = alloc_buf(buf_size);
+    b->compress_buf = pktpool_alloc_buf(buf_size);
+    b->decompress_buf = pktpool_alloc_buf(buf_size);
 #endif
 
     return b;
@@ -3697,17 +3700,17 @@ free_context_buffers(struct context_buffers *b)
 {
     if (b)
     {
-        free_buf(&b->read_link_buf);
-        free_buf(&b->read_tun_buf);
-        free_buf(&b->aux_buf);
+        pktpool_free_buf(&b->read_link_buf);
+        pktpool_free_buf(&b->read_tun_buf);
+        pktpool_free_buf(&b->aux_buf);
 
 #ifdef USE_COMP
-        free_buf(&b->compress_buf);
-        free_buf(&b->decompress_buf);
+        pktpool_free_buf(&b->compress_buf);
+        pktpool_free_buf(&b->decompress_buf);
 #endif
 
-        free_buf(&b->encrypt_buf);
-        free_buf(&b->decrypt_buf);
+        pktpool_free_buf(&b->encrypt_buf);
+        pktpool_free_buf(&b->decrypt_buf);
 
         free(b);
     }
@@ -4056,6 +4059,11 @@ do_event_set_init(struct context *c, bool need_us_timeout)
         flags |= EVENT_METHOD_US_TIMEOUT;
     }
 
+    if (c->options.io_uring)
+    {
+        flags |= EVENT_METHOD_IO_URING;
+    }
+
     c->c2.event_set = event_set_init(&c->c2.event_set_max, flags);
     c->c2.event_set_owned = true;
 }
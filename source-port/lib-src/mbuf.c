@@ -31,6 +31,7 @@
 #include "integer.h"
 #include "misc.h"
 #include "mbuf.h"
+#include "pktpool.h"
 
 #include "memdbg.h"
 
@@ -60,12 +61,18 @@ mbuf_free(struct mbuf_set *ms)
     }
 }
 
+/* the packet follows the mbuf_buffer in the same block, on a cache line */
+#define MBUF_BUFFER_SIZE ((sizeof(struct mbuf_buffer) + 63) & ~(size_t)63)
+
 struct mbuf_buffer *
 mbuf_alloc_buf(const struct buffer *buf)
 {
-    struct mbuf_buffer *ret;
-    ALLOC_OBJ(ret, struct mbuf_buffer);
-    ret->buf = clone_buf(buf);
+    struct mbuf_buffer *ret = pktpool_get(MBUF_BUFFER_SIZE + buf->capacity);
+    ret->buf.capacity = buf->capacity;
+    ret->buf.offset = buf->offset;
+    ret->buf.len = buf->len;
+    ret->buf.data = (uint8_t *)ret + MBUF_BUFFER_SIZE;
+    memcpy(BPTR(&ret->buf), BPTR(buf), BLEN(buf));
     ret->refcount = 1;
     ret->flags = 0;
     return ret;
@@ -78,8 +85,7 @@ mbuf_free_buf(struct mbuf_buffer *mb)
     {
         if (--mb->refcount <= 0)
         {
-            free_buf(&mb->buf);
-            free(mb);
+            pktpool_put(mb);
         }
     }
 }
@@ -0,0 +1,771 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "syshead.h"
+
+#if ENABLE_SERVER_CRYPTO_THREADS
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "multi.h"
+#include "forward.h"
+#include "occ.h"
+#include "ssl_pkt.h"
+#include "fdmisc.h"
+#include "platform.h"
+#include "mcrypto.h"
+
+#include "memdbg.h"
+
+/* packets in flight over all workers, a power of 2 */
+#define MULTI_CRYPTO_QUEUE 1024
+
+/* max number of packets a worker takes from its ring at once */
+#define MULTI_CRYPTO_BUDGET CRYPTO_BATCH_MAX
+
+/* the cipher copies of a client, per worker */
+#define MULTI_CRYPTO_ENCRYPT 0
+#define MULTI_CRYPTO_DECRYPT 1
+
+struct multi_crypto_job
+{
+    struct multi_instance *mi; /* holds a reference */
+    bool from_link;            /* read from the socket, else from the tun/tap device */
+    struct link_socket *sock;
+    struct multi_crypto_copy *copy; /* cipher copy of the client */
+    bool offload;              /* the crypto is left to a worker */
+
+    struct buffer data; /* slot storage, the packet as queued */
+    struct buffer work; /* slot storage, the packet after the crypto */
+    struct buffer buf;  /* the packet */
+
+    /* socket -> tun/tap */
+    struct crypto_options *co;
+    const uint8_t *ad_start;
+    struct frame frame;
+    struct crypto_detached d;
+
+    /* tun/tap -> socket */
+    struct encrypt_detached e;
+
+    atomic_bool done; /* the crypto is done */
+};
+
+struct multi_crypto_worker
+{
+    struct multi_crypto *set;
+    int index;
+    pthread_t thread;
+    bool started;
+
+    /* jobs handed to this worker; the event loop moves tail, the
+     * worker head.  There are never more than MULTI_CRYPTO_QUEUE jobs. */
+    unsigned int ring[MULTI_CRYPTO_QUEUE];
+    atomic_uint tail;
+    unsigned int head;
+
+    /* for sleeping while the ring is empty */
+    atomic_bool sleeping;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+struct multi_crypto
+{
+    struct multi_context *m;
+    int buf_size;
+    atomic_bool stopping;
+
+    /* the jobs, handed out and retired in order by the event loop */
+    struct multi_crypto_job jobs[MULTI_CRYPTO_QUEUE];
+    unsigned int head;
+    unsigned int tail;
+    int next_worker;
+
+    /* wakes up the event loop */
+    int wakeup_pipe[2];
+    atomic_bool wakeup_pending;
+
+    int n_workers;
+    struct multi_crypto_worker *workers;
+};
+
+struct multi_crypto_copy
+{
+    struct cipher_copy cc;
+    int in_flight; /* jobs using cc */
+};
+
+struct multi_crypto_peer
+{
+    int n_copies;
+    struct multi_crypto_copy copies[];
+};
+
+/*
+ * The crypto workers bypass everything in the event loop that has
+ * per-packet state other than the crypto; return what stands in the
+ * way, if any.
+ */
+static const char *
+multi_crypto_unsupported(const struct multi_context *m)
+{
+    const struct context *c = &m->top;
+
+    for (int i = 0; i < c->c1.link_sockets_num; i++)
+    {
+        if (!proto_is_udp(c->c2.link_sockets[i]->info.proto))
+        {
+            return "a TCP or unix socket";
+        }
+    }
+    if (dco_enabled(&c->options))
+    {
+        return "data channel offload";
+    }
+#if ENABLE_SERVER_SHARDS
+    if (m->shards)
+    {
+        return "--server-shards";
+    }
+#endif
+    if (c->options.shaper)
+    {
+        return "--shaper";
+    }
+    if (c->options.passtos)
+    {
+        return "--passtos";
+    }
+    if (c->options.ce.fragment)
+    {
+        return "--fragment";
+    }
+    if (c->options.block_ipv6)
+    {
+        return "--block-ipv6";
+    }
+#ifdef ENABLE_DEBUG
+    if (c->options.gremlin)
+    {
+        return "--gremlin";
+    }
+#endif
+    if (!c->c1.tuntap || c->c1.tuntap->backend_driver == DRIVER_AFUNIX)
+    {
+        return "this tun/tap backend";
+    }
+    return NULL;
+}
+
+/*
+ * Can the packets of mi go to the workers?
+ */
+static bool
+multi_crypto_usable(const struct multi_crypto *set, const struct multi_instance *mi)
+{
+    const struct context *c = &mi->context;
+
+    if (mi->halt || !c->c2.tls_multi || c->c2.tls_multi->multi_state < CAS_CONNECT_DONE)
+    {
+        return false;
+    }
+#ifdef USE_COMP
+    /* the decompressed packet would end up in the shared buffers */
+    if (c->c2.comp_context)
+    {
+        return false;
+    }
+#endif
+    return BUF_SIZE(&c->c2.frame) <= set->buf_size;
+}
+
+void
+multi_crypto_peer_free(struct multi_crypto_peer *peer)
+{
+    if (peer)
+    {
+        for (int i = 0; i < peer->n_copies; i++)
+        {
+            cipher_copy_free(&peer->copies[i].cc);
+        }
+        free(peer);
+    }
+}
+
+/*
+ * Return the cipher copy of mi for worker w and the direction dir, which
+ * may be replaced if no job uses it.
+ */
+static struct multi_crypto_copy *
+multi_crypto_copy_of(struct multi_crypto *set, struct multi_instance *mi, int w, int dir)
+{
+    if (!mi->crypto_peer)
+    {
+        const int n_copies = 2 * set->n_workers;
+        mi->crypto_peer = calloc(1, sizeof(struct multi_crypto_peer)
+                                        + n_copies * sizeof(struct multi_crypto_copy));
+        check_malloc_return(mi->crypto_peer);
+        mi->crypto_peer->n_copies = n_copies;
+    }
+
+    struct multi_crypto_copy *copy = &mi->crypto_peer->copies[2 * w + dir];
+    copy->cc.busy = copy->in_flight > 0;
+    return copy;
+}
+
+/*
+ * Take the next free job for a copy of the packet in buf, or return
+ * NULL if the packet has to be dropped.
+ */
+static struct multi_crypto_job *
+multi_crypto_job_new(struct multi_crypto *set, struct multi_instance *mi, bool from_link,
+                     const struct buffer *buf, struct link_socket *sock)
+{
+    if (set->tail - set->head >= MULTI_CRYPTO_QUEUE)
+    {
+        msg(D_MULTI_DROPPED, "MULTI: packet dropped due to output saturation (crypto workers)");
+        return NULL;
+    }
+
+    struct multi_crypto_job *job = &set->jobs[set->tail % MULTI_CRYPTO_QUEUE];
+    job->buf = job->data;
+    ASSERT(buf_init(&job->buf, mi->context.c2.frame.buf.headroom));
+    if (!buf_copy(&job->buf, buf))
+    {
+        msg(D_MULTI_DROPPED, "MULTI: packet too large for the crypto workers, dropped");
+        return NULL;
+    }
+
+    multi_instance_inc_refcount(mi);
+    job->mi = mi;
+    job->from_link = from_link;
+    job->sock = sock;
+    job->copy = NULL;
+    job->offload = false;
+    job->co = NULL;
+    job->ad_start = NULL;
+    atomic_store_explicit(&job->done, false, memory_order_relaxed);
+
+    return job;
+}
+
+/*
+ * Hand job to worker w, or, if there is nothing left for a worker to do,
+ * leave it for multi_crypto_retire() right away.
+ */
+static void
+multi_crypto_submit(struct multi_crypto *set, struct multi_crypto_job *job, int w)
+{
+    const unsigned int n = set->tail++;
+
+    if (!job->offload || job->buf.len <= 0)
+    {
+        job->offload = false;
+        atomic_store_explicit(&job->done, true, memory_order_relaxed);
+        return;
+    }
+
+    ++job->copy->in_flight;
+
+    struct multi_crypto_worker *worker = &set->workers[w];
+    const unsigned int tail = atomic_load_explicit(&worker->tail, memory_order_relaxed);
+    worker->ring[tail % MULTI_CRYPTO_QUEUE] = n;
+    /* sequentially consistent, so that either the worker sees the job
+     * before it goes to sleep or we see it sleeping */
+    atomic_store(&worker->tail, tail + 1);
+    if (atomic_load(&worker->sleeping))
+    {
+        pthread_mutex_lock(&worker->lock);
+        pthread_cond_signal(&worker->cond);
+        pthread_mutex_unlock(&worker->lock);
+    }
+}
+
+/*
+ * Pick the worker for the next job.
+ */
+static int
+multi_crypto_next_worker(struct multi_crypto *set)
+{
+    const int w = set->next_worker;
+    set->next_worker = (w + 1) % set->n_workers;
+    return w;
+}
+
+bool
+multi_crypto_link(struct multi_context *m, struct multi_instance *mi, struct link_socket *sock)
+{
+    struct multi_crypto *set = m->crypto;
+    const struct buffer *buf = &m->top.c2.buf;
+
+    if (!set || BLEN(buf) <= 0)
+    {
+        return false;
+    }
+
+    /* the control channel stays with the event loop */
+    const int op = *BPTR(buf) >> P_OPCODE_SHIFT;
+    if ((op != P_DATA_V1 && op != P_DATA_V2) || !multi_crypto_usable(set, mi))
+    {
+        return false;
+    }
+
+    struct multi_crypto_job *job = multi_crypto_job_new(set, mi, true, buf, sock);
+    if (!job)
+    {
+        return true;
+    }
+
+    struct context *c = &mi->context;
+    struct link_socket_info *lsi = &sock->info;
+    const int w = multi_crypto_next_worker(set);
+    struct gc_arena gc = gc_new();
+
+    set_prefix(mi);
+
+    c->c2.from = m->top.c2.from;
+    link_read_accounting(c, BLEN(&job->buf));
+
+    msg(D_LINK_RW, "%s READ [%d] from %s: %s", proto2ascii(lsi->proto, lsi->af, true),
+        BLEN(&job->buf), print_link_socket_actual(&c->c2.from, &gc), PROTO_DUMP(&job->buf, &gc));
+
+    if (!link_socket_verify_incoming_addr(&job->buf, lsi, &c->c2.from))
+    {
+        link_socket_bad_incoming_addr(&job->buf, lsi, &c->c2.from);
+    }
+
+    if (tls_pre_decrypt(c->c2.tls_multi, &c->c2.from, &job->buf, &job->co, false, &job->ad_start))
+    {
+        /* only data channel packets get here, but be safe */
+        job->buf.len = 0;
+    }
+
+    if (job->buf.len > 0)
+    {
+        struct multi_crypto_copy *copy =
+            multi_crypto_copy_of(set, mi, w, MULTI_CRYPTO_DECRYPT);
+
+        job->frame = c->c2.frame;
+        job->copy = copy;
+        job->offload = openvpn_decrypt_prepare(job->co, &job->buf, &copy->cc, &job->d);
+        if (!job->offload)
+        {
+            openvpn_decrypt(&job->buf, job->work, job->co, &c->c2.frame, job->ad_start);
+        }
+    }
+
+    clear_prefix();
+    gc_free(&gc);
+
+    multi_crypto_submit(set, job, w);
+    return true;
+}
+
+bool
+multi_crypto_tun(struct multi_context *m, struct multi_instance *mi)
+{
+    struct multi_crypto *set = m->crypto;
+    const struct buffer *buf = &m->top.c2.buf;
+
+    if (!set || BLEN(buf) <= 0 || !multi_crypto_usable(set, mi))
+    {
+        return false;
+    }
+
+    struct multi_crypto_job *job =
+        multi_crypto_job_new(set, mi, false, buf, mi->context.c2.link_sockets[0]);
+    if (!job)
+    {
+        return true;
+    }
+
+    struct context *c = &mi->context;
+    const int w = multi_crypto_next_worker(set);
+    struct multi_crypto_copy *copy = multi_crypto_copy_of(set, mi, w, MULTI_CRYPTO_ENCRYPT);
+
+    set_prefix(mi);
+
+    c->c2.tun_read_bytes += job->buf.len;
+    dmsg(D_TUN_RW, "TUN READ [%d]", BLEN(&job->buf));
+
+    /* the packet ID is reserved and the epoch key iterated here, so they
+     * stay in the order the packets are handed out */
+    process_ip_header(c, PIP_MSSFIX | PIPV4_CLIENT_NAT, &job->buf, job->sock);
+    encrypt_sign_prepare(c, &job->buf, &job->work, clear_buf(), &copy->cc, &job->e);
+    job->copy = copy;
+    job->offload = job->e.pending;
+
+    clear_prefix();
+
+    multi_crypto_submit(set, job, w);
+    return true;
+}
+
+/*
+ * The crypto of n jobs starting at position head of the ring of w.
+ * Runs in the worker thread.
+ */
+static void
+multi_crypto_batch(struct multi_crypto_worker *w, unsigned int head, unsigned int n)
+{
+    struct multi_crypto *set = w->set;
+    struct crypto_batch_packet decrypt[MULTI_CRYPTO_BUDGET];
+    struct crypto_batch_packet encrypt[MULTI_CRYPTO_BUDGET];
+    int n_decrypt = 0, n_encrypt = 0;
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        struct multi_crypto_job *job =
+            &set->jobs[w->ring[(head + i) % MULTI_CRYPTO_QUEUE] % MULTI_CRYPTO_QUEUE];
+        if (job->from_link)
+        {
+            decrypt[n_decrypt++] = (struct crypto_batch_packet){
+                .buf = &job->buf,
+                .work = job->work,
+                .d = &job->d,
+                .frame = &job->frame,
+                .ad_start = job->ad_start,
+            };
+        }
+        else
+        {
+            encrypt[n_encrypt++] = (struct crypto_batch_packet){
+                .buf = &job->buf,
+                .work = job->work,
+                .opt = &job->e.snap,
+            };
+        }
+    }
+    openvpn_decrypt_detached_batch(decrypt, n_decrypt);
+    openvpn_encrypt_batch(encrypt, n_encrypt);
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        struct multi_crypto_job *job =
+            &set->jobs[w->ring[(head + i) % MULTI_CRYPTO_QUEUE] % MULTI_CRYPTO_QUEUE];
+        if (!job->from_link)
+        {
+            encrypt_sign_detached_finish(&job->buf, &job->e);
+        }
+        atomic_store_explicit(&job->done, true, memory_order_release);
+    }
+
+    /* no logging here, msg() belongs to the event loop.  The pipe only
+     * fills up if the event loop is far behind, and then it wakes up
+     * anyway. */
+    if (!atomic_exchange(&set->wakeup_pending, true)
+        && write(set->wakeup_pipe[1], "x", 1) < 0)
+    {
+        atomic_store(&set->wakeup_pending, false);
+    }
+}
+
+static void *
+multi_crypto_thread(void *arg)
+{
+    struct multi_crypto_worker *w = arg;
+    struct multi_crypto *set = w->set;
+
+    while (true)
+    {
+        const unsigned int tail = atomic_load_explicit(&w->tail, memory_order_acquire);
+
+        if (tail == w->head)
+        {
+            pthread_mutex_lock(&w->lock);
+            atomic_store(&w->sleeping, true);
+            while (atomic_load(&w->tail) == w->head && !atomic_load(&set->stopping))
+            {
+                pthread_cond_wait(&w->cond, &w->lock);
+            }
+            atomic_store(&w->sleeping, false);
+            pthread_mutex_unlock(&w->lock);
+
+            if (atomic_load(&set->stopping))
+            {
+                break;
+            }
+            continue;
+        }
+
+        const unsigned int n = min_uint(tail - w->head, MULTI_CRYPTO_BUDGET);
+        multi_crypto_batch(w, w->head, n);
+        w->head += n;
+    }
+
+    return NULL;
+}
+
+/*
+ * Finish a packet from the socket: check it for replays, route it and
+ * write it to the tun/tap device.
+ */
+static void
+multi_crypto_link_finish(struct multi_context *m, struct multi_crypto_job *job)
+{
+    struct multi_instance *mi = job->mi;
+    struct context *c = &mi->context;
+
+    if (job->offload)
+    {
+        openvpn_decrypt_commit(job->co, &job->d, &job->buf);
+    }
+    if (job->buf.len <= 0)
+    {
+        return;
+    }
+
+    const bool occ = is_occ_msg(&job->buf);
+
+    /* the instance may have a packet of its own pending in there */
+    const struct buffer saved_buf = c->c2.buf;
+    const struct buffer saved_to_tun = c->c2.to_tun;
+
+    c->c2.buf = job->buf;
+    process_incoming_link_part2(c, &job->sock->info, NULL);
+    multi_route_incoming_link(m, mi);
+
+    struct buffer buf = c->c2.to_tun;
+    if (buf.len > 0)
+    {
+        process_ip_header(c, PIP_MSSFIX | PIPV4_EXTRACT_DHCP_ROUTER | PIPV4_CLIENT_NAT | PIP_OUTGOING,
+                          &buf, job->sock);
+        if (buf.len > c->c2.frame.buf.payload_size)
+        {
+            msg(D_LINK_ERRORS, "tun packet too large on write (tried=%d,max=%d)", buf.len,
+                c->c2.frame.buf.payload_size);
+            buf.len = 0;
+        }
+    }
+
+    c->c2.buf = saved_buf;
+    c->c2.to_tun = saved_to_tun;
+
+    if (buf.len > 0)
+    {
+        const int size = write_tun(m->top.c1.tuntap, BPTR(&buf), BLEN(&buf));
+        tun_write_accounting(c, BLEN(&buf), size);
+    }
+
+    /* an OCC request wants a reply, a signal wants the instance closed */
+    if (occ || IS_SIG(c))
+    {
+        multi_schedule_instance_now(m, mi);
+    }
+}
+
+/*
+ * Finish a packet from the tun/tap device: send it.
+ */
+static void
+multi_crypto_tun_finish(struct multi_crypto_job *job)
+{
+    struct context *c = &job->mi->context;
+
+    if (job->buf.len > 0)
+    {
+        const int len = BLEN(&job->buf);
+        const int size = (int)link_socket_write_udp_direct(job->sock, &job->buf, &job->e.to);
+
+        link_write_detached_accounting(c, job->sock, &job->e, &job->copy->cc, len, size, errno);
+    }
+}
+
+void
+multi_crypto_retire(struct multi_context *m)
+{
+    struct multi_crypto *set = m->crypto;
+    char buf[64];
+
+    if (!set)
+    {
+        return;
+    }
+
+    while (read(set->wakeup_pipe[0], buf, sizeof(buf)) > 0)
+    {
+    }
+    atomic_store(&set->wakeup_pending, false);
+
+    while (set->head != set->tail)
+    {
+        struct multi_crypto_job *job = &set->jobs[set->head % MULTI_CRYPTO_QUEUE];
+        if (!atomic_load_explicit(&job->done, memory_order_acquire))
+        {
+            break;
+        }
+
+        struct multi_instance *mi = job->mi;
+        if (!mi->halt)
+        {
+            set_prefix(mi);
+            if (job->from_link)
+            {
+                multi_crypto_link_finish(m, job);
+            }
+            else
+            {
+                multi_crypto_tun_finish(job);
+            }
+            clear_prefix();
+        }
+
+        if (job->offload)
+        {
+            --job->copy->in_flight;
+        }
+        multi_instance_dec_refcount(mi);
+        job->mi = NULL;
+        ++set->head;
+    }
+}
+
+void
+multi_crypto_init(struct multi_context *m)
+{
+    struct multi_crypto *set;
+    const int n_workers = m->top.options.server_crypto_threads;
+
+    if (n_workers < 1)
+    {
+        return;
+    }
+
+    const char *unsupported = multi_crypto_unsupported(m);
+    if (unsupported)
+    {
+        msg(M_WARN, "NOTE: --server-crypto-threads is not used with %s, the event loop does "
+                    "the crypto",
+            unsupported);
+        return;
+    }
+
+    ALLOC_OBJ_CLEAR(set, struct multi_crypto);
+    set->m = m;
+    set->buf_size = BUF_SIZE(&m->top.c2.frame);
+    set->n_workers = n_workers;
+    ALLOC_ARRAY_CLEAR(set->workers, struct multi_crypto_worker, n_workers);
+    if (pipe(set->wakeup_pipe) < 0)
+    {
+        msg(M_ERR, "ERROR: cannot create pipe for crypto workers");
+    }
+    set_nonblock(set->wakeup_pipe[0]);
+    set_nonblock(set->wakeup_pipe[1]);
+    set_cloexec(set->wakeup_pipe[0]);
+    set_cloexec(set->wakeup_pipe[1]);
+
+    for (int j = 0; j < MULTI_CRYPTO_QUEUE; j++)
+    {
+        set->jobs[j].data = alloc_buf(set->buf_size);
+        set->jobs[j].work = alloc_buf(set->buf_size);
+    }
+
+    m->crypto = set;
+
+    for (int i = 0; i < n_workers; i++)
+    {
+        struct multi_crypto_worker *w = &set->workers[i];
+        w->set = set;
+        w->index = i;
+        pthread_mutex_init(&w->lock, NULL);
+        pthread_cond_init(&w->cond, NULL);
+
+        if (platform_thread_create(&w->thread, multi_crypto_thread, w) != 0)
+        {
+            msg(M_ERR, "ERROR: cannot start crypto worker %d", i);
+        }
+        w->started = true;
+    }
+
+    msg(M_INFO, "MULTI: running the data channel crypto on %d worker threads", n_workers);
+}
+
+void
+multi_crypto_free(struct multi_context *m)
+{
+    struct multi_crypto *set = m->crypto;
+
+    if (!set)
+    {
+        return;
+    }
+
+    atomic_store(&set->stopping, true);
+    for (int i = 0; i < set->n_workers; i++)
+    {
+        struct multi_crypto_worker *w = &set->workers[i];
+        pthread_mutex_lock(&w->lock);
+        pthread_cond_signal(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+
+    for (int i = 0; i < set->n_workers; i++)
+    {
+        struct multi_crypto_worker *w = &set->workers[i];
+        if (w->started)
+        {
+            pthread_join(w->thread, NULL);
+        }
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->lock);
+    }
+
+    /* drop the packets still in flight */
+    for (unsigned int j = set->head; j != set->tail; j++)
+    {
+        struct multi_crypto_job *job = &set->jobs[j % MULTI_CRYPTO_QUEUE];
+        if (job->offload)
+        {
+            --job->copy->in_flight;
+        }
+        multi_instance_dec_refcount(job->mi);
+    }
+    for (int j = 0; j < MULTI_CRYPTO_QUEUE; j++)
+    {
+        free_buf(&set->jobs[j].data);
+        free_buf(&set->jobs[j].work);
+    }
+
+    close(set->wakeup_pipe[0]);
+    close(set->wakeup_pipe[1]);
+    free(set->workers);
+    free(set);
+    m->crypto = NULL;
+}
+
+void
+multi_crypto_event_set(struct multi_context *m, struct event_set *es, void *arg)
+{
+    if (m->crypto)
+    {
+        event_ctl(es, m->crypto->wakeup_pipe[0], EVENT_READ, arg);
+    }
+}
+
+#endif /* ENABLE_SERVER_CRYPTO_THREADS */
@@ -0,0 +1,105 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Data channel crypto workers for --mode server over UDP
+ * (--server-crypto-threads).
+ *
+ * Unlike --server-shards, the event loop keeps doing all of the data
+ * channel work except for the cipher itself.  For a data channel packet
+ * of an established client it picks the key, reserves the packet ID and
+ * copies the packet into the next free job, then hands the job to the
+ * next worker in turn through a ring that only the event loop writes and
+ * only that worker reads.  The worker runs the cipher on a private copy
+ * of the key, several packets of a client in one go, and marks the jobs
+ * done.
+ *
+ * The event loop retires the jobs in the order it handed them out: it
+ * checks received packets for replays and routes them, and writes the
+ * packets to the tun/tap device or the socket.  So the packets of a
+ * client leave in the order they arrived, even when they were spread
+ * over several workers, and the replay windows, the epoch keys and the
+ * rest of the client state are only ever touched by the event loop.
+ */
+
+#ifndef MCRYPTO_H
+#define MCRYPTO_H
+
+#if ENABLE_SERVER_CRYPTO_THREADS
+
+#define MULTI_CRYPTO_THREADS_MAX 64
+
+struct multi_context;
+struct multi_instance;
+struct multi_crypto_peer;
+struct event_set;
+struct link_socket;
+
+/**
+ * Start the crypto workers requested by --server-crypto-threads, if the
+ * configuration allows it.
+ */
+void multi_crypto_init(struct multi_context *m);
+
+/**
+ * Stop the crypto workers.  Packets still in flight are dropped.
+ */
+void multi_crypto_free(struct multi_context *m);
+
+/**
+ * Hand the packet in \c m->top.c2.buf, which was read from \a sock, to
+ * a crypto worker.
+ *
+ * @return true if a worker took the packet (or it was dropped because
+ *     all jobs are in use), false if the event loop has to process it.
+ */
+bool multi_crypto_link(struct multi_context *m, struct multi_instance *mi,
+                       struct link_socket *sock);
+
+/**
+ * Hand the packet in \c m->top.c2.buf, which was read from the tun/tap
+ * device and routed to \a mi, to a crypto worker.
+ *
+ * @return true if a worker took the packet (or it was dropped because
+ *     all jobs are in use), false if the event loop has to process it.
+ */
+bool multi_crypto_tun(struct multi_context *m, struct multi_instance *mi);
+
+/**
+ * Add the pipe the workers wake up the event loop with to the event set.
+ */
+void multi_crypto_event_set(struct multi_context *m, struct event_set *es, void *arg);
+
+/**
+ * Finish the packets the workers are done with, in order.  Called when
+ * the workers woke up the event loop, and before it goes to sleep.
+ */
+void multi_crypto_retire(struct multi_context *m);
+
+/**
+ * Free the cipher copies the workers used for a client.
+ */
+void multi_crypto_peer_free(struct multi_crypto_peer *peer);
+
+#endif /* ENABLE_SERVER_CRYPTO_THREADS */
+
+#endif /* MCRYPTO_H */
@@ -0,0 +1,408 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "syshead.h"
+
+#if ENABLE_SERVER_PROCESSES
+
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+
+#include "multi.h"
+#include "fdmisc.h"
+#include "ssl_pkt.h"
+#include "mproc.h"
+
+#include "memdbg.h"
+
+/*
+ * The steering program needs eBPF socket arrays (Linux 4.19).  Without
+ * them, the kernel spreads the packets by the hash of their addresses,
+ * and a client that floats may end up at the wrong process.
+ */
+#if defined(SO_ATTACH_REUSEPORT_EBPF) && defined(__NR_bpf)
+#define MPROC_STEER 1
+#else
+#define MPROC_STEER 0
+#endif
+
+static int mproc_n = 1;
+static int mproc_k = 0;
+static pid_t mproc_pids[MPROC_MAX];
+
+/* sibling k reads what the others send to mproc_tx[k] from mproc_rx */
+static int mproc_rx = -1;
+static int mproc_tx[MPROC_MAX];
+
+/* set while a packet passed on by a sibling is routed */
+static bool mproc_from_sibling;
+
+#if MPROC_STEER
+static int mproc_map_fd = -1;
+static int mproc_prog_fd = -1;
+
+static int
+mproc_bpf(int cmd, union bpf_attr *attr)
+{
+    return (int)syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+/*
+ * Load the program that picks the socket of a packet:
+ *
+ *   if the packet is P_DATA_V2:
+ *       key = peer-id % n
+ *   else:
+ *       key = hash of the addresses % n
+ *   sk_select_reuseport(ctx, map, &key, 0)
+ *
+ * If the selected process has no socket in the map (it is restarting),
+ * the kernel falls back to its own choice.
+ */
+static int
+mproc_bpf_prog(int map_fd, int n)
+{
+#define INSN(c, d, s, o, i) \
+    (struct bpf_insn) { .code = (c), .dst_reg = (d), .src_reg = (s), .off = (o), .imm = (i) }
+
+    const struct bpf_insn prog[] = {
+        /* r6 = ctx */
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_6, BPF_REG_1, 0, 0),
+        /* r0 = skb_load_bytes(ctx, 8, fp - 8, 4): the first word after the UDP header */
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_2, 0, 0, 8),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_3, BPF_REG_10, 0, 0),
+        INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_3, 0, 0, -8),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_4, 0, 0, 4),
+        INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_skb_load_bytes),
+        INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_0, 0, 7, 0),
+        /* r0 = ntohl(word), r1 = opcode */
+        INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_0, BPF_REG_10, -8, 0),
+        INSN(BPF_ALU | BPF_END | BPF_TO_BE, BPF_REG_0, 0, 0, 32),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, BPF_REG_0, 0, 0),
+        INSN(BPF_ALU | BPF_RSH | BPF_K, BPF_REG_1, 0, 0, P_OPCODE_SHIFT + 24),
+        INSN(BPF_JMP | BPF_JNE | BPF_K, BPF_REG_1, 0, 2, P_DATA_V2),
+        /* r0 = peer-id */
+        INSN(BPF_ALU | BPF_AND | BPF_K, BPF_REG_0, 0, 0, 0xffffff),
+        INSN(BPF_JMP | BPF_JA, 0, 0, 1, 0),
+        /* r0 = ctx->hash */
+        INSN(BPF_LDX | BPF_MEM | BPF_W, BPF_REG_0, BPF_REG_6,
+             offsetof(struct sk_reuseport_md, hash), 0),
+        /* key = r0 % n */
+        INSN(BPF_ALU | BPF_MOD | BPF_K, BPF_REG_0, 0, 0, n),
+        INSN(BPF_STX | BPF_MEM | BPF_W, BPF_REG_10, BPF_REG_0, -4, 0),
+        /* sk_select_reuseport(ctx, map, fp - 4, 0) */
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, BPF_REG_6, 0, 0),
+        INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_2, BPF_PSEUDO_MAP_FD, 0, map_fd),
+        INSN(0, 0, 0, 0, 0),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_3, BPF_REG_10, 0, 0),
+        INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_3, 0, 0, -4),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_4, 0, 0, 0),
+        INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_sk_select_reuseport),
+        INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, SK_PASS),
+        INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+    };
+#undef INSN
+
+    union bpf_attr attr;
+    CLEAR(attr);
+    attr.prog_type = BPF_PROG_TYPE_SK_REUSEPORT;
+    attr.insns = (uintptr_t)prog;
+    attr.insn_cnt = SIZE(prog);
+    attr.license = (uintptr_t) "GPL";
+    return mproc_bpf(BPF_PROG_LOAD, &attr);
+}
+
+static void
+mproc_steer_init(int n)
+{
+    union bpf_attr attr;
+    CLEAR(attr);
+    attr.map_type = BPF_MAP_TYPE_REUSEPORT_SOCKARRAY;
+    attr.key_size = sizeof(uint32_t);
+    attr.value_size = sizeof(uint64_t);
+    attr.max_entries = n;
+
+    mproc_map_fd = mproc_bpf(BPF_MAP_CREATE, &attr);
+    if (mproc_map_fd < 0)
+    {
+        msg(M_WARN | M_ERRNO, "WARNING: --server-processes: cannot create the socket map, "
+                              "clients that float may lose their session");
+        return;
+    }
+
+    mproc_prog_fd = mproc_bpf_prog(mproc_map_fd, n);
+    if (mproc_prog_fd < 0)
+    {
+        msg(M_WARN | M_ERRNO, "WARNING: --server-processes: cannot load the steering program, "
+                              "clients that float may lose their session");
+        close(mproc_map_fd);
+        mproc_map_fd = -1;
+        return;
+    }
+
+    set_cloexec(mproc_map_fd);
+    set_cloexec(mproc_prog_fd);
+}
+#endif /* MPROC_STEER */
+
+void
+mproc_fork(const struct options *o)
+{
+    const int n = o->server_processes;
+    int pairs[MPROC_MAX][2];
+
+    if (n <= 1)
+    {
+        return;
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (socketpair(AF_UNIX, SOCK_DGRAM, 0, pairs[i]) < 0)
+        {
+            msg(M_ERR, "--server-processes: socketpair failed");
+        }
+    }
+
+#if MPROC_STEER
+    mproc_steer_init(n);
+#endif
+
+    const pid_t parent = getpid();
+    for (int i = 1; i < n; ++i)
+    {
+        const pid_t pid = fork();
+        if (pid < 0)
+        {
+            msg(M_ERR, "--server-processes: fork failed");
+        }
+        else if (pid == 0)
+        {
+            /* go down with the first process */
+            prctl(PR_SET_PDEATHSIG, SIGTERM);
+            if (getppid() != parent)
+            {
+                openvpn_exit(OPENVPN_EXIT_STATUS_GOOD); /* exit point */
+            }
+            mproc_k = i;
+            break;
+        }
+        mproc_pids[i] = pid;
+    }
+    mproc_n = n;
+
+    for (int i = 0; i < n; ++i)
+    {
+        if (i == mproc_k)
+        {
+            mproc_rx = pairs[i][0];
+            close(pairs[i][1]);
+            mproc_tx[i] = -1;
+        }
+        else
+        {
+            close(pairs[i][0]);
+            mproc_tx[i] = pairs[i][1];
+            set_nonblock(mproc_tx[i]);
+            set_cloexec(mproc_tx[i]);
+        }
+    }
+    set_nonblock(mproc_rx);
+    set_cloexec(mproc_rx);
+
+    msg(M_INFO, "Server process %d of %d, pid %d", mproc_k, mproc_n, (int)getpid());
+}
+
+static const char *
+mproc_suffix(const char *file, struct gc_arena *gc)
+{
+    if (!file)
+    {
+        return NULL;
+    }
+    struct buffer out = alloc_buf_gc(strlen(file) + 16, gc);
+    buf_printf(&out, "%s.%d", file, mproc_k);
+    return BSTR(&out);
+}
+
+void
+mproc_options(struct options *o)
+{
+    if (mproc_n <= 1)
+    {
+        return;
+    }
+
+    o->tuntap_options.multi_queue = true;
+    /* every instance starts from the saved tun/tap options */
+    if (o->pre_connect)
+    {
+        o->pre_connect->tuntap_options.multi_queue = true;
+    }
+
+    if (mproc_k > 0)
+    {
+        o->management_addr = NULL;
+        o->ifconfig_noexec = true;
+        o->route_noexec = true;
+        o->up_script = NULL;
+        o->down_script = NULL;
+        o->route_script = NULL;
+        o->route_predown_script = NULL;
+        o->status_file = mproc_suffix(o->status_file, &o->gc);
+        o->ifconfig_pool_persist_filename =
+            mproc_suffix(o->ifconfig_pool_persist_filename, &o->gc);
+    }
+}
+
+void
+mproc_signal(int signum)
+{
+    if (mproc_n <= 1 || mproc_k != 0)
+    {
+        return;
+    }
+
+    for (int i = 1; i < mproc_n; ++i)
+    {
+        if (kill(mproc_pids[i], signum) < 0)
+        {
+            msg(M_WARN | M_ERRNO, "--server-processes: cannot signal process %d (pid %d)", i,
+                (int)mproc_pids[i]);
+        }
+    }
+}
+
+int
+mproc_index(void)
+{
+    return mproc_k;
+}
+
+int
+mproc_count(void)
+{
+    return mproc_n;
+}
+
+void
+mproc_socket_reuseport(socket_descriptor_t sd)
+{
+    int on = 1;
+    if (setsockopt(sd, SOL_SOCKET, SO_REUSEPORT, (void *)&on, sizeof(on)) < 0)
+    {
+        msg(M_ERR, "UDP: failed setsockopt for SO_REUSEPORT");
+    }
+}
+
+void
+mproc_socket_steer(socket_descriptor_t sd)
+{
+#if MPROC_STEER
+    if (mproc_prog_fd < 0)
+    {
+        return;
+    }
+
+    union bpf_attr attr;
+    uint32_t key = mproc_k;
+    uint64_t value = sd;
+    CLEAR(attr);
+    attr.map_fd = mproc_map_fd;
+    attr.key = (uintptr_t)&key;
+    attr.value = (uintptr_t)&value;
+    attr.flags = BPF_ANY;
+    if (mproc_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0)
+    {
+        msg(M_WARN | M_ERRNO, "WARNING: --server-processes: cannot add the socket to the map");
+        return;
+    }
+
+    if (setsockopt(sd, SOL_SOCKET, SO_ATTACH_REUSEPORT_EBPF, (void *)&mproc_prog_fd,
+                   sizeof(mproc_prog_fd))
+        < 0)
+    {
+        msg(M_WARN | M_ERRNO, "WARNING: --server-processes: cannot attach the steering program");
+    }
+#endif /* MPROC_STEER */
+}
+
+void
+mproc_tun_unrouted(struct multi_context *m)
+{
+    const struct buffer *buf = &m->top.c2.buf;
+
+    if (mproc_n <= 1 || mproc_from_sibling || BLEN(buf) <= 0)
+    {
+        return;
+    }
+
+    for (int i = 0; i < mproc_n; ++i)
+    {
+        /* a sibling that is busy loses the packet, like a full tun/tap queue would */
+        if (i != mproc_k && send(mproc_tx[i], BPTR(buf), BLEN(buf), MSG_DONTWAIT) < 0
+            && errno != EAGAIN && errno != EWOULDBLOCK)
+        {
+            msg(D_MULTI_ERRORS | M_ERRNO, "MULTI: cannot pass a packet on to process %d", i);
+        }
+    }
+}
+
+void
+mproc_event_set(struct event_set *es, void *arg)
+{
+    if (mproc_rx >= 0)
+    {
+        event_ctl(es, mproc_rx, EVENT_READ, arg);
+    }
+}
+
+void
+mproc_process_sibling(struct multi_context *m, const unsigned int mpp_flags)
+{
+    struct context *c = &m->top;
+
+    c->c2.buf = c->c2.buffers->read_tun_buf;
+    ASSERT(buf_init(&c->c2.buf, c->c2.frame.buf.headroom));
+    ASSERT(buf_safe(&c->c2.buf, c->c2.frame.buf.payload_size));
+
+    const ssize_t len =
+        recv(mproc_rx, BPTR(&c->c2.buf), c->c2.frame.buf.payload_size, MSG_DONTWAIT);
+    if (len <= 0)
+    {
+        c->c2.buf.len = 0;
+        return;
+    }
+    c->c2.buf.len = (int)len;
+
+    mproc_from_sibling = true;
+    multi_process_incoming_tun(m, mpp_flags);
+    mproc_from_sibling = false;
+}
+
+#endif /* ENABLE_SERVER_PROCESSES */
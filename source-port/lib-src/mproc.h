@@ -0,0 +1,119 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Sibling server processes for --mode server over UDP
+ * (--server-processes).
+ *
+ * The first process forks the others right after startup, and each one
+ * then runs a complete server of its own:
+ *
+ *   - its UDP socket is bound to the shared port with SO_REUSEPORT.  A
+ *     steering program attached to the group sends a P_DATA_V2 packet
+ *     to the process its peer-id belongs to, and every other packet to
+ *     the process picked by the hash of its source address, so a client
+ *     always talks to the same process, even after it floated;
+ *
+ *   - process k hands out the peer-ids p with p % n == k and the pool
+ *     addresses with index i % n == k;
+ *
+ *   - all processes attach one queue of a multi-queue tun/tap device,
+ *     which the first one configures.  The kernel sends the replies of
+ *     a flow to the queue that wrote it.  A packet that arrives on the
+ *     queue of a process that has no client for it is passed on to the
+ *     siblings over a datagram socket, and dropped if they cannot route
+ *     it either.
+ *
+ * Only the first process runs the management interface, the --up and
+ * --down scripts and configures the device; the siblings append their
+ * number to the --status and --ifconfig-pool-persist files.
+ */
+
+#ifndef MPROC_H
+#define MPROC_H
+
+#if ENABLE_SERVER_PROCESSES
+
+#define MPROC_MAX 64
+
+struct options;
+struct multi_context;
+struct event_set;
+
+/**
+ * Fork the sibling processes requested by --server-processes.  Called
+ * once at startup, before any socket or device is opened.
+ */
+void mproc_fork(const struct options *o);
+
+/**
+ * Adjust freshly parsed options to the role of this process.
+ */
+void mproc_options(struct options *o);
+
+/**
+ * Pass a signal that ended the tunnel on to the siblings, if this is
+ * the first process.
+ */
+void mproc_signal(int signum);
+
+/**
+ * Number of this process, 0 .. \c mproc_count() - 1.
+ */
+int mproc_index(void);
+
+/**
+ * Number of server processes, 1 if --server-processes is not used.
+ */
+int mproc_count(void);
+
+/**
+ * Set SO_REUSEPORT on a server socket before it is bound.
+ */
+void mproc_socket_reuseport(socket_descriptor_t sd);
+
+/**
+ * Make the bound server socket \a sd the one the steering program
+ * picks for this process.
+ */
+void mproc_socket_steer(socket_descriptor_t sd);
+
+/**
+ * Pass the packet in \c m->top.c2.buf, which was read from the tun/tap
+ * device and which this process cannot route, on to the siblings.
+ */
+void mproc_tun_unrouted(struct multi_context *m);
+
+/**
+ * Add the socket the siblings pass packets on to to the event set.
+ */
+void mproc_event_set(struct event_set *es, void *arg);
+
+/**
+ * Process a packet passed on by a sibling like one read from the
+ * tun/tap device.
+ */
+void mproc_process_sibling(struct multi_context *m, const unsigned int mpp_flags);
+
+#endif /* ENABLE_SERVER_PROCESSES */
+
+#endif /* MPROC_H */
@@ -30,6 +30,7 @@
 #include "mroute.h"
 #include "proto.h"
 #include "error.h"
+#include "integer.h"
 #include "socket.h"
 
 #include "memdbg.h"
@@ -473,82 +474,267 @@ mroute_addr_print_ex(const struct mroute_addr *ma, const unsigned int flags, str
 }
 
 /*
- * mroute_helper's main job is keeping track of
- * currently used CIDR netlengths, so we don't
- * have to cycle through all 33.
+ * mroute_helper's main job is keeping the CIDR routes in a path
+ * compressed binary trie per address family, so that the route of a
+ * host is found by walking at most one node per prefix length in use,
+ * instead of probing the route hash table once per prefix length.
  */
 
-struct mroute_helper *
-mroute_helper_init(int ageable_ttl_secs)
+struct mroute_lpm_node
 {
-    struct mroute_helper *mh;
-    ALLOC_OBJ_CLEAR(mh, struct mroute_helper);
-    mh->ageable_ttl_secs = ageable_ttl_secs;
-    return mh;
+    struct mroute_lpm_node *child[2];
+    void *route;     /* NULL if this node only joins two subtrees */
+    uint8_t netbits; /* length of prefix */
+    uint8_t prefix[16];
+};
+
+static inline int
+mroute_lpm_bit(const uint8_t *key, int i)
+{
+    return (key[i >> 3] >> (7 - (i & 7))) & 1;
+}
+
+/*
+ * Number of leading bits, up to max, that a and b have in common.
+ */
+static int
+mroute_lpm_common(const uint8_t *a, const uint8_t *b, int max)
+{
+    int i = 0;
+    while (i + 8 <= max && a[i >> 3] == b[i >> 3])
+    {
+        i += 8;
+    }
+    while (i < max && mroute_lpm_bit(a, i) == mroute_lpm_bit(b, i))
+    {
+        ++i;
+    }
+    return i;
+}
+
+static struct mroute_lpm_node *
+mroute_lpm_node_new(const uint8_t *key, int netbits, void *route)
+{
+    struct mroute_lpm_node *n;
+    ALLOC_OBJ_CLEAR(n, struct mroute_lpm_node);
+    n->route = route;
+    n->netbits = (uint8_t)netbits;
+    memcpy(n->prefix, key, (netbits + 7) >> 3);
+    if (netbits & 7)
+    {
+        n->prefix[netbits >> 3] &= (uint8_t)(0xff << (8 - (netbits & 7)));
+    }
+    return n;
 }
 
 static void
-mroute_helper_regenerate(struct mroute_helper *mh)
+mroute_lpm_free(struct mroute_lpm_node *n)
 {
-    int i, j = 0;
-    for (i = MR_HELPER_NET_LEN - 1; i >= 0; --i)
+    if (n)
     {
-        if (mh->net_len_refcount[i] > 0)
+        mroute_lpm_free(n->child[0]);
+        mroute_lpm_free(n->child[1]);
+        free(n);
+    }
+}
+
+static void *
+mroute_lpm_insert(struct mroute_lpm_node **link, const uint8_t *key, int netbits, void *route)
+{
+    struct mroute_lpm_node *n;
+
+    while ((n = *link))
+    {
+        const int common = mroute_lpm_common(n->prefix, key, min_int(n->netbits, netbits));
+        if (common < n->netbits)
+        {
+            /* the new prefix diverges from n, or is shorter than it */
+            struct mroute_lpm_node *branch;
+            if (common == netbits)
+            {
+                branch = mroute_lpm_node_new(key, netbits, route);
+            }
+            else
+            {
+                branch = mroute_lpm_node_new(key, common, NULL);
+                branch->child[mroute_lpm_bit(key, common)] =
+                    mroute_lpm_node_new(key, netbits, route);
+            }
+            branch->child[mroute_lpm_bit(n->prefix, common)] = n;
+            *link = branch;
+            return NULL;
+        }
+        if (n->netbits == netbits)
         {
-            mh->net_len[j++] = (uint8_t)i;
+            void *old = n->route;
+            n->route = route;
+            return old;
         }
+        link = &n->child[mroute_lpm_bit(key, n->netbits)];
+    }
+    *link = mroute_lpm_node_new(key, netbits, route);
+    return NULL;
+}
+
+/*
+ * Unlink a node that holds no route and has at most one child.
+ */
+static void
+mroute_lpm_collapse(struct mroute_lpm_node **link)
+{
+    struct mroute_lpm_node *n = *link;
+    if (n && !n->route && !(n->child[0] && n->child[1]))
+    {
+        *link = n->child[0] ? n->child[0] : n->child[1];
+        free(n);
     }
-    mh->n_net_len = j;
+}
 
-#ifdef ENABLE_DEBUG
-    if (check_debug_level(D_MULTI_DEBUG))
+static void
+mroute_lpm_remove(struct mroute_lpm_node **link, const uint8_t *key, int netbits,
+                  const void *route)
+{
+    struct mroute_lpm_node **parent = NULL;
+    struct mroute_lpm_node *n;
+
+    while ((n = *link) && n->netbits <= netbits
+           && mroute_lpm_common(n->prefix, key, n->netbits) == n->netbits)
     {
-        struct gc_arena gc = gc_new();
-        struct buffer out = alloc_buf_gc(256, &gc);
-        buf_printf(&out, "MROUTE CIDR netlen:");
-        for (i = 0; i < mh->n_net_len; ++i)
+        if (n->netbits == netbits)
         {
-            buf_printf(&out, " /%d", mh->net_len[i]);
+            if (n->route == route)
+            {
+                n->route = NULL;
+                mroute_lpm_collapse(link);
+                if (parent)
+                {
+                    mroute_lpm_collapse(parent);
+                }
+            }
+            return;
         }
-        dmsg(D_MULTI_DEBUG, "%s", BSTR(&out));
-        gc_free(&gc);
+        parent = link;
+        link = &n->child[mroute_lpm_bit(key, n->netbits)];
     }
-#endif
 }
 
-void
-mroute_helper_add_iroute46(struct mroute_helper *mh, int netbits)
+static void *
+mroute_lpm_lookup(const struct mroute_lpm_node *n, const uint8_t *key, int maxbits,
+                  bool (*usable)(const void *route, const void *arg), const void *arg)
 {
-    if (netbits >= 0)
+    void *found[MR_HELPER_NET_LEN];
+    int n_found = 0;
+
+    while (n && n->netbits <= maxbits
+           && mroute_lpm_common(n->prefix, key, n->netbits) == n->netbits)
     {
-        ASSERT(netbits < MR_HELPER_NET_LEN);
-        ++mh->cache_generation;
-        ++mh->net_len_refcount[netbits];
-        if (mh->net_len_refcount[netbits] == 1)
+        if (n->route)
+        {
+            found[n_found++] = n->route;
+        }
+        if (n->netbits == maxbits)
+        {
+            break;
+        }
+        n = n->child[mroute_lpm_bit(key, n->netbits)];
+    }
+
+    /* longest prefix first, skip the routes of dying instances */
+    while (n_found > 0)
+    {
+        void *route = found[--n_found];
+        if (usable(route, arg))
         {
-            mroute_helper_regenerate(mh);
+            return route;
         }
     }
+    return NULL;
+}
+
+/*
+ * Select the trie and key bits of addr.
+ */
+static struct mroute_lpm_node **
+mroute_helper_trie(struct mroute_helper *mh, const struct mroute_addr *addr,
+                   const uint8_t **key, int *maxbits)
+{
+    switch (addr->type & MR_ADDR_MASK)
+    {
+        case MR_ADDR_IPV4:
+            *key = (const uint8_t *)&addr->v4.addr;
+            *maxbits = 32;
+            return &mh->lpm4;
+
+        case MR_ADDR_IPV6:
+            *key = addr->v6.addr.s6_addr;
+            *maxbits = 128;
+            return &mh->lpm6;
+
+        default:
+            return NULL;
+    }
+}
+
+struct mroute_helper *
+mroute_helper_init(int ageable_ttl_secs)
+{
+    struct mroute_helper *mh;
+    ALLOC_OBJ_CLEAR(mh, struct mroute_helper);
+    mh->ageable_ttl_secs = ageable_ttl_secs;
+    return mh;
+}
+
+void
+mroute_helper_add_iroute46(struct mroute_helper *mh, const struct mroute_addr *addr, void *route)
+{
+    const uint8_t *key;
+    int maxbits;
+    struct mroute_lpm_node **root = mroute_helper_trie(mh, addr, &key, &maxbits);
+
+    if (root && (addr->type & MR_WITH_NETBITS) && addr->netbits <= maxbits)
+    {
+        ++mh->cache_generation;
+        mroute_lpm_insert(root, key, addr->netbits, route);
+    }
 }
 
 void
-mroute_helper_del_iroute46(struct mroute_helper *mh, int netbits)
+mroute_helper_del_iroute46(struct mroute_helper *mh, const struct mroute_addr *addr,
+                           const void *route)
 {
-    if (netbits >= 0)
+    const uint8_t *key;
+    int maxbits;
+    struct mroute_lpm_node **root = mroute_helper_trie(mh, addr, &key, &maxbits);
+
+    if (root && (addr->type & MR_WITH_NETBITS) && addr->netbits <= maxbits)
     {
-        ASSERT(netbits < MR_HELPER_NET_LEN);
         ++mh->cache_generation;
-        --mh->net_len_refcount[netbits];
-        ASSERT(mh->net_len_refcount[netbits] >= 0);
-        if (!mh->net_len_refcount[netbits])
-        {
-            mroute_helper_regenerate(mh);
-        }
+        mroute_lpm_remove(root, key, addr->netbits, route);
+    }
+}
+
+void *
+mroute_helper_lookup(struct mroute_helper *mh, const struct mroute_addr *addr,
+                     bool (*usable)(const void *route, const void *arg), const void *arg)
+{
+    const uint8_t *key;
+    int maxbits;
+    struct mroute_lpm_node **root = mroute_helper_trie(mh, addr, &key, &maxbits);
+
+    if (!root)
+    {
+        return NULL;
     }
+    return mroute_lpm_lookup(*root, key, maxbits, usable, arg);
 }
 
 void
 mroute_helper_free(struct mroute_helper *mh)
 {
-    free(mh);
+    if (mh)
+    {
+        mroute_lpm_free(mh->lpm4);
+        mroute_lpm_free(mh->lpm6);
+        free(mh);
+    }
 }
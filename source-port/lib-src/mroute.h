@@ -121,16 +121,17 @@ static_assert(offsetof(struct mroute_addr, v4mappedv6.addr)
  */
 #define MR_HELPER_NET_LEN 129
 
+struct mroute_lpm_node;
+
 /*
  * Used to help maintain CIDR routing table.
  */
 struct mroute_helper
 {
-    unsigned int cache_generation;           /* incremented when route added */
-    int ageable_ttl_secs;                    /* host route cache entry time-to-live*/
-    int n_net_len;                           /* length of net_len array */
-    uint8_t net_len[MR_HELPER_NET_LEN];      /* CIDR netlengths in descending order */
-    int net_len_refcount[MR_HELPER_NET_LEN]; /* refcount of each netlength */
+    unsigned int cache_generation;  /* incremented when route added */
+    int ageable_ttl_secs;           /* host route cache entry time-to-live*/
+    struct mroute_lpm_node *lpm4;   /* IPv4 CIDR routes, longest prefix match */
+    struct mroute_lpm_node *lpm6;   /* IPv6 CIDR routes, longest prefix match */
 };
 
 struct openvpn_sockaddr;
@@ -161,9 +162,27 @@ struct mroute_helper *mroute_helper_init(int ageable_ttl_secs);
 
 void mroute_helper_free(struct mroute_helper *mh);
 
-void mroute_helper_add_iroute46(struct mroute_helper *mh, int netbits);
+/**
+ * Add the CIDR route \a addr, an IPv4 or IPv6 address with
+ * MR_WITH_NETBITS set, to the prefix table, or replace the \a route
+ * stored for it.
+ */
+void mroute_helper_add_iroute46(struct mroute_helper *mh, const struct mroute_addr *addr,
+                                void *route);
 
-void mroute_helper_del_iroute46(struct mroute_helper *mh, int netbits);
+/**
+ * Remove the CIDR route \a addr from the prefix table, if \a route is
+ * what is stored for it.
+ */
+void mroute_helper_del_iroute46(struct mroute_helper *mh, const struct mroute_addr *addr,
+                                const void *route);
+
+/**
+ * Return the route of the longest prefix that contains the host
+ * address \a addr and for which \a usable returns true, or NULL.
+ */
+void *mroute_helper_lookup(struct mroute_helper *mh, const struct mroute_addr *addr,
+                           bool (*usable)(const void *route, const void *arg), const void *arg);
 
 unsigned int mroute_extract_addr_ip(struct mroute_addr *src, struct mroute_addr *dest,
                                     const struct buffer *buf);
@@ -0,0 +1,408 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "syshead.h"
+
+#if ENABLE_ASYNC_LOG
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include "buffer.h"
+#include "error.h"
+#include "msg_async.h"
+#include "platform.h"
+
+#include "memdbg.h"
+
+/* how long the writer waits for more messages after writing some, in ms */
+#define MSG_ASYNC_INTERVAL 10
+
+#define MSG_ASYNC_ALIGN(n) (((n) + 7) & ~(size_t)7)
+
+/* level of an entry that only fills the end of the ring */
+#define MSG_ASYNC_PAD (-1)
+
+struct msg_async_entry
+{
+    FILE *fp;      /* NULL for syslog */
+    uint32_t size; /* of the entry, aligned */
+    int32_t level; /* syslog level, or MSG_ASYNC_PAD */
+    int32_t len;   /* of the text, which follows with a NUL byte */
+};
+
+struct msg_async_ring
+{
+    atomic_size_t head; /* written by the thread of the ring */
+    atomic_size_t tail; /* written by the writer */
+    atomic_bool orphan; /* its thread exited */
+    char *buf;          /* MSG_ASYNC_RING_SIZE bytes */
+
+    /* only used by the thread of the ring */
+    bool busy;          /* scratch buffers in use */
+    unsigned int lost;  /* messages dropped since the last one queued */
+    char m1[ERR_BUF_SIZE];
+    char m2[ERR_BUF_SIZE];
+
+    struct msg_async_ring *next; /* set once */
+};
+
+static atomic_bool msg_async_running;       /* GLOBAL */
+static atomic_bool msg_async_idle;          /* GLOBAL */
+static atomic_uint msg_async_dropped_total; /* GLOBAL */
+static bool msg_async_initialized;          /* GLOBAL */
+static pthread_key_t msg_async_key;         /* GLOBAL */
+static pthread_t msg_async_thread;          /* GLOBAL */
+
+/* protect the list of rings and the sleep of the writer */
+static pthread_mutex_t msg_async_lock = PTHREAD_MUTEX_INITIALIZER; /* GLOBAL */
+static pthread_cond_t msg_async_wake = PTHREAD_COND_INITIALIZER;   /* GLOBAL */
+static struct msg_async_ring *msg_async_rings;                     /* GLOBAL */
+static bool msg_async_stopping;                                    /* GLOBAL */
+
+/* a thread that logged exited: its ring can go to the next new thread
+ * once it is written out */
+static void
+msg_async_thread_exit(void *arg)
+{
+    struct msg_async_ring *r = arg;
+    atomic_store(&r->orphan, true);
+}
+
+/* the child of a fork() has no writer */
+static void
+msg_async_atfork_child(void)
+{
+    atomic_store(&msg_async_running, false);
+}
+
+static struct msg_async_ring *
+msg_async_ring_new(void)
+{
+    struct msg_async_ring *r, *fresh;
+
+    /* not under the lock: a failure is M_FATAL, which stops the writer */
+    ALLOC_OBJ_CLEAR(fresh, struct msg_async_ring);
+    fresh->buf = malloc(MSG_ASYNC_RING_SIZE);
+    check_malloc_return(fresh->buf);
+
+    pthread_mutex_lock(&msg_async_lock);
+    for (r = msg_async_rings; r; r = r->next)
+    {
+        if (atomic_load(&r->orphan) && atomic_load(&r->head) == atomic_load(&r->tail))
+        {
+            atomic_store(&r->orphan, false);
+            r->busy = false;
+            r->lost = 0;
+            break;
+        }
+    }
+    if (!r)
+    {
+        r = fresh;
+        fresh = NULL;
+        r->next = msg_async_rings;
+        msg_async_rings = r;
+    }
+    pthread_mutex_unlock(&msg_async_lock);
+
+    if (fresh)
+    {
+        free(fresh->buf);
+        free(fresh);
+    }
+
+    pthread_setspecific(msg_async_key, r);
+    return r;
+}
+
+struct msg_async_ring *
+msg_async_acquire(char **m1, char **m2)
+{
+    struct msg_async_ring *r;
+
+    if (!atomic_load_explicit(&msg_async_running, memory_order_acquire))
+    {
+        return NULL;
+    }
+    r = pthread_getspecific(msg_async_key);
+    if (!r)
+    {
+        r = msg_async_ring_new();
+    }
+    if (r->busy)
+    {
+        return NULL;
+    }
+    r->busy = true;
+    *m1 = r->m1;
+    *m2 = r->m2;
+    return r;
+}
+
+void
+msg_async_release(struct msg_async_ring *r)
+{
+    r->busy = false;
+}
+
+unsigned int
+msg_async_lost(struct msg_async_ring *r)
+{
+    const unsigned int lost = r->lost;
+    r->lost = 0;
+    return lost;
+}
+
+void
+msg_async_put(struct msg_async_ring *r, FILE *fp, int level, const char *text, int len)
+{
+    const size_t need = MSG_ASYNC_ALIGN(sizeof(struct msg_async_entry) + len + 1);
+    size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+    const size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+    size_t off = head & (MSG_ASYNC_RING_SIZE - 1);
+    const size_t skip = MSG_ASYNC_RING_SIZE - off < need ? MSG_ASYNC_RING_SIZE - off : 0;
+    struct msg_async_entry *e;
+
+    if (head + skip + need - tail > MSG_ASYNC_RING_SIZE)
+    {
+        r->lost++;
+        atomic_fetch_add_explicit(&msg_async_dropped_total, 1, memory_order_relaxed);
+        pthread_cond_signal(&msg_async_wake);
+        return;
+    }
+
+    /* an entry does not wrap around: the writer skips the end of the ring
+     * if it cannot hold an entry, or at a padding entry */
+    if (skip)
+    {
+        if (skip >= sizeof(struct msg_async_entry))
+        {
+            e = (struct msg_async_entry *)(r->buf + off);
+            e->level = MSG_ASYNC_PAD;
+        }
+        head += skip;
+        off = 0;
+    }
+
+    e = (struct msg_async_entry *)(r->buf + off);
+    e->fp = fp;
+    e->size = (uint32_t)need;
+    e->level = level;
+    e->len = len;
+    memcpy(e + 1, text, len);
+    ((char *)(e + 1))[len] = '\0';
+    /* both seq_cst: the writer stores idle, then loads head, before it
+     * sleeps, so one of us sees the other */
+    atomic_store(&r->head, head + need);
+
+    if (atomic_load(&msg_async_idle) && atomic_exchange(&msg_async_idle, false))
+    {
+        pthread_mutex_lock(&msg_async_lock);
+        pthread_cond_signal(&msg_async_wake);
+        pthread_mutex_unlock(&msg_async_lock);
+    }
+    else if (head + need - tail > MSG_ASYNC_RING_SIZE / 2)
+    {
+        pthread_cond_signal(&msg_async_wake);
+    }
+}
+
+/* is there anything to write, with msg_async_lock held */
+static bool
+msg_async_pending(void)
+{
+    for (struct msg_async_ring *r = msg_async_rings; r; r = r->next)
+    {
+        if (atomic_load(&r->head) != atomic_load_explicit(&r->tail, memory_order_relaxed))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* write what the rings hold, flushing each file once */
+static bool
+msg_async_drain(void)
+{
+    bool wrote = false;
+    FILE *flush[2] = { NULL, NULL };
+    struct msg_async_ring *r;
+
+    pthread_mutex_lock(&msg_async_lock);
+    r = msg_async_rings;
+    pthread_mutex_unlock(&msg_async_lock);
+
+    for (; r; r = r->next)
+    {
+        size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+        const size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+        while (tail != head)
+        {
+            const size_t off = tail & (MSG_ASYNC_RING_SIZE - 1);
+            const struct msg_async_entry *e = (const struct msg_async_entry *)(r->buf + off);
+
+            if (MSG_ASYNC_RING_SIZE - off < sizeof(*e) || e->level == MSG_ASYNC_PAD)
+            {
+                tail += MSG_ASYNC_RING_SIZE - off;
+                continue;
+            }
+
+            if (e->fp)
+            {
+                fwrite(e + 1, 1, e->len, e->fp);
+                if (flush[0] != e->fp && flush[1] != e->fp)
+                {
+                    flush[flush[0] ? 1 : 0] = e->fp;
+                }
+            }
+#if SYSLOG_CAPABILITY
+            else
+            {
+                syslog(e->level, "%s", (const char *)(e + 1));
+            }
+#endif
+            tail += e->size;
+        }
+        if (tail != atomic_load_explicit(&r->tail, memory_order_relaxed))
+        {
+            atomic_store_explicit(&r->tail, tail, memory_order_release);
+            wrote = true;
+        }
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (flush[i])
+        {
+            fflush(flush[i]);
+        }
+    }
+    return wrote;
+}
+
+static void *
+msg_async_writer(void *arg)
+{
+    bool wrote = false;
+    bool stop;
+
+    do
+    {
+        pthread_mutex_lock(&msg_async_lock);
+        if (msg_async_stopping)
+        {
+            /* a last drain */
+        }
+        else if (wrote)
+        {
+            /* let more messages gather */
+            struct timespec ts;
+
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += MSG_ASYNC_INTERVAL * 1000000;
+            if (ts.tv_nsec >= 1000000000)
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&msg_async_wake, &msg_async_lock, &ts);
+        }
+        else
+        {
+            /* sleep until a message is queued, msg_async_put() wakes us
+             * if it sees the flag after queueing */
+            atomic_store(&msg_async_idle, true);
+            if (!msg_async_pending())
+            {
+                pthread_cond_wait(&msg_async_wake, &msg_async_lock);
+            }
+            atomic_store(&msg_async_idle, false);
+        }
+        stop = msg_async_stopping;
+        pthread_mutex_unlock(&msg_async_lock);
+
+        wrote = msg_async_drain();
+    } while (!stop);
+
+    return NULL;
+}
+
+void
+msg_async_start(void)
+{
+    if (atomic_load(&msg_async_running))
+    {
+        return;
+    }
+    if (!msg_async_initialized)
+    {
+        if (pthread_key_create(&msg_async_key, msg_async_thread_exit) != 0)
+        {
+            msg(M_WARN, "WARNING: --log-async: no thread-specific data, logging directly");
+            return;
+        }
+        pthread_atfork(NULL, NULL, msg_async_atfork_child);
+        msg_async_initialized = true;
+    }
+    msg_async_stopping = false;
+
+    const int status = platform_thread_create(&msg_async_thread, msg_async_writer, NULL);
+
+    if (status != 0)
+    {
+        msg(M_WARN, "WARNING: --log-async: cannot start the writer thread, logging directly");
+        return;
+    }
+    atomic_store_explicit(&msg_async_running, true, memory_order_release);
+}
+
+void
+msg_async_stop(void)
+{
+    /* once, should a fatal error on a thread race the exit */
+    if (!atomic_exchange(&msg_async_running, false))
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&msg_async_lock);
+    msg_async_stopping = true;
+    pthread_cond_signal(&msg_async_wake);
+    pthread_mutex_unlock(&msg_async_lock);
+    pthread_join(msg_async_thread, NULL);
+
+    const unsigned int dropped = atomic_exchange(&msg_async_dropped_total, 0);
+    if (dropped)
+    {
+        msg(M_INFO, "--log-async: %u message(s) were dropped in all, with the rings full",
+            dropped);
+    }
+}
+
+#endif /* ENABLE_ASYNC_LOG */
@@ -0,0 +1,88 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Log output from a writer thread (--log-async).
+ *
+ * Each thread that logs gets a ring, allocated on its first message,
+ * that only it writes and only the writer thread reads.  x_msg_va()
+ * formats a message in the scratch buffers of the ring, as it would be
+ * written, and copies the line into the ring; the writer thread writes
+ * what the rings hold in batches, flushing the log file once per batch.
+ *
+ * Verbosity and --mute are applied when the message is logged, as
+ * before, and the copy to the management interface is not delayed.  A
+ * message that does not fit in the ring is dropped and counted, and the
+ * next message of the thread is preceded by a note of how many were.
+ */
+
+#ifndef MSG_ASYNC_H
+#define MSG_ASYNC_H
+
+#if ENABLE_ASYNC_LOG
+
+/* bytes of the ring of a thread, a power of 2 */
+#define MSG_ASYNC_RING_SIZE (256 * 1024)
+
+struct msg_async_ring;
+
+/**
+ * Start the writer thread.  Messages are written directly until then.
+ */
+void msg_async_start(void);
+
+/**
+ * Write the messages queued and stop the writer thread.  Messages are
+ * written directly again.
+ */
+void msg_async_stop(void);
+
+/**
+ * Get the ring of the calling thread, and its two scratch buffers of
+ * ERR_BUF_SIZE bytes.
+ *
+ * @return the ring, or NULL if the writer is not running or the ring is
+ *     already in use by a message being logged, in which case the
+ *     message has to be written directly.
+ */
+struct msg_async_ring *msg_async_acquire(char **m1, char **m2);
+
+/**
+ * Queue the \a len bytes of \a text for \a fp, or for syslog with
+ * \a level if \a fp is NULL.
+ */
+void msg_async_put(struct msg_async_ring *r, FILE *fp, int level, const char *text, int len);
+
+/**
+ * The number of messages of the thread of \a r dropped since the last
+ * call, with the ring full.
+ */
+unsigned int msg_async_lost(struct msg_async_ring *r);
+
+/**
+ * Done with the scratch buffers of \a r.
+ */
+void msg_async_release(struct msg_async_ring *r);
+
+#endif /* ENABLE_ASYNC_LOG */
+
+#endif /* MSG_ASYNC_H */
@@ -0,0 +1,817 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "syshead.h"
+
+#if ENABLE_SERVER_SHARDS
+
+#include <pthread.h>
+
+#include "multi.h"
+#include "forward.h"
+#include "occ.h"
+#include "ssl_pkt.h"
+#include "fdmisc.h"
+#include "platform.h"
+#include "mshard.h"
+
+#include "memdbg.h"
+
+/* packets queued per shard */
+#define MULTI_SHARD_QUEUE 256
+
+/* max number of packets a shard handles per turn of the lock */
+#define MULTI_SHARD_BUDGET 32
+
+struct multi_shard_item
+{
+    struct multi_instance *mi; /* holds a reference */
+    bool from_link;            /* read from the socket, else from the tun/tap device */
+    struct link_socket *sock;
+    struct link_socket_actual from;
+
+    struct buffer data; /* slot storage, the packet as queued */
+    struct buffer work; /* slot storage, the packet after the crypto */
+    struct buffer buf;  /* the packet */
+
+    /* socket -> tun/tap */
+    struct crypto_options *co;
+    const uint8_t *ad_start;
+    struct frame frame;
+    bool detached;
+    struct crypto_detached d;
+
+    /* tun/tap -> socket */
+    struct encrypt_detached e;
+
+    /* the write, accounted for under the next lock */
+    int len;
+    int size;
+    int err;
+};
+
+struct multi_shard
+{
+    struct multi_shards *set;
+    int index;
+    pthread_t thread;
+    bool started;
+
+    /* queue of packets, filled by the event loop */
+    pthread_mutex_t qlock;
+    pthread_cond_t qcond;
+    unsigned int head;
+    unsigned int tail;
+    struct multi_shard_item items[MULTI_SHARD_QUEUE];
+};
+
+struct multi_shards
+{
+    struct multi_context *m;
+    int buf_size;
+    bool stopping;
+
+    /* the data channel lock, handed out in the order it was asked for */
+    pthread_mutex_t mutex;
+    pthread_cond_t turn;
+    unsigned int next_ticket;
+    unsigned int serving;
+
+    /* wakes up the event loop */
+    int wakeup_pipe[2];
+    bool wakeup_pending;
+
+    int n_shards;
+    struct multi_shard *shards;
+};
+
+static void
+multi_shards_lock_set(struct multi_shards *set)
+{
+    pthread_mutex_lock(&set->mutex);
+    const unsigned int ticket = set->next_ticket++;
+    while (ticket != set->serving)
+    {
+        pthread_cond_wait(&set->turn, &set->mutex);
+    }
+    pthread_mutex_unlock(&set->mutex);
+}
+
+static void
+multi_shards_unlock_set(struct multi_shards *set)
+{
+    pthread_mutex_lock(&set->mutex);
+    ++set->serving;
+    pthread_cond_broadcast(&set->turn);
+    pthread_mutex_unlock(&set->mutex);
+}
+
+/*
+ * Ask the event loop to look at the schedule and the mbuf queue.
+ * Called with the lock held.
+ */
+static void
+multi_shards_wakeup(struct multi_shards *set)
+{
+    if (!set->wakeup_pending)
+    {
+        set->wakeup_pending = true;
+        if (write(set->wakeup_pipe[1], "x", 1) != 1)
+        {
+            msg(D_MULTI_ERRORS | M_ERRNO, "MULTI: cannot wake up the event loop");
+        }
+    }
+}
+
+/*
+ * The shards bypass everything in the event loop that has per-packet
+ * state other than the crypto; return what stands in the way, if any.
+ */
+static const char *
+multi_shards_unsupported(const struct multi_context *m)
+{
+    const struct context *c = &m->top;
+
+    for (int i = 0; i < c->c1.link_sockets_num; i++)
+    {
+        if (!proto_is_udp(c->c2.link_sockets[i]->info.proto))
+        {
+            return "a TCP or unix socket";
+        }
+    }
+    if (dco_enabled(&c->options))
+    {
+        return "data channel offload";
+    }
+    if (c->options.shaper)
+    {
+        return "--shaper";
+    }
+    if (c->options.passtos)
+    {
+        return "--passtos";
+    }
+    if (c->options.ce.fragment)
+    {
+        return "--fragment";
+    }
+    if (c->options.block_ipv6)
+    {
+        return "--block-ipv6";
+    }
+#ifdef ENABLE_DEBUG
+    if (c->options.gremlin)
+    {
+        return "--gremlin";
+    }
+#endif
+    if (!c->c1.tuntap || c->c1.tuntap->backend_driver == DRIVER_AFUNIX)
+    {
+        return "this tun/tap backend";
+    }
+    return NULL;
+}
+
+/*
+ * Return the shard of mi, or NULL if the event loop has to process its
+ * packets.
+ */
+static struct multi_shard *
+multi_shard_of(struct multi_context *m, struct multi_instance *mi)
+{
+    struct multi_shards *set = m->shards;
+    const struct context *c = &mi->context;
+
+    if (!set || mi->halt || !c->c2.tls_multi || c->c2.tls_multi->multi_state < CAS_CONNECT_DONE
+        || c->c2.tls_multi->peer_id == MAX_PEER_ID)
+    {
+        return NULL;
+    }
+#ifdef USE_COMP
+    /* the decompressed packet would end up in the shared buffers */
+    if (c->c2.comp_context)
+    {
+        return NULL;
+    }
+#endif
+    if (BUF_SIZE(&c->c2.frame) > set->buf_size)
+    {
+        return NULL;
+    }
+
+    /* with --server-processes, the peer-ids of this process are
+     * peer_id_step apart */
+    return &set->shards[(c->c2.tls_multi->peer_id / m->peer_id_step) % set->n_shards];
+}
+
+/*
+ * Copy a packet to the queue of shard s.  Called by the event loop.
+ */
+static void
+multi_shard_enqueue(struct multi_shard *s, struct multi_instance *mi, bool from_link,
+                    const struct buffer *buf, struct link_socket *sock)
+{
+    pthread_mutex_lock(&s->qlock);
+
+    if (s->tail - s->head >= MULTI_SHARD_QUEUE)
+    {
+        pthread_mutex_unlock(&s->qlock);
+        msg(D_MULTI_DROPPED, "MULTI: packet dropped due to output saturation (shard %d)",
+            s->index);
+        return;
+    }
+
+    struct multi_shard_item *item = &s->items[s->tail % MULTI_SHARD_QUEUE];
+    item->buf = item->data;
+    ASSERT(buf_init(&item->buf, mi->context.c2.frame.buf.headroom));
+    if (!buf_copy(&item->buf, buf))
+    {
+        pthread_mutex_unlock(&s->qlock);
+        msg(D_MULTI_DROPPED, "MULTI: packet too large for shard %d, dropped", s->index);
+        return;
+    }
+
+    multi_instance_inc_refcount(mi);
+    item->mi = mi;
+    item->from_link = from_link;
+    item->sock = sock;
+    item->from = s->set->m->top.c2.from;
+    item->len = 0;
+
+    ++s->tail;
+    pthread_cond_signal(&s->qcond);
+    pthread_mutex_unlock(&s->qlock);
+}
+
+bool
+multi_shards_link(struct multi_context *m, struct multi_instance *mi, struct link_socket *sock)
+{
+    const struct buffer *buf = &m->top.c2.buf;
+
+    if (!m->shards || BLEN(buf) <= 0)
+    {
+        return false;
+    }
+
+    /* the control channel stays with the event loop */
+    const int op = *BPTR(buf) >> P_OPCODE_SHIFT;
+    if (op != P_DATA_V1 && op != P_DATA_V2)
+    {
+        return false;
+    }
+
+    struct multi_shard *s = multi_shard_of(m, mi);
+    if (!s)
+    {
+        return false;
+    }
+
+    multi_shard_enqueue(s, mi, true, buf, sock);
+    return true;
+}
+
+bool
+multi_shards_tun(struct multi_context *m, struct multi_instance *mi)
+{
+    const struct buffer *buf = &m->top.c2.buf;
+
+    if (!m->shards || BLEN(buf) <= 0)
+    {
+        return false;
+    }
+
+    struct multi_shard *s = multi_shard_of(m, mi);
+    if (!s)
+    {
+        return false;
+    }
+
+    multi_shard_enqueue(s, mi, false, buf, mi->context.c2.link_sockets[0]);
+    return true;
+}
+
+/*
+ * Account for the writes of the last n packets, and give their slots
+ * back to the queue.  Called with the lock held.
+ */
+static void
+multi_shard_flush(struct multi_shard *s, unsigned int n)
+{
+    for (unsigned int i = 0; i < n; i++)
+    {
+        struct multi_shard_item *item = &s->items[(s->head + i) % MULTI_SHARD_QUEUE];
+        struct multi_instance *mi = item->mi;
+        struct context *c = &mi->context;
+
+        if (item->len && !mi->halt)
+        {
+            set_prefix(mi);
+            if (item->from_link)
+            {
+                errno = item->err;
+                tun_write_accounting(c, item->len, item->size);
+            }
+            else
+            {
+                link_write_detached_accounting(c, item->sock, &item->e, &mi->shard_encrypt,
+                                               item->len, item->size, item->err);
+            }
+            clear_prefix();
+        }
+
+        mi->shard_encrypt.busy = false;
+        mi->shard_decrypt.busy = false;
+        multi_instance_dec_refcount(mi);
+        item->mi = NULL;
+    }
+
+    pthread_mutex_lock(&s->qlock);
+    s->head += n;
+    pthread_mutex_unlock(&s->qlock);
+}
+
+/*
+ * First half of a packet from the socket: find the key and, if the
+ * cipher can be copied, leave the decryption for later.  Called with the
+ * lock held.
+ */
+static void
+multi_shard_link_prepare(struct multi_shard_item *item)
+{
+    struct multi_instance *mi = item->mi;
+    struct context *c = &mi->context;
+    struct link_socket_info *lsi = &item->sock->info;
+    struct gc_arena gc = gc_new();
+
+    item->co = NULL;
+    item->ad_start = NULL;
+    item->detached = false;
+
+    c->c2.from = item->from;
+    link_read_accounting(c, BLEN(&item->buf));
+
+    msg(D_LINK_RW, "%s READ [%d] from %s: %s", proto2ascii(lsi->proto, lsi->af, true),
+        BLEN(&item->buf), print_link_socket_actual(&c->c2.from, &gc),
+        PROTO_DUMP(&item->buf, &gc));
+
+    if (!link_socket_verify_incoming_addr(&item->buf, lsi, &c->c2.from))
+    {
+        link_socket_bad_incoming_addr(&item->buf, lsi, &c->c2.from);
+    }
+
+    if (tls_pre_decrypt(c->c2.tls_multi, &c->c2.from, &item->buf, &item->co, false,
+                        &item->ad_start))
+    {
+        /* only data channel packets are queued, but be safe */
+        item->buf.len = 0;
+    }
+    if (c->c2.tls_multi->multi_state < CAS_CONNECT_DONE)
+    {
+        item->buf.len = 0;
+    }
+
+    if (item->buf.len > 0)
+    {
+        item->frame = c->c2.frame;
+        item->detached = openvpn_decrypt_prepare(item->co, &item->buf, &mi->shard_decrypt,
+                                                 &item->d);
+        if (item->detached)
+        {
+            mi->shard_decrypt.busy = true;
+        }
+        else
+        {
+            openvpn_decrypt(&item->buf, item->work, item->co, &c->c2.frame, item->ad_start);
+        }
+    }
+
+    gc_free(&gc);
+}
+
+/*
+ * Second half of a packet from the socket: check it for replays, pass
+ * it on to other clients or leave it for the tun/tap device.  Called
+ * with the lock held.
+ */
+static void
+multi_shard_link_finish(struct multi_shard *s, struct multi_shard_item *item)
+{
+    struct multi_context *m = s->set->m;
+    struct multi_instance *mi = item->mi;
+    struct context *c = &mi->context;
+
+    if (mi->halt)
+    {
+        item->buf.len = 0;
+        return;
+    }
+
+    if (item->detached)
+    {
+        openvpn_decrypt_commit(item->co, &item->d, &item->buf);
+    }
+    if (item->buf.len <= 0)
+    {
+        return;
+    }
+
+    const bool occ = is_occ_msg(&item->buf);
+
+    /* the event loop may have a packet of its own pending in there */
+    const struct buffer saved_buf = c->c2.buf;
+    const struct buffer saved_to_tun = c->c2.to_tun;
+
+    c->c2.buf = item->buf;
+    process_incoming_link_part2(c, &item->sock->info, NULL);
+    multi_route_incoming_link(m, mi);
+
+    item->buf = c->c2.to_tun;
+    if (item->buf.len > 0)
+    {
+        process_ip_header(c, PIP_MSSFIX | PIPV4_EXTRACT_DHCP_ROUTER | PIPV4_CLIENT_NAT | PIP_OUTGOING,
+                          &item->buf, item->sock);
+        if (item->buf.len > c->c2.frame.buf.payload_size)
+        {
+            msg(D_LINK_ERRORS, "tun packet too large on write (tried=%d,max=%d)", item->buf.len,
+                c->c2.frame.buf.payload_size);
+            item->buf.len = 0;
+        }
+    }
+
+    c->c2.buf = saved_buf;
+    c->c2.to_tun = saved_to_tun;
+
+    /* an OCC request wants a reply, a signal wants the instance closed */
+    if (occ || IS_SIG(c))
+    {
+        multi_schedule_instance_now(m, mi);
+        multi_shards_wakeup(s->set);
+    }
+}
+
+/*
+ * Packet from the tun/tap device: everything up to the encryption.
+ * Called with the lock held.
+ */
+static void
+multi_shard_tun_prepare(struct multi_shard_item *item)
+{
+    struct multi_instance *mi = item->mi;
+    struct context *c = &mi->context;
+
+    c->c2.tun_read_bytes += item->buf.len;
+    dmsg(D_TUN_RW, "TUN READ [%d]", BLEN(&item->buf));
+
+    process_ip_header(c, PIP_MSSFIX | PIPV4_CLIENT_NAT, &item->buf, item->sock);
+    encrypt_sign_prepare(c, &item->buf, &item->work, clear_buf(), &mi->shard_encrypt, &item->e);
+    if (item->e.pending)
+    {
+        mi->shard_encrypt.busy = true;
+    }
+}
+
+/*
+ * Handle n packets starting at slot first.
+ */
+static void
+multi_shard_batch(struct multi_shard *s, unsigned int first, unsigned int n)
+{
+    struct multi_shards *set = s->set;
+    struct multi_context *m = set->m;
+    struct tuntap *tt = m->top.c1.tuntap;
+    bool from_link = false;
+
+    ASSERT(n <= MULTI_SHARD_BUDGET);
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        struct multi_shard_item *item = &s->items[(first + i) % MULTI_SHARD_QUEUE];
+        if (item->mi->halt)
+        {
+            item->buf.len = 0;
+            continue;
+        }
+        set_prefix(item->mi);
+        if (item->from_link)
+        {
+            multi_shard_link_prepare(item);
+            from_link = true;
+        }
+        else
+        {
+            multi_shard_tun_prepare(item);
+        }
+        clear_prefix();
+    }
+
+    multi_shards_unlock_set(set);
+
+    /* the crypto of the whole batch, packets of a client back to back */
+    struct crypto_batch_packet decrypt[MULTI_SHARD_BUDGET];
+    struct crypto_batch_packet encrypt[MULTI_SHARD_BUDGET];
+    int n_decrypt = 0, n_encrypt = 0;
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        struct multi_shard_item *item = &s->items[(first + i) % MULTI_SHARD_QUEUE];
+        if (item->buf.len <= 0)
+        {
+            continue;
+        }
+        if (item->from_link && item->detached)
+        {
+            decrypt[n_decrypt++] = (struct crypto_batch_packet){
+                .buf = &item->buf,
+                .work = item->work,
+                .d = &item->d,
+                .frame = &item->frame,
+                .ad_start = item->ad_start,
+            };
+        }
+        else if (!item->from_link && item->e.pending)
+        {
+            encrypt[n_encrypt++] = (struct crypto_batch_packet){
+                .buf = &item->buf,
+                .work = item->work,
+                .opt = &item->e.snap,
+            };
+        }
+    }
+    openvpn_decrypt_detached_batch(decrypt, n_decrypt);
+    openvpn_encrypt_batch(encrypt, n_encrypt);
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        struct multi_shard_item *item = &s->items[(first + i) % MULTI_SHARD_QUEUE];
+        if (!item->from_link)
+        {
+            encrypt_sign_detached_finish(&item->buf, &item->e);
+        }
+    }
+
+    if (from_link)
+    {
+        const unsigned int mbuf_before = mbuf_len(m->mbuf);
+
+        multi_shards_lock_set(set);
+        for (unsigned int i = 0; i < n; i++)
+        {
+            struct multi_shard_item *item = &s->items[(first + i) % MULTI_SHARD_QUEUE];
+            if (item->from_link)
+            {
+                set_prefix(item->mi);
+                multi_shard_link_finish(s, item);
+                clear_prefix();
+            }
+        }
+        /* packets for other clients are sent by the event loop */
+        if (mbuf_len(m->mbuf) > mbuf_before)
+        {
+            multi_shards_wakeup(set);
+        }
+        multi_shards_unlock_set(set);
+    }
+
+    for (unsigned int i = 0; i < n; i++)
+    {
+        struct multi_shard_item *item = &s->items[(first + i) % MULTI_SHARD_QUEUE];
+        if (item->buf.len <= 0)
+        {
+            continue;
+        }
+        item->len = BLEN(&item->buf);
+        if (item->from_link)
+        {
+            item->size = write_tun(tt, BPTR(&item->buf), BLEN(&item->buf));
+        }
+        else
+        {
+            item->size = (int)link_socket_write_udp_direct(item->sock, &item->buf, &item->e.to);
+        }
+        item->err = errno;
+    }
+}
+
+static void *
+multi_shard_thread(void *arg)
+{
+    struct multi_shard *s = arg;
+    struct multi_shards *set = s->set;
+    unsigned int done = 0; /* handled, but not accounted for yet */
+
+    while (true)
+    {
+        pthread_mutex_lock(&s->qlock);
+        while (!done && s->tail == s->head && !set->stopping)
+        {
+            pthread_cond_wait(&s->qcond, &s->qlock);
+        }
+        const bool stop = set->stopping;
+        const unsigned int first = s->head + done;
+        const unsigned int n = min_uint(s->tail - first, MULTI_SHARD_BUDGET);
+        pthread_mutex_unlock(&s->qlock);
+
+        if (stop)
+        {
+            break;
+        }
+
+        multi_shards_lock_set(set);
+        multi_shard_flush(s, done);
+        done = n;
+        if (n)
+        {
+            /* releases the lock */
+            multi_shard_batch(s, first, n);
+        }
+        else
+        {
+            multi_shards_unlock_set(set);
+        }
+    }
+
+    return NULL;
+}
+
+void
+multi_shards_init(struct multi_context *m)
+{
+    struct multi_shards *set;
+    const int n_shards = m->top.options.server_shards;
+
+    if (n_shards < 2)
+    {
+        return;
+    }
+
+    const char *unsupported = multi_shards_unsupported(m);
+    if (unsupported)
+    {
+        msg(M_WARN, "NOTE: --server-shards is not used with %s, all clients are served by one "
+                    "thread",
+            unsupported);
+        return;
+    }
+
+    ALLOC_OBJ_CLEAR(set, struct multi_shards);
+    set->m = m;
+    set->buf_size = BUF_SIZE(&m->top.c2.frame);
+    set->n_shards = n_shards;
+    ALLOC_ARRAY_CLEAR(set->shards, struct multi_shard, n_shards);
+    pthread_mutex_init(&set->mutex, NULL);
+    pthread_cond_init(&set->turn, NULL);
+    if (pipe(set->wakeup_pipe) < 0)
+    {
+        msg(M_ERR, "ERROR: cannot create pipe for server shards");
+    }
+    set_nonblock(set->wakeup_pipe[0]);
+    set_nonblock(set->wakeup_pipe[1]);
+    set_cloexec(set->wakeup_pipe[0]);
+    set_cloexec(set->wakeup_pipe[1]);
+
+    /* the event loop runs with the lock held */
+    multi_shards_lock_set(set);
+    m->shards = set;
+
+    for (int i = 0; i < n_shards; i++)
+    {
+        struct multi_shard *s = &set->shards[i];
+        s->set = set;
+        s->index = i;
+        pthread_mutex_init(&s->qlock, NULL);
+        pthread_cond_init(&s->qcond, NULL);
+        for (int j = 0; j < MULTI_SHARD_QUEUE; j++)
+        {
+            s->items[j].data = alloc_buf(set->buf_size);
+            s->items[j].work = alloc_buf(set->buf_size);
+        }
+
+        if (platform_thread_create(&s->thread, multi_shard_thread, s) != 0)
+        {
+            msg(M_ERR, "ERROR: cannot start server shard %d", i);
+        }
+        s->started = true;
+    }
+
+    msg(M_INFO, "MULTI: serving the data channel from %d shard threads", n_shards);
+}
+
+void
+multi_shards_free(struct multi_context *m)
+{
+    struct multi_shards *set = m->shards;
+
+    if (!set)
+    {
+        return;
+    }
+
+    for (int i = 0; i < set->n_shards; i++)
+    {
+        struct multi_shard *s = &set->shards[i];
+        pthread_mutex_lock(&s->qlock);
+        set->stopping = true;
+        pthread_cond_signal(&s->qcond);
+        pthread_mutex_unlock(&s->qlock);
+    }
+
+    /* let the shards finish the batch they are in */
+    multi_shards_unlock_set(set);
+
+    for (int i = 0; i < set->n_shards; i++)
+    {
+        struct multi_shard *s = &set->shards[i];
+        if (s->started)
+        {
+            pthread_join(s->thread, NULL);
+        }
+
+        /* drop the packets still queued */
+        for (unsigned int j = s->head; j != s->tail; j++)
+        {
+            multi_instance_dec_refcount(s->items[j % MULTI_SHARD_QUEUE].mi);
+        }
+        for (int j = 0; j < MULTI_SHARD_QUEUE; j++)
+        {
+            free_buf(&s->items[j].data);
+            free_buf(&s->items[j].work);
+        }
+        pthread_cond_destroy(&s->qcond);
+        pthread_mutex_destroy(&s->qlock);
+    }
+
+    close(set->wakeup_pipe[0]);
+    close(set->wakeup_pipe[1]);
+    pthread_cond_destroy(&set->turn);
+    pthread_mutex_destroy(&set->mutex);
+    free(set->shards);
+    free(set);
+    m->shards = NULL;
+}
+
+void
+multi_shards_event_set(struct multi_context *m, struct event_set *es, void *arg)
+{
+    if (m->shards)
+    {
+        event_ctl(es, m->shards->wakeup_pipe[0], EVENT_READ, arg);
+    }
+}
+
+void
+multi_shards_wakeup_done(struct multi_context *m)
+{
+    char buf[64];
+
+    if (m->shards)
+    {
+        while (read(m->shards->wakeup_pipe[0], buf, sizeof(buf)) > 0)
+        {
+        }
+        m->shards->wakeup_pending = false;
+    }
+}
+
+void
+multi_shards_unlock(struct multi_context *m)
+{
+    if (m->shards)
+    {
+        multi_shards_unlock_set(m->shards);
+    }
+}
+
+void
+multi_shards_lock(struct multi_context *m)
+{
+    if (m->shards)
+    {
+        multi_shards_lock_set(m->shards);
+    }
+}
+
+#endif /* ENABLE_SERVER_SHARDS */
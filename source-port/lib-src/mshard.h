@@ -0,0 +1,109 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Data channel shards for --mode server over UDP (--server-shards).
+ *
+ * Every client is owned by the shard its peer-id maps to.  The event
+ * loop keeps reading the sockets and the tun/tap device, runs the
+ * control channel and the timers, and looks up the client a packet
+ * belongs to.  Data channel packets of established clients are then
+ * copied to the queue of their shard, which decrypts and routes them or
+ * encrypts them, and writes them to the tun/tap device or the socket.
+ * A client always maps to the same shard, so its packets stay in order.
+ *
+ * Like with --tun-queues, the event loop holds the data channel lock
+ * except while it sleeps in event_wait().  A shard takes the lock for a
+ * batch of packets to pick keys and reserve packet IDs, and once more
+ * to check for replays and route; the crypto and the writes happen
+ * without it.  The lock hands out turns in order, so the shards get
+ * theirs even when the event loop never sleeps for long.
+ */
+
+#ifndef MSHARD_H
+#define MSHARD_H
+
+#if ENABLE_SERVER_SHARDS
+
+#define MULTI_SHARDS_MAX 64
+
+struct multi_context;
+struct multi_instance;
+struct event_set;
+struct link_socket;
+
+/**
+ * Start the shard threads requested by --server-shards, if the
+ * configuration allows it.  The calling thread holds the data channel
+ * lock when this returns.
+ */
+void multi_shards_init(struct multi_context *m);
+
+/**
+ * Stop the shard threads.  Packets still queued are dropped.
+ */
+void multi_shards_free(struct multi_context *m);
+
+/**
+ * Pass the packet in \c m->top.c2.buf, which was read from \a sock, to
+ * the shard of \a mi.
+ *
+ * @return true if the shard took the packet (or dropped it because its
+ *     queue is full), false if the event loop has to process it.
+ */
+bool multi_shards_link(struct multi_context *m, struct multi_instance *mi,
+                       struct link_socket *sock);
+
+/**
+ * Pass the packet in \c m->top.c2.buf, which was read from the tun/tap
+ * device and routed to \a mi, to the shard of \a mi.
+ *
+ * @return true if the shard took the packet (or dropped it because its
+ *     queue is full), false if the event loop has to process it.
+ */
+bool multi_shards_tun(struct multi_context *m, struct multi_instance *mi);
+
+/**
+ * Add the shards' wakeup pipe to the event set of the event loop.  The
+ * shards use it when they queue packets for other clients (mbuf) or
+ * need the event loop to look at a client.
+ */
+void multi_shards_event_set(struct multi_context *m, struct event_set *es, void *arg);
+
+/**
+ * Empty the wakeup pipe after it woke up the event loop.
+ */
+void multi_shards_wakeup_done(struct multi_context *m);
+
+/**
+ * Release the data channel lock before the event loop goes to sleep.
+ */
+void multi_shards_unlock(struct multi_context *m);
+
+/**
+ * Take the data channel lock again after waking up.
+ */
+void multi_shards_lock(struct multi_context *m);
+
+#endif /* ENABLE_SERVER_SHARDS */
+
+#endif /* MSHARD_H */
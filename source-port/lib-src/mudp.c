@@ -56,6 +56,7 @@ send_hmac_reset_packet(struct multi_context *m, struct tls_pre_decrypt_state *st
     buf_copy(&c->c2.buffers->aux_buf, &buf);
     m->hmac_reply = c->c2.buffers->aux_buf;
     m->hmac_reply_dest = &m->top.c2.from;
+    m->initial_stats.replied++;
     msg(D_MULTI_DEBUG, "Reset packet from client, sending HMAC based reset challenge");
 }
 
@@ -72,17 +73,34 @@ do_pre_decrypt_check(struct multi_context *m, struct tls_pre_decrypt_state *stat
     struct tls_auth_standalone *tas = m->top.c2.tls_auth_standalone;
 
     verdict = tls_pre_decrypt_lite(tas, state, &m->top.c2.from, &m->top.c2.buf);
+    if (verdict == VERDICT_INVALID)
+    {
+        m->initial_stats.dropped++;
+        return false;
+    }
+    m->initial_stats.verified++;
 
     hmac_ctx_t *hmac = m->top.c2.session_id_hmac;
     struct openvpn_sockaddr *from = &m->top.c2.from.dest;
     int handwindow = m->top.options.handshake_window;
 
+    /* Only packets that passed the tls-auth/tls-crypt check count against
+     * the limit of their source prefix, so that packets spoofed from it
+     * cannot lock its clients out */
+    if (m->initial_prefix_limiter
+        && !reflect_filter_prefix_check(m->initial_prefix_limiter, from))
+    {
+        m->initial_stats.dropped++;
+        return false;
+    }
+
     if (verdict == VERDICT_VALID_RESET_V3 || verdict == VERDICT_VALID_RESET_V2)
     {
         /* Check if we are still below our limit for sending out
          * responses */
         if (!reflect_filter_rate_limit_check(m->initial_rate_limiter))
         {
+            m->initial_stats.dropped++;
             return false;
         }
     }
@@ -309,16 +327,11 @@ multi_get_create_instance_udp(struct multi_context *m, bool *floated, struct lin
 }
 
 /*
- * Send a packet to UDP socket.
+ * Send a pending stateless HMAC reset reply, if any.
  */
 static inline void
-multi_process_outgoing_link(struct multi_context *m, const unsigned int mpp_flags)
+multi_process_outgoing_hmac_reply(struct multi_context *m)
 {
-    struct multi_instance *mi = multi_process_outgoing_link_pre(m);
-    if (mi)
-    {
-        multi_process_outgoing_link_dowork(m, mi, mpp_flags);
-    }
     if (m->hmac_reply_dest && m->hmac_reply.len > 0)
     {
         msg_set_prefix("Connection Attempt");
@@ -330,6 +343,68 @@ multi_process_outgoing_link(struct multi_context *m, const unsigned int mpp_flag
     }
 }
 
+/*
+ * Maximum number of queued client-to-client or broadcast packets
+ * encrypted and sent in one pass of the event loop.
+ */
+#define MULTI_MBUF_BATCH 64
+
+/*
+ * Send a packet to UDP socket.  If it came from the mbuf queue, keep
+ * going with the next queued packets, so that a broadcast reaches all
+ * its recipients in one pass, and with --udp-send-batch in a few
+ * sendmmsg() calls, instead of one event loop iteration per recipient.
+ * Stop as soon as a packet could not be sent completely.
+ */
+static inline void
+multi_process_outgoing_link(struct multi_context *m, const unsigned int mpp_flags)
+{
+    const bool from_queue = !m->pending;
+    struct multi_instance *mi = multi_process_outgoing_link_pre(m);
+    int n = 0;
+
+    while (mi)
+    {
+        multi_process_outgoing_link_dowork(m, mi, mpp_flags);
+        if (!from_queue || m->pending || IS_SIG(&m->top) || ++n == MULTI_MBUF_BATCH
+            || !mbuf_defined(m->mbuf))
+        {
+            break;
+        }
+        mi = multi_get_queue(m->mbuf);
+    }
+    multi_process_outgoing_hmac_reply(m);
+}
+
+#if ENABLE_UDP_BATCH
+/*
+ * Process the datagrams left over from a batched read (--udp-recv-batch)
+ * one at a time.  Output produced by the previous datagram is flushed
+ * first, since it refers to m->pending and m->top.c2.from which the next
+ * datagram overwrites.  Output of the last datagram is left to the
+ * caller, like in the unbatched case.
+ */
+static void
+multi_process_incoming_link_batch(struct multi_context *m, const unsigned int mpp_flags,
+                                  struct link_socket *sock)
+{
+    while (!IS_SIG(&m->top) && link_socket_rx_batch_pending(sock))
+    {
+        if (m->pending)
+        {
+            multi_io_action(m, m->pending, TA_INITIAL, false);
+        }
+        multi_process_outgoing_hmac_reply(m);
+
+        read_incoming_link(&m->top, sock);
+        if (!IS_SIG(&m->top))
+        {
+            multi_process_incoming_link(m, NULL, mpp_flags, sock);
+        }
+    }
+}
+#endif
+
 /*
  * Process an I/O event.
  */
@@ -393,6 +468,9 @@ multi_process_io_udp(struct multi_context *m, struct link_socket *sock)
         {
             multi_process_incoming_link(m, NULL, mpp_flags, sock);
         }
+#if ENABLE_UDP_BATCH
+        multi_process_incoming_link_batch(m, mpp_flags, sock);
+#endif
     }
     /* Incoming data on TUN device */
     else if (status & TUN_READ)
@@ -52,6 +52,10 @@
 #include "ssl_util.h"
 #include "dco.h"
 #include "reflect_filter.h"
+#include "mshard.h"
+#include "mproc.h"
+#include "ssl_offload.h"
+#include "pktpool.h"
 
 /*#define MULTI_DEBUG_EVENT_LOOP*/
 
@@ -190,6 +194,7 @@ multi_reap_range(const struct multi_context *m, int start_bucket, int end_bucket
         {
             dmsg(D_MULTI_DEBUG, "MULTI: REAP DEL %s", mroute_addr_print(&r->addr, &gc));
             learn_address_script(m, NULL, "delete", &r->addr);
+            mroute_helper_del_iroute46(m->route_helper, &r->addr, r);
             multi_route_del(r);
             hash_iterator_delete_element(&hi);
         }
@@ -341,7 +346,7 @@ multi_init(struct context *t)
      * This is our scheduler, for time-based wakeup
      * events.
      */
-    m->schedule = schedule_init();
+    m->schedule = schedule_init(t->options.server_scheduler);
 
     /*
      * Limit frequency of incoming connections to control
@@ -350,12 +355,25 @@ multi_init(struct context *t)
     m->new_connection_limiter = frequency_limit_init(t->options.cf_max, t->options.cf_per);
     m->initial_rate_limiter =
         initial_rate_limit_init(t->options.cf_initial_max, t->options.cf_initial_per);
+    if (t->options.cf_prefix_max > 0)
+    {
+        m->initial_prefix_limiter =
+            initial_prefix_limit_init(t->options.cf_prefix_max, t->options.cf_prefix_per);
+    }
 
     /*
      * Allocate broadcast/multicast buffer list
      */
     m->mbuf = mbuf_init(t->options.n_bcast_buf);
 
+    /*
+     * Per VLAN broadcast member lists
+     */
+    if (t->options.vlan_tagging)
+    {
+        ALLOC_ARRAY_CLEAR(m->bcast_vlan, struct multi_bcast_group, OPENVPN_8021Q_MAX_VID + 1);
+    }
+
     /*
      * Different status file format options are available
      */
@@ -380,6 +398,10 @@ multi_init(struct context *t)
             t->options.ifconfig_pool_end, t->options.duplicate_cn,
             t->options.ifconfig_ipv6_pool_defined, t->options.ifconfig_ipv6_pool_base,
             t->options.ifconfig_ipv6_pool_netbits);
+#if ENABLE_SERVER_PROCESSES
+        /* each server process hands out its own share of the pool */
+        ifconfig_pool_partition(m->ifconfig_pool, mproc_index(), mproc_count());
+#endif
 
         /* reload pool data from file */
         if (t->c1.ifconfig_pool_persist)
@@ -411,13 +433,23 @@ multi_init(struct context *t)
     m->max_clients = t->options.max_clients;
 
     m->instances = calloc(m->max_clients, sizeof(struct multi_instance *));
+    m->peer_id_first = 0;
+    m->peer_id_step = 1;
+#if ENABLE_SERVER_PROCESSES
+    /* the steering program finds a client's process by its peer-id */
+    m->peer_id_first = mproc_index();
+    m->peer_id_step = mproc_count();
+#endif
 
     m->top.c2.event_set = t->c2.event_set;
 
     /*
      * Initialize multi-socket I/O wait object
      */
-    m->multi_io = multi_io_init(t->options.max_clients, &m->max_clients);
+    m->multi_io = multi_io_init(t->options.max_clients, &m->max_clients,
+                                t->options.io_uring ? EVENT_METHOD_IO_URING : 0);
+    m->multi_io->edge = t->options.server_edge_triggered && has_udp_in_local_list(&t->options)
+                        && !dco_enabled(&t->options);
     m->tcp_queue_limit = t->options.tcp_queue_limit;
 
     /*
@@ -493,9 +525,67 @@ ungenerate_prefix(struct multi_instance *mi)
 }
 
 /*
- * Tell the route helper about deleted iroutes so
- * that it can update its mask of currently used
- * CIDR netlengths.
+ * Route table key of an IPv4 or IPv6 address, with netbits
+ * if netbits >= 0.
+ */
+static struct mroute_addr
+multi_in_addr_t_to_mroute(in_addr_t a, int netbits)
+{
+    struct openvpn_sockaddr remote_si;
+    struct mroute_addr addr = { 0 };
+
+    CLEAR(remote_si);
+    remote_si.addr.in4.sin_family = AF_INET;
+    remote_si.addr.in4.sin_addr.s_addr = htonl(a);
+    addr.proto = 0;
+    ASSERT(mroute_extract_openvpn_sockaddr(&addr, &remote_si, false));
+
+    if (netbits >= 0)
+    {
+        addr.type |= MR_WITH_NETBITS;
+        addr.netbits = (uint8_t)netbits;
+    }
+    return addr;
+}
+
+static struct mroute_addr
+multi_in6_addr_to_mroute(struct in6_addr a6, int netbits)
+{
+    struct mroute_addr addr = { 0 };
+
+    addr.len = 16;
+    addr.type = MR_ADDR_IPV6;
+    addr.netbits = 0;
+    addr.v6.addr = a6;
+
+    if (netbits >= 0)
+    {
+        addr.type |= MR_WITH_NETBITS;
+        addr.netbits = (uint8_t)netbits;
+        mroute_addr_mask_host_bits(&addr);
+    }
+    return addr;
+}
+
+/*
+ * Remove the CIDR route addr of mi from the prefix table of the
+ * route helper.  The route itself stays in vhash until it is reaped.
+ */
+static void
+multi_del_iroute_prefix(struct multi_context *m, struct multi_instance *mi,
+                        const struct mroute_addr *addr)
+{
+    struct multi_route *route = (struct multi_route *)hash_lookup(m->vhash, addr);
+    if (route && route->instance == mi)
+    {
+        mroute_helper_del_iroute46(m->route_helper, addr, route);
+    }
+}
+
+/*
+ * Take the iroutes of a client out of the prefix table
+ * of the route helper, so that they are no longer
+ * considered for routing.
  */
 static void
 multi_del_iroutes(struct multi_context *m, struct multi_instance *mi)
@@ -509,12 +599,17 @@ multi_del_iroutes(struct multi_context *m, struct multi_instance *mi)
     {
         for (ir = mi->context.options.iroutes; ir != NULL; ir = ir->next)
         {
-            mroute_helper_del_iroute46(m->route_helper, ir->netbits);
+            if (ir->netbits >= 0)
+            {
+                struct mroute_addr addr = multi_in_addr_t_to_mroute(ir->network, ir->netbits);
+                multi_del_iroute_prefix(m, mi, &addr);
+            }
         }
 
         for (ir6 = mi->context.options.iroutes_ipv6; ir6 != NULL; ir6 = ir6->next)
         {
-            mroute_helper_del_iroute46(m->route_helper, ir6->netbits);
+            struct mroute_addr addr = multi_in6_addr_to_mroute(ir6->network, ir6->netbits);
+            multi_del_iroute_prefix(m, mi, &addr);
         }
     }
 }
@@ -578,6 +673,100 @@ multi_client_disconnect_script(struct multi_context *m, struct multi_instance *m
 #endif
 }
 
+/*
+ * Broadcast member lists.  Removal moves the last member into the
+ * vacated slot, so every instance records where it is stored.
+ */
+static int
+multi_bcast_group_add(struct multi_bcast_group *g, struct multi_instance *mi)
+{
+    if (g->n == g->capacity)
+    {
+        g->capacity = g->capacity ? g->capacity * 2 : 16;
+        g->members = realloc(g->members, g->capacity * sizeof(g->members[0]));
+        check_malloc_return(g->members);
+    }
+    g->members[g->n] = mi;
+    return g->n++;
+}
+
+/*
+ * Remove the member in slot and return the instance that took its
+ * place, if any.
+ */
+static struct multi_instance *
+multi_bcast_group_del(struct multi_bcast_group *g, int slot)
+{
+    ASSERT(slot >= 0 && slot < g->n);
+    g->members[slot] = g->members[--g->n];
+    return slot < g->n ? g->members[slot] : NULL;
+}
+
+static void
+multi_bcast_group_free(struct multi_bcast_group *g)
+{
+    free(g->members);
+    CLEAR(*g);
+}
+
+static void
+multi_bcast_leave_vlan(struct multi_context *m, struct multi_instance *mi)
+{
+    if (mi->bcast_vid)
+    {
+        struct multi_instance *moved =
+            multi_bcast_group_del(&m->bcast_vlan[mi->bcast_vid], mi->bcast_vlan_slot);
+        if (moved)
+        {
+            moved->bcast_vlan_slot = mi->bcast_vlan_slot;
+        }
+        mi->bcast_vid = 0;
+    }
+}
+
+/*
+ * Put the instance on the member list of its --vlan-pvid, which a
+ * client-config-dir file or plugin may have changed since it joined.
+ */
+static void
+multi_bcast_set_vlan(struct multi_context *m, struct multi_instance *mi)
+{
+    const uint16_t vid = mi->context.options.vlan_pvid;
+
+    if (!m->bcast_vlan || mi->bcast_slot < 0 || vid == mi->bcast_vid)
+    {
+        return;
+    }
+    multi_bcast_leave_vlan(m, mi);
+    if (vid > 0 && vid <= OPENVPN_8021Q_MAX_VID)
+    {
+        mi->bcast_vlan_slot = multi_bcast_group_add(&m->bcast_vlan[vid], mi);
+        mi->bcast_vid = vid;
+    }
+}
+
+static void
+multi_bcast_join(struct multi_context *m, struct multi_instance *mi)
+{
+    mi->bcast_slot = multi_bcast_group_add(&m->bcast_all, mi);
+    multi_bcast_set_vlan(m, mi);
+}
+
+static void
+multi_bcast_leave(struct multi_context *m, struct multi_instance *mi)
+{
+    if (mi->bcast_slot >= 0)
+    {
+        struct multi_instance *moved = multi_bcast_group_del(&m->bcast_all, mi->bcast_slot);
+        if (moved)
+        {
+            moved->bcast_slot = mi->bcast_slot;
+        }
+        mi->bcast_slot = -1;
+        multi_bcast_leave_vlan(m, mi);
+    }
+}
+
 void
 multi_close_instance(struct multi_context *m, struct multi_instance *mi, bool shutdown)
 {
@@ -604,6 +793,8 @@ multi_close_instance(struct multi_context *m, struct multi_instance *mi, bool sh
         m->earliest_wakeup = NULL;
     }
 
+    multi_bcast_leave(m, mi);
+
     if (!shutdown)
     {
         if (mi->did_real_hash)
@@ -716,15 +907,35 @@ multi_uninit(struct multi_context *m)
 
         schedule_free(m->schedule);
         mbuf_free(m->mbuf);
+        multi_bcast_group_free(&m->bcast_all);
+        if (m->bcast_vlan)
+        {
+            for (int vid = 0; vid <= OPENVPN_8021Q_MAX_VID; ++vid)
+            {
+                multi_bcast_group_free(&m->bcast_vlan[vid]);
+            }
+            free(m->bcast_vlan);
+            m->bcast_vlan = NULL;
+        }
         ifconfig_pool_free(m->ifconfig_pool);
         frequency_limit_free(m->new_connection_limiter);
         initial_rate_limit_free(m->initial_rate_limiter);
+        initial_prefix_limit_free(m->initial_prefix_limiter);
         multi_reap_free(m->reaper);
         mroute_helper_free(m->route_helper);
         multi_io_free(m->multi_io);
     }
 }
 
+/*
+ * Number of peer-ids this process can hand out.
+ */
+static inline int
+multi_peer_id_slots(const struct multi_context *m)
+{
+    return (m->max_clients - m->peer_id_first + m->peer_id_step - 1) / m->peer_id_step;
+}
+
 /*
  * Create a client instance object for a newly connected client.
  */
@@ -744,6 +955,7 @@ multi_create_instance(struct multi_context *m, const struct mroute_addr *real,
     mi->gc = gc_new();
     multi_instance_inc_refcount(mi);
     mi->vaddr_handle = -1;
+    mi->bcast_slot = -1;
     mi->created = now;
     mroute_addr_init(&mi->real);
 
@@ -760,12 +972,18 @@ multi_create_instance(struct multi_context *m, const struct mroute_addr *real,
     }
 
     mi->context.c2.tls_multi->multi_state = CAS_NOT_CONNECTED;
+#if ENABLE_SERVER_TLS_THREADS
+    mi->context.c2.tls_multi->opt.offload = m->tls_offload;
+#endif
+#if ENABLE_AUTH_HELPERS
+    mi->context.c2.tls_multi->opt.auth_helpers = m->auth_helpers;
+#endif
 
-    if (hash_n_elements(m->hash) >= m->max_clients)
+    if (hash_n_elements(m->hash) >= multi_peer_id_slots(m))
     {
         msg(D_MULTI_ERRORS,
             "MULTI: new incoming connection would exceed maximum number of clients (%d)",
-            m->max_clients);
+            multi_peer_id_slots(m));
         goto err;
     }
 
@@ -785,6 +1003,7 @@ multi_create_instance(struct multi_context *m, const struct mroute_addr *real,
         goto err;
     }
     mi->did_iter = true;
+    multi_bcast_join(m, mi);
 
 #ifdef ENABLE_MANAGEMENT
     do
@@ -902,6 +1121,19 @@ multi_print_status(struct multi_context *m, struct status_output *so, const int
             {
                 status_printf(so, "Max bcast/mcast queue length,%d", mbuf_maximum_queued(m->mbuf));
             }
+            {
+                struct pktpool_stats ps;
+                pktpool_get_stats(&ps);
+                status_printf(so, "Packet buffer pool hits," counter_format, ps.hits);
+                status_printf(so, "Packet buffer pool misses," counter_format,
+                              ps.misses + ps.oversize);
+            }
+            status_printf(so, "Initial packets dropped," counter_format,
+                          m->initial_stats.dropped);
+            status_printf(so, "Initial packets verified," counter_format,
+                          m->initial_stats.verified);
+            status_printf(so, "Initial packets replied," counter_format,
+                          m->initial_stats.replied);
 
             status_printf(so, "END");
         }
@@ -994,6 +1226,20 @@ multi_print_status(struct multi_context *m, struct status_output *so, const int
                 status_printf(so, "GLOBAL_STATS%cMax bcast/mcast queue length%c%d", sep, sep,
                               mbuf_maximum_queued(m->mbuf));
             }
+            {
+                struct pktpool_stats ps;
+                pktpool_get_stats(&ps);
+                status_printf(so, "GLOBAL_STATS%cPacket buffer pool hits%c" counter_format, sep,
+                              sep, ps.hits);
+                status_printf(so, "GLOBAL_STATS%cPacket buffer pool misses%c" counter_format, sep,
+                              sep, ps.misses + ps.oversize);
+            }
+            status_printf(so, "GLOBAL_STATS%cInitial packets dropped%c" counter_format, sep, sep,
+                          m->initial_stats.dropped);
+            status_printf(so, "GLOBAL_STATS%cInitial packets verified%c" counter_format, sep, sep,
+                          m->initial_stats.verified);
+            status_printf(so, "GLOBAL_STATS%cInitial packets replied%c" counter_format, sep, sep,
+                          m->initial_stats.replied);
 
             status_printf(so, "GLOBAL_STATS%cdco_enabled%c%d", sep, sep,
                           dco_enabled(&m->top.options));
@@ -1106,6 +1352,7 @@ multi_learn_addr(struct multi_context *m, struct multi_instance *mi, const struc
                 /* modify hash table entry, replacing old route */
                 he->key = &newroute->addr;
                 he->value = newroute;
+                mroute_helper_add_iroute46(m->route_helper, &newroute->addr, newroute);
             }
         }
         else
@@ -1119,6 +1366,7 @@ multi_learn_addr(struct multi_context *m, struct multi_instance *mi, const struc
 
                 /* add new route */
                 hash_add_fast(m->vhash, bucket, &newroute->addr, hv, newroute);
+                mroute_helper_add_iroute46(m->route_helper, &newroute->addr, newroute);
             }
         }
 
@@ -1135,6 +1383,15 @@ multi_learn_addr(struct multi_context *m, struct multi_instance *mi, const struc
     return owner;
 }
 
+/*
+ * Callback of mroute_helper_lookup().
+ */
+static bool
+multi_route_usable(const void *route, const void *arg)
+{
+    return multi_route_defined((const struct multi_context *)arg, (const struct multi_route *)route);
+}
+
 /*
  * Get client instance based on virtual address.
  */
@@ -1160,31 +1417,14 @@ multi_get_instance_by_virtual_addr(struct multi_context *m, const struct mroute_
         route->last_reference = now;
         ret = mi;
     }
-    else if (cidr_routing) /* do we need to regenerate a host route cache entry? */
+    else if (cidr_routing) /* longest matching CIDR route */
     {
-        struct mroute_helper *rh = m->route_helper;
-        struct mroute_addr tryaddr;
-        int i;
-
-        /* cycle through each CIDR length */
-        for (i = 0; i < rh->n_net_len; ++i)
+        route = (struct multi_route *)mroute_helper_lookup(m->route_helper, addr,
+                                                            multi_route_usable, m);
+        if (route)
         {
-            tryaddr = *addr;
-            tryaddr.type |= MR_WITH_NETBITS;
-            tryaddr.netbits = rh->net_len[i];
-            mroute_addr_mask_host_bits(&tryaddr);
-
-            /* look up a possible route with netbits netmask */
-            route = (struct multi_route *)hash_lookup(m->vhash, &tryaddr);
-
-            if (route && multi_route_defined(m, route))
-            {
-                /* found an applicable route, cache host route */
-                struct multi_instance *mi = route->instance;
-                multi_learn_addr(m, mi, addr, MULTI_ROUTE_CACHE | MULTI_ROUTE_AGEABLE);
-                ret = mi;
-                break;
-            }
+            route->last_reference = now;
+            ret = route->instance;
         }
     }
 
@@ -1218,20 +1458,7 @@ multi_learn_in_addr_t(struct multi_context *m, struct multi_instance *mi, in_add
                       int netbits, /* -1 if host route, otherwise # of network bits in address */
                       bool primary)
 {
-    struct openvpn_sockaddr remote_si;
-    struct mroute_addr addr = { 0 };
-
-    CLEAR(remote_si);
-    remote_si.addr.in4.sin_family = AF_INET;
-    remote_si.addr.in4.sin_addr.s_addr = htonl(a);
-    addr.proto = 0;
-    ASSERT(mroute_extract_openvpn_sockaddr(&addr, &remote_si, false));
-
-    if (netbits >= 0)
-    {
-        addr.type |= MR_WITH_NETBITS;
-        addr.netbits = (uint8_t)netbits;
-    }
+    struct mroute_addr addr = multi_in_addr_t_to_mroute(a, netbits);
 
     struct multi_instance *owner = multi_learn_addr(m, mi, &addr, 0);
 #ifdef ENABLE_MANAGEMENT
@@ -1257,19 +1484,7 @@ multi_learn_in6_addr(struct multi_context *m, struct multi_instance *mi, struct
                      int netbits, /* -1 if host route, otherwise # of network bits in address */
                      bool primary)
 {
-    struct mroute_addr addr = { 0 };
-
-    addr.len = 16;
-    addr.type = MR_ADDR_IPV6;
-    addr.netbits = 0;
-    addr.v6.addr = a6;
-
-    if (netbits >= 0)
-    {
-        addr.type |= MR_WITH_NETBITS;
-        addr.netbits = (uint8_t)netbits;
-        mroute_addr_mask_host_bits(&addr);
-    }
+    struct mroute_addr addr = multi_in6_addr_to_mroute(a6, netbits);
 
     struct multi_instance *owner = multi_learn_addr(m, mi, &addr, 0);
 #ifdef ENABLE_MANAGEMENT
@@ -1317,8 +1532,6 @@ multi_add_iroutes(struct multi_context *m, struct multi_instance *mi)
                     print_in_addr_t(ir->network, 0, &gc), multi_instance_string(mi, false, &gc));
             }
 
-            mroute_helper_add_iroute46(m->route_helper, ir->netbits);
-
             multi_learn_in_addr_t(m, mi, ir->network, ir->netbits, false);
         }
         for (ir6 = mi->context.options.iroutes_ipv6; ir6 != NULL; ir6 = ir6->next)
@@ -1327,8 +1540,6 @@ multi_add_iroutes(struct multi_context *m, struct multi_instance *mi)
                 print_in6_addr(ir6->network, 0, &gc), ir6->netbits,
                 multi_instance_string(mi, false, &gc));
 
-            mroute_helper_add_iroute46(m->route_helper, ir6->netbits);
-
             multi_learn_in6_addr(m, mi, ir6->network, ir6->netbits, false);
         }
     }
@@ -1397,6 +1608,7 @@ check_stale_routes(struct multi_context *m)
             dmsg(D_MULTI_DEBUG, "MULTI: Deleting stale route for address '%s'",
                  mroute_addr_print(&r->addr, &gc));
             learn_address_script(m, NULL, "delete", &r->addr);
+            mroute_helper_del_iroute46(m->route_helper, &r->addr, r);
             multi_route_del(r);
             hash_iterator_delete_element(&hi);
         }
@@ -2259,6 +2471,28 @@ multi_client_connect_call_script(struct multi_context *m, struct multi_instance
             goto cleanup;
         }
 
+#if ENABLE_AUTH_HELPERS
+        if (auth_helpers_defined(m->auth_helpers, AUTH_HELPER_CLIENT_CONNECT))
+        {
+            /* the helper answers through the deferred return file */
+            struct tls_multi *multi = mi->context.c2.tls_multi;
+            struct tls_session *session = &multi->session[TM_ACTIVE];
+            const struct auth_helper_key key =
+                auth_helper_key_of(session, &session->key[KS_PRIMARY]);
+            if (auth_helpers_request(m->auth_helpers, AUTH_HELPER_CLIENT_CONNECT,
+                                     mi->context.c2.es, NULL, ccs->deferred_ret_file,
+                                     ccs->config_file, multi, multi->peer_id, &key))
+            {
+                ret = CC_RET_DEFERRED;
+            }
+            else
+            {
+                ret = CC_RET_FAILED;
+            }
+            goto cleanup;
+        }
+#endif
+
         argv_parse_cmd(&argv, mi->context.options.client_connect_script);
         argv_printf_cat(&argv, "%s", ccs->config_file);
 
@@ -2383,6 +2617,9 @@ multi_client_connect_late_setup(struct multi_context *m, struct multi_instance *
     mi->reporting_addr = mi->context.c2.push_ifconfig_local;
     mi->reporting_addr_ipv6 = mi->context.c2.push_ifconfig_ipv6_local;
 
+    /* --vlan-pvid may have been set by the client-connect handlers */
+    multi_bcast_set_vlan(m, mi);
+
     /* set context-level authentication flag */
     mi->context.c2.tls_multi->multi_state = CAS_CONNECT_DONE;
 
@@ -2901,34 +3138,35 @@ static void
 multi_bcast(struct multi_context *m, const struct buffer *buf,
             const struct multi_instance *sender_instance, uint16_t vid)
 {
-    struct hash_iterator hi;
-    struct hash_element *he;
-    struct multi_instance *mi;
+    const struct multi_bcast_group *g = &m->bcast_all;
     struct mbuf_buffer *mb;
 
-    if (BLEN(buf) > 0)
+    if (vid != 0)
+    {
+        /* only clients on the same VLAN */
+        if (!m->bcast_vlan || vid > OPENVPN_8021Q_MAX_VID)
+        {
+            return;
+        }
+        g = &m->bcast_vlan[vid];
+    }
+
+    if (BLEN(buf) > 0 && g->n > 0)
     {
         perf_push(PERF_MULTI_BCAST);
 #ifdef MULTI_DEBUG_EVENT_LOOP
         printf("BCAST len=%d\n", BLEN(buf));
 #endif
+        /* all recipients share one copy of the packet */
         mb = mbuf_alloc_buf(buf);
-        hash_iterator_init(m->iter, &hi);
-
-        while ((he = hash_iterator_next(&hi)))
+        for (int i = 0; i < g->n; ++i)
         {
-            mi = (struct multi_instance *)he->value;
+            struct multi_instance *mi = g->members[i];
             if (mi != sender_instance && !mi->halt)
             {
-                if (vid != 0 && vid != mi->context.options.vlan_pvid)
-                {
-                    continue;
-                }
                 multi_add_mbuf(m, mi, mb);
             }
         }
-
-        hash_iterator_free(&hi);
         mbuf_free_buf(mb);
         perf_pop();
     }
@@ -2979,6 +3217,148 @@ multi_schedule_context_wakeup(struct multi_context *m, struct multi_instance *mi
                        compute_wakeup_sigma(&mi->context.c2.timeval));
 }
 
+void
+multi_schedule_instance_now(struct multi_context *m, struct multi_instance *mi)
+{
+    mi->context.c2.timeval.tv_sec = 0;
+    mi->context.c2.timeval.tv_usec = 0;
+    multi_schedule_context_wakeup(m, mi);
+}
+
+#if ENABLE_SERVER_TLS_THREADS
+/*
+ * Start the handshake workers of --server-tls-threads, unless the private
+ * key is one that only the event loop may use.
+ */
+static void
+multi_tls_offload_init(struct multi_context *m)
+{
+    const struct options *o = &m->top.options;
+    const char *unsupported = NULL;
+
+    if (o->server_tls_threads < 1)
+    {
+        return;
+    }
+
+#ifdef ENABLE_MANAGEMENT
+    if (o->management_flags & MF_EXTERNAL_KEY)
+    {
+        unsupported = "--management-external-key";
+    }
+#endif
+#ifdef ENABLE_PKCS11
+    if (o->pkcs11_providers[0])
+    {
+        unsupported = "--pkcs11-providers";
+    }
+#endif
+    if (unsupported)
+    {
+        msg(M_WARN, "NOTE: --server-tls-threads is not used with %s, the event loop does the "
+                    "TLS handshakes",
+            unsupported);
+        return;
+    }
+
+    m->tls_offload = tls_offload_new(o->server_tls_threads);
+}
+
+void
+multi_tls_offload_retire(struct multi_context *m)
+{
+    struct tls_multi *owners[64];
+    int n;
+
+    do
+    {
+        n = tls_offload_retire(m->tls_offload, owners, SIZE(owners));
+        for (int i = 0; i < n; i++)
+        {
+            const uint32_t peer_id = owners[i]->peer_id;
+            if (peer_id >= m->max_clients)
+            {
+                continue;
+            }
+
+            /* the client may be gone already */
+            struct multi_instance *mi = m->instances[peer_id];
+            if (mi && !mi->halt && mi->context.c2.tls_multi == owners[i])
+            {
+                interval_action(&mi->context.c2.tmp_int);
+                multi_schedule_instance_now(m, mi);
+            }
+        }
+    } while (n == SIZE(owners));
+}
+#endif
+
+#if ENABLE_AUTH_HELPERS
+/*
+ * Start the helpers of --auth-helpers for the scripts that are set.
+ */
+static void
+multi_auth_helpers_init(struct multi_context *m)
+{
+    const struct options *o = &m->top.options;
+
+    if (o->auth_helpers < 1)
+    {
+        return;
+    }
+
+    const char *commands[AUTH_HELPER_TYPES] = {
+        [AUTH_HELPER_USER_PASS_VERIFY] = o->auth_user_pass_verify_script,
+        [AUTH_HELPER_CLIENT_CONNECT] = o->client_connect_script,
+        [AUTH_HELPER_CLIENT_CRRESPONSE] = o->client_crresponse_script,
+    };
+    if (!commands[AUTH_HELPER_USER_PASS_VERIFY] && !commands[AUTH_HELPER_CLIENT_CONNECT]
+        && !commands[AUTH_HELPER_CLIENT_CRRESPONSE])
+    {
+        msg(M_WARN, "NOTE: --auth-helpers is not used without --auth-user-pass-verify, "
+                    "--client-connect or --client-crresponse");
+        return;
+    }
+
+    m->auth_helpers = auth_helpers_new(commands, o->auth_helpers, m->top.c2.es);
+}
+
+void
+multi_auth_helpers_retire(struct multi_context *m)
+{
+    struct auth_helper_result results[64];
+    int n;
+
+    if (!m->auth_helpers)
+    {
+        return;
+    }
+
+    do
+    {
+        n = auth_helpers_retire(m->auth_helpers, results, SIZE(results));
+        for (int i = 0; i < n; i++)
+        {
+            const uint32_t peer_id = results[i].peer_id;
+            if (peer_id >= m->max_clients)
+            {
+                continue;
+            }
+
+            /* the client may be gone already */
+            struct multi_instance *mi = m->instances[peer_id];
+            if (mi && !mi->halt && mi->context.c2.tls_multi == results[i].owner)
+            {
+                verify_auth_helper_done(results[i].owner, results[i].type, &results[i].key,
+                                        results[i].status);
+                interval_action(&mi->context.c2.tmp_int);
+                multi_schedule_instance_now(m, mi);
+            }
+        }
+    } while (n == SIZE(results));
+}
+#endif /* if ENABLE_AUTH_HELPERS */
+
 #if defined(ENABLE_ASYNC_PUSH)
 static void
 add_inotify_file_watch(struct multi_context *m, struct multi_instance *mi, int inotify_fd,
@@ -3342,6 +3722,128 @@ multi_process_incoming_dco(struct multi_context *m)
 }
 #endif /* if defined(ENABLE_DCO) */
 
+void
+multi_route_incoming_link(struct multi_context *m, struct multi_instance *mi)
+{
+    struct gc_arena gc = gc_new();
+    struct context *c = &mi->context;
+    struct mroute_addr src, dest;
+    unsigned int mroute_flags;
+    struct multi_instance *dest_mi;
+
+    if (TUNNEL_TYPE(m->top.c1.tuntap) == DEV_TYPE_TUN)
+    {
+        /* extract packet source and dest addresses */
+        mroute_flags = mroute_extract_addr_from_packet(&src, &dest, 0, &c->c2.to_tun, DEV_TYPE_TUN);
+
+        /* drop packet if extract failed */
+        if (!(mroute_flags & MROUTE_EXTRACT_SUCCEEDED))
+        {
+            c->c2.to_tun.len = 0;
+        }
+        /* make sure that source address is associated with this client */
+        else if (multi_get_instance_by_virtual_addr(m, &src, true) != mi)
+        {
+            /* IPv6 link-local address (fe80::xxx)? */
+            if ((src.type & MR_ADDR_MASK) == MR_ADDR_IPV6 && IN6_IS_ADDR_LINKLOCAL(&src.v6.addr))
+            {
+                /* do nothing, for now.  TODO: add address learning */
+            }
+            else
+            {
+                msg(D_MULTI_DROPPED, "MULTI: bad source address from client [%s], packet dropped",
+                    mroute_addr_print(&src, &gc));
+            }
+            c->c2.to_tun.len = 0;
+        }
+        /* client-to-client communication enabled? */
+        else if (m->enable_c2c)
+        {
+            /* multicast? */
+            if (mroute_flags & MROUTE_EXTRACT_MCAST)
+            {
+                /* for now, treat multicast as broadcast */
+                multi_bcast(m, &c->c2.to_tun, mi, 0);
+            }
+            else /* possible client to client routing */
+            {
+                ASSERT(!(mroute_flags & MROUTE_EXTRACT_BCAST));
+                dest_mi = multi_get_instance_by_virtual_addr(m, &dest, true);
+
+                /* if dest addr is a known client, route to it */
+                if (dest_mi)
+                {
+                    {
+                        multi_unicast(m, &c->c2.to_tun, dest_mi);
+                        register_activity(c, BLEN(&c->c2.to_tun));
+                    }
+                    c->c2.to_tun.len = 0;
+                }
+            }
+        }
+    }
+    else if (TUNNEL_TYPE(m->top.c1.tuntap) == DEV_TYPE_TAP)
+    {
+        uint16_t vid = 0;
+
+        if (m->top.options.vlan_tagging)
+        {
+            if (vlan_is_tagged(&c->c2.to_tun))
+            {
+                /* Drop VLAN-tagged frame. */
+                msg(D_VLAN_DEBUG, "dropping incoming VLAN-tagged frame");
+                c->c2.to_tun.len = 0;
+            }
+            else
+            {
+                vid = c->options.vlan_pvid;
+            }
+        }
+        /* extract packet source and dest addresses */
+        mroute_flags =
+            mroute_extract_addr_from_packet(&src, &dest, vid, &c->c2.to_tun, DEV_TYPE_TAP);
+
+        if (mroute_flags & MROUTE_EXTRACT_SUCCEEDED)
+        {
+            if (multi_learn_addr(m, mi, &src, 0) == mi)
+            {
+                /* check for broadcast */
+                if (m->enable_c2c)
+                {
+                    if (mroute_flags & (MROUTE_EXTRACT_BCAST | MROUTE_EXTRACT_MCAST))
+                    {
+                        multi_bcast(m, &c->c2.to_tun, mi, vid);
+                    }
+                    else /* try client-to-client routing */
+                    {
+                        dest_mi = multi_get_instance_by_virtual_addr(m, &dest, false);
+
+                        /* if dest addr is a known client, route to it */
+                        if (dest_mi)
+                        {
+                            multi_unicast(m, &c->c2.to_tun, dest_mi);
+                            register_activity(c, BLEN(&c->c2.to_tun));
+                            c->c2.to_tun.len = 0;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                msg(D_MULTI_DROPPED, "MULTI: bad source address from client [%s], packet dropped",
+                    mroute_addr_print(&src, &gc));
+                c->c2.to_tun.len = 0;
+            }
+        }
+        else
+        {
+            c->c2.to_tun.len = 0;
+        }
+    }
+
+    gc_free(&gc);
+}
+
 /*
  * Process packets in the TCP/UDP socket -> TUN/TAP interface direction,
  * i.e. client -> server direction.
@@ -3350,12 +3852,7 @@ bool
 multi_process_incoming_link(struct multi_context *m, struct multi_instance *instance,
                             const unsigned int mpp_flags, struct link_socket *sock)
 {
-    struct gc_arena gc = gc_new();
-
     struct context *c;
-    struct mroute_addr src, dest;
-    unsigned int mroute_flags;
-    struct multi_instance *mi;
     bool ret = true;
     bool floated = false;
 
@@ -3369,7 +3866,22 @@ multi_process_incoming_link(struct multi_context *m, struct multi_instance *inst
 #ifdef MULTI_DEBUG_EVENT_LOOP
         printf("TCP/UDP -> TUN [%d]\n", BLEN(&m->top.c2.buf));
 #endif
-        multi_set_pending(m, multi_get_create_instance_udp(m, &floated, sock));
+        struct multi_instance *mi = multi_get_create_instance_udp(m, &floated, sock);
+#if ENABLE_SERVER_SHARDS
+        /* data packets of established clients go to their shard */
+        if (mi && !floated && multi_shards_link(m, mi, sock))
+        {
+            return true;
+        }
+#endif
+#if ENABLE_SERVER_CRYPTO_THREADS
+        /* data packets of established clients go to the crypto workers */
+        if (mi && !floated && multi_crypto_link(m, mi, sock))
+        {
+            return true;
+        }
+#endif
+        multi_set_pending(m, mi);
     }
     else
     {
@@ -3417,119 +3929,7 @@ multi_process_incoming_link(struct multi_context *m, struct multi_instance *inst
             }
             perf_pop();
 
-            if (TUNNEL_TYPE(m->top.c1.tuntap) == DEV_TYPE_TUN)
-            {
-                /* extract packet source and dest addresses */
-                mroute_flags =
-                    mroute_extract_addr_from_packet(&src, &dest, 0, &c->c2.to_tun, DEV_TYPE_TUN);
-
-                /* drop packet if extract failed */
-                if (!(mroute_flags & MROUTE_EXTRACT_SUCCEEDED))
-                {
-                    c->c2.to_tun.len = 0;
-                }
-                /* make sure that source address is associated with this client */
-                else if (multi_get_instance_by_virtual_addr(m, &src, true) != m->pending)
-                {
-                    /* IPv6 link-local address (fe80::xxx)? */
-                    if ((src.type & MR_ADDR_MASK) == MR_ADDR_IPV6
-                        && IN6_IS_ADDR_LINKLOCAL(&src.v6.addr))
-                    {
-                        /* do nothing, for now.  TODO: add address learning */
-                    }
-                    else
-                    {
-                        msg(D_MULTI_DROPPED,
-                            "MULTI: bad source address from client [%s], packet dropped",
-                            mroute_addr_print(&src, &gc));
-                    }
-                    c->c2.to_tun.len = 0;
-                }
-                /* client-to-client communication enabled? */
-                else if (m->enable_c2c)
-                {
-                    /* multicast? */
-                    if (mroute_flags & MROUTE_EXTRACT_MCAST)
-                    {
-                        /* for now, treat multicast as broadcast */
-                        multi_bcast(m, &c->c2.to_tun, m->pending, 0);
-                    }
-                    else /* possible client to client routing */
-                    {
-                        ASSERT(!(mroute_flags & MROUTE_EXTRACT_BCAST));
-                        mi = multi_get_instance_by_virtual_addr(m, &dest, true);
-
-                        /* if dest addr is a known client, route to it */
-                        if (mi)
-                        {
-                            {
-                                multi_unicast(m, &c->c2.to_tun, mi);
-                                register_activity(c, BLEN(&c->c2.to_tun));
-                            }
-                            c->c2.to_tun.len = 0;
-                        }
-                    }
-                }
-            }
-            else if (TUNNEL_TYPE(m->top.c1.tuntap) == DEV_TYPE_TAP)
-            {
-                uint16_t vid = 0;
-
-                if (m->top.options.vlan_tagging)
-                {
-                    if (vlan_is_tagged(&c->c2.to_tun))
-                    {
-                        /* Drop VLAN-tagged frame. */
-                        msg(D_VLAN_DEBUG, "dropping incoming VLAN-tagged frame");
-                        c->c2.to_tun.len = 0;
-                    }
-                    else
-                    {
-                        vid = c->options.vlan_pvid;
-                    }
-                }
-                /* extract packet source and dest addresses */
-                mroute_flags =
-                    mroute_extract_addr_from_packet(&src, &dest, vid, &c->c2.to_tun, DEV_TYPE_TAP);
-
-                if (mroute_flags & MROUTE_EXTRACT_SUCCEEDED)
-                {
-                    if (multi_learn_addr(m, m->pending, &src, 0) == m->pending)
-                    {
-                        /* check for broadcast */
-                        if (m->enable_c2c)
-                        {
-                            if (mroute_flags & (MROUTE_EXTRACT_BCAST | MROUTE_EXTRACT_MCAST))
-                            {
-                                multi_bcast(m, &c->c2.to_tun, m->pending, vid);
-                            }
-                            else /* try client-to-client routing */
-                            {
-                                mi = multi_get_instance_by_virtual_addr(m, &dest, false);
-
-                                /* if dest addr is a known client, route to it */
-                                if (mi)
-                                {
-                                    multi_unicast(m, &c->c2.to_tun, mi);
-                                    register_activity(c, BLEN(&c->c2.to_tun));
-                                    c->c2.to_tun.len = 0;
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        msg(D_MULTI_DROPPED,
-                            "MULTI: bad source address from client [%s], packet dropped",
-                            mroute_addr_print(&src, &gc));
-                        c->c2.to_tun.len = 0;
-                    }
-                }
-                else
-                {
-                    c->c2.to_tun.len = 0;
-                }
-            }
+            multi_route_incoming_link(m, m->pending);
         }
 
         /* postprocess and set wakeup */
@@ -3538,7 +3938,6 @@ multi_process_incoming_link(struct multi_context *m, struct multi_instance *inst
         clear_prefix();
     }
 
-    gc_free(&gc);
     return ret;
 }
 
@@ -3592,11 +3991,36 @@ multi_process_incoming_tun(struct multi_context *m, const unsigned int mpp_flags
             {
                 /* for now, treat multicast as broadcast */
                 multi_bcast(m, &m->top.c2.buf, NULL, vid);
+#if ENABLE_SERVER_PROCESSES
+                mproc_tun_unrouted(m);
+#endif
             }
             else
             {
-                multi_set_pending(
-                    m, multi_get_instance_by_virtual_addr(m, &dest, dev_type == DEV_TYPE_TUN));
+                struct multi_instance *mi =
+                    multi_get_instance_by_virtual_addr(m, &dest, dev_type == DEV_TYPE_TUN);
+#if ENABLE_SERVER_PROCESSES
+                /* the client may belong to a sibling process */
+                if (!mi)
+                {
+                    mproc_tun_unrouted(m);
+                }
+#endif
+#if ENABLE_SERVER_SHARDS
+                /* the shard of the client encrypts and sends the packet */
+                if (mi && multi_shards_tun(m, mi))
+                {
+                    return true;
+                }
+#endif
+#if ENABLE_SERVER_CRYPTO_THREADS
+                /* a crypto worker encrypts the packet, we send it */
+                if (mi && multi_crypto_tun(m, mi))
+                {
+                    return true;
+                }
+#endif
+                multi_set_pending(m, mi);
 
                 if (m->pending)
                 {
@@ -4141,7 +4565,7 @@ multi_assign_peer_id(struct multi_context *m, struct multi_instance *mi)
     /* max_clients must be less then max peer-id value */
     ASSERT(m->max_clients < MAX_PEER_ID);
 
-    for (int i = 0; i < m->max_clients; ++i)
+    for (int i = m->peer_id_first; i < m->max_clients; i += m->peer_id_step)
     {
         if (!m->instances[i])
         {
@@ -4237,8 +4661,33 @@ tunnel_server(struct context *top)
     }
 #endif
 
+#if ENABLE_SERVER_SHARDS
+    multi_shards_init(&multi);
+#endif
+#if ENABLE_SERVER_CRYPTO_THREADS
+    multi_crypto_init(&multi);
+#endif
+#if ENABLE_SERVER_TLS_THREADS
+    multi_tls_offload_init(&multi);
+#endif
+#if ENABLE_AUTH_HELPERS
+    multi_auth_helpers_init(&multi);
+#endif
+
+    if (top->options.cpu_affinity >= 0)
+    {
+        platform_cpu_affinity(top->options.cpu_affinity);
+    }
+
     tunnel_server_loop(&multi);
 
+#if ENABLE_SERVER_CRYPTO_THREADS
+    multi_crypto_free(&multi);
+#endif
+#if ENABLE_SERVER_SHARDS
+    multi_shards_free(&multi);
+#endif
+
 #ifdef ENABLE_ASYNC_PUSH
     close(top->c2.inotify_fd);
 #endif
@@ -4251,6 +4700,13 @@ tunnel_server(struct context *top)
 
     /* tear down tunnel instance (unless --persist-tun) */
     multi_uninit(&multi);
+#if ENABLE_SERVER_TLS_THREADS
+    /* after the clients, which may still wait for a worker */
+    tls_offload_free(multi.tls_offload);
+#endif
+#if ENABLE_AUTH_HELPERS
+    auth_helpers_free(multi.auth_helpers);
+#endif
     multi_top_free(&multi);
     close_instance(top);
 }
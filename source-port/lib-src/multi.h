@@ -41,6 +41,7 @@
 #include "perf.h"
 #include "vlan.h"
 #include "reflect_filter.h"
+#include "mcrypto.h"
 
 #define MULTI_PREFIX_MAX_LENGTH 256
 
@@ -134,6 +135,9 @@ struct multi_instance
 
     bool did_real_hash;
     bool did_iter;
+    int bcast_slot;      /**< index in multi_context.bcast_all, -1 if not a member */
+    int bcast_vlan_slot; /**< index in the member list of bcast_vid */
+    uint16_t bcast_vid;  /**< VLAN whose member list holds this instance, 0 if none */
 #ifdef ENABLE_MANAGEMENT
     bool did_cid_hash;
     struct buffer_list *cc_config;
@@ -147,9 +151,28 @@ struct multi_instance
 #ifdef ENABLE_ASYNC_PUSH
     int inotify_watch; /* watch descriptor for acf */
 #endif
+#if ENABLE_SERVER_SHARDS
+    struct cipher_copy shard_encrypt; /**< Ciphers used by the shard of this */
+    struct cipher_copy shard_decrypt; /**< instance, see mshard.h. */
+#endif
+#if ENABLE_SERVER_CRYPTO_THREADS
+    struct multi_crypto_peer *crypto_peer; /**< Ciphers used by the crypto
+                                            *   workers, see mcrypto.h. */
+#endif
 };
 
 
+/**
+ * Instances that receive a broadcast, kept as a flat array so that
+ * multi_bcast() does not have to walk the iterator hash.
+ */
+struct multi_bcast_group
+{
+    struct multi_instance **members;
+    int n;
+    int capacity;
+};
+
 /**
  * Main OpenVPN server state structure.
  *
@@ -176,15 +199,23 @@ struct multi_context
     struct mbuf_set *mbuf;             /**< Set of buffers for passing data
                                         *   channel packets between VPN tunnel
                                         *   instances. */
+    struct multi_bcast_group bcast_all; /**< All instances, for broadcasts */
+    struct multi_bcast_group *bcast_vlan; /**< Instances by --vlan-pvid, indexed
+                                           *   by VID, with --vlan-tagging only */
     struct multi_io *multi_io;         /**< I/O state and events tracker */
     struct ifconfig_pool *ifconfig_pool;
     struct frequency_limit *new_connection_limiter;
     struct initial_packet_rate_limit *initial_rate_limiter;
+    struct initial_packet_prefix_limit *initial_prefix_limiter; /**< --connect-flood-guard */
+    struct initial_packet_stats initial_stats;
     struct mroute_helper *route_helper;
     struct multi_reap *reaper;
     struct mroute_addr local;
     bool enable_c2c;
     int max_clients;
+    int peer_id_first; /**< first peer-id this process hands out */
+    int peer_id_step;  /**< distance between the peer-ids of this process,
+                        *   > 1 with --server-processes */
     int tcp_queue_limit;
     int status_file_version;
     int n_clients; /* current number of authenticated clients */
@@ -218,6 +249,19 @@ struct multi_context
 #endif
 
     struct deferred_signal_schedule_entry deferred_shutdown_signal;
+
+#if ENABLE_SERVER_SHARDS
+    struct multi_shards *shards; /**< Data channel threads (--server-shards) */
+#endif
+#if ENABLE_SERVER_CRYPTO_THREADS
+    struct multi_crypto *crypto; /**< Crypto workers (--server-crypto-threads) */
+#endif
+#if ENABLE_SERVER_TLS_THREADS
+    struct tls_offload *tls_offload; /**< TLS handshake workers (--server-tls-threads) */
+#endif
+#if ENABLE_AUTH_HELPERS
+    struct auth_helpers *auth_helpers; /**< Script helpers (--auth-helpers) */
+#endif
 };
 
 /**
@@ -341,6 +385,43 @@ bool multi_process_incoming_dco(struct multi_context *m);
 bool multi_process_incoming_link(struct multi_context *m, struct multi_instance *instance,
                                  const unsigned int mpp_flags, struct link_socket *sock);
 
+/**
+ * Route a decrypted packet that \c process_incoming_link_part2() left in
+ * the \c to_tun buffer of \a mi: check its source address, learn it in
+ * TAP mode and pass it on to the other clients it is addressed to.  What
+ * is left in \c to_tun afterwards is for the tun/tap device.
+ *
+ * @param m            - The single \c multi_context structure.
+ * @param mi           - The VPN tunnel instance the packet came from.
+ */
+void multi_route_incoming_link(struct multi_context *m, struct multi_instance *mi);
+
+/**
+ * Have the event loop process \a mi as soon as it runs its timers, e.g.
+ * to answer an OCC request or act on a signal raised by another thread.
+ */
+void multi_schedule_instance_now(struct multi_context *m, struct multi_instance *mi);
+
+#if ENABLE_SERVER_TLS_THREADS
+/**
+ * Have the event loop run the TLS state machine of the clients whose
+ * handshake workers (--server-tls-threads) are done.
+ *
+ * @param m            - The single \c multi_context structure.
+ */
+void multi_tls_offload_retire(struct multi_context *m);
+#endif
+
+#if ENABLE_AUTH_HELPERS
+/**
+ * Have the event loop act on the answers of the --auth-helpers helpers
+ * for the clients that are still there.
+ *
+ * @param m            - The single \c multi_context structure.
+ */
+void multi_auth_helpers_retire(struct multi_context *m);
+#endif
+
 
 /**
  * Determine the destination VPN tunnel of a packet received over the
@@ -471,6 +552,13 @@ multi_instance_dec_refcount(struct multi_instance *mi)
 {
     if (--mi->refcount <= 0)
     {
+#if ENABLE_SERVER_SHARDS
+        cipher_copy_free(&mi->shard_encrypt);
+        cipher_copy_free(&mi->shard_decrypt);
+#endif
+#if ENABLE_SERVER_CRYPTO_THREADS
+        multi_crypto_peer_free(mi->crypto_peer);
+#endif
         gc_free(&mi->gc);
         free(mi);
     }
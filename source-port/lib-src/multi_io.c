@@ -31,6 +31,10 @@
 #include "multi.h"
 #include "forward.h"
 #include "multi_io.h"
+#include "mshard.h"
+#include "mproc.h"
+#include "ssl_offload.h"
+#include "auth_helper.h"
 
 #ifdef HAVE_SYS_INOTIFY_H
 #include <sys/inotify.h>
@@ -45,6 +49,17 @@
 #define MULTI_IO_MANAGEMENT       ((void *)4)
 #define MULTI_IO_FILE_CLOSE_WRITE ((void *)5)
 #define MULTI_IO_DCO              ((void *)6)
+#define MULTI_IO_SHARDS           ((void *)7)
+#define MULTI_IO_SIBLING          ((void *)8)
+#define MULTI_IO_CRYPTO           ((void *)9)
+#define MULTI_IO_TLS_OFFLOAD      ((void *)10)
+#define MULTI_IO_AUTH_HELPER      ((void *)11)
+
+/*
+ * Packets read from a UDP socket or the TUN/TAP device in a row with
+ * --server-edge-triggered, before the other events get their turn
+ */
+#define MULTI_IO_EDGE_BUDGET 64
 
 struct ta_iow_flags
 {
@@ -93,6 +108,9 @@ pract(int action)
         case TA_TUN_WRITE_TIMEOUT:
             return "TA_TUN_WRITE_TIMEOUT";
 
+        case TA_SIBLING_READ:
+            return "TA_SIBLING_READ";
+
         default:
             return "?";
     }
@@ -113,7 +131,7 @@ multi_get_context(struct multi_context *m, struct multi_instance *mi)
 }
 
 struct multi_io *
-multi_io_init(int maxevents, int *maxclients)
+multi_io_init(int maxevents, int *maxclients, unsigned int flags)
 {
     struct multi_io *multi_io;
     const int extra_events = BASE_N_EVENTS;
@@ -123,7 +141,7 @@ multi_io_init(int maxevents, int *maxclients)
 
     ALLOC_OBJ_CLEAR(multi_io, struct multi_io);
     multi_io->maxevents = maxevents + extra_events;
-    multi_io->es = event_set_init(&multi_io->maxevents, 0);
+    multi_io->es = event_set_init(&multi_io->maxevents, flags);
     wait_signal(multi_io->es, MULTI_IO_SIG);
     ALLOC_ARRAY(multi_io->esr, struct event_set_return, multi_io->maxevents);
     *maxclients = max_int(min_int(multi_io->maxevents - extra_events, *maxclients), 1);
@@ -143,6 +161,12 @@ multi_io_set_global_rw_flags(struct multi_context *m, struct multi_instance *mi)
     mi->socket_set_called = true;
     if (proto_is_dgram(mi->context.c2.link_sockets[0]->info.proto))
     {
+        /* the socket of the server, registered once with
+         * --server-edge-triggered */
+        if (m->multi_io->edge)
+        {
+            return;
+        }
         socket_set(mi->context.c2.link_sockets[0], m->multi_io->es, EVENT_READ,
                    &mi->context.c2.link_sockets[0]->ev_arg, NULL);
     }
@@ -165,27 +189,202 @@ multi_io_free(struct multi_io *multi_io)
     }
 }
 
+/*
+ * With --server-edge-triggered, the UDP sockets and the TUN/TAP device are
+ * registered once, for EVENT_READ | EVENT_EDGE, and are not waited for as
+ * long as they may have packets: they are readable from an edge until a
+ * read finds nothing.  Output is written without waiting either, as with
+ * --fast-io.
+ */
+static bool
+multi_io_edge_ready(const struct multi_context *m)
+{
+    const struct context *c = &m->top;
+
+    if (m->multi_io->tun_readable
+        || (p2mp_iow_flags(m) & (IOW_TO_TUN | IOW_TO_LINK | IOW_MBUF)))
+    {
+        return true;
+    }
+    for (int i = 0; i < c->c1.link_sockets_num; i++)
+    {
+        const struct link_socket *sock = c->c2.link_sockets[i];
+
+        if (proto_is_dgram(sock->info.proto) && sock->edge_readable)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Turn the edges returned by event_wait() into readable fds, and return an
+ * event for each UDP socket and the TUN/TAP device that is ready, or for
+ * the first UDP socket if there is output.
+ */
+static int
+multi_io_edge_events(struct multi_context *m, int status)
+{
+    struct multi_io *multi_io = m->multi_io;
+    const struct context *c = &m->top;
+    bool output = (p2mp_iow_flags(m) & (IOW_TO_TUN | IOW_TO_LINK | IOW_MBUF)) != 0;
+    int n = 0;
+
+    for (int i = 0; i < status; i++)
+    {
+        const struct event_set_return *e = &multi_io->esr[i];
+        const struct event_arg *ev_arg = (const struct event_arg *)e->arg;
+
+        if (e->arg == MULTI_IO_TUN)
+        {
+            multi_io->tun_readable = true;
+        }
+        else if (e->arg >= MULTI_N && ev_arg->type == EVENT_ARG_LINK_SOCKET && ev_arg->u.sock
+                 && proto_is_dgram(ev_arg->u.sock->info.proto))
+        {
+            ev_arg->u.sock->edge_readable = true;
+        }
+        else
+        {
+            multi_io->esr[n++] = *e;
+        }
+    }
+
+    for (int i = 0; i < c->c1.link_sockets_num && n < multi_io->maxevents; i++)
+    {
+        struct link_socket *sock = c->c2.link_sockets[i];
+
+        if (proto_is_dgram(sock->info.proto) && (sock->edge_readable || output))
+        {
+            multi_io->esr[n].rwflags = EVENT_READ;
+            multi_io->esr[n].arg = &sock->ev_arg;
+            n++;
+            output = false;
+        }
+    }
+    if (multi_io->tun_readable && n < multi_io->maxevents)
+    {
+        multi_io->esr[n].rwflags = EVENT_READ;
+        multi_io->esr[n].arg = MULTI_IO_TUN;
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Write the output and read a UDP socket until it has no datagrams left,
+ * or the budget is spent.
+ */
+static void
+multi_io_edge_udp(struct multi_context *m, struct link_socket *sock)
+{
+    for (int n = 0; n < MULTI_IO_EDGE_BUDGET && !IS_SIG(&m->top); n++)
+    {
+        const unsigned int flags = p2mp_iow_flags(m);
+        unsigned int status = 0;
+
+        if (flags & IOW_TO_TUN)
+        {
+            status |= TUN_WRITE;
+        }
+        if (flags & (IOW_TO_LINK | IOW_MBUF))
+        {
+            status |= SOCKET_WRITE;
+        }
+        if (!status && sock->edge_readable)
+        {
+            status = SOCKET_READ;
+        }
+        if (!status)
+        {
+            break;
+        }
+
+        m->multi_io->udp_flags = status;
+        multi_process_io_udp(m, sock);
+        if (m->pending)
+        {
+            multi_io_action(m, m->pending, TA_INITIAL, false);
+        }
+        if ((status & SOCKET_READ) && sock->read_drained)
+        {
+            sock->edge_readable = false;
+        }
+    }
+}
+
+/*
+ * Read the TUN/TAP device until it has no packets left, or the budget is
+ * spent.
+ */
+static void
+multi_io_edge_tun(struct multi_context *m)
+{
+    struct multi_io *multi_io = m->multi_io;
+
+    for (int n = 0; n < MULTI_IO_EDGE_BUDGET && multi_io->tun_readable && !IS_SIG(&m->top); n++)
+    {
+        /* output first, from the next pass */
+        if (!(p2mp_iow_flags(m) & IOW_READ_TUN))
+        {
+            break;
+        }
+        multi_io_action(m, NULL, TA_TUN_READ, false);
+        if (m->top.c1.tuntap->read_drained)
+        {
+            multi_io->tun_readable = false;
+        }
+    }
+}
+
 int
 multi_io_wait(struct multi_context *m)
 {
     int status, i;
     unsigned int *persistent = &m->multi_io->tun_rwflags;
 
+#if ENABLE_SERVER_CRYPTO_THREADS
+    /* finish what the workers are done with before going to sleep, it
+     * may leave packets for other clients in the mbuf queue */
+    multi_crypto_retire(m);
+#endif
+#if ENABLE_AUTH_HELPERS
+    /* requests that failed while the clients were processed */
+    multi_auth_helpers_retire(m);
+#endif
+
     if (!tuntap_is_dco_win(m->top.c1.tuntap))
     {
         for (i = 0; i < m->top.c1.link_sockets_num; i++)
         {
-            socket_set_listen_persistent(m->top.c2.link_sockets[i], m->multi_io->es,
-                                         &m->top.c2.link_sockets[i]->ev_arg);
+            struct link_socket *sock = m->top.c2.link_sockets[i];
+
+            if (m->multi_io->edge && proto_is_dgram(sock->info.proto))
+            {
+                socket_set(sock, m->multi_io->es, EVENT_READ | EVENT_EDGE, &sock->ev_arg, NULL);
+            }
+            else
+            {
+                socket_set_listen_persistent(sock, m->multi_io->es, &sock->ev_arg);
+            }
         }
     }
 
-    if (has_udp_in_local_list(&m->top.options))
+    if (m->multi_io->edge)
+    {
+        if (multi_io_edge_ready(m))
+        {
+            tv_clear(&m->top.c2.timeval);
+        }
+    }
+    else if (has_udp_in_local_list(&m->top.options))
     {
         get_io_flags_udp(&m->top, m->multi_io, p2mp_iow_flags(m));
     }
 
-    tun_set(m->top.c1.tuntap, m->multi_io->es, EVENT_READ, MULTI_IO_TUN, persistent);
+    tun_set(m->top.c1.tuntap, m->multi_io->es,
+            m->multi_io->edge ? EVENT_READ | EVENT_EDGE : EVENT_READ, MULTI_IO_TUN, persistent);
 #if defined(ENABLE_DCO)
     dco_event_set(&m->top.c1.tuntap->dco, m->multi_io->es, MULTI_IO_DCO);
 #endif
@@ -203,9 +402,45 @@ multi_io_wait(struct multi_context *m)
     event_ctl(m->multi_io->es, m->top.c2.inotify_fd, EVENT_READ, MULTI_IO_FILE_CLOSE_WRITE);
 #endif
 
-    status =
-        event_wait(m->multi_io->es, &m->top.c2.timeval, m->multi_io->esr, m->multi_io->maxevents);
+#if ENABLE_SERVER_SHARDS
+    multi_shards_event_set(m, m->multi_io->es, MULTI_IO_SHARDS);
+#endif
+#if ENABLE_SERVER_PROCESSES
+    mproc_event_set(m->multi_io->es, MULTI_IO_SIBLING);
+#endif
+#if ENABLE_SERVER_CRYPTO_THREADS
+    multi_crypto_event_set(m, m->multi_io->es, MULTI_IO_CRYPTO);
+#endif
+#if ENABLE_SERVER_TLS_THREADS
+    if (m->tls_offload)
+    {
+        event_ctl(m->multi_io->es, tls_offload_event_fd(m->tls_offload), EVENT_READ,
+                  MULTI_IO_TLS_OFFLOAD);
+    }
+#endif
+#if ENABLE_AUTH_HELPERS
+    if (m->auth_helpers)
+    {
+        auth_helpers_event_set(m->auth_helpers, m->multi_io->es, MULTI_IO_AUTH_HELPER);
+    }
+#endif
+
+    /* send what the timers queued before going to sleep */
+    sockets_flush_batched(&m->top);
+
+#if ENABLE_SERVER_SHARDS
+    /* the shards may use the data channel while we sleep */
+    multi_shards_unlock(m);
+#endif
+    status = io_event_wait(&m->top, m->multi_io->es, m->multi_io->esr, m->multi_io->maxevents);
+#if ENABLE_SERVER_SHARDS
+    multi_shards_lock(m);
+#endif
     update_time();
+    if (m->multi_io->edge && status >= 0)
+    {
+        status = multi_io_edge_events(m, status);
+    }
     m->multi_io->n_esr = 0;
     if (status > 0)
     {
@@ -305,6 +540,12 @@ multi_io_dispatch(struct multi_context *m, struct multi_instance *mi, const int
             }
             break;
 
+#if ENABLE_SERVER_PROCESSES
+        case TA_SIBLING_READ:
+            mproc_process_sibling(m, mpp_flags);
+            break;
+#endif
+
         case TA_SOCKET_READ:
         case TA_SOCKET_READ_RESIDUAL:
             ASSERT(mi);
@@ -468,6 +709,11 @@ multi_io_process_io(struct multi_context *m)
                         socket_reset_listen_persistent(ev_arg->u.sock);
                         mi = multi_create_instance_tcp(m, ev_arg->u.sock);
                     }
+                    else if (multi_io->edge)
+                    {
+                        multi_io_edge_udp(m, ev_arg->u.sock);
+                        mi = NULL;
+                    }
                     else
                     {
                         multi_process_io_udp(m, ev_arg->u.sock);
@@ -496,7 +742,11 @@ multi_io_process_io(struct multi_context *m)
                 /* incoming data on TUN? */
                 if (e->arg == MULTI_IO_TUN)
                 {
-                    if (e->rwflags & EVENT_WRITE)
+                    if (multi_io->edge)
+                    {
+                        multi_io_edge_tun(m);
+                    }
+                    else if (e->rwflags & EVENT_WRITE)
                     {
                         multi_io_action(m, NULL, TA_TUN_WRITE, false);
                     }
@@ -534,6 +784,42 @@ multi_io_process_io(struct multi_context *m)
                 {
                     multi_process_file_closed(m, MPP_PRE_SELECT | MPP_RECORD_TOUCH);
                 }
+#endif
+#if ENABLE_SERVER_SHARDS
+                /* a shard queued packets or scheduled an instance */
+                else if (e->arg == MULTI_IO_SHARDS)
+                {
+                    multi_shards_wakeup_done(m);
+                }
+#endif
+#if ENABLE_SERVER_CRYPTO_THREADS
+                /* the crypto workers finished packets */
+                else if (e->arg == MULTI_IO_CRYPTO)
+                {
+                    multi_crypto_retire(m);
+                }
+#endif
+#if ENABLE_SERVER_TLS_THREADS
+                /* handshake workers are done */
+                else if (e->arg == MULTI_IO_TLS_OFFLOAD)
+                {
+                    multi_tls_offload_retire(m);
+                }
+#endif
+#if ENABLE_AUTH_HELPERS
+                /* the script helpers answered */
+                else if (e->arg == MULTI_IO_AUTH_HELPER)
+                {
+                    auth_helpers_io(m->auth_helpers);
+                    multi_auth_helpers_retire(m);
+                }
+#endif
+#if ENABLE_SERVER_PROCESSES
+                /* a sibling process passed on a tun/tap packet */
+                else if (e->arg == MULTI_IO_SIBLING)
+                {
+                    multi_io_action(m, NULL, TA_SIBLING_READ, false);
+                }
 #endif
         }
         if (IS_SIG(&m->top))
@@ -553,6 +839,11 @@ multi_io_process_io(struct multi_context *m)
             multi_io_action(m, mi, TA_SOCKET_WRITE, true);
         }
     }
+
+    /*
+     * Send the UDP datagrams queued during this pass
+     */
+    sockets_flush_batched(&m->top);
 }
 
 void
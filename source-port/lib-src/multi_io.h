@@ -44,6 +44,7 @@
 #define TA_INITIAL               8
 #define TA_TIMEOUT               9
 #define TA_TUN_WRITE_TIMEOUT     10
+#define TA_SIBLING_READ          11
 
 /*
  * I/O state and events tracker
@@ -56,12 +57,16 @@ struct multi_io
     int maxevents;
     unsigned int tun_rwflags;
     unsigned int udp_flags;
+
+    /* --server-edge-triggered */
+    bool edge;
+    bool tun_readable; /* until a read finds no packet */
 #ifdef ENABLE_MANAGEMENT
     unsigned int management_persist_flags;
 #endif
 };
 
-struct multi_io *multi_io_init(int maxevents, int *maxclients);
+struct multi_io *multi_io_init(int maxevents, int *maxclients, unsigned int flags);
 
 void multi_io_free(struct multi_io *multi_io);
 
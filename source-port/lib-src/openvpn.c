@@ -32,6 +32,9 @@
 #include "win32.h"
 #include "platform.h"
 #include "string.h"
+#include "tun_queue.h"
+#include "mproc.h"
+#include "msg_async.h"
 
 #include "memdbg.h"
 
@@ -69,11 +72,24 @@ tunnel_point_to_point(struct context *c)
         return;
     }
 
+    if (c->options.cpu_affinity >= 0)
+    {
+        platform_cpu_affinity(c->options.cpu_affinity);
+    }
+
     /* main event loop */
     while (true)
     {
         perf_push(PERF_EVENT_LOOP);
 
+#if ENABLE_TUN_QUEUES
+        /* in pull mode the tun device only opens once the push arrives */
+        if (!c->c2.tun_queues_checked)
+        {
+            tun_queues_start(c);
+        }
+#endif
+
         /* process timers, TLS, etc. */
         pre_select(c);
         P2P_CHECK_SIG();
@@ -96,6 +112,10 @@ tunnel_point_to_point(struct context *c)
         perf_pop();
     }
 
+#if ENABLE_TUN_QUEUES
+    tun_queues_stop(c);
+#endif
+
     persist_client_stats(c);
 
     uninit_management_callback();
@@ -280,7 +300,23 @@ openvpn_main(int argc, char *argv[])
             {
                 c.did_we_daemonize = possibly_become_daemon(&c.options);
                 write_pid_file(c.options.writepid, c.options.chroot_dir);
+#if ENABLE_SERVER_PROCESSES
+                mproc_fork(&c.options);
+#endif
+            }
+
+#if ENABLE_ASYNC_LOG
+            /* after the forks of --daemon and --server-processes */
+            if (c.options.log_async)
+            {
+                msg_async_start();
             }
+#endif
+
+#if ENABLE_SERVER_PROCESSES
+            /* leave the shared parts of the setup to the first process */
+            mproc_options(&c.options);
+#endif
 
 #ifdef ENABLE_MANAGEMENT
             /* open management subsystem */
@@ -325,6 +361,12 @@ openvpn_main(int argc, char *argv[])
                 if (IS_SIG(&c))
                 {
                     print_signal(c.sig, NULL, M_INFO);
+#if ENABLE_SERVER_PROCESSES
+                    if (c.sig->source == SIG_SOURCE_HARD)
+                    {
+                        mproc_signal(c.sig->signal_received);
+                    }
+#endif
                 }
 
                 /* pass restart status to management subsystem */
@@ -367,6 +367,12 @@ struct context_2
     struct context_buffers *buffers;
     bool buffers_owned; /* if true, we should free all buffers on close */
 
+#if ENABLE_TUN_QUEUES
+    /* worker threads serving the extra queues of a --tun-queues device */
+    struct tun_queue_set *tun_queues;
+    bool tun_queues_checked;
+#endif
+
     /*
      * These buffers don't actually allocate storage, they are used
      * as pointers to the allocated buffers in
@@ -61,6 +61,12 @@
 #include "dco.h"
 #include "options_util.h"
 #include "tun_afunix.h"
+#include "mshard.h"
+#include "mcrypto.h"
+#include "ssl_offload.h"
+#include "mproc.h"
+#include "auth_helper.h"
+#include "schedule.h"
 
 #include <ctype.h>
 
@@ -285,6 +291,16 @@ static const char usage_message[] =
     "--multihome     : Configure a multi-homed UDP server.\n"
 #endif
     "--fast-io       : Optimize TUN/TAP/UDP writes.\n"
+#if IO_URING
+    "--io-uring      : Wait for the sockets and the TUN/TAP device with io_uring.\n"
+#endif
+#if ENABLE_BUSY_POLL
+    "--busy-poll n   : Busy poll the UDP sockets for n microseconds before sleeping\n"
+    "                  (SO_BUSY_POLL), and poll the event loop for as long before\n"
+    "                  it blocks.  Lower latency, for more CPU.\n"
+    "--cpu-affinity n: Run the event loop on CPU n.  The threads it starts run on\n"
+    "                  the CPUs OpenVPN was started on.\n"
+#endif
     "--remap-usr1 s  : On SIGUSR1 signals, remap signal (s='SIGHUP' or 'SIGTERM').\n"
     "--persist-tun   : Keep tun/tap device open across SIGUSR1 or --ping-restart.\n"
     "--persist-remote-ip : Keep remote IP address across SIGUSR1 or --ping-restart.\n"
@@ -313,6 +329,16 @@ static const char usage_message[] =
     "                  or --fragment max value, whichever is lower.\n"
     "--sndbuf size   : Set the TCP/UDP send buffer size.\n"
     "--rcvbuf size   : Set the TCP/UDP receive buffer size.\n"
+#if ENABLE_UDP_BATCH
+    "--udp-recv-batch n : Read up to n UDP datagrams per system call.\n"
+    "--udp-send-batch n : Server only: queue up to n UDP datagrams per event loop\n"
+    "                  pass and send them with a single system call.\n"
+#endif
+#if ENABLE_UDP_OFFLOAD
+    "--socket-flags UDP_GSO UDP_GRO : Let the kernel segment runs of queued\n"
+    "                  datagrams (server with --udp-send-batch) and coalesce\n"
+    "                  received ones.\n"
+#endif
 #if defined(TARGET_LINUX) && HAVE_DECL_SO_MARK
     "--mark value    : Mark encrypted packets being sent with value. The mark value\n"
     "                  can be matched in policy routing and packetfilter rules.\n"
@@ -321,6 +347,10 @@ static const char usage_message[] =
     "                  via a VRF present on the system.\n"
 #endif
     "--txqueuelen n  : Set the tun/tap TX queue length to n (Linux only).\n"
+#if ENABLE_TUN_QUEUES
+    "--tun-queues n  : Open n queues on the tun/tap device and serve all but\n"
+    "                  the first one from worker threads (Linux only).\n"
+#endif
 #ifdef ENABLE_MEMSTATS
     "--memstats file : Write live usage stats to memory mapped binary file.\n"
 #endif
@@ -353,6 +383,11 @@ static const char usage_message[] =
     "--log file      : Output log to file which is created/truncated on open.\n"
     "--log-append file : Append log to file, or create file if nonexistent.\n"
     "--suppress-timestamps : Don't log timestamps to stdout/stderr.\n"
+#if ENABLE_ASYNC_LOG
+    "--log-async     : Write the log from a thread of its own, so that logging\n"
+    "                  does not block the tunnel.  Messages are dropped, and\n"
+    "                  counted, if the log cannot keep up.\n"
+#endif
     "--machine-readable-output : Always log timestamp, message flags to stdout/stderr.\n"
     "--writepid file : Write main process ID to file.\n"
     "--nice n        : Change process priority (>0 = lower, <0 = higher).\n"
@@ -483,6 +518,11 @@ static const char usage_message[] =
     "--duplicate-cn  : Allow multiple clients with the same common name to\n"
     "                  concurrently connect.\n"
     "--client-connect cmd : Run command cmd on client connection.\n"
+#if ENABLE_AUTH_HELPERS
+    "--auth-helpers n : Run --auth-user-pass-verify, --client-connect and\n"
+    "                  --client-crresponse as n long-lived helper processes each,\n"
+    "                  answering requests on their stdin, instead of once per event.\n"
+#endif
     "--client-disconnect cmd : Run command cmd on client disconnection.\n"
     "--client-config-dir dir : Directory for custom client config files.\n"
     "--ccd-exclusive : Refuse connection unless custom client config is found.\n"
@@ -496,7 +536,34 @@ static const char usage_message[] =
     "--learn-address cmd : Run command cmd to validate client virtual addresses.\n"
     "--connect-freq n s : Allow a maximum of n new connections per s seconds.\n"
     "--connect-freq-initial n s : Allow a maximum of n replies for initial connections attempts per s seconds.\n"
+    "--connect-flood-guard n s : Allow a maximum of n authentic initial packets per s\n"
+    "                  seconds from each /24 (IPv4) or /56 (IPv6) source.\n"
     "--max-clients n : Allow a maximum of n simultaneously connected clients.\n"
+    "--server-scheduler s : Keep the timers of the clients in a treap (s='treap',\n"
+    "                  the default) or in a timing wheel (s='wheel').\n"
+#ifndef _WIN32
+    "--server-edge-triggered : Register the UDP sockets and the TUN/TAP device of\n"
+    "                  the server once, edge-triggered, and read them until they\n"
+    "                  are empty.  Output is written without waiting, as with\n"
+    "                  --fast-io.\n"
+#endif
+#if ENABLE_SERVER_SHARDS
+    "--server-shards n : Serve the data channel of a UDP server from n threads,\n"
+    "                  each one owning the clients whose peer-id maps to it.\n"
+#endif
+#if ENABLE_SERVER_CRYPTO_THREADS
+    "--server-crypto-threads n : Encrypt and decrypt the data channel packets of a\n"
+    "                  UDP server on n worker threads.\n"
+#endif
+#if ENABLE_SERVER_TLS_THREADS
+    "--server-tls-threads n : Run the TLS handshakes of the clients on n worker\n"
+    "                  threads.\n"
+#endif
+#if ENABLE_SERVER_PROCESSES
+    "--server-processes n : Run a UDP server as n processes sharing the port and\n"
+    "                  the tun/tap device, each one owning the clients whose\n"
+    "                  peer-id maps to it.\n"
+#endif
     "--max-routes-per-client n : Allow a maximum of n internal routes per client.\n"
     "--stale-routes-check n [t] : Remove routes with a last activity timestamp\n"
     "                             older than n seconds. Run this check every t\n"
@@ -630,6 +697,9 @@ static const char usage_message[] =
     "                  after new key renegotiation begins (default=%d).\n"
     "--single-session: Allow only one session (reset state on restart).\n"
     "--tls-exit      : Exit on TLS negotiation failure.\n"
+    "--tls-resume [n]: Resume earlier TLS 1.3 sessions to speed up reconnects and\n"
+    "                  renegotiations.  A server keeps its sessions for n seconds\n"
+    "                  (default=%d).\n"
     "--tls-auth f [d]: Add an additional layer of authentication on top of the TLS\n"
     "                  control channel to protect against attacks on the TLS stack\n"
     "                  and DoS attacks.\n"
@@ -838,6 +908,7 @@ init_options(struct options *o, const bool init_gc)
     o->resolve_retry_seconds = RESOLV_RETRY_INFINITE;
     o->resolve_in_advance = false;
     o->proto_force = -1;
+    o->cpu_affinity = -1;
     o->occ = true;
 #ifdef ENABLE_MANAGEMENT
     o->management_log_history_cache = 250;
@@ -1453,10 +1524,19 @@ show_p2mp_parms(const struct options *o)
     SHOW_INT(cf_per);
     SHOW_INT(cf_initial_max);
     SHOW_INT(cf_initial_per);
+    SHOW_INT(cf_prefix_max);
+    SHOW_INT(cf_prefix_per);
     SHOW_INT(max_clients);
     SHOW_INT(max_routes_per_client);
+    SHOW_INT(server_scheduler);
+    SHOW_BOOL(server_edge_triggered);
+    SHOW_INT(server_shards);
+    SHOW_INT(server_crypto_threads);
+    SHOW_INT(server_tls_threads);
+    SHOW_INT(server_processes);
     SHOW_STR(auth_user_pass_verify_script);
     SHOW_BOOL(auth_user_pass_verify_script_via_file);
+    SHOW_INT(auth_helpers);
     SHOW_BOOL(auth_token_generate);
     SHOW_BOOL(force_key_material_export);
     SHOW_INT(auth_token_lifetime);
@@ -1772,6 +1852,7 @@ show_settings(const struct options *o)
     SHOW_BOOL(daemon);
     SHOW_BOOL(log);
     SHOW_BOOL(suppress_timestamps);
+    SHOW_BOOL(log_async);
     SHOW_BOOL(machine_readable_output);
     SHOW_INT(nice);
     SHOW_INT(verbosity);
@@ -1790,8 +1871,18 @@ show_settings(const struct options *o)
     SHOW_INT(mark);
 #endif
     SHOW_INT(sockflags);
+#if ENABLE_TUN_QUEUES
+    SHOW_INT(tuntap_options.queues);
+#endif
+#if ENABLE_UDP_BATCH
+    SHOW_INT(udp_recv_batch);
+    SHOW_INT(udp_send_batch);
+#endif
 
     SHOW_BOOL(fast_io);
+    SHOW_BOOL(io_uring);
+    SHOW_INT(busy_poll);
+    SHOW_INT(cpu_affinity);
 
     SHOW_INT(comp.alg);
     SHOW_INT(comp.flags);
@@ -1931,6 +2022,7 @@ show_settings(const struct options *o)
     SHOW_BOOL(single_session);
     SHOW_BOOL(push_peer_info);
     SHOW_BOOL(tls_exit);
+    SHOW_INT(tls_resume);
 
     SHOW_STR(tls_crypt_v2_metadata);
 
@@ -2514,6 +2606,9 @@ options_postprocess_verify_ce(const struct options *options, const struct connec
             msg(M_USAGE, "--mode server only works with --dev tun or --dev tap");
         }
         MUST_BE_UNDEF(pull, "pull");
+#if ENABLE_TUN_QUEUES
+        MUST_BE_UNDEF(tuntap_options.queues, "tun-queues");
+#endif
         if (options->pull_filter_list)
         {
             msg(M_WARN, "--pull-filter ignored for --mode server");
@@ -2632,6 +2727,21 @@ options_postprocess_verify_ce(const struct options *options, const struct connec
             MUST_BE_UNDEF(vlan_accept, "vlan-accept");
             MUST_BE_UNDEF(vlan_pvid, "vlan-pvid");
         }
+        if (options->server_processes > 1)
+        {
+            if (!proto_is_udp(ce->proto))
+            {
+                msg(M_USAGE, "--server-processes only works with --proto udp");
+            }
+            if (!tun_name_is_fixed(options->dev))
+            {
+                msg(M_USAGE, "--server-processes needs a fixed --dev name like tun0");
+            }
+            if (options->vlan_tagging)
+            {
+                msg(M_USAGE, "--server-processes cannot be used with --vlan-tagging");
+            }
+        }
     }
     else
     {
@@ -2648,6 +2758,7 @@ options_postprocess_verify_ce(const struct options *options, const struct connec
         MUST_BE_UNDEF(learn_address_script, "learn-address");
         MUST_BE_UNDEF(client_connect_script, "client-connect");
         MUST_BE_UNDEF(client_crresponse_script, "client-crresponse");
+        MUST_BE_UNDEF(auth_helpers, "auth-helpers");
         MUST_BE_UNDEF(client_disconnect_script, "client-disconnect");
         MUST_BE_UNDEF(client_config_dir, "client-config-dir");
         MUST_BE_UNDEF(ccd_exclusive, "ccd-exclusive");
@@ -2655,6 +2766,13 @@ options_postprocess_verify_ce(const struct options *options, const struct connec
         MUST_BE_UNDEF(duplicate_cn, "duplicate-cn");
         MUST_BE_UNDEF(cf_max, "connect-freq");
         MUST_BE_UNDEF(cf_per, "connect-freq");
+        MUST_BE_UNDEF(cf_prefix_max, "connect-flood-guard");
+        MUST_BE_UNDEF(server_scheduler, "server-scheduler");
+        MUST_BE_UNDEF(server_edge_triggered, "server-edge-triggered");
+        MUST_BE_UNDEF(server_shards, "server-shards");
+        MUST_BE_UNDEF(server_crypto_threads, "server-crypto-threads");
+        MUST_BE_UNDEF(server_tls_threads, "server-tls-threads");
+        MUST_BE_UNDEF(server_processes, "server-processes");
         MUST_BE_FALSE(options->ssl_flags
                           & (SSLF_CLIENT_CERT_NOT_REQUIRED | SSLF_CLIENT_CERT_OPTIONAL),
                       "verify-client-cert");
@@ -2892,6 +3010,7 @@ options_postprocess_verify_ce(const struct options *options, const struct connec
         MUST_BE_UNDEF(single_session, "single-session");
         MUST_BE_UNDEF(push_peer_info, "push-peer-info");
         MUST_BE_UNDEF(tls_exit, "tls-exit");
+        MUST_BE_UNDEF(tls_resume, "tls-resume");
         MUST_BE_UNDEF(crl_file, "crl-verify");
         MUST_BE_UNDEF(ns_cert_type, "ns-cert-type");
         MUST_BE_UNDEF(remote_cert_ku[0], "remote-cert-ku");
@@ -4845,7 +4964,8 @@ usage(void)
     fprintf(fp, usage_message, title_string, o.ce.connect_retry_seconds,
             o.ce.connect_retry_seconds_max, o.ce.local_port, o.ce.remote_port, TUN_MTU_DEFAULT,
             TAP_MTU_EXTRA_DEFAULT, o.verbosity, o.authname, o.replay_window, o.replay_time,
-            o.tls_timeout, o.renegotiate_seconds, o.handshake_window, o.transition_window);
+            o.tls_timeout, o.renegotiate_seconds, o.handshake_window, o.transition_window,
+            TLS_RESUME_LIFETIME_DEFAULT);
     fflush(fp);
 
 #endif                                       /* ENABLE_SMALL */
@@ -6891,6 +7011,16 @@ add_option(struct options *options, char *p[], bool is_inline, const char *file,
         options->suppress_timestamps = true;
         set_suppress_timestamps(true);
     }
+    else if (streq(p[0], "log-async") && !p[1])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if ENABLE_ASYNC_LOG
+        options->log_async = true;
+#else
+        msg(msglevel, "--log-async not supported on this OS");
+        goto err;
+#endif
+    }
     else if (streq(p[0], "machine-readable-output") && !p[1])
     {
         VERIFY_PERMISSION(OPT_P_GENERAL);
@@ -7120,12 +7250,54 @@ add_option(struct options *options, char *p[], bool is_inline, const char *file,
             {
                 options->sockflags |= SF_TCP_NODELAY;
             }
+#if ENABLE_UDP_OFFLOAD
+            else if (streq(p[j], "UDP_GSO"))
+            {
+                options->sockflags |= SF_UDP_GSO;
+            }
+            else if (streq(p[j], "UDP_GRO"))
+            {
+                options->sockflags |= SF_UDP_GRO;
+            }
+#endif
             else
             {
                 msg(msglevel, "unknown socket flag: %s", p[j]);
             }
         }
     }
+    else if (streq(p[0], "udp-recv-batch") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if ENABLE_UDP_BATCH
+        int batch = positive_atoi(p[1], msglevel);
+        if (batch < 1 || batch > UDP_BATCH_MAX)
+        {
+            msg(msglevel, "--udp-recv-batch must be between 1 and %d", UDP_BATCH_MAX);
+            goto err;
+        }
+        options->udp_recv_batch = batch;
+#else
+        msg(msglevel, "--udp-recv-batch not supported on this OS");
+        goto err;
+#endif
+    }
+    else if (streq(p[0], "udp-send-batch") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if ENABLE_UDP_BATCH
+        int batch = positive_atoi(p[1], msglevel);
+        if (batch < 1 || batch > UDP_BATCH_MAX)
+        {
+            msg(msglevel, "--udp-send-batch must be between 1 and %d", UDP_BATCH_MAX);
+            goto err;
+        }
+        options->udp_send_batch = batch;
+#else
+        msg(msglevel, "--udp-send-batch not supported on this OS");
+        goto err;
+#endif
+    }
 #ifdef TARGET_LINUX
     else if (streq(p[0], "bind-dev") && p[1])
     {
@@ -7141,6 +7313,22 @@ add_option(struct options *options, char *p[], bool is_inline, const char *file,
 #else
         msg(msglevel, "--txqueuelen not supported on this OS");
         goto err;
+#endif
+    }
+    else if (streq(p[0], "tun-queues") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if ENABLE_TUN_QUEUES
+        int queues = positive_atoi(p[1], msglevel);
+        if (queues < 1 || queues > TUN_QUEUES_MAX)
+        {
+            msg(msglevel, "--tun-queues must be between 1 and %d", TUN_QUEUES_MAX);
+            goto err;
+        }
+        options->tuntap_options.queues = queues;
+#else
+        msg(msglevel, "--tun-queues not supported on this OS");
+        goto err;
 #endif
     }
     else if (streq(p[0], "shaper") && p[1] && !p[2])
@@ -7191,6 +7379,47 @@ add_option(struct options *options, char *p[], bool is_inline, const char *file,
         VERIFY_PERMISSION(OPT_P_GENERAL | OPT_P_CONNECTION);
         options->ce.bind_local = false;
     }
+    else if (streq(p[0], "io-uring") && !p[1])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if IO_URING
+        options->io_uring = true;
+#else
+        msg(msglevel, "--io-uring not supported by this build");
+        goto err;
+#endif
+    }
+    else if (streq(p[0], "busy-poll") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if ENABLE_BUSY_POLL
+        int usec = positive_atoi(p[1], msglevel);
+        if (usec < 1 || usec > 1000000)
+        {
+            msg(msglevel, "--busy-poll must be between 1 and 1000000");
+            goto err;
+        }
+        options->busy_poll = usec;
+#else
+        msg(msglevel, "--busy-poll not supported on this OS");
+        goto err;
+#endif
+    }
+    else if (streq(p[0], "cpu-affinity") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if ENABLE_BUSY_POLL
+        if (!valid_integer(p[1], true))
+        {
+            msg(msglevel, "--cpu-affinity must be a CPU number");
+            goto err;
+        }
+        options->cpu_affinity = atoi(p[1]);
+#else
+        msg(msglevel, "--cpu-affinity not supported on this OS");
+        goto err;
+#endif
+    }
     else if (streq(p[0], "fast-io") && !p[1])
     {
         VERIFY_PERMISSION(OPT_P_GENERAL);
@@ -7984,6 +8213,19 @@ add_option(struct options *options, char *p[], bool is_inline, const char *file,
         options->cf_initial_max = cf_max;
         options->cf_initial_per = cf_per;
     }
+    else if (streq(p[0], "connect-flood-guard") && p[1] && p[2] && !p[3])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        int cf_max = positive_atoi(p[1], msglevel);
+        int cf_per = positive_atoi(p[2], msglevel);
+        if (cf_max < 1 || cf_per < 1)
+        {
+            msg(msglevel, "--connect-flood-guard parameters must be integers and >= 1");
+            goto err;
+        }
+        options->cf_prefix_max = cf_max;
+        options->cf_prefix_per = cf_per;
+    }
     else if (streq(p[0], "max-clients") && p[1] && !p[2])
     {
         int max_clients;
@@ -8002,6 +8244,99 @@ add_option(struct options *options, char *p[], bool is_inline, const char *file,
         }
         options->max_clients = max_clients;
     }
+    else if (streq(p[0], "server-scheduler") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        if (streq(p[1], "treap"))
+        {
+            options->server_scheduler = SCHEDULE_TREAP;
+        }
+        else if (streq(p[1], "wheel"))
+        {
+            options->server_scheduler = SCHEDULE_WHEEL;
+        }
+        else
+        {
+            msg(msglevel, "Bad --server-scheduler parameter: %s", p[1]);
+            goto err;
+        }
+    }
+    else if (streq(p[0], "server-edge-triggered") && !p[1])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#ifndef _WIN32
+        options->server_edge_triggered = true;
+#else
+        msg(msglevel, "--server-edge-triggered not supported on this OS");
+        goto err;
+#endif
+    }
+    else if (streq(p[0], "server-shards") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if ENABLE_SERVER_SHARDS
+        int shards = positive_atoi(p[1], msglevel);
+        if (shards < 1 || shards > MULTI_SHARDS_MAX)
+        {
+            msg(msglevel, "--server-shards must be between 1 and %d", MULTI_SHARDS_MAX);
+            goto err;
+        }
+        options->server_shards = shards;
+#else
+        msg(msglevel, "--server-shards not supported on this OS");
+        goto err;
+#endif
+    }
+    else if (streq(p[0], "server-crypto-threads") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if ENABLE_SERVER_CRYPTO_THREADS
+        int threads = positive_atoi(p[1], msglevel);
+        if (threads < 1 || threads > MULTI_CRYPTO_THREADS_MAX)
+        {
+            msg(msglevel, "--server-crypto-threads must be between 1 and %d",
+                MULTI_CRYPTO_THREADS_MAX);
+            goto err;
+        }
+        options->server_crypto_threads = threads;
+#else
+        msg(msglevel, "--server-crypto-threads not supported on this OS");
+        goto err;
+#endif
+    }
+    else if (streq(p[0], "server-tls-threads") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if ENABLE_SERVER_TLS_THREADS
+        int threads = positive_atoi(p[1], msglevel);
+        if (threads < 1 || threads > TLS_OFFLOAD_THREADS_MAX)
+        {
+            msg(msglevel, "--server-tls-threads must be between 1 and %d",
+                TLS_OFFLOAD_THREADS_MAX);
+            goto err;
+        }
+        options->server_tls_threads = threads;
+#else
+        msg(msglevel, "--server-tls-threads not supported by this build");
+        goto err;
+#endif
+    }
+    else if (streq(p[0], "server-processes") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if ENABLE_SERVER_PROCESSES
+        int processes = positive_atoi(p[1], msglevel);
+        if (processes < 1 || processes > MPROC_MAX)
+        {
+            msg(msglevel, "--server-processes must be between 1 and %d", MPROC_MAX);
+            goto err;
+        }
+        options->server_processes = processes;
+#else
+        msg(msglevel, "--server-processes not supported on this OS");
+        goto err;
+#endif
+    }
     else if (streq(p[0], "max-routes-per-client") && p[1] && !p[2])
     {
         VERIFY_PERMISSION(OPT_P_INHERIT);
@@ -8136,6 +8471,22 @@ add_option(struct options *options, char *p[], bool is_inline, const char *file,
         set_user_script(options, &options->client_crresponse_script, p[1], "client-crresponse",
                         true);
     }
+    else if (streq(p[0], "auth-helpers") && p[1] && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+#if ENABLE_AUTH_HELPERS
+        int helpers = positive_atoi(p[1], msglevel);
+        if (helpers < 1 || helpers > AUTH_HELPERS_MAX)
+        {
+            msg(msglevel, "--auth-helpers must be between 1 and %d", AUTH_HELPERS_MAX);
+            goto err;
+        }
+        options->auth_helpers = helpers;
+#else
+        msg(msglevel, "--auth-helpers not supported by this build");
+        goto err;
+#endif
+    }
     else if (streq(p[0], "client-disconnect") && p[1])
     {
         VERIFY_PERMISSION(OPT_P_SCRIPT);
@@ -9588,6 +9939,22 @@ add_option(struct options *options, char *p[], bool is_inline, const char *file,
             goto err;
         }
     }
+    else if (streq(p[0], "tls-resume") && !p[2])
+    {
+        VERIFY_PERMISSION(OPT_P_GENERAL);
+        int lifetime = TLS_RESUME_LIFETIME_DEFAULT;
+        if (p[1])
+        {
+            lifetime = positive_atoi(p[1], msglevel);
+            if (lifetime < 1 || lifetime > TLS_RESUME_LIFETIME_MAX)
+            {
+                msg(msglevel, "--tls-resume lifetime must be between 1 and %d seconds",
+                    TLS_RESUME_LIFETIME_MAX);
+                goto err;
+            }
+        }
+        options->tls_resume = lifetime;
+    }
     else if (streq(p[0], "tls-timeout") && p[1] && !p[2])
     {
         VERIFY_PERMISSION(OPT_P_TLS_PARMS);
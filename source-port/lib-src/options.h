@@ -394,6 +394,7 @@ struct options
 
     bool log;
     bool suppress_timestamps;
+    bool log_async;
     bool machine_readable_output;
     int nice;
     int verbosity;
@@ -409,6 +410,11 @@ struct options
 
     /* optimize TUN/TAP/UDP writes */
     bool fast_io;
+    bool io_uring;
+
+    /* spin before sleeping, for latency */
+    int busy_poll;
+    int cpu_affinity;
 
     struct compress_options comp;
 
@@ -423,6 +429,10 @@ struct options
     /* socket flags */
     unsigned int sockflags;
 
+    /* max datagrams per recvmmsg()/sendmmsg() call, <= 1 disables batching */
+    int udp_recv_batch;
+    int udp_send_batch;
+
     /* route management */
     const char *route_script;
     const char *route_predown_script;
@@ -535,13 +545,23 @@ struct options
     int cf_initial_max;
     int cf_initial_per;
 
+    int cf_prefix_max;
+    int cf_prefix_per;
+
     int max_clients;
     int max_routes_per_client;
+    int server_scheduler;
+    bool server_edge_triggered;
+    int server_shards;
+    int server_crypto_threads;
+    int server_tls_threads;
+    int server_processes;
     int stale_routes_check_interval;
     int stale_routes_ageing_time;
 
     const char *auth_user_pass_verify_script;
     bool auth_user_pass_verify_script_via_file;
+    int auth_helpers;
     bool auth_token_generate;
     bool auth_token_call_auth;
     int auth_token_lifetime;
@@ -686,6 +706,9 @@ struct options
 
     bool tls_exit;
 
+    /* Seconds a TLS session can be resumed, 0 to not resume */
+    int tls_resume;
+
     const struct x509_track *x509_track;
 
     /* special state parms */
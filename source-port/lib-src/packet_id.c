@@ -45,12 +45,7 @@
 
 /* #define PID_SIMULATE_BACKTRACK */
 
-/*
- * Special time_t value that indicates that
- * sequence number has expired.
- */
-#define SEQ_UNSEEN  ((time_t)0)
-#define SEQ_EXPIRED ((time_t)1)
+#define SEQ_WORD_BITS 64
 
 #ifdef ENABLE_DEBUG
 static void packet_id_debug_print(int msglevel, const struct packet_id_rec *p,
@@ -71,6 +66,68 @@ packet_id_debug(int msglevel, const struct packet_id_rec *p, const struct packet
 #endif
 }
 
+/*
+ * Allocate a window for seq_backtrack sequence numbers, in one block.
+ */
+static struct seq_window *
+seq_window_new(int seq_backtrack)
+{
+    struct seq_window *w;
+    const int n_words = (int)adjust_power_of_2(seq_backtrack / SEQ_WORD_BITS + 2);
+    const size_t size = sizeof(*w) + n_words * (sizeof(w->bits[0]) + sizeof(w->word_time[0]));
+
+    w = calloc(1, size);
+    check_malloc_return(w);
+    w->n_words = n_words;
+    w->word_time = (time_t *)&w->bits[n_words];
+    return w;
+}
+
+static void
+seq_window_reset(struct seq_window *w, uint64_t floor)
+{
+    memset(w->bits, 0, w->n_words * sizeof(w->bits[0]));
+    memset(w->word_time, 0, w->n_words * sizeof(w->word_time[0]));
+    w->floor = floor;
+    w->reap_word = 0;
+}
+
+/*
+ * Move the top of the window from id to new_id, clearing the words
+ * that are reused.
+ */
+static void
+seq_window_advance(struct seq_window *w, uint64_t id, uint64_t new_id)
+{
+    const uint64_t top = id / SEQ_WORD_BITS;
+    const uint64_t new_top = new_id / SEQ_WORD_BITS;
+    const uint64_t mask = w->n_words - 1;
+
+    if (new_top - top >= (uint64_t)w->n_words)
+    {
+        memset(w->bits, 0, w->n_words * sizeof(w->bits[0]));
+        memset(w->word_time, 0, w->n_words * sizeof(w->word_time[0]));
+        return;
+    }
+    for (uint64_t i = top + 1; i <= new_top; ++i)
+    {
+        w->bits[i & mask] = 0;
+        w->word_time[i & mask] = 0;
+    }
+}
+
+static inline uint64_t *
+seq_window_word(const struct seq_window *w, uint64_t id)
+{
+    return (uint64_t *)&w->bits[(id / SEQ_WORD_BITS) & (w->n_words - 1)];
+}
+
+static inline uint64_t
+seq_window_bit(uint64_t id)
+{
+    return (uint64_t)1 << (id % SEQ_WORD_BITS);
+}
+
 static void
 packet_id_init_recv(struct packet_id_rec *rec, int seq_backtrack, int time_backtrack,
                     const char *name, int unit)
@@ -81,7 +138,7 @@ packet_id_init_recv(struct packet_id_rec *rec, int seq_backtrack, int time_backt
     {
         ASSERT(MIN_SEQ_BACKTRACK <= seq_backtrack && seq_backtrack <= MAX_SEQ_BACKTRACK);
         ASSERT(MIN_TIME_BACKTRACK <= time_backtrack && time_backtrack <= MAX_TIME_BACKTRACK);
-        CIRC_LIST_ALLOC(rec->seq_list, struct seq_list, seq_backtrack);
+        rec->window = seq_window_new(seq_backtrack);
         rec->seq_backtrack = seq_backtrack;
         rec->time_backtrack = time_backtrack;
     }
@@ -106,7 +163,7 @@ packet_id_move_recv(struct packet_id_rec *dest, struct packet_id_rec *src)
     ASSERT(src);
     ASSERT(dest);
     /* clear free any old data in rec list */
-    free(dest->seq_list);
+    free(dest->window);
     CLEAR(*dest);
 
     /* Copy data to dest */
@@ -123,7 +180,7 @@ packet_id_free(struct packet_id *p)
     if (p)
     {
         dmsg(D_PID_DEBUG, "PID packet_id_free");
-        free(p->rec.seq_list);
+        free(p->rec.window);
         CLEAR(*p);
     }
 }
@@ -131,16 +188,14 @@ packet_id_free(struct packet_id *p)
 void
 packet_id_add(struct packet_id_rec *p, const struct packet_id_net *pin)
 {
-    const time_t local_now = now;
-    if (p->seq_list)
+    struct seq_window *w = p->window;
+    if (w)
     {
-        int64_t diff;
-
         /*
-         * If time value increases, start a new sequence list of number
-         * sequence for the new time point.
+         * If time value increases, start a new sequence window
+         * for the new time point.
          */
-        if (!CIRC_LIST_SIZE(p->seq_list) || pin->time > p->time
+        if (pin->time > p->time
             || (pin->id >= p->seq_backtrack && pin->id - p->seq_backtrack > p->id))
         {
             p->time = pin->time;
@@ -149,23 +204,19 @@ packet_id_add(struct packet_id_rec *p, const struct packet_id_net *pin)
             {
                 p->id = pin->id - p->seq_backtrack;
             }
-            CIRC_LIST_RESET(p->seq_list);
+            seq_window_reset(w, p->id);
         }
 
-        while (p->id < pin->id
-#ifdef PID_SIMULATE_BACKTRACK
-               || (get_random() % 64) < 31
-#endif
-        )
+        if (p->id < pin->id)
         {
-            CIRC_LIST_PUSH(p->seq_list, SEQ_UNSEEN);
-            ++p->id;
+            seq_window_advance(w, p->id, pin->id);
+            p->id = pin->id;
         }
 
-        diff = p->id - pin->id;
-        if (diff < CIRC_LIST_SIZE(p->seq_list) && local_now > SEQ_EXPIRED)
+        if (p->id - pin->id < p->seq_backtrack && pin->id > w->floor)
         {
-            CIRC_LIST_ITEM(p->seq_list, diff) = local_now;
+            *seq_window_word(w, pin->id) |= seq_window_bit(pin->id);
+            w->word_time[(pin->id / SEQ_WORD_BITS) & (w->n_words - 1)] = now;
         }
     }
     else
@@ -179,30 +230,58 @@ packet_id_add(struct packet_id_rec *p, const struct packet_id_net *pin)
  * Expire sequence numbers which can no longer
  * be accepted because they would violate
  * time_backtrack.
+ *
+ * Walks the words from the oldest one not expired yet up to the first
+ * one that received a packet recently, and raises the floor to the
+ * highest sequence number received in the words before it.  Words are
+ * looked at again only until they expire, so this is not a pass over
+ * the whole window.
  */
 void
 packet_id_reap(struct packet_id_rec *p)
 {
     const time_t local_now = now;
-    if (p->time_backtrack)
+    struct seq_window *w = p->window;
+
+    if (p->time_backtrack && w)
     {
-        bool expire = false;
-        for (int i = 0; i < CIRC_LIST_SIZE(p->seq_list); ++i)
+        const uint64_t top = p->id / SEQ_WORD_BITS;
+        uint64_t word = (w->floor + 1) / SEQ_WORD_BITS;
+
+        if (word < w->reap_word)
+        {
+            word = w->reap_word;
+        }
+        /* only words still in the window */
+        if (p->id >= p->seq_backtrack && word < (p->id - p->seq_backtrack + 1) / SEQ_WORD_BITS)
         {
-            const time_t t = CIRC_LIST_ITEM(p->seq_list, i);
-            if (t == SEQ_EXPIRED)
+            word = (p->id - p->seq_backtrack + 1) / SEQ_WORD_BITS;
+        }
+
+        for (; word <= top; ++word)
+        {
+            const int i = (int)(word & (w->n_words - 1));
+            const time_t t = w->word_time[i];
+            if (t && t + p->time_backtrack >= local_now)
             {
                 break;
             }
-            if (!expire && t && t + p->time_backtrack < local_now)
-            {
-                expire = true;
-            }
-            if (expire)
+            if (t)
             {
-                CIRC_LIST_ITEM(p->seq_list, i) = SEQ_EXPIRED;
+                /* highest sequence number received in this word */
+                uint64_t bits = w->bits[i];
+                int hi = SEQ_WORD_BITS - 1;
+                while (!(bits & ((uint64_t)1 << hi)))
+                {
+                    --hi;
+                }
+                if (w->floor < word * SEQ_WORD_BITS + hi)
+                {
+                    w->floor = word * SEQ_WORD_BITS + hi;
+                }
             }
         }
+        w->reap_word = word;
     }
     p->last_reap = local_now;
 }
@@ -252,24 +331,21 @@ packet_id_test(struct packet_id_rec *p, const struct packet_id_net *pin)
                                 p->max_backtrack_stat);
             }
 
-            if (diff >= (packet_id_type)CIRC_LIST_SIZE(p->seq_list))
+            if (diff >= p->seq_backtrack || pin->id <= p->window->floor)
             {
                 packet_id_debug(D_PID_DEBUG_LOW, p, pin, "PID_ERR large diff", diff);
                 return false;
             }
 
+            if (!(*seq_window_word(p->window, pin->id) & seq_window_bit(pin->id)))
             {
-                const time_t v = CIRC_LIST_ITEM(p->seq_list, diff);
-                if (v == 0)
-                {
-                    return true;
-                }
-                else
-                {
-                    /* raised from D_PID_DEBUG_LOW to reduce verbosity */
-                    packet_id_debug(D_PID_DEBUG_MEDIUM, p, pin, "PID_ERR replay", diff);
-                    return false;
-                }
+                return true;
+            }
+            else
+            {
+                /* raised from D_PID_DEBUG_LOW to reduce verbosity */
+                packet_id_debug(D_PID_DEBUG_MEDIUM, p, pin, "PID_ERR replay", diff);
+                return false;
             }
         }
         else if (pin->time < p->time) /* if time goes back, reject */
@@ -580,39 +656,37 @@ packet_id_debug_print(int msglevel, const struct packet_id_rec *p, const struct
     struct buffer out = alloc_buf_gc(256, &gc);
     struct timeval tv;
     const time_t prev_now = now;
-    const struct seq_list *sl = p->seq_list;
-    int i;
+    const struct seq_window *w = p->window;
 
     CLEAR(tv);
     gettimeofday(&tv, NULL);
 
     buf_printf(&out, "%s [" packet_id_format "]", message, value);
     buf_printf(&out, " [%s-%d] [", p->name, p->unit);
-    for (i = 0; sl != NULL && i < sl->x_size; ++i)
+    for (uint64_t diff = 0; w != NULL && diff < p->seq_backtrack && diff <= p->id; ++diff)
     {
+        const uint64_t id = p->id - diff;
         char c;
-        time_t v;
-        int diff;
 
-        v = CIRC_LIST_ITEM(sl, i);
-        if (v == SEQ_UNSEEN)
+        if (id <= w->floor)
         {
-            c = '_';
+            c = 'E';
         }
-        else if (v == SEQ_EXPIRED)
+        else if (!(*seq_window_word(w, id) & seq_window_bit(id)))
         {
-            c = 'E';
+            c = '_';
         }
         else
         {
-            diff = (int)(prev_now - v);
-            if (diff < 0)
+            const time_t v = w->word_time[(id / SEQ_WORD_BITS) & (w->n_words - 1)];
+            const int age = (int)(prev_now - v);
+            if (age < 0)
             {
                 c = 'N';
             }
-            else if (diff < 10)
+            else if (age < 10)
             {
-                c = (char)('0' + diff);
+                c = (char)('0' + age);
             }
             else
             {
@@ -631,9 +705,9 @@ packet_id_debug_print(int msglevel, const struct packet_id_rec *p, const struct
 
     buf_printf(&out, " r=[%d,%" PRIu64 ",%d,%" PRIu64 ",%d]", (int)(p->last_reap - tv.tv_sec),
                p->seq_backtrack, p->time_backtrack, p->max_backtrack_stat, (int)p->initialized);
-    if (sl != NULL)
+    if (w != NULL)
     {
-        buf_printf(&out, " sl=[%d,%d,%d,%d]", sl->x_head, sl->x_size, sl->x_cap, sl->x_sizeof);
+        buf_printf(&out, " sw=[%d," packet_id_format "]", w->n_words, w->floor);
     }
 
 
@@ -29,7 +29,6 @@
 #ifndef PACKET_ID_H
 #define PACKET_ID_H
 
-#include "circ_list.h"
 #include "buffer.h"
 #include "error.h"
 #include "otime.h"
@@ -96,14 +95,32 @@ typedef uint64_t packet_id_print_type;
 
 /*
  * Do a reap pass through the sequence number
- * array once every n seconds in order to
+ * window once every n seconds in order to
  * expire sequence numbers which can no longer
  * be accepted because they would violate
  * TIME_BACKTRACK.
  */
 #define SEQ_REAP_INTERVAL 5
 
-CIRC_LIST(seq_list, time_t);
+/*
+ * Sliding window of the sequence numbers received, a ring of bits as
+ * in RFC 6479.  Bit (id % (64 * n_words)) is set once id has been
+ * received.  The ring has at least one word more than the window, so
+ * that it can move forward a whole word at a time: the words it moves
+ * into are cleared, nothing else has to be shifted.
+ *
+ * For TIME_BACKTRACK, each word remembers when the last packet in it
+ * was received, and sequence numbers up to floor are no longer
+ * accepted.
+ */
+struct seq_window
+{
+    uint64_t floor;     /* highest sequence number expired */
+    uint64_t reap_word; /* first word (id / 64) packet_id_reap() has to look at */
+    int n_words;        /* power of 2 */
+    time_t *word_time;  /* last receive time of each word, 0 if none */
+    uint64_t bits[];
+};
 
 /*
  * This is the data structure we keep on the receiving side,
@@ -119,7 +136,7 @@ struct packet_id_rec
     int time_backtrack;          /* set from --replay-window */
     uint64_t max_backtrack_stat; /* maximum backtrack seen so far */
     bool initialized;            /* true if packet_id_init was called */
-    struct seq_list *seq_list;   /* packet-id "memory" */
+    struct seq_window *window;   /* packet-id "memory" */
     const char *name;
     int unit;
 };
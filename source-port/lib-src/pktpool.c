@@ -0,0 +1,251 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "syshead.h"
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+#include "error.h"
+#include "integer.h"
+#include "pktpool.h"
+
+#include "memdbg.h"
+
+#define PKTPOOL_ALIGN     64
+#define PKTPOOL_MIN_SHIFT 9  /* 512 bytes */
+#define PKTPOOL_MAX_SHIFT 16 /* 64 KiB */
+#define PKTPOOL_CLASSES   (PKTPOOL_MAX_SHIFT - PKTPOOL_MIN_SHIFT + 1)
+
+/* bytes kept on the free list of each class */
+#define PKTPOOL_FREE_BYTES (4 * 1024 * 1024)
+
+/*
+ * Precedes every block, in the cache line before the data.
+ */
+struct pktpool_chunk
+{
+    void *raw;                  /* what malloc() returned */
+    struct pktpool_chunk *next; /* on the free list */
+    int cls;                    /* size class, -1 if not pooled */
+};
+
+static_assert(sizeof(struct pktpool_chunk) <= PKTPOOL_ALIGN, "pktpool header too large");
+
+struct pktpool_class
+{
+    struct pktpool_chunk *free;
+    int n_free;
+    int max_free;
+};
+
+static struct
+{
+#ifndef _WIN32
+    pthread_mutex_t lock;
+#endif
+    struct pktpool_class classes[PKTPOOL_CLASSES];
+    struct pktpool_stats stats;
+} pktpool = {
+#ifndef _WIN32
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+};
+
+static inline void
+pktpool_lock(void)
+{
+#ifndef _WIN32
+    pthread_mutex_lock(&pktpool.lock);
+#endif
+}
+
+static inline void
+pktpool_unlock(void)
+{
+#ifndef _WIN32
+    pthread_mutex_unlock(&pktpool.lock);
+#endif
+}
+
+/*
+ * Return the smallest class that fits size bytes, or -1.
+ */
+static int
+pktpool_class_of(size_t size)
+{
+    for (int cls = 0; cls < PKTPOOL_CLASSES; ++cls)
+    {
+        if (size <= ((size_t)1 << (PKTPOOL_MIN_SHIFT + cls)))
+        {
+            return cls;
+        }
+    }
+    return -1;
+}
+
+static struct pktpool_chunk *
+pktpool_chunk_new(size_t size, int cls)
+{
+    void *raw = malloc(PKTPOOL_ALIGN + size + PKTPOOL_ALIGN - 1);
+    check_malloc_return(raw);
+
+    const uintptr_t p = ((uintptr_t)raw + PKTPOOL_ALIGN - 1) & ~(uintptr_t)(PKTPOOL_ALIGN - 1);
+    struct pktpool_chunk *chunk = (struct pktpool_chunk *)p;
+    chunk->raw = raw;
+    chunk->next = NULL;
+    chunk->cls = cls;
+    return chunk;
+}
+
+static inline void *
+pktpool_chunk_data(struct pktpool_chunk *chunk)
+{
+    return (uint8_t *)chunk + PKTPOOL_ALIGN;
+}
+
+void *
+pktpool_get(size_t size)
+{
+    const int cls = pktpool_class_of(size);
+    struct pktpool_chunk *chunk = NULL;
+
+    pktpool_lock();
+    if (cls < 0)
+    {
+        ++pktpool.stats.oversize;
+    }
+    else if (pktpool.classes[cls].free)
+    {
+        struct pktpool_class *pc = &pktpool.classes[cls];
+        chunk = pc->free;
+        pc->free = chunk->next;
+        --pc->n_free;
+        ++pktpool.stats.hits;
+    }
+    else
+    {
+        ++pktpool.stats.misses;
+    }
+    pktpool_unlock();
+
+    if (!chunk)
+    {
+        chunk = pktpool_chunk_new(cls < 0 ? size : (size_t)1 << (PKTPOOL_MIN_SHIFT + cls), cls);
+    }
+    return pktpool_chunk_data(chunk);
+}
+
+void
+pktpool_put(void *block)
+{
+    if (!block)
+    {
+        return;
+    }
+
+    struct pktpool_chunk *chunk = (struct pktpool_chunk *)((uint8_t *)block - PKTPOOL_ALIGN);
+    if (chunk->cls >= 0)
+    {
+        struct pktpool_class *pc = &pktpool.classes[chunk->cls];
+
+        pktpool_lock();
+        if (!pc->max_free)
+        {
+            pc->max_free = max_int(PKTPOOL_FREE_BYTES >> (PKTPOOL_MIN_SHIFT + chunk->cls), 8);
+        }
+        if (pc->n_free < pc->max_free)
+        {
+            chunk->next = pc->free;
+            pc->free = chunk;
+            ++pc->n_free;
+            chunk = NULL;
+        }
+        else
+        {
+            ++pktpool.stats.released;
+        }
+        pktpool_unlock();
+    }
+
+    if (chunk)
+    {
+        free(chunk->raw);
+    }
+}
+
+struct buffer
+pktpool_alloc_buf(size_t size)
+{
+    struct buffer buf;
+
+    if (!buf_size_valid(size))
+    {
+        buf_size_error(size);
+    }
+    buf.capacity = (int)size;
+    buf.offset = 0;
+    buf.len = 0;
+    buf.data = pktpool_get(size);
+    memset(buf.data, 0, size);
+
+    return buf;
+}
+
+void
+pktpool_free_buf(struct buffer *buf)
+{
+    pktpool_put(buf->data);
+    CLEAR(*buf);
+}
+
+void
+pktpool_get_stats(struct pktpool_stats *stats)
+{
+    pktpool_lock();
+    *stats = pktpool.stats;
+    pktpool_unlock();
+}
+
+void
+pktpool_drain(void)
+{
+    pktpool_lock();
+    for (int cls = 0; cls < PKTPOOL_CLASSES; ++cls)
+    {
+        struct pktpool_class *pc = &pktpool.classes[cls];
+        while (pc->free)
+        {
+            struct pktpool_chunk *chunk = pc->free;
+            pc->free = chunk->next;
+            free(chunk->raw);
+        }
+        pc->n_free = 0;
+    }
+    pktpool_unlock();
+}
@@ -0,0 +1,82 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Pool of packet sized buffers.
+ *
+ * Buffers come in power of 2 size classes from 512 bytes to 64 KiB and
+ * start on a cache line.  A released buffer goes back to the free list
+ * of its class, up to a few MiB per class, and the next request of that
+ * class takes it from there instead of from malloc().  Larger requests
+ * bypass the pool.
+ *
+ * The pool is shared by all threads of the process.
+ */
+
+#ifndef PKTPOOL_H
+#define PKTPOOL_H
+
+#include "buffer.h"
+#include "common.h"
+
+struct pktpool_stats
+{
+    counter_type hits;     /* requests served from a free list */
+    counter_type misses;   /* requests that had to malloc() */
+    counter_type oversize; /* requests too large for the pool */
+    counter_type released; /* buffers freed because their free list was full */
+};
+
+/**
+ * Get a block of at least \a size bytes, aligned to a cache line.  The
+ * contents are undefined.
+ */
+void *pktpool_get(size_t size);
+
+/**
+ * Give a block from pktpool_get() back to the pool.  NULL is ignored.
+ */
+void pktpool_put(void *block);
+
+/**
+ * Like alloc_buf(), but the data comes from the pool.  It must be
+ * released with pktpool_free_buf().
+ */
+struct buffer pktpool_alloc_buf(size_t size);
+
+/**
+ * Give the data of a buffer from pktpool_alloc_buf() back to the pool
+ * and clear the buffer.
+ */
+void pktpool_free_buf(struct buffer *buf);
+
+/**
+ * Return the counters of the pool.
+ */
+void pktpool_get_stats(struct pktpool_stats *stats);
+
+/**
+ * Free the buffers on the free lists, at exit.
+ */
+void pktpool_drain(void);
+
+#endif /* PKTPOOL_H */
@@ -48,6 +48,10 @@
 #include <sys/prctl.h>
 #endif
 
+#if ENABLE_BUSY_POLL
+#include <sched.h>
+#endif
+
 /* Redefine the top level directory of the filesystem
  * to restrict access to files for security */
 void
@@ -332,6 +336,68 @@ platform_nice(int niceval)
     }
 }
 
+#if ENABLE_BUSY_POLL
+/* the CPUs of the process before any thread was pinned */
+static cpu_set_t platform_cpus;  /* GLOBAL */
+static bool platform_cpus_saved; /* GLOBAL */
+#endif
+
+/* Pin the calling thread to a CPU */
+void
+platform_cpu_affinity(int cpu)
+{
+#if ENABLE_BUSY_POLL
+    cpu_set_t set;
+
+    if (!platform_cpus_saved)
+    {
+        platform_cpus_saved = sched_getaffinity(0, sizeof(platform_cpus), &platform_cpus) == 0;
+    }
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) < 0)
+    {
+        msg(M_WARN | M_ERRNO, "WARNING: cpu-affinity %d failed", cpu);
+    }
+    else
+    {
+        msg(M_INFO, "cpu-affinity %d succeeded", cpu);
+    }
+#else
+    msg(M_WARN, "WARNING: cpu-affinity %d failed (function not implemented)", cpu);
+#endif
+}
+
+#ifndef _WIN32
+/* Start a worker thread */
+int
+platform_thread_create(pthread_t *thread, void *(*func)(void *), void *arg)
+{
+    sigset_t all, old;
+    pthread_attr_t attr;
+
+    pthread_attr_init(&attr);
+#if ENABLE_BUSY_POLL
+    /* not on the CPU the calling thread may be pinned to, by this run or
+     * by the one before a restart */
+    if (platform_cpus_saved)
+    {
+        pthread_attr_setaffinity_np(&attr, sizeof(platform_cpus), &platform_cpus);
+    }
+#endif
+
+    /* signals are for the main thread only */
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    const int status = pthread_create(thread, &attr, func, arg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    pthread_attr_destroy(&attr);
+    return status;
+}
+#endif
+
 /* Get current PID */
 unsigned int
 platform_getpid(void)
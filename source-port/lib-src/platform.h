@@ -51,6 +51,10 @@
 #include <sys/resource.h>
 #endif
 
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
 #include "basic.h"
 #include "buffer.h"
 
@@ -115,6 +119,18 @@ void platform_chroot(const char *path);
 
 void platform_nice(int niceval);
 
+void platform_cpu_affinity(int cpu);
+
+#ifndef _WIN32
+/*
+ * Start a thread running func(arg), with all signals blocked: they are
+ * for the main thread only.  It runs on the CPUs of the process from
+ * before platform_cpu_affinity() pinned any thread.  Returns 0 or an
+ * error number, as pthread_create() does.
+ */
+int platform_thread_create(pthread_t *thread, void *(*func)(void *), void *arg);
+#endif
+
 unsigned int platform_getpid(void);
 
 void platform_mlockall(bool print_msg); /* Disable paging */
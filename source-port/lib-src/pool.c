@@ -31,83 +31,200 @@
 #include "error.h"
 #include "socket.h"
 #include "otime.h"
+#include "list.h"
+#include "crypto.h"
 
 #include "memdbg.h"
 
+static uint32_t
+ifconfig_pool_cn_hash_function(const void *key, uint32_t iv)
+{
+    const char *cn = (const char *)key;
+    return hash_func((const uint8_t *)cn, (uint32_t)strlen(cn), iv);
+}
+
+static bool
+ifconfig_pool_cn_compare_function(const void *key1, const void *key2)
+{
+    return !strcmp((const char *)key1, (const char *)key2);
+}
+
+/*
+ * Is entry h one that this pool hands out (see ifconfig_pool_partition)?
+ */
+static inline bool
+ifconfig_pool_mine(const struct ifconfig_pool *pool, const int h)
+{
+    return h >= pool->first && (h - pool->first) % pool->step == 0;
+}
+
 static void
-ifconfig_pool_entry_free(struct ifconfig_pool_entry *ipe, bool hard)
+ifconfig_pool_free_list_unlink(struct ifconfig_pool *pool, const int h)
 {
-    ipe->in_use = false;
-    if (hard && ipe->common_name)
+    struct ifconfig_pool_entry *ipe = &pool->list[h];
+
+    if (!ipe->on_free_list)
     {
-        free(ipe->common_name);
-        ipe->common_name = NULL;
+        return;
     }
-    if (hard)
+    if (ipe->free_prev >= 0)
     {
-        ipe->last_release = 0;
+        pool->list[ipe->free_prev].free_next = ipe->free_next;
     }
     else
     {
-        ipe->last_release = now;
+        pool->free_head = ipe->free_next;
     }
+    if (ipe->free_next >= 0)
+    {
+        pool->list[ipe->free_next].free_prev = ipe->free_prev;
+    }
+    else
+    {
+        pool->free_tail = ipe->free_prev;
+    }
+    ipe->on_free_list = false;
+    ipe->free_prev = ipe->free_next = -1;
 }
 
-static int
-ifconfig_pool_find(struct ifconfig_pool *pool, const char *common_name)
+/*
+ * Put an unused entry on the free list: at the head if it has no release
+ * time (never used, or hard released), behind all others if it was just
+ * released.  Entries without a release time are thus taken last in,
+ * first out, not lowest first.
+ */
+static void
+ifconfig_pool_free_list_link(struct ifconfig_pool *pool, const int h)
 {
-    int i;
-    time_t earliest_release = 0;
-    int previous_usage = -1;
-    int new_usage = -1;
+    struct ifconfig_pool_entry *ipe = &pool->list[h];
 
-    for (i = 0; i < pool->size; ++i)
+    ifconfig_pool_free_list_unlink(pool, h);
+    if (ipe->in_use || ipe->fixed || !ifconfig_pool_mine(pool, h))
     {
-        struct ifconfig_pool_entry *ipe = &pool->list[i];
-        if (!ipe->in_use)
+        return;
+    }
+
+    ipe->on_free_list = true;
+    if (ipe->last_release == 0)
+    {
+        ipe->free_prev = -1;
+        ipe->free_next = pool->free_head;
+        if (pool->free_head >= 0)
         {
-            /*
-             * If duplicate_cn mode, take first available IP address
-             */
-            if (pool->duplicate_cn)
-            {
-                new_usage = i;
-                break;
-            }
+            pool->list[pool->free_head].free_prev = h;
+        }
+        else
+        {
+            pool->free_tail = h;
+        }
+        pool->free_head = h;
+    }
+    else
+    {
+        ipe->free_prev = pool->free_tail;
+        ipe->free_next = -1;
+        if (pool->free_tail >= 0)
+        {
+            pool->list[pool->free_tail].free_next = h;
+        }
+        else
+        {
+            pool->free_head = h;
+        }
+        pool->free_tail = h;
+    }
+}
 
-            /*
-             * Keep track of the unused IP address entry which
-             * was released earliest.
-             */
-            if ((new_usage == -1 || ipe->last_release < earliest_release) && !ipe->fixed)
-            {
-                earliest_release = ipe->last_release;
-                new_usage = i;
-            }
+/*
+ * Set or clear the common name of entry h and keep cn_hash in sync.
+ * The hash stores h + 1, as NULL means not found.
+ */
+static void
+ifconfig_pool_set_cn(struct ifconfig_pool *pool, const int h, const char *common_name)
+{
+    struct ifconfig_pool_entry *ipe = &pool->list[h];
 
-            /*
-             * Keep track of a possible allocation to us
-             * from an earlier session.
-             */
-            if (previous_usage < 0 && common_name && ipe->common_name
-                && !strcmp(common_name, ipe->common_name))
-            {
-                previous_usage = i;
-            }
+    if (ipe->common_name)
+    {
+        if (pool->cn_hash
+            && hash_lookup(pool->cn_hash, ipe->common_name) == (void *)(intptr_t)(h + 1))
+        {
+            hash_remove(pool->cn_hash, ipe->common_name);
         }
+        free(ipe->common_name);
+        ipe->common_name = NULL;
+    }
+    if (common_name)
+    {
+        ipe->common_name = string_alloc(common_name, NULL);
+        if (pool->cn_hash)
+        {
+            /* an element for another entry with this name has that
+             * entry's string as its key, which replacing would keep */
+            hash_remove(pool->cn_hash, ipe->common_name);
+            hash_add(pool->cn_hash, ipe->common_name, (void *)(intptr_t)(h + 1), false);
+        }
+    }
+}
+
+static void
+ifconfig_pool_entry_free(struct ifconfig_pool *pool, const int h, bool hard)
+{
+    struct ifconfig_pool_entry *ipe = &pool->list[h];
+
+    ipe->in_use = false;
+    if (hard)
+    {
+        ifconfig_pool_set_cn(pool, h, NULL);
+        ipe->last_release = 0;
+    }
+    else
+    {
+        ipe->last_release = now;
     }
+    ifconfig_pool_free_list_link(pool, h);
+}
 
-    if (previous_usage >= 0)
+/*
+ * Build the free list of a pool that has not handed out anything yet,
+ * lowest entry first.
+ */
+static void
+ifconfig_pool_free_list_init(struct ifconfig_pool *pool)
+{
+    pool->free_head = pool->free_tail = -1;
+    for (int i = pool->size - 1; i >= 0; --i)
     {
-        return previous_usage;
+        struct ifconfig_pool_entry *ipe = &pool->list[i];
+        ASSERT(!ipe->in_use && ipe->last_release == 0);
+        ipe->on_free_list = false;
+        ipe->free_prev = ipe->free_next = -1;
+        ifconfig_pool_free_list_link(pool, i);
     }
+}
 
-    if (new_usage >= 0)
+/*
+ * Pick the entry for a new client: the unused one that was last
+ * assigned to the same common name, or else the one that was released
+ * earliest.  With duplicate_cn, just any unused one.
+ */
+static int
+ifconfig_pool_find(struct ifconfig_pool *pool, const char *common_name)
+{
+    if (pool->cn_hash && common_name)
     {
-        return new_usage;
+        void *value = hash_lookup(pool->cn_hash, common_name);
+        if (value)
+        {
+            const int h = (int)(intptr_t)value - 1;
+            if (!pool->list[h].in_use && ifconfig_pool_mine(pool, h))
+            {
+                return h;
+            }
+        }
     }
 
-    return -1;
+    return pool->free_head;
 }
 
 /*
@@ -149,6 +266,7 @@ ifconfig_pool_init(const bool ipv4_pool, enum pool_type type, in_addr_t start, i
     ALLOC_OBJ_CLEAR(pool, struct ifconfig_pool);
 
     pool->duplicate_cn = duplicate_cn;
+    pool->step = 1;
 
     pool->ipv4.enabled = ipv4_pool;
 
@@ -272,11 +390,28 @@ ifconfig_pool_init(const bool ipv4_pool, enum pool_type type, in_addr_t start, i
     ASSERT(pool->size > 0);
 
     ALLOC_ARRAY_CLEAR(pool->list, struct ifconfig_pool_entry, pool->size);
+    ifconfig_pool_free_list_init(pool);
+
+    if (!pool->duplicate_cn)
+    {
+        pool->cn_hash = hash_init(256, get_random(), ifconfig_pool_cn_hash_function,
+                                  ifconfig_pool_cn_compare_function);
+    }
 
     gc_free(&gc);
     return pool;
 }
 
+void
+ifconfig_pool_partition(struct ifconfig_pool *pool, const int index, const int count)
+{
+    ASSERT(count >= 1 && index >= 0 && index < count);
+    pool->first = index;
+    pool->step = count;
+    ifconfig_pool_free_list_init(pool);
+    msg(D_IFCONFIG_POOL, "IFCONFIG POOL: handing out entries %d + n * %d", index, count);
+}
+
 void
 ifconfig_pool_free(struct ifconfig_pool *pool)
 {
@@ -286,7 +421,11 @@ ifconfig_pool_free(struct ifconfig_pool *pool)
 
         for (i = 0; i < pool->size; ++i)
         {
-            ifconfig_pool_entry_free(&pool->list[i], true);
+            ifconfig_pool_set_cn(pool, i, NULL);
+        }
+        if (pool->cn_hash)
+        {
+            hash_free(pool->cn_hash);
         }
         free(pool->list);
         free(pool);
@@ -304,12 +443,10 @@ ifconfig_pool_acquire(struct ifconfig_pool *pool, in_addr_t *local, in_addr_t *r
     {
         struct ifconfig_pool_entry *ipe = &pool->list[i];
         ASSERT(!ipe->in_use);
-        ifconfig_pool_entry_free(ipe, true);
+        ifconfig_pool_entry_free(pool, i, true);
+        ifconfig_pool_free_list_unlink(pool, i);
         ipe->in_use = true;
-        if (common_name)
-        {
-            ipe->common_name = string_alloc(common_name, NULL);
-        }
+        ifconfig_pool_set_cn(pool, i, common_name);
 
         if (pool->ipv4.enabled && local && remote)
         {
@@ -352,7 +489,7 @@ ifconfig_pool_release(struct ifconfig_pool *pool, ifconfig_pool_handle hand, con
 
     if (pool && hand >= 0 && hand < pool->size)
     {
-        ifconfig_pool_entry_free(&pool->list[hand], hard);
+        ifconfig_pool_entry_free(pool, hand, hard);
         ret = true;
     }
     return ret;
@@ -476,11 +613,11 @@ ifconfig_pool_set(struct ifconfig_pool *pool, const char *cn, ifconfig_pool_hand
                   const bool fixed)
 {
     struct ifconfig_pool_entry *e = &pool->list[h];
-    ifconfig_pool_entry_free(e, true);
-    e->in_use = false;
-    e->common_name = string_alloc(cn, NULL);
+    ifconfig_pool_entry_free(pool, h, true);
+    ifconfig_pool_set_cn(pool, h, cn);
     e->last_release = now;
     e->fixed = fixed;
+    ifconfig_pool_free_list_link(pool, h);
 }
 
 static void
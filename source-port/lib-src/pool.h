@@ -43,8 +43,13 @@ struct ifconfig_pool_entry
     char *common_name;
     time_t last_release;
     bool fixed;
+    bool on_free_list;
+    int free_prev; /* neighbours on the free list, -1 at the ends */
+    int free_next;
 };
 
+struct hash;
+
 struct ifconfig_pool
 {
     bool duplicate_cn;
@@ -60,7 +65,16 @@ struct ifconfig_pool
         struct in6_addr base;
     } ipv6;
     int size;
+    int first; /* only the entries first, first + step, ... are handed out */
+    int step;
     struct ifconfig_pool_entry *list;
+
+    /* unused entries that may be handed out, earliest released first */
+    int free_head;
+    int free_tail;
+
+    /* common name -> entry it was last assigned to, without duplicate_cn */
+    struct hash *cn_hash;
 };
 
 struct ifconfig_pool_persist
@@ -78,6 +92,12 @@ struct ifconfig_pool *ifconfig_pool_init(const bool ipv4_pool, enum pool_type ty
 
 void ifconfig_pool_free(struct ifconfig_pool *pool);
 
+/*
+ * Hand out only the entries i with i % count == index, so that
+ * several server processes can share one pool.
+ */
+void ifconfig_pool_partition(struct ifconfig_pool *pool, const int index, const int count);
+
 bool ifconfig_pool_verify_range(const int msglevel, const in_addr_t start, const in_addr_t end);
 
 ifconfig_pool_handle ifconfig_pool_acquire(struct ifconfig_pool *pool, in_addr_t *local,
@@ -35,6 +35,8 @@
 #include <memory.h>
 
 #include "crypto.h"
+#include "socket.h"
+#include "list.h"
 #include "reflect_filter.h"
 
 
@@ -104,3 +106,111 @@ initial_rate_limit_free(struct initial_packet_rate_limit *irl)
 {
     free(irl);
 }
+
+/* the bits of the source prefix of addr, returns their length or 0 */
+static int
+initial_prefix_of(const struct openvpn_sockaddr *addr, uint8_t prefix[8])
+{
+    if (addr->addr.sa.sa_family == AF_INET)
+    {
+        const uint8_t *a = (const uint8_t *)&addr->addr.in4.sin_addr.s_addr;
+        memcpy(prefix, a, INITIAL_PREFIX_BITS_IPV4 / 8);
+        return INITIAL_PREFIX_BITS_IPV4 / 8;
+    }
+    else if (addr->addr.sa.sa_family == AF_INET6)
+    {
+        const uint8_t *a = addr->addr.in6.sin6_addr.s6_addr;
+        if (IN6_IS_ADDR_V4MAPPED(&addr->addr.in6.sin6_addr))
+        {
+            memcpy(prefix, a + 12, INITIAL_PREFIX_BITS_IPV4 / 8);
+            return INITIAL_PREFIX_BITS_IPV4 / 8;
+        }
+        memcpy(prefix, a, INITIAL_PREFIX_BITS_IPV6 / 8);
+        return INITIAL_PREFIX_BITS_IPV6 / 8;
+    }
+    return 0;
+}
+
+/* add the tokens of the seconds since *last_refill, up to burst */
+static void
+initial_bucket_refill(int64_t *tokens, time_t *last_refill, int64_t rate, int64_t burst)
+{
+    if (now > *last_refill)
+    {
+        *tokens += (int64_t)(now - *last_refill) * rate;
+        if (*tokens > burst)
+        {
+            *tokens = burst;
+        }
+        *last_refill = now;
+    }
+}
+
+bool
+reflect_filter_prefix_check(struct initial_packet_prefix_limit *ipl,
+                            const struct openvpn_sockaddr *from)
+{
+    uint8_t prefix[8] = { 0 };
+    const int len = initial_prefix_of(from, prefix);
+    if (!len)
+    {
+        return true;
+    }
+
+    const uint32_t hv = hash_func(prefix, sizeof(prefix), ipl->hash_key ^ (uint32_t)len);
+    struct initial_prefix_bucket *b = &ipl->buckets[hv & (INITIAL_PREFIX_BUCKETS - 1)];
+    const int64_t burst = ipl->max_per_period * ipl->period_length;
+
+    initial_bucket_refill(&b->tokens, &b->last_refill, ipl->max_per_period, burst);
+
+    if ((b->len != len || memcmp(b->prefix, prefix, sizeof(prefix)))
+        && (!b->len || b->tokens >= burst))
+    {
+        /* the slot is unused, or its owner has been idle long enough to
+         * refill: hand it over, if not too many prefixes did lately.  A
+         * flood from ever new prefixes would otherwise get a full bucket
+         * for each packet. */
+        initial_bucket_refill(&ipl->new_tokens, &ipl->new_last_refill, INITIAL_PREFIX_BUCKETS,
+                              (int64_t)INITIAL_PREFIX_BUCKETS * ipl->period_length);
+        if (ipl->new_tokens < ipl->period_length)
+        {
+            return false;
+        }
+        ipl->new_tokens -= ipl->period_length;
+
+        memcpy(b->prefix, prefix, sizeof(prefix));
+        b->len = (uint8_t)len;
+        b->tokens = burst;
+        b->last_refill = now;
+    }
+
+    if (b->tokens < ipl->period_length)
+    {
+        return false;
+    }
+    b->tokens -= ipl->period_length;
+    return true;
+}
+
+struct initial_packet_prefix_limit *
+initial_prefix_limit_init(int max_per_period, int period_length)
+{
+    struct initial_packet_prefix_limit *ipl;
+
+    ALLOC_OBJ_CLEAR(ipl, struct initial_packet_prefix_limit);
+
+    ipl->max_per_period = max_per_period;
+    ipl->period_length = period_length;
+    ipl->new_tokens = (int64_t)INITIAL_PREFIX_BUCKETS * period_length;
+    ipl->new_last_refill = now;
+    /* keyed, so that the slots prefixes share cannot be chosen from outside */
+    prng_bytes((uint8_t *)&ipl->hash_key, sizeof(ipl->hash_key));
+
+    return ipl;
+}
+
+void
+initial_prefix_limit_free(struct initial_packet_prefix_limit *ipl)
+{
+    free(ipl);
+}
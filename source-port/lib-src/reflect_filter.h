@@ -69,4 +69,71 @@ struct initial_packet_rate_limit *initial_rate_limit_init(int max_per_period, in
  * free the initial-packet rate limiter structure
  */
 void initial_rate_limit_free(struct initial_packet_rate_limit *irl);
+
+/** source prefix lengths the --connect-flood-guard limit applies to */
+#define INITIAL_PREFIX_BITS_IPV4 24
+#define INITIAL_PREFIX_BITS_IPV6 56
+
+/** number of token buckets of the --connect-flood-guard limit */
+#define INITIAL_PREFIX_BUCKETS 4096
+
+/** a token bucket of a source prefix */
+struct initial_prefix_bucket
+{
+    uint8_t prefix[8]; /**< the address bytes of the prefix */
+    uint8_t len;       /**< their number, 0 if the slot is unused */
+    int64_t tokens;
+    time_t last_refill;
+};
+
+/**
+ * struct that handles the per source prefix limit of --connect-flood-guard.
+ *
+ * Each prefix gets a token bucket: a packet costs period_length tokens,
+ * and max_per_period tokens are added each second, up to
+ * max_per_period * period_length.  The buckets live in a fixed table,
+ * indexed by a keyed hash of the prefix.  A prefix only takes over a
+ * slot that is unused, or whose bucket has refilled since its owner's
+ * last packet; otherwise its packets are taken from the owner's bucket.
+ *
+ * Taking over a slot gives a full bucket, so the number of prefixes that
+ * may do so is capped too: at most INITIAL_PREFIX_BUCKETS per
+ * period_length seconds, with a bucket of its own.
+ */
+struct initial_packet_prefix_limit
+{
+    int64_t max_per_period;
+    int period_length;
+    uint32_t hash_key;
+    int64_t new_tokens;      /**< the cap of the prefixes taking over a slot */
+    time_t new_last_refill;
+    struct initial_prefix_bucket buckets[INITIAL_PREFIX_BUCKETS];
+};
+
+/** what became of the initial packets of unknown peers */
+struct initial_packet_stats
+{
+    counter_type dropped;  /**< over a limit, malformed, or not authentic */
+    counter_type verified; /**< passed the tls-auth/tls-crypt check */
+    counter_type replied;  /**< answered with a stateless HMAC reset */
+};
+
+/**
+ * checks if the source prefix of \a from is still allowed to send an
+ * initial packet, and takes a token from its bucket if so.  Addresses
+ * other than IPv4 and IPv6 are always allowed.
+ */
+bool reflect_filter_prefix_check(struct initial_packet_prefix_limit *ipl,
+                                 const struct openvpn_sockaddr *from);
+
+/**
+ * allocate and initialize the per source prefix limiter structure
+ */
+struct initial_packet_prefix_limit *initial_prefix_limit_init(int max_per_period,
+                                                              int period_length);
+
+/**
+ * free the per source prefix limiter structure
+ */
+void initial_prefix_limit_free(struct initial_packet_prefix_limit *ipl);
 #endif /* ifndef REFLECT_FILTER_H */
@@ -398,28 +398,403 @@ schedule_find_least(struct schedule_entry *e)
     return e;
 }
 
+/*
+ *  Timing wheel functions below this point
+ *
+ *  Level k of the wheel has 64 slots of 64^k ticks of 1 ms each.  An
+ *  entry due in less than 64^(k+1) ticks, and not less than 64^k, goes
+ *  into level k, in the slot of its tick.  Each time the tick of the
+ *  wheel crosses 64 ticks, the entries of the next slot of level 1 are
+ *  spread over level 0, each time it crosses 64^2 ticks, the ones of the
+ *  next slot of level 2 are spread over levels 1 and 0, and so on.  The
+ *  entries of level 0 whose tick is passed go to the due list.
+ */
+
+#define WHEEL_BITS   6
+#define WHEEL_SLOTS  (1 << WHEEL_BITS)
+#define WHEEL_MASK   (WHEEL_SLOTS - 1)
+#define WHEEL_LEVELS 6
+
+/* the value of pri for the due list */
+#define WHEEL_DUE (WHEEL_LEVELS * WHEEL_SLOTS + 1)
+
+struct schedule_wheel
+{
+    uint64_t tick;                /* ms, the slot of level 0 we are at */
+    struct schedule_entry *due;   /* entries whose tick is passed */
+    unsigned int n_upper;         /* entries above level 0 */
+    uint64_t used[WHEEL_LEVELS];  /* bitmap of the slots that are not empty */
+    struct schedule_entry *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+};
+
+static inline uint64_t
+wheel_tick(const struct timeval *tv)
+{
+    return (uint64_t)tv->tv_sec * 1000 + tv->tv_usec / 1000;
+}
+
+/* rotate right, so that bit n becomes bit 0 */
+static inline uint64_t
+wheel_ror(uint64_t used, unsigned int n)
+{
+    n &= WHEEL_MASK;
+    return n ? (used >> n) | (used << (WHEEL_SLOTS - n)) : used;
+}
+
+static inline void
+wheel_link(struct schedule_entry **head, struct schedule_entry *e)
+{
+    e->lt = NULL;
+    e->gt = *head;
+    if (*head)
+    {
+        (*head)->lt = e;
+    }
+    *head = e;
+}
+
+static void
+wheel_unlink(struct schedule_wheel *w, struct schedule_entry *e)
+{
+    struct schedule_entry **head;
+
+    if (e->pri == WHEEL_DUE)
+    {
+        head = &w->due;
+    }
+    else
+    {
+        const unsigned int level = (e->pri - 1) >> WHEEL_BITS;
+        const unsigned int slot = (e->pri - 1) & WHEEL_MASK;
+
+        head = &w->slots[level][slot];
+        if (!e->lt && !e->gt)
+        {
+            w->used[level] &= ~((uint64_t)1 << slot);
+        }
+        if (level)
+        {
+            --w->n_upper;
+        }
+    }
+
+    if (e->lt)
+    {
+        e->lt->gt = e->gt;
+    }
+    else
+    {
+        *head = e->gt;
+    }
+    if (e->gt)
+    {
+        e->gt->lt = e->lt;
+    }
+    e->lt = e->gt = NULL;
+    e->pri = 0;
+}
+
+static void
+wheel_place(struct schedule_wheel *w, struct schedule_entry *e)
+{
+    uint64_t t = wheel_tick(&e->tv);
+    uint64_t delta;
+    unsigned int level, slot;
+
+    if (t < w->tick)
+    {
+        wheel_link(&w->due, e);
+        e->pri = WHEEL_DUE;
+        return;
+    }
+
+    delta = t - w->tick;
+    for (level = 0; level < WHEEL_LEVELS - 1; ++level)
+    {
+        if (delta < (uint64_t)1 << (WHEEL_BITS * (level + 1)))
+        {
+            break;
+        }
+    }
+    if (level == WHEEL_LEVELS - 1 && delta >= (uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS))
+    {
+        /* beyond the wheel, wait in its last slot */
+        t = w->tick + ((uint64_t)1 << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    }
+
+    slot = (t >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    wheel_link(&w->slots[level][slot], e);
+    w->used[level] |= (uint64_t)1 << slot;
+    e->pri = level * WHEEL_SLOTS + slot + 1;
+    if (level)
+    {
+        ++w->n_upper;
+    }
+}
+
+/* spread the entries of a slot over the lower levels */
+static void
+wheel_cascade(struct schedule_wheel *w, unsigned int level, unsigned int slot)
+{
+    struct schedule_entry *e = w->slots[level][slot];
+
+    w->slots[level][slot] = NULL;
+    w->used[level] &= ~((uint64_t)1 << slot);
+    while (e)
+    {
+        struct schedule_entry *next = e->gt;
+        --w->n_upper;
+        wheel_place(w, e);
+        e = next;
+    }
+}
+
+/* move the entries of the slots of level 0 from the tick to end to the due list */
+static void
+wheel_expire(struct schedule_wheel *w, uint64_t end)
+{
+    const unsigned int first = w->tick & WHEEL_MASK;
+    const unsigned int n = (unsigned int)(end - w->tick);
+    uint64_t used = wheel_ror(w->used[0], first);
+
+    if (n < WHEEL_SLOTS)
+    {
+        used &= ((uint64_t)1 << n) - 1;
+    }
+    while (used)
+    {
+        const unsigned int slot = (first + __builtin_ctzll(used)) & WHEEL_MASK;
+        struct schedule_entry *e = w->slots[0][slot];
+
+        used &= used - 1;
+        w->slots[0][slot] = NULL;
+        w->used[0] &= ~((uint64_t)1 << slot);
+        while (e)
+        {
+            struct schedule_entry *next = e->gt;
+            wheel_link(&w->due, e);
+            e->pri = WHEEL_DUE;
+            e = next;
+        }
+    }
+}
+
+/* move the wheel forward to tick now */
+static void
+wheel_advance(struct schedule_wheel *w, uint64_t now)
+{
+    while (w->tick < now)
+    {
+        const uint64_t next = (w->tick | WHEEL_MASK) + 1;
+        unsigned int level;
+
+        if (!w->n_upper && !w->used[0])
+        {
+            w->tick = now;
+            break;
+        }
+        if (now < next)
+        {
+            wheel_expire(w, now);
+            w->tick = now;
+            break;
+        }
+        wheel_expire(w, next);
+        w->tick = next;
+
+        for (level = 1; level < WHEEL_LEVELS; ++level)
+        {
+            const unsigned int slot = (next >> (WHEEL_BITS * level)) & WHEEL_MASK;
+            if (w->used[level] & ((uint64_t)1 << slot))
+            {
+                wheel_cascade(w, level, slot);
+            }
+            if (slot)
+            {
+                break;
+            }
+        }
+    }
+}
+
+/* place all entries again after the clock went back to tick now */
+static void
+wheel_resync(struct schedule_wheel *w, uint64_t now)
+{
+    struct schedule_entry *all = w->due;
+    unsigned int level, slot;
+
+    w->due = NULL;
+    for (level = 0; level < WHEEL_LEVELS; ++level)
+    {
+        for (slot = 0; slot < WHEEL_SLOTS; ++slot)
+        {
+            struct schedule_entry *e = w->slots[level][slot];
+            while (e)
+            {
+                struct schedule_entry *next = e->gt;
+                wheel_link(&all, e);
+                e = next;
+            }
+            w->slots[level][slot] = NULL;
+        }
+        w->used[level] = 0;
+    }
+    w->n_upper = 0;
+    w->tick = now;
+
+    while (all)
+    {
+        struct schedule_entry *next = all->gt;
+        wheel_place(w, all);
+        all = next;
+    }
+}
+
+void
+schedule_wheel_add_modify(struct schedule *s, struct schedule_entry *e)
+{
+    struct schedule_wheel *w = s->wheel;
+
+    if (e->pri)
+    {
+        wheel_unlink(w, e);
+    }
+    wheel_place(w, e);
+
+    if (s->earliest_wakeup == e)
+    {
+        s->earliest_wakeup = NULL;
+    }
+    else if (s->earliest_wakeup && tv_lt(&e->tv, &s->earliest_wakeup->tv))
+    {
+        s->earliest_wakeup = e;
+    }
+}
+
+static struct schedule_entry *
+wheel_find_least(struct schedule *s, uint64_t now)
+{
+    struct schedule_wheel *w = s->wheel;
+    struct schedule_entry *least = NULL;
+    unsigned int level;
+
+    if (now < w->tick)
+    {
+        /* the wall clock went back: what was due may not be anymore */
+        wheel_resync(w, now);
+        s->earliest_wakeup = NULL;
+    }
+    wheel_advance(w, now);
+
+    /* the cache stays valid as the wheel moves */
+    if (s->earliest_wakeup)
+    {
+        return s->earliest_wakeup;
+    }
+    if (w->due)
+    {
+        return w->due;
+    }
+
+    /*
+     * An entry of a level may be due after one of any level above that was
+     * placed earlier, so look at every level whose first slot starts before
+     * the least entry found so far.
+     */
+    for (level = 0; level < WHEEL_LEVELS; ++level)
+    {
+        /* the slot we are at holds the current tick on level 0, and the
+         * next round of the wheel on the others */
+        const unsigned int shift = WHEEL_BITS * level;
+        const unsigned int first = ((w->tick >> shift) + (level ? 1 : 0)) & WHEEL_MASK;
+        const uint64_t used = wheel_ror(w->used[level], first);
+        unsigned int skip;
+        struct schedule_entry *e;
+
+        if (!used)
+        {
+            continue;
+        }
+        skip = __builtin_ctzll(used);
+        if (least
+            && (((w->tick >> shift) + (level ? 1 : 0) + skip) << shift) > wheel_tick(&least->tv))
+        {
+            continue;
+        }
+
+        /* the entries of a slot of level 0 share their tick, above they don't */
+        e = w->slots[level][(first + skip) & WHEEL_MASK];
+        if (!least || tv_lt(&e->tv, &least->tv))
+        {
+            least = e;
+        }
+        if (level)
+        {
+            for (e = e->gt; e; e = e->gt)
+            {
+                if (tv_lt(&e->tv, &least->tv))
+                {
+                    least = e;
+                }
+            }
+        }
+    }
+    return least;
+}
+
+struct schedule_entry *
+schedule_wheel_find_least(struct schedule *s)
+{
+    struct timeval now_tv;
+
+    openvpn_gettimeofday(&now_tv, NULL);
+    return wheel_find_least(s, wheel_tick(&now_tv));
+}
+
 /*
  *  Public functions below this point
  */
 
 struct schedule *
-schedule_init(void)
+schedule_init(int type)
 {
     struct schedule *s;
 
     ALLOC_OBJ_CLEAR(s, struct schedule);
+    if (type == SCHEDULE_WHEEL)
+    {
+        struct timeval now_tv;
+
+        ALLOC_OBJ_CLEAR(s->wheel, struct schedule_wheel);
+        openvpn_gettimeofday(&now_tv, NULL);
+        s->wheel->tick = wheel_tick(&now_tv);
+    }
     return s;
 }
 
 void
 schedule_free(struct schedule *s)
 {
+    free(s->wheel);
     free(s);
 }
 
 void
 schedule_remove_entry(struct schedule *s, struct schedule_entry *e)
 {
+    if (s->wheel)
+    {
+        if (s->earliest_wakeup == e)
+        {
+            s->earliest_wakeup = NULL;
+        }
+        if (e->pri)
+        {
+            wheel_unlink(s->wheel, e);
+        }
+        return;
+    }
     s->earliest_wakeup = NULL; /* invalidate cache */
     schedule_remove_node(s, e);
 }
@@ -629,6 +1004,140 @@ schedule_print(struct schedule *s)
     schedule_print_work(s->root, 0);
 }
 
+/* a wakeup at ms tick t, somewhere within the ms */
+static void
+wheel_test_tv(struct timeval *tv, uint64_t t)
+{
+    tv->tv_sec = (time_t)(t / 1000);
+    tv->tv_usec = (suseconds_t)((t % 1000) * 1000 + random() % 1000);
+}
+
+/*
+ * Check the least entry of the wheel against the one found by scanning
+ * all entries, with a clock of our own: it moves by a few ms, by minutes,
+ * to the end of a slot of a level or back now and then, while entries
+ * are moved to any level, removed, or the cached least one is.  An
+ * entry that is due already may be returned for another one that is due.
+ */
+static void
+schedule_wheel_test(const int n, const int ops)
+{
+    struct gc_arena gc = gc_new();
+    struct schedule *s = schedule_init(SCHEDULE_WHEEL);
+    struct schedule_entry *array;
+    uint64_t now = s->wheel->tick;
+    int errors = 0;
+
+    printf("Wheel Phase n=%d\n", n);
+
+    ALLOC_ARRAY_CLEAR(array, struct schedule_entry, n);
+
+    for (int i = 0; i < ops; ++i)
+    {
+        const long choice = random();
+        struct schedule_entry *e = &array[random() % n];
+        struct schedule_entry *least = NULL;
+        struct timeval tv;
+
+        switch (choice & 0xF)
+        {
+            case 0:
+                now += 1000 + random() % (600 * 1000);
+                break;
+
+            case 1:
+                if ((choice & 0xF0) == 0)
+                {
+                    now -= random() % (3600 * 1000);
+                }
+                break;
+
+            case 2:
+            {
+                /* to a few s before the first slot of a level that is not
+                 * empty, where entries placed long ago are due soon */
+                const unsigned int level = 1 + random() % 3;
+                const unsigned int shift = WHEEL_BITS * level;
+                const uint64_t tick = s->wheel->tick;
+                const uint64_t used =
+                    wheel_ror(s->wheel->used[level], (unsigned int)(tick >> shift) + 1);
+                if (used)
+                {
+                    const uint64_t start = ((tick >> shift) + 1 + __builtin_ctzll(used)) << shift;
+                    if (start - 4096 > now)
+                    {
+                        now = start - 1 - random() % 4096;
+                    }
+                }
+                break;
+            }
+
+            case 3:
+                if (e->pri)
+                {
+                    schedule_remove_entry(s, e);
+                }
+                break;
+
+            case 4:
+                if (s->earliest_wakeup)
+                {
+                    schedule_remove_entry(s, s->earliest_wakeup);
+                }
+                break;
+
+            default:
+            {
+                /* within 64^(k+1) ms, for a level k at random, and half
+                 * of the time at the start of a slot of the level */
+                const unsigned int level = random() % WHEEL_LEVELS;
+                const unsigned int shift = WHEEL_BITS * level;
+                uint64_t t = now - 10 + (uint64_t)random() % ((uint64_t)1 << (shift + WHEEL_BITS));
+
+                if (choice & 0x10)
+                {
+                    t = ((t >> shift) << shift) + random() % 64;
+                }
+                wheel_test_tv(&tv, t);
+                schedule_add_entry(s, e, &tv, 0);
+                break;
+            }
+        }
+        now += random() % 8;
+
+        for (int j = 0; j < n; ++j)
+        {
+            if (array[j].pri && (!least || tv_lt(&array[j].tv, &least->tv)))
+            {
+                least = &array[j];
+            }
+        }
+
+        s->earliest_wakeup = wheel_find_least(s, now);
+        e = s->earliest_wakeup;
+        if (!least != !e
+            || (least
+                && (wheel_tick(&least->tv) < now ? wheel_tick(&e->tv) >= now
+                                                 : wheel_tick(&e->tv) != wheel_tick(&least->tv))))
+        {
+            printf("Wheel Phase op %d: least %s, found %s [COMPUTED DIFFERENT MIN VALUES!]\n", i,
+                   least ? tv_string(&least->tv, &gc) : "none",
+                   e ? tv_string(&e->tv, &gc) : "none");
+            ++errors;
+        }
+    }
+
+    printf("Wheel Phase %d errors\n", errors);
+
+    for (int i = 0; i < n; ++i)
+    {
+        schedule_remove_entry(s, &array[i]);
+    }
+    free(array);
+    schedule_free(s);
+    gc_free(&gc);
+}
+
 void
 schedule_test(void)
 {
@@ -638,7 +1147,7 @@ schedule_test(void)
 
     int i, j;
     struct schedule_entry **array;
-    struct schedule *s = schedule_init();
+    struct schedule *s = schedule_init(SCHEDULE_TREAP);
     struct schedule_entry *e;
 
     CLEAR(z);
@@ -696,6 +1205,10 @@ schedule_test(void)
     free(array);
     free(s);
     gc_free(&gc);
+
+    /* with few entries, the levels are mostly empty */
+    schedule_wheel_test(8, 1000000);
+    schedule_wheel_test(1000, 100000);
 }
 
 #endif /* ifdef SCHEDULE_TEST */
@@ -25,13 +25,21 @@
 
 /*
  * This code implements an efficient scheduler using
- * a random treap binary tree.
+ * a random treap binary tree, or a hierarchical timing
+ * wheel (--server-scheduler wheel).
  *
  * The scheduler is used by the server executive to
  * keep track of which instances need service at a
  * known time in the future.  Instances need to
  * schedule events for things such as sending
  * a ping or scheduling a TLS renegotiation.
+ *
+ * The treap keeps the entries sorted: adding or
+ * removing one is O(log n).  The wheel hashes them
+ * into slots of 1 ms, 64 ms, 4 s, ... so that adding,
+ * moving and removing one is O(1), at the cost of a
+ * 1 ms resolution: entries due within the same
+ * millisecond come out in no particular order.
  */
 
 /* define to enable a special test mode */
@@ -40,6 +48,14 @@
 #include "otime.h"
 #include "error.h"
 
+/* --server-scheduler */
+#define SCHEDULE_TREAP 0
+#define SCHEDULE_WHEEL 1
+
+/*
+ * On the wheel, pri is the slot of the entry plus one,
+ * and lt/gt are the links of the list of the slot.
+ */
 struct schedule_entry
 {
     struct timeval tv;             /* wakeup time */
@@ -49,15 +65,18 @@ struct schedule_entry
     struct schedule_entry *gt;
 };
 
+struct schedule_wheel;
+
 struct schedule
 {
     struct schedule_entry *earliest_wakeup; /* cached earliest wakeup */
     struct schedule_entry *root;            /* the root of the treap (btree) */
+    struct schedule_wheel *wheel;           /* the timing wheel, if used instead */
 };
 
 /* Public functions */
 
-struct schedule *schedule_init(void);
+struct schedule *schedule_init(int type);
 
 void schedule_free(struct schedule *s);
 
@@ -79,6 +98,10 @@ void schedule_add_modify(struct schedule *s, struct schedule_entry *e);
 
 void schedule_remove_node(struct schedule *s, struct schedule_entry *e);
 
+void schedule_wheel_add_modify(struct schedule *s, struct schedule_entry *e);
+
+struct schedule_entry *schedule_wheel_find_least(struct schedule *s);
+
 /* Public inline functions */
 
 /*
@@ -100,8 +123,15 @@ schedule_add_entry(struct schedule *s, struct schedule_entry *e, const struct ti
     if (!IN_TREE(e) || !sigma || !tv_within_sigma(tv, &e->tv, sigma))
     {
         e->tv = *tv;
-        schedule_add_modify(s, e);
-        s->earliest_wakeup = NULL; /* invalidate cache */
+        if (s->wheel)
+        {
+            schedule_wheel_add_modify(s, e);
+        }
+        else
+        {
+            schedule_add_modify(s, e);
+            s->earliest_wakeup = NULL; /* invalidate cache */
+        }
     }
 }
 
@@ -117,7 +147,11 @@ schedule_get_earliest_wakeup(struct schedule *s, struct timeval *wakeup)
     struct schedule_entry *ret;
 
     /* cache result */
-    if (!s->earliest_wakeup)
+    if (s->wheel)
+    {
+        s->earliest_wakeup = schedule_wheel_find_least(s);
+    }
+    else if (!s->earliest_wakeup)
     {
         s->earliest_wakeup = schedule_find_least(s->root);
     }
@@ -36,6 +36,7 @@
 #include "occ.h"
 #include "manage.h"
 #include "openvpn.h"
+#include "pktpool.h"
 
 #include "memdbg.h"
 
@@ -520,6 +521,12 @@ print_status(struct context *c, struct status_output *so)
         }
     }
 #endif
+    {
+        struct pktpool_stats ps;
+        pktpool_get_stats(&ps);
+        status_printf(so, "Packet buffer pool hits," counter_format, ps.hits);
+        status_printf(so, "Packet buffer pool misses," counter_format, ps.misses + ps.oversize);
+    }
 
     status_printf(so, "END");
     status_flush(so);
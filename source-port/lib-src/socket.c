@@ -38,6 +38,7 @@
 #include "manage.h"
 #include "openvpn.h"
 #include "forward.h"
+#include "mproc.h"
 
 #include "memdbg.h"
 
@@ -56,6 +57,32 @@ sockets_read_residual(const struct context *c)
     return false;
 }
 
+bool
+sockets_read_batched(const struct context *c)
+{
+#if ENABLE_UDP_BATCH
+    for (int i = 0; i < c->c1.link_sockets_num; i++)
+    {
+        if (link_socket_rx_batch_pending(c->c2.link_sockets[i]))
+        {
+            return true;
+        }
+    }
+#endif
+    return false;
+}
+
+void
+sockets_flush_batched(struct context *c)
+{
+#if ENABLE_UDP_BATCH
+    for (int i = 0; i < c->c1.link_sockets_num; i++)
+    {
+        link_socket_flush_tx_batch(c->c2.link_sockets[i]);
+    }
+#endif
+}
+
 /*
  * Convert sockflags/getaddr_flags into getaddr_flags
  */
@@ -930,6 +957,23 @@ socket_set_tcp_nodelay(socket_descriptor_t sd, int state)
 #endif
 }
 
+#if ENABLE_UDP_OFFLOAD
+static bool
+socket_set_udp_gro(socket_descriptor_t sd, int state)
+{
+    if (setsockopt(sd, SOL_UDP, UDP_GRO, (void *)&state, sizeof(state)) != 0)
+    {
+        msg(M_WARN, "NOTE: setsockopt UDP_GRO=%d failed", state);
+        return false;
+    }
+    else
+    {
+        dmsg(D_OSBUF, "Socket flags: UDP_GRO=%d succeeded", state);
+        return true;
+    }
+}
+#endif
+
 static inline void
 socket_set_mark(socket_descriptor_t sd, int mark)
 {
@@ -941,9 +985,37 @@ socket_set_mark(socket_descriptor_t sd, int mark)
 #endif
 }
 
+#if ENABLE_BUSY_POLL
+static void
+socket_set_busy_poll(socket_descriptor_t sd, int usec)
+{
+    if (usec)
+    {
+        if (setsockopt(sd, SOL_SOCKET, SO_BUSY_POLL, (void *)&usec, sizeof(usec)) != 0)
+        {
+            msg(M_WARN | M_ERRNO, "NOTE: setsockopt SO_BUSY_POLL=%d failed", usec);
+        }
+#ifdef SO_PREFER_BUSY_POLL
+        const int on = 1;
+        if (setsockopt(sd, SOL_SOCKET, SO_PREFER_BUSY_POLL, (void *)&on, sizeof(on)) != 0)
+        {
+            msg(M_WARN | M_ERRNO, "NOTE: setsockopt SO_PREFER_BUSY_POLL failed");
+        }
+#endif
+    }
+}
+#endif
+
 static bool
 socket_set_flags(socket_descriptor_t sd, unsigned int sockflags)
 {
+#if ENABLE_UDP_OFFLOAD
+    if (sockflags & SF_UDP_GRO)
+    {
+        socket_set_udp_gro(sd, 1);
+    }
+#endif
+
     /* SF_TCP_NODELAY doesn't make sense for dco-win */
     if ((sockflags & SF_TCP_NODELAY) && (!(sockflags & SF_DCO_WIN)))
     {
@@ -960,7 +1032,9 @@ link_socket_update_flags(struct link_socket *sock, unsigned int sockflags)
 {
     if (sock && socket_defined(sock->sd))
     {
-        sock->sockflags |= sockflags;
+        /* the offload flags size the socket buffers, they cannot be
+         * changed after the socket has been set up */
+        sock->sockflags |= sockflags & ~(SF_UDP_GSO | SF_UDP_GRO);
         return socket_set_flags(sock->sd, sock->sockflags);
     }
     else
@@ -1094,6 +1168,9 @@ create_socket(struct link_socket *sock, struct addrinfo *addr)
     {
         sock->sd = create_socket_udp(addr, sock->sockflags);
         sock->sockflags |= SF_GETADDRINFO_DGRAM;
+#if ENABLE_BUSY_POLL
+        socket_set_busy_poll(sock->sd, sock->busy_poll);
+#endif
 
         /* Assume that control socket and data socket to the socks proxy
          * are using the same IP family */
@@ -1139,7 +1216,21 @@ create_socket(struct link_socket *sock, struct addrinfo *addr)
     }
 #endif
 
+#if ENABLE_SERVER_PROCESSES
+    if (sock->sockflags & SF_REUSEPORT)
+    {
+        mproc_socket_reuseport(sock->sd);
+    }
+#endif
+
     bind_local(sock, addr->ai_family);
+
+#if ENABLE_SERVER_PROCESSES
+    if (sock->sockflags & SF_REUSEPORT_STEER)
+    {
+        mproc_socket_steer(sock->sd);
+    }
+#endif
 }
 
 #ifdef TARGET_ANDROID
@@ -1572,6 +1663,16 @@ static void stream_buf_close(struct stream_buf *sb);
 
 static bool stream_buf_added(struct stream_buf *sb, int length_added);
 
+#if ENABLE_UDP_BATCH
+static void link_socket_rx_batch_init(struct link_socket *sock, const struct frame *frame);
+
+static void link_socket_rx_batch_free(struct link_socket *sock);
+
+static void link_socket_tx_batch_init(struct link_socket *sock, const struct frame *frame);
+
+static void link_socket_tx_batch_free(struct link_socket *sock);
+#endif
+
 /* For stream protocols, allocate a buffer to build up packet.
  * Called after frame has been finalized. */
 
@@ -1585,6 +1686,19 @@ socket_frame_init(const struct frame *frame, struct link_socket *sock)
     sock->rw_handle.write = sock->writes.overlapped.hEvent;
 #endif
 
+#if ENABLE_UDP_OFFLOAD
+    if (!proto_is_udp(sock->info.proto) || sock->socks_proxy)
+    {
+        sock->sockflags &= ~(SF_UDP_GSO | SF_UDP_GRO);
+    }
+    /* segmentation works on the server send queue only */
+    if ((sock->sockflags & SF_UDP_GSO) && !sock->tx_batch_size)
+    {
+        msg(M_WARN, "NOTE: --socket-flags UDP_GSO is only used in UDP server mode, ignoring");
+        sock->sockflags &= ~SF_UDP_GSO;
+    }
+#endif
+
     if (link_socket_connection_oriented(sock))
     {
 #ifdef _WIN32
@@ -1597,6 +1711,19 @@ socket_frame_init(const struct frame *frame, struct link_socket *sock)
                         sock->info.proto);
 #endif
     }
+#if ENABLE_UDP_BATCH
+    else if (proto_is_udp(sock->info.proto) && !sock->socks_proxy)
+    {
+        if (sock->rx_batch_size > 1 || (sock->sockflags & SF_UDP_GRO))
+        {
+            link_socket_rx_batch_init(sock, frame);
+        }
+        if (sock->tx_batch_size > 1 || (sock->sockflags & SF_UDP_GSO))
+        {
+            link_socket_tx_batch_init(sock, frame);
+        }
+    }
+#endif
 }
 
 static void
@@ -1843,6 +1970,37 @@ link_socket_init_phase1(struct context *c, int sock_index, int mode)
 
     sock->mark = o->mark;
     sock->bind_dev = o->bind_dev;
+#if ENABLE_BUSY_POLL
+    sock->busy_poll = o->busy_poll;
+#endif
+#if ENABLE_UDP_BATCH
+    sock->rx_batch_size = o->udp_recv_batch;
+    /* only the server event loop flushes queued writes, and --passtos
+     * needs a setsockopt() between individual writes */
+    if (o->mode == MODE_SERVER && !o->passtos)
+    {
+        sock->tx_batch_size = o->udp_send_batch;
+    }
+#endif
+#if ENABLE_UDP_OFFLOAD
+    /* with DCO the kernel owns the data channel socket */
+    if (dco_enabled(o))
+    {
+        sock->sockflags &= ~(SF_UDP_GSO | SF_UDP_GRO);
+    }
+#endif
+#if ENABLE_SERVER_PROCESSES
+    /* the server processes share the port, and the steering program
+     * of the first --local picks the process by peer-id */
+    if (c->mode == CM_TOP && mproc_count() > 1 && proto_is_udp(proto))
+    {
+        sock->sockflags |= SF_REUSEPORT;
+        if (sock_index == 0)
+        {
+            sock->sockflags |= SF_REUSEPORT_STEER;
+        }
+    }
+#endif
     sock->info.proto = proto;
     sock->info.af = o->ce.af;
     sock->info.remote_float = o->ce.remote_float;
@@ -2258,6 +2416,10 @@ link_socket_close(struct link_socket *sock)
         {
 #ifdef _WIN32
             close_net_event_win32(&sock->listen_handle, sock->sd, 0);
+#endif
+#if ENABLE_UDP_BATCH
+            /* don't lose queued datagrams like exit notifications */
+            link_socket_flush_tx_batch(sock);
 #endif
             if (!gremlin)
             {
@@ -2288,6 +2450,10 @@ link_socket_close(struct link_socket *sock)
 
         stream_buf_close(&sock->stream_buf);
         free_buf(&sock->stream_buf_data);
+#if ENABLE_UDP_BATCH
+        link_socket_rx_batch_free(sock);
+        link_socket_tx_batch_free(sock);
+#endif
         if (!gremlin)
         {
             free(sock);
@@ -3214,37 +3380,25 @@ link_socket_read_tcp(struct link_socket *sock, struct buffer *buf)
     max_int(CMSG_SPACE(sizeof(struct in6_pktinfo)), CMSG_SPACE(sizeof(struct in_addr)))
 #endif
 
-static socklen_t
-link_socket_read_udp_posix_recvmsg(struct link_socket *sock, struct buffer *buf,
-                                   struct link_socket_actual *from)
+/*
+ * Parse the ancillary data returned by recvmsg() or recvmmsg(): the
+ * destination address of the datagram and, with UDP_GRO, the size of
+ * the segments the kernel coalesced.  Returns that segment size, or 0
+ * if the datagram was received as is.
+ */
+static int
+link_socket_read_cmsg(struct msghdr *mesg, struct link_socket_actual *from)
 {
-    struct iovec iov;
-    uint8_t pktinfo_buf[PKTINFO_BUF_SIZE];
-    struct msghdr mesg = { 0 };
-    socklen_t fromlen = sizeof(from->dest.addr);
+    int gro_size = 0;
 
-    ASSERT(sock->sd >= 0); /* can't happen */
-
-    iov.iov_base = BPTR(buf);
-    iov.iov_len = buf_forward_capacity_total(buf);
-    mesg.msg_iov = &iov;
-    mesg.msg_iovlen = 1;
-    mesg.msg_name = &from->dest.addr;
-    mesg.msg_namelen = fromlen;
-    mesg.msg_control = pktinfo_buf;
-    mesg.msg_controllen = sizeof pktinfo_buf;
-    buf->len = recvmsg(sock->sd, &mesg, 0);
-    if (buf->len >= 0)
+    for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(mesg); cmsg != NULL; cmsg = CMSG_NXTHDR(mesg, cmsg))
     {
-        struct cmsghdr *cmsg;
-        fromlen = mesg.msg_namelen;
-        cmsg = CMSG_FIRSTHDR(&mesg);
-        if (cmsg != NULL && CMSG_NXTHDR(&mesg, cmsg) == NULL
+        if (
 #if defined(HAVE_IN_PKTINFO) && defined(HAVE_IPI_SPEC_DST)
-            && cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_PKTINFO
+            cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_PKTINFO
             && cmsg->cmsg_len >= CMSG_LEN(sizeof(struct in_pktinfo)))
 #elif defined(IP_RECVDSTADDR)
-            && cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVDSTADDR
+            cmsg->cmsg_level == IPPROTO_IP && cmsg->cmsg_type == IP_RECVDSTADDR
             && cmsg->cmsg_len >= CMSG_LEN(sizeof(struct in_addr)))
 #else /* if defined(HAVE_IN_PKTINFO) && defined(HAVE_IPI_SPEC_DST) */
 #error ENABLE_IP_PKTINFO is set without IP_PKTINFO xor IP_RECVDSTADDR (fix syshead.h)
@@ -3260,15 +3414,21 @@ link_socket_read_udp_posix_recvmsg(struct link_socket *sock, struct buffer *buf,
 #error ENABLE_IP_PKTINFO is set without IP_PKTINFO xor IP_RECVDSTADDR (fix syshead.h)
 #endif
         }
-        else if (cmsg != NULL && CMSG_NXTHDR(&mesg, cmsg) == NULL
-                 && cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO
+        else if (cmsg->cmsg_level == IPPROTO_IPV6 && cmsg->cmsg_type == IPV6_PKTINFO
                  && cmsg->cmsg_len >= CMSG_LEN(sizeof(struct in6_pktinfo)))
         {
             struct in6_pktinfo *pkti6 = (struct in6_pktinfo *)CMSG_DATA(cmsg);
             from->pi.in6.ipi6_ifindex = pkti6->ipi6_ifindex;
             from->pi.in6.ipi6_addr = pkti6->ipi6_addr;
         }
-        else if (cmsg != NULL)
+#if ENABLE_UDP_OFFLOAD
+        else if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO
+                 && cmsg->cmsg_len >= CMSG_LEN(sizeof(int)))
+        {
+            memcpy(&gro_size, CMSG_DATA(cmsg), sizeof(gro_size));
+        }
+#endif
+        else
         {
             msg(M_WARN,
                 "CMSG received that cannot be parsed (cmsg_level=%d, cmsg_type=%d, cmsg=len=%d)",
@@ -3276,6 +3436,35 @@ link_socket_read_udp_posix_recvmsg(struct link_socket *sock, struct buffer *buf,
         }
     }
 
+    return gro_size;
+}
+
+static socklen_t
+link_socket_read_udp_posix_recvmsg(struct link_socket *sock, struct buffer *buf,
+                                   struct link_socket_actual *from)
+{
+    struct iovec iov;
+    uint8_t pktinfo_buf[PKTINFO_BUF_SIZE];
+    struct msghdr mesg = { 0 };
+    socklen_t fromlen = sizeof(from->dest.addr);
+
+    ASSERT(sock->sd >= 0); /* can't happen */
+
+    iov.iov_base = BPTR(buf);
+    iov.iov_len = buf_forward_capacity_total(buf);
+    mesg.msg_iov = &iov;
+    mesg.msg_iovlen = 1;
+    mesg.msg_name = &from->dest.addr;
+    mesg.msg_namelen = fromlen;
+    mesg.msg_control = pktinfo_buf;
+    mesg.msg_controllen = sizeof pktinfo_buf;
+    buf->len = recvmsg(sock->sd, &mesg, 0);
+    if (buf->len >= 0)
+    {
+        fromlen = mesg.msg_namelen;
+        link_socket_read_cmsg(&mesg, from);
+    }
+
     return fromlen;
 }
 #endif /* if ENABLE_IP_PKTINFO */
@@ -3310,6 +3499,196 @@ link_socket_read_udp_posix(struct link_socket *sock, struct buffer *buf,
     return buf->len;
 }
 
+#if ENABLE_UDP_BATCH
+
+#if ENABLE_UDP_OFFLOAD
+/* room for the address plus a UDP_GRO or UDP_SEGMENT header */
+#define UDP_BATCH_CMSG_SIZE (PKTINFO_BUF_SIZE + CMSG_SPACE(sizeof(int)))
+#elif ENABLE_IP_PKTINFO
+#define UDP_BATCH_CMSG_SIZE PKTINFO_BUF_SIZE
+#else
+#define UDP_BATCH_CMSG_SIZE 0
+#endif
+
+static void
+link_socket_rx_batch_init(struct link_socket *sock, const struct frame *frame)
+{
+    struct link_socket_rx_batch *b;
+    const int size = min_int(sock->rx_batch_size, UDP_BATCH_MAX);
+
+    ALLOC_OBJ_CLEAR(b, struct link_socket_rx_batch);
+    b->size = size;
+    b->headroom = frame->buf.headroom;
+    ALLOC_ARRAY_CLEAR(b->bufs, struct buffer, size);
+    ALLOC_ARRAY_CLEAR(b->from, struct link_socket_actual, size);
+    ALLOC_ARRAY_CLEAR(b->msgs, struct mmsghdr, size);
+    ALLOC_ARRAY_CLEAR(b->iovs, struct iovec, size);
+    if (UDP_BATCH_CMSG_SIZE)
+    {
+        ALLOC_ARRAY_CLEAR(b->cmsg_bufs, uint8_t, size * UDP_BATCH_CMSG_SIZE);
+    }
+
+    int buf_size = BUF_SIZE(frame);
+#if ENABLE_UDP_OFFLOAD
+    ALLOC_ARRAY_CLEAR(b->gro_size, int, size);
+    if (sock->sockflags & SF_UDP_GRO)
+    {
+        /* a coalesced datagram is much larger than the frame */
+        buf_size = max_int(buf_size, b->headroom + UDP_OFFLOAD_MAX_SIZE);
+    }
+#endif
+    for (int i = 0; i < size; i++)
+    {
+        b->bufs[i] = alloc_buf(buf_size);
+    }
+
+    sock->rx_batch = b;
+    msg(D_OSBUF, "UDP: reading up to %d datagrams per recvmmsg() call", size);
+}
+
+static void
+link_socket_rx_batch_free(struct link_socket *sock)
+{
+    struct link_socket_rx_batch *b = sock->rx_batch;
+    if (b)
+    {
+        for (int i = 0; i < b->size; i++)
+        {
+            free_buf(&b->bufs[i]);
+        }
+        free(b->bufs);
+        free(b->from);
+        free(b->msgs);
+        free(b->iovs);
+        free(b->cmsg_bufs);
+#if ENABLE_UDP_OFFLOAD
+        free(b->gro_size);
+#endif
+        free(b);
+        sock->rx_batch = NULL;
+    }
+}
+
+/*
+ * Refill the batch with a single recvmmsg() call.  MSG_WAITFORONE
+ * makes the call return as soon as the socket queue is empty, so
+ * we never block once the first datagram is in.
+ */
+static int
+link_socket_rx_batch_fill(struct link_socket *sock)
+{
+    struct link_socket_rx_batch *b = sock->rx_batch;
+    const bool use_cmsg =
+#if ENABLE_IP_PKTINFO
+        (sock->info.proto == PROTO_UDP && (sock->sockflags & SF_USE_IP_PKTINFO))
+        || (sock->sockflags & SF_UDP_GRO);
+#else
+        false;
+#endif
+    const socklen_t expectedlen = af_addr_size(sock->info.af);
+
+    ASSERT(sock->sd >= 0); /* can't happen */
+
+    for (int i = 0; i < b->size; i++)
+    {
+        struct msghdr *mesg = &b->msgs[i].msg_hdr;
+
+        ASSERT(buf_init(&b->bufs[i], b->headroom));
+        addr_zero_host(&b->from[i].dest);
+
+        b->iovs[i].iov_base = BPTR(&b->bufs[i]);
+        b->iovs[i].iov_len = buf_forward_capacity_total(&b->bufs[i]);
+
+        CLEAR(*mesg);
+        mesg->msg_iov = &b->iovs[i];
+        mesg->msg_iovlen = 1;
+        mesg->msg_name = &b->from[i].dest.addr;
+        mesg->msg_namelen = sizeof(b->from[i].dest.addr);
+        if (use_cmsg)
+        {
+            mesg->msg_control = b->cmsg_bufs + i * UDP_BATCH_CMSG_SIZE;
+            mesg->msg_controllen = UDP_BATCH_CMSG_SIZE;
+        }
+    }
+
+    b->next = 0;
+    b->count = 0;
+
+    const int status = recvmmsg(sock->sd, b->msgs, b->size, MSG_WAITFORONE, NULL);
+    if (status <= 0)
+    {
+        return status;
+    }
+
+    for (int i = 0; i < status; i++)
+    {
+        struct msghdr *mesg = &b->msgs[i].msg_hdr;
+
+        b->bufs[i].len = b->msgs[i].msg_len;
+#if ENABLE_UDP_OFFLOAD
+        b->gro_size[i] = 0;
+#endif
+#if ENABLE_IP_PKTINFO
+        if (use_cmsg)
+        {
+            const int gro_size = link_socket_read_cmsg(mesg, &b->from[i]);
+#if ENABLE_UDP_OFFLOAD
+            b->gro_size[i] = gro_size;
+#else
+            (void)gro_size;
+#endif
+        }
+#endif
+        /* FIXME: won't do anything when sock->info.af == AF_UNSPEC */
+        if (expectedlen && mesg->msg_namelen != expectedlen)
+        {
+            bad_address_length(mesg->msg_namelen, expectedlen);
+        }
+    }
+    b->count = status;
+
+    return status;
+}
+
+int
+link_socket_read_udp_batch(struct link_socket *sock, struct buffer *buf,
+                           struct link_socket_actual *from)
+{
+    struct link_socket_rx_batch *b = sock->rx_batch;
+
+    if (!link_socket_rx_batch_pending(sock))
+    {
+        const int status = link_socket_rx_batch_fill(sock);
+        if (status <= 0)
+        {
+            return buf->len = status;
+        }
+    }
+
+    /* hand out the next datagram; buf now points into the batch slot */
+    struct buffer *slot = &b->bufs[b->next];
+    *buf = *slot;
+    *from = b->from[b->next];
+#if ENABLE_UDP_OFFLOAD
+    const int gro_size = b->gro_size[b->next];
+    if (gro_size > 0 && BLEN(slot) > gro_size)
+    {
+        /* coalesced by UDP_GRO: split off one segment and keep the rest
+         * of the slot for the next call; the segment may not grow into
+         * the one following it */
+        buf->len = gro_size;
+        buf->capacity = buf->offset + buf->len;
+        ASSERT(buf_advance(slot, gro_size));
+        return buf->len;
+    }
+#endif
+    b->next++;
+
+    return buf->len;
+}
+
+#endif /* if ENABLE_UDP_BATCH */
+
 #endif /* ifndef _WIN32 */
 
 /*
@@ -3333,30 +3712,26 @@ link_socket_write_tcp(struct link_socket *sock, struct buffer *buf, struct link_
 
 #if ENABLE_IP_PKTINFO
 
-ssize_t
-link_socket_write_udp_posix_sendmsg(struct link_socket *sock, struct buffer *buf,
-                                    struct link_socket_actual *to)
+/*
+ * Set up the destination address and source address ancillary data
+ * of a datagram which is to be sent with sendmsg() or sendmmsg().
+ */
+static void
+link_socket_write_pktinfo(struct msghdr *mesg, struct link_socket_actual *to, uint8_t *pktinfo_buf)
 {
-    struct iovec iov;
-    struct msghdr mesg;
     struct cmsghdr *cmsg;
-    uint8_t pktinfo_buf[PKTINFO_BUF_SIZE];
 
-    iov.iov_base = BPTR(buf);
-    iov.iov_len = BLEN(buf);
-    mesg.msg_iov = &iov;
-    mesg.msg_iovlen = 1;
     switch (to->dest.addr.sa.sa_family)
     {
         case AF_INET:
         {
-            mesg.msg_name = &to->dest.addr.sa;
-            mesg.msg_namelen = sizeof(struct sockaddr_in);
-            mesg.msg_control = pktinfo_buf;
-            mesg.msg_flags = 0;
+            mesg->msg_name = &to->dest.addr.sa;
+            mesg->msg_namelen = sizeof(struct sockaddr_in);
+            mesg->msg_control = pktinfo_buf;
+            mesg->msg_flags = 0;
 #if defined(HAVE_IN_PKTINFO) && defined(HAVE_IPI_SPEC_DST)
-            mesg.msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
-            cmsg = CMSG_FIRSTHDR(&mesg);
+            mesg->msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
+            cmsg = CMSG_FIRSTHDR(mesg);
             cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_pktinfo));
             cmsg->cmsg_level = SOL_IP;
             cmsg->cmsg_type = IP_PKTINFO;
@@ -3368,9 +3743,9 @@ link_socket_write_udp_posix_sendmsg(struct link_socket *sock, struct buffer *buf
                 pkti->ipi_addr.s_addr = 0;
             }
 #elif defined(IP_RECVDSTADDR)
-            ASSERT(CMSG_SPACE(sizeof(struct in_addr)) <= sizeof(pktinfo_buf));
-            mesg.msg_controllen = CMSG_SPACE(sizeof(struct in_addr));
-            cmsg = CMSG_FIRSTHDR(&mesg);
+            ASSERT(CMSG_SPACE(sizeof(struct in_addr)) <= PKTINFO_BUF_SIZE);
+            mesg->msg_controllen = CMSG_SPACE(sizeof(struct in_addr));
+            cmsg = CMSG_FIRSTHDR(mesg);
             cmsg->cmsg_len = CMSG_LEN(sizeof(struct in_addr));
             cmsg->cmsg_level = IPPROTO_IP;
             cmsg->cmsg_type = IP_RECVDSTADDR;
@@ -3384,14 +3759,14 @@ link_socket_write_udp_posix_sendmsg(struct link_socket *sock, struct buffer *buf
         case AF_INET6:
         {
             struct in6_pktinfo *pkti6;
-            mesg.msg_name = &to->dest.addr.sa;
-            mesg.msg_namelen = sizeof(struct sockaddr_in6);
-
-            ASSERT(CMSG_SPACE(sizeof(struct in6_pktinfo)) <= sizeof(pktinfo_buf));
-            mesg.msg_control = pktinfo_buf;
-            mesg.msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
-            mesg.msg_flags = 0;
-            cmsg = CMSG_FIRSTHDR(&mesg);
+            mesg->msg_name = &to->dest.addr.sa;
+            mesg->msg_namelen = sizeof(struct sockaddr_in6);
+
+            ASSERT(CMSG_SPACE(sizeof(struct in6_pktinfo)) <= PKTINFO_BUF_SIZE);
+            mesg->msg_control = pktinfo_buf;
+            mesg->msg_controllen = CMSG_SPACE(sizeof(struct in6_pktinfo));
+            mesg->msg_flags = 0;
+            cmsg = CMSG_FIRSTHDR(mesg);
             cmsg->cmsg_len = CMSG_LEN(sizeof(struct in6_pktinfo));
             cmsg->cmsg_level = IPPROTO_IPV6;
             cmsg->cmsg_type = IPV6_PKTINFO;
@@ -3405,11 +3780,299 @@ link_socket_write_udp_posix_sendmsg(struct link_socket *sock, struct buffer *buf
         default:
             ASSERT(0);
     }
+}
+
+ssize_t
+link_socket_write_udp_posix_sendmsg(struct link_socket *sock, struct buffer *buf,
+                                    struct link_socket_actual *to)
+{
+    struct iovec iov;
+    struct msghdr mesg;
+    uint8_t pktinfo_buf[PKTINFO_BUF_SIZE];
+
+    iov.iov_base = BPTR(buf);
+    iov.iov_len = BLEN(buf);
+    mesg.msg_iov = &iov;
+    mesg.msg_iovlen = 1;
+    link_socket_write_pktinfo(&mesg, to, pktinfo_buf);
     return sendmsg(sock->sd, &mesg, 0);
 }
 
 #endif /* if ENABLE_IP_PKTINFO */
 
+#if ENABLE_UDP_BATCH
+
+static void
+link_socket_tx_batch_init(struct link_socket *sock, const struct frame *frame)
+{
+    struct link_socket_tx_batch *b;
+    const int size = min_int(sock->tx_batch_size, UDP_BATCH_MAX);
+
+    ALLOC_OBJ_CLEAR(b, struct link_socket_tx_batch);
+    b->size = size;
+    ALLOC_ARRAY_CLEAR(b->bufs, struct buffer, size);
+    ALLOC_ARRAY_CLEAR(b->to, struct link_socket_actual, size);
+    ALLOC_ARRAY_CLEAR(b->msgs, struct mmsghdr, size);
+    ALLOC_ARRAY_CLEAR(b->iovs, struct iovec, size);
+    if (UDP_BATCH_CMSG_SIZE)
+    {
+        ALLOC_ARRAY_CLEAR(b->cmsg_bufs, uint8_t, size * UDP_BATCH_CMSG_SIZE);
+    }
+
+    int buf_size = BUF_SIZE(frame);
+#if ENABLE_UDP_OFFLOAD
+    ALLOC_ARRAY_CLEAR(b->gso_size, int, size);
+    ALLOC_ARRAY_CLEAR(b->gso_segs, int, size);
+    if (sock->sockflags & SF_UDP_GSO)
+    {
+        buf_size = max_int(buf_size, UDP_OFFLOAD_MAX_SIZE);
+    }
+#endif
+    for (int i = 0; i < size; i++)
+    {
+        b->bufs[i] = alloc_buf(buf_size);
+    }
+
+    sock->tx_batch = b;
+    msg(D_OSBUF, "UDP: writing up to %d datagrams per sendmmsg() call", size);
+}
+
+static void
+link_socket_tx_batch_free(struct link_socket *sock)
+{
+    struct link_socket_tx_batch *b = sock->tx_batch;
+    if (b)
+    {
+        for (int i = 0; i < b->size; i++)
+        {
+            free_buf(&b->bufs[i]);
+        }
+        free(b->bufs);
+        free(b->to);
+        free(b->msgs);
+        free(b->iovs);
+        free(b->cmsg_bufs);
+#if ENABLE_UDP_OFFLOAD
+        free(b->gso_size);
+        free(b->gso_segs);
+#endif
+        free(b);
+        sock->tx_batch = NULL;
+    }
+}
+
+#if ENABLE_UDP_OFFLOAD
+/*
+ * Append a datagram to the last queued one, so that the kernel sends
+ * both from a single UDP_SEGMENT buffer.  This only works for the same
+ * destination and as long as all segments but the last one have the
+ * same size.
+ */
+static bool
+link_socket_tx_gso_append(struct link_socket_tx_batch *b, const struct buffer *buf,
+                          const struct link_socket_actual *to)
+{
+    if (!b->count)
+    {
+        return false;
+    }
+
+    const int i = b->count - 1;
+    struct buffer *slot = &b->bufs[i];
+    const int len = BLEN(buf);
+
+    if (len > b->gso_size[i]
+        /* a short segment terminates the run */
+        || BLEN(slot) != b->gso_size[i] * b->gso_segs[i]
+        || b->gso_segs[i] >= UDP_GSO_MAX_SEGMENTS
+        /* leave room for the IP and UDP headers */
+        || BLEN(slot) + len > UDP_OFFLOAD_MAX_SIZE - 1024
+        || !link_socket_actual_match(&b->to[i], to)
+        || memcmp(&b->to[i].pi, &to->pi, sizeof(to->pi)) != 0)
+    {
+        return false;
+    }
+
+    ASSERT(buf_copy(slot, buf));
+    b->gso_segs[i]++;
+    return true;
+}
+
+/*
+ * Add the UDP_SEGMENT header behind whatever ancillary data the
+ * message already carries.
+ */
+static void
+link_socket_write_gso(struct msghdr *mesg, uint8_t *cmsg_buf, uint16_t gso_size)
+{
+    struct cmsghdr *cmsg = (struct cmsghdr *)(cmsg_buf + mesg->msg_controllen);
+
+    mesg->msg_control = cmsg_buf;
+    mesg->msg_controllen += CMSG_SPACE(sizeof(gso_size));
+    cmsg->cmsg_len = CMSG_LEN(sizeof(gso_size));
+    cmsg->cmsg_level = SOL_UDP;
+    cmsg->cmsg_type = UDP_SEGMENT;
+    memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+}
+
+/*
+ * The kernel refused to segment a coalesced datagram, either because
+ * the outgoing device cannot do it (EIO) or because a segment does not
+ * fit the path MTU (EINVAL).  Send the segments one by one instead.
+ */
+static void
+link_socket_tx_gso_split(struct link_socket *sock, int i, int err)
+{
+    struct link_socket_tx_batch *b = sock->tx_batch;
+    struct msghdr *mesg = &b->msgs[i].msg_hdr;
+    const struct buffer *slot = &b->bufs[i];
+
+    if (err == EIO)
+    {
+        msg(M_WARN, "NOTE: UDP segmentation offload failed, disabling UDP_GSO");
+        sock->sockflags &= ~SF_UDP_GSO;
+    }
+
+    /* drop the UDP_SEGMENT header, it was added last */
+    mesg->msg_controllen -= CMSG_SPACE(sizeof(uint16_t));
+    if (!mesg->msg_controllen)
+    {
+        mesg->msg_control = NULL;
+    }
+
+    for (int off = 0; off < BLEN(slot); off += b->gso_size[i])
+    {
+        b->iovs[i].iov_base = BPTR(slot) + off;
+        b->iovs[i].iov_len = min_int(b->gso_size[i], BLEN(slot) - off);
+        if (sendmsg(sock->sd, mesg, 0) < 0)
+        {
+            check_status(-1, "write", sock, NULL);
+            break;
+        }
+    }
+}
+#endif /* if ENABLE_UDP_OFFLOAD */
+
+/*
+ * Queue a datagram for the next link_socket_flush_tx_batch().  The
+ * packet is copied, so the caller may reuse its buffer right away.
+ * Returns the number of bytes queued, so that the caller's accounting
+ * (shaper, ping timer, statistics) works like for an immediate write.
+ */
+ssize_t
+link_socket_write_udp_batch(struct link_socket *sock, struct buffer *buf,
+                            struct link_socket_actual *to)
+{
+    struct link_socket_tx_batch *b = sock->tx_batch;
+
+#if ENABLE_UDP_OFFLOAD
+    if ((sock->sockflags & SF_UDP_GSO) && link_socket_tx_gso_append(b, buf, to))
+    {
+        return BLEN(buf);
+    }
+#endif
+
+    if (b->count == b->size)
+    {
+        link_socket_flush_tx_batch(sock);
+    }
+
+    struct buffer *slot = &b->bufs[b->count];
+    ASSERT(buf_init(slot, 0));
+    ASSERT(buf_copy(slot, buf));
+    b->to[b->count] = *to;
+#if ENABLE_UDP_OFFLOAD
+    b->gso_size[b->count] = BLEN(buf);
+    b->gso_segs[b->count] = 1;
+#endif
+    b->count++;
+
+    return BLEN(buf);
+}
+
+void
+link_socket_flush_tx_batch(struct link_socket *sock)
+{
+    struct link_socket_tx_batch *b = sock->tx_batch;
+    int sent = 0;
+
+    if (!b || !b->count || !socket_defined(sock->sd))
+    {
+        return;
+    }
+
+    for (int i = 0; i < b->count; i++)
+    {
+        struct msghdr *mesg = &b->msgs[i].msg_hdr;
+
+        b->iovs[i].iov_base = BPTR(&b->bufs[i]);
+        b->iovs[i].iov_len = BLEN(&b->bufs[i]);
+
+        CLEAR(*mesg);
+        mesg->msg_iov = &b->iovs[i];
+        mesg->msg_iovlen = 1;
+#if ENABLE_IP_PKTINFO
+        if ((sock->sockflags & SF_USE_IP_PKTINFO) && addr_defined_ipi(&b->to[i]))
+        {
+            link_socket_write_pktinfo(mesg, &b->to[i], b->cmsg_bufs + i * UDP_BATCH_CMSG_SIZE);
+        }
+        else
+#endif
+        {
+            mesg->msg_name = &b->to[i].dest.addr.sa;
+            mesg->msg_namelen = (socklen_t)af_addr_size(b->to[i].dest.addr.sa.sa_family);
+        }
+#if ENABLE_UDP_OFFLOAD
+        if (b->gso_segs[i] > 1)
+        {
+            link_socket_write_gso(mesg, b->cmsg_bufs + i * UDP_BATCH_CMSG_SIZE,
+                                  (uint16_t)b->gso_size[i]);
+        }
+#endif
+    }
+
+    while (sent < b->count)
+    {
+        const int status = sendmmsg(sock->sd, b->msgs + sent, b->count - sent, 0);
+        if (status > 0)
+        {
+            sent += status;
+            continue;
+        }
+        if (status == 0)
+        {
+            /* nothing sent and no error to report, errno is stale */
+            msg(D_LINK_ERRORS, "UDP: sendmmsg() sent nothing, dropped %d queued datagrams",
+                b->count - sent);
+            break;
+        }
+
+        const int err = openvpn_errno();
+#if ENABLE_UDP_OFFLOAD
+        if (b->gso_segs[sent] > 1 && err != EAGAIN && err != EWOULDBLOCK)
+        {
+            link_socket_tx_gso_split(sock, sent, err);
+            sent++;
+            continue;
+        }
+#endif
+        check_status(-1, "write", sock, NULL);
+        if (err == EAGAIN || err == EWOULDBLOCK)
+        {
+            msg(D_LINK_ERRORS, "UDP: dropped %d queued datagrams", b->count - sent);
+            break;
+        }
+
+        /* skip the datagram which failed, e.g. with an unreachable
+         * destination, and carry on with the rest */
+        sent++;
+    }
+
+    b->count = 0;
+}
+
+#endif /* if ENABLE_UDP_BATCH */
+
 /*
  * Win32 overlapped socket I/O functions.
  */
@@ -169,6 +169,64 @@ struct socket_buffer_size
 void socket_set_buffers(socket_descriptor_t fd, const struct socket_buffer_size *sbs,
                         bool reduce_size);
 
+#if ENABLE_UDP_BATCH
+
+/* upper bound for --udp-recv-batch */
+#define UDP_BATCH_MAX 64
+
+#if ENABLE_UDP_OFFLOAD
+/* largest datagram the kernel coalesces for UDP_GRO or segments for UDP_SEGMENT */
+#define UDP_OFFLOAD_MAX_SIZE 65536
+
+/* max number of segments we put into one UDP_SEGMENT datagram */
+#define UDP_GSO_MAX_SEGMENTS 64
+#endif
+
+/*
+ * Datagrams pulled in by a single recvmmsg() call.  They are handed
+ * out one at a time by link_socket_read(), so the rest of the data
+ * path still sees one packet per read.
+ */
+struct link_socket_rx_batch
+{
+    int size;  /* number of slots */
+    int count; /* datagrams received by the last recvmmsg() */
+    int next;  /* next slot to hand out */
+    int headroom;
+
+    struct buffer *bufs;
+    struct link_socket_actual *from;
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    uint8_t *cmsg_bufs;
+#if ENABLE_UDP_OFFLOAD
+    int *gro_size; /* segment size if the kernel coalesced datagrams, else 0 */
+#endif
+};
+
+/*
+ * Datagrams queued by link_socket_write() during one pass of the
+ * server event loop, sent with a single sendmmsg() call by
+ * link_socket_flush_tx_batch().
+ */
+struct link_socket_tx_batch
+{
+    int size;  /* number of slots */
+    int count; /* datagrams queued */
+
+    struct buffer *bufs;
+    struct link_socket_actual *to;
+    struct mmsghdr *msgs;
+    struct iovec *iovs;
+    uint8_t *cmsg_bufs;
+#if ENABLE_UDP_OFFLOAD
+    int *gso_size; /* size of the first datagram in the slot */
+    int *gso_segs; /* number of datagrams appended to the slot */
+#endif
+};
+
+#endif /* if ENABLE_UDP_BATCH */
+
 /*
  * This is the main socket structure used by OpenVPN.  The SOCKET_
  * defines try to abstract away our implementation differences between
@@ -199,6 +257,11 @@ struct link_socket
     /* used for long-term queueing of pre-accepted socket listen */
     bool listen_persistent_queued;
 
+    /* --server-edge-triggered: the socket may have datagrams since its
+     * last edge, until a read finds none */
+    bool edge_readable;
+    bool read_drained; /* the last read found no datagram */
+
     const char *remote_host;
     const char *remote_port;
     const char *local_host;
@@ -225,15 +288,32 @@ struct link_socket
 #define SF_GETADDRINFO_DGRAM (1 << 4)
 #define SF_DCO_WIN           (1 << 5)
 #define SF_PREPEND_SA        (1 << 6)
+#define SF_UDP_GSO           (1 << 7)
+#define SF_UDP_GRO           (1 << 8)
+#define SF_REUSEPORT         (1 << 9)
+#define SF_REUSEPORT_STEER   (1 << 10)
     unsigned int sockflags;
     int mark;
     const char *bind_dev;
+#if ENABLE_BUSY_POLL
+    int busy_poll; /* --busy-poll microseconds, or 0 */
+#endif
 
     /* for stream sockets */
     struct stream_buf stream_buf;
     struct buffer stream_buf_data;
     bool stream_reset;
 
+#if ENABLE_UDP_BATCH
+    /* for batched datagram reads (--udp-recv-batch) */
+    int rx_batch_size;
+    struct link_socket_rx_batch *rx_batch;
+
+    /* for batched datagram writes (--udp-send-batch) */
+    int tx_batch_size;
+    struct link_socket_tx_batch *tx_batch;
+#endif
+
     /* HTTP proxy */
     struct http_proxy_info *http_proxy;
 
@@ -1012,6 +1092,23 @@ link_socket_read_udp_win32(struct link_socket *sock, struct buffer *buf,
 int link_socket_read_udp_posix(struct link_socket *sock, struct buffer *buf,
                                struct link_socket_actual *from);
 
+#if ENABLE_UDP_BATCH
+
+int link_socket_read_udp_batch(struct link_socket *sock, struct buffer *buf,
+                               struct link_socket_actual *from);
+
+/*
+ * Returns true if the last batched read left datagrams which have
+ * not been handed out by link_socket_read() yet.
+ */
+static inline bool
+link_socket_rx_batch_pending(const struct link_socket *sock)
+{
+    return sock->rx_batch && sock->rx_batch->next < sock->rx_batch->count;
+}
+
+#endif /* if ENABLE_UDP_BATCH */
+
 #endif /* ifdef _WIN32 */
 
 /* read a TCP or UDP packet from link */
@@ -1027,7 +1124,17 @@ link_socket_read(struct link_socket *sock, struct buffer *buf, struct link_socke
 #ifdef _WIN32
         res = link_socket_read_udp_win32(sock, buf, from);
 #else
-        res = link_socket_read_udp_posix(sock, buf, from);
+#if ENABLE_UDP_BATCH
+        if (sock->rx_batch)
+        {
+            res = link_socket_read_udp_batch(sock, buf, from);
+        }
+        else
+#endif
+        {
+            res = link_socket_read_udp_posix(sock, buf, from);
+        }
+        sock->read_drained = res < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
 #endif
         return res;
     }
@@ -1098,10 +1205,26 @@ link_socket_write_win32(struct link_socket *sock, struct buffer *buf, struct lin
 ssize_t link_socket_write_udp_posix_sendmsg(struct link_socket *sock, struct buffer *buf,
                                             struct link_socket_actual *to);
 
+#if ENABLE_UDP_BATCH
+
+ssize_t link_socket_write_udp_batch(struct link_socket *sock, struct buffer *buf,
+                                    struct link_socket_actual *to);
 
+/*
+ * Send all datagrams queued by link_socket_write_udp_batch().
+ */
+void link_socket_flush_tx_batch(struct link_socket *sock);
+
+#endif
+
+/*
+ * Send one datagram right away, bypassing the --udp-send-batch queue.
+ * Unlike link_socket_write(), this may be called by threads other
+ * than the one owning the queue.
+ */
 static inline ssize_t
-link_socket_write_udp_posix(struct link_socket *sock, struct buffer *buf,
-                            struct link_socket_actual *to)
+link_socket_write_udp_direct(struct link_socket *sock, struct buffer *buf,
+                             struct link_socket_actual *to)
 {
 #if ENABLE_IP_PKTINFO
     if (proto_is_udp(sock->info.proto) && (sock->sockflags & SF_USE_IP_PKTINFO)
@@ -1115,6 +1238,19 @@ link_socket_write_udp_posix(struct link_socket *sock, struct buffer *buf,
                       (socklen_t)af_addr_size(to->dest.addr.sa.sa_family));
 }
 
+static inline ssize_t
+link_socket_write_udp_posix(struct link_socket *sock, struct buffer *buf,
+                            struct link_socket_actual *to)
+{
+#if ENABLE_UDP_BATCH
+    if (sock->tx_batch)
+    {
+        return link_socket_write_udp_batch(sock, buf, to);
+    }
+#endif
+    return link_socket_write_udp_direct(sock, buf, to);
+}
+
 static inline ssize_t
 link_socket_write_tcp_posix(struct link_socket *sock, struct buffer *buf)
 {
@@ -1195,6 +1331,18 @@ link_socket_set_tos(struct link_socket *sock)
  */
 bool sockets_read_residual(const struct context *c);
 
+/*
+ * Returns true if any initialized socket holds datagrams from
+ * a batched read which have not been processed yet.
+ */
+bool sockets_read_batched(const struct context *c);
+
+/*
+ * Send the datagrams queued for batched writing on all
+ * initialized sockets.
+ */
+void sockets_flush_batched(struct context *c);
+
 static inline event_t
 socket_event_handle(const struct link_socket *sock)
 {
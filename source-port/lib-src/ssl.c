@@ -60,6 +60,8 @@
 #include "ssl_backend.h"
 #include "ssl_ncp.h"
 #include "ssl_util.h"
+#include "ssl_offload.h"
+#include "ssl_crl.h"
 #include "auth_token.h"
 #include "mss.h"
 #include "dco.h"
@@ -453,14 +455,28 @@ tls_version_parse(const char *vstr, const char *extra)
  * - the CRL file was passed inline
  * - the CRL file was not modified since the last (re)load
  *
+ * With the CRL index, see ssl_crl.h, a CRL directory is indexed the same
+ * way, and a changed CRL is reloaded in the background.
+ *
  * @param ssl_ctx         The TLS context to use when reloading the CRL
  * @param crl_file        The file name to load the CRL from, or
  *                        or an array containing the inline CRL.
  * @param crl_file_inline True if crl_file is an inline CRL.
+ * @param crl_dir         True if crl_file is a CRL directory.
  */
 static void
-tls_ctx_reload_crl(struct tls_root_ctx *ssl_ctx, const char *crl_file, bool crl_file_inline)
+tls_ctx_reload_crl(struct tls_root_ctx *ssl_ctx, const char *crl_file, bool crl_file_inline,
+                   bool crl_dir)
 {
+#if ENABLE_CRL_INDEX
+    crl_store_reload(ssl_ctx, crl_file, crl_file_inline, crl_dir);
+#else
+    /* a CRL directory is looked into by each verification */
+    if (crl_dir)
+    {
+        return;
+    }
+
     /* if something goes wrong with stat(), we'll store 0 as mtime */
     platform_stat_t crl_stat = { 0 };
 
@@ -502,6 +518,7 @@ tls_ctx_reload_crl(struct tls_root_ctx *ssl_ctx, const char *crl_file, bool crl_
     ssl_ctx->crl_last_mtime = crl_stat.st_mtime;
     ssl_ctx->crl_last_size = crl_stat.st_size;
     backend_tls_ctx_reload_crl(ssl_ctx, crl_file, crl_file_inline);
+#endif /* if ENABLE_CRL_INDEX */
 }
 
 /*
@@ -554,6 +571,11 @@ init_ssl(const struct options *options, struct tls_root_ctx *new_ctx, bool in_ch
         goto err;
     }
 
+    if (options->tls_resume)
+    {
+        tls_ctx_set_session_resumption(new_ctx, options->tls_server, options->tls_resume);
+    }
+
     if (options->pkcs12_file)
     {
         if (0
@@ -631,8 +653,10 @@ init_ssl(const struct options *options, struct tls_root_ctx *new_ctx, bool in_ch
     tls_ctx_check_cert_time(new_ctx);
 
     /* Read CRL */
-    if (options->crl_file && !(options->ssl_flags & SSLF_CRL_VERIFY_DIR))
+    if (options->crl_file)
     {
+        const bool crl_dir = options->ssl_flags & SSLF_CRL_VERIFY_DIR;
+
         /* If we're running with the chroot option, we may run init_ssl() before
          * and after chroot-ing. We can use the crl_file path as-is if we're
          * not going to chroot, or if we already are inside the chroot.
@@ -642,13 +666,14 @@ init_ssl(const struct options *options, struct tls_root_ctx *new_ctx, bool in_ch
          */
         if (!options->chroot_dir || in_chroot || options->crl_file_inline)
         {
-            tls_ctx_reload_crl(new_ctx, options->crl_file, options->crl_file_inline);
+            tls_ctx_reload_crl(new_ctx, options->crl_file, options->crl_file_inline, crl_dir);
         }
         else
         {
             struct gc_arena gc = gc_new();
             struct buffer crl_file_buf = prepend_dir(options->chroot_dir, options->crl_file, &gc);
-            tls_ctx_reload_crl(new_ctx, BSTR(&crl_file_buf), options->crl_file_inline);
+            tls_ctx_reload_crl(new_ctx, BSTR(&crl_file_buf), options->crl_file_inline,
+                               crl_dir);
             gc_free(&gc);
         }
     }
@@ -875,10 +900,11 @@ key_state_init(struct tls_session *session, struct key_state *ks)
      * Attempt CRL reload before TLS negotiation. Won't be performed if
      * the file was not modified since the last reload
      */
-    if (session->opt->crl_file && !(session->opt->ssl_flags & SSLF_CRL_VERIFY_DIR))
+    if (session->opt->crl_file)
     {
         tls_ctx_reload_crl(&session->opt->ssl_ctx, session->opt->crl_file,
-                           session->opt->crl_file_inline);
+                           session->opt->crl_file_inline,
+                           session->opt->ssl_flags & SSLF_CRL_VERIFY_DIR);
     }
 }
 
@@ -901,6 +927,9 @@ key_state_free(struct key_state *ks, bool clear)
 {
     ks->state = S_UNDEF;
 
+#if ENABLE_SERVER_TLS_THREADS
+    tls_offload_cancel(ks);
+#endif
     key_state_ssl_free(&ks->ks_ssl);
 
     free_key_ctx_bi(&ks->crypto_options.key_ctx_bi);
@@ -2617,6 +2646,51 @@ read_incoming_tls_plaintext(struct key_state *ks, struct buffer *buf, interval_t
     return true;
 }
 
+#if ENABLE_SERVER_TLS_THREADS
+/**
+ * read_incoming_tls_plaintext() for the handshake of a server with
+ * --server-tls-threads: finish the read of a worker, if there is one,
+ * and hand the next read to a worker if new ciphertext was written to
+ * the TLS object.  Sets \c *busy in that case, the TLS object is the
+ * worker's then.
+ */
+static bool
+read_incoming_tls_plaintext_offload(struct tls_multi *multi, struct tls_session *session,
+                                    struct key_state *ks, bool new_ciphertext,
+                                    interval_t *wakeup, bool *continue_tls_process, bool *busy)
+{
+    struct buffer *buf = &ks->plaintext_read_buf;
+
+    if (tls_offload_done(ks))
+    {
+        int status = tls_offload_read_plaintext_done(ks, session, buf);
+
+        update_time();
+        if (status == -1)
+        {
+            msg(D_TLS_ERRORS, "TLS Error: TLS object -> incoming plaintext read error");
+            return false;
+        }
+        if (status == 1)
+        {
+            *continue_tls_process = true;
+            dmsg(D_TLS_DEBUG, "TLS -> Incoming Plaintext");
+
+            /* More data may be available, wake up again asap to check. */
+            *wakeup = 0;
+            return true;
+        }
+    }
+
+    if (new_ciphertext)
+    {
+        tls_offload_read_plaintext(session->opt->offload, multi, ks);
+        *busy = true;
+    }
+    return true;
+}
+#endif /* ENABLE_SERVER_TLS_THREADS */
+
 static bool
 write_outgoing_tls_ciphertext(struct tls_session *session, bool *continue_tls_process)
 {
@@ -2806,7 +2880,16 @@ tls_process_state(struct tls_multi *multi, struct tls_session *session, struct b
         return false;
     }
 
+#if ENABLE_SERVER_TLS_THREADS
+    /* A handshake worker has the TLS object */
+    if (tls_offload_busy(ks))
+    {
+        return false;
+    }
+#endif
+
     /* Write incoming ciphertext to TLS object */
+    bool new_ciphertext = false;
     struct reliable_entry *entry = reliable_get_entry_sequenced(ks->rec_reliable);
     if (entry)
     {
@@ -2821,10 +2904,11 @@ tls_process_state(struct tls_multi *multi, struct tls_session *session, struct b
         }
         else
         {
-            if (!read_incoming_tls_ciphertext(&entry->buf, ks, &continue_tls_process))
+            if (!read_incoming_tls_ciphertext(&entry->buf, ks, &new_ciphertext))
             {
                 goto error;
             }
+            continue_tls_process |= new_ciphertext;
         }
     }
 
@@ -2832,6 +2916,22 @@ tls_process_state(struct tls_multi *multi, struct tls_session *session, struct b
     struct buffer *buf = &ks->plaintext_read_buf;
     if (!buf->len)
     {
+#if ENABLE_SERVER_TLS_THREADS
+        if (session->opt->offload && ks->state >= S_PRE_START && ks->state <= S_START)
+        {
+            bool busy = false;
+            if (!read_incoming_tls_plaintext_offload(multi, session, ks, new_ciphertext, wakeup,
+                                                     &continue_tls_process, &busy))
+            {
+                goto error;
+            }
+            if (busy)
+            {
+                return false;
+            }
+        }
+        else
+#endif
         if (!read_incoming_tls_plaintext(ks, buf, wakeup, &continue_tls_process))
         {
             goto error;
@@ -2860,6 +2960,11 @@ tls_process_state(struct tls_multi *multi, struct tls_session *session, struct b
         && ((ks->state == S_SENT_KEY && !session->opt->server)
             || (ks->state == S_START && session->opt->server)))
     {
+        if (!key_state_check_resumed(&ks->ks_ssl, session))
+        {
+            msg(D_TLS_ERRORS, "TLS Error: Certificate verification failed (resumed session)");
+            goto error;
+        }
         if (!key_method_2_read(buf, multi, session))
         {
             goto error;
@@ -2895,6 +3000,10 @@ tls_process_state(struct tls_multi *multi, struct tls_session *session, struct b
 error:
     tls_clear_error();
 
+#if ENABLE_SERVER_TLS_THREADS
+    tls_offload_cancel(ks);
+#endif
+
     /* Shut down the TLS session but do a last read from the TLS
      * object to be able to read potential TLS alerts */
     key_state_ssl_shutdown(&ks->ks_ssl);
@@ -2940,7 +3049,7 @@ should_trigger_renegotiation(const struct tls_session *session, const struct key
     {
         /* We only need to check the send key as we always keep send
          * key epoch >= recv key epoch in \c epoch_replace_update_recv_key */
-        if (ks->crypto_options.epoch_key_send.epoch >= 0xF000)
+        if (ks->crypto_options.key_ctx_bi.encrypt.epoch >= 0xF000)
         {
             return true;
         }
@@ -3025,6 +3134,17 @@ tls_process(struct tls_multi *multi, struct tls_session *session, struct buffer
         key_state_soft_reset(session);
     }
 
+    /* Derive the data keys of the next epochs outside of the data path */
+    for (int i = 0; i < KS_SIZE; i++)
+    {
+        struct crypto_options *co = &session->key[i].crypto_options;
+        if (session->key[i].state >= S_GENERATED_KEYS && (co->flags & CO_EPOCH_DATA_KEY_FORMAT)
+            && co->key_ctx_bi.initialized)
+        {
+            epoch_precompute_keys(co);
+        }
+    }
+
     /* Kill lame duck key transition_window seconds after primary key negotiation */
     if (lame_duck_must_die(session, wakeup))
     {
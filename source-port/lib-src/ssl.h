@@ -54,6 +54,12 @@
  */
 #define CONTROL_SEND_ACK_MAX 4
 
+/*
+ * Default and maximum lifetime of resumable TLS sessions (--tls-resume)
+ */
+#define TLS_RESUME_LIFETIME_DEFAULT 7200
+#define TLS_RESUME_LIFETIME_MAX     (7 * 24 * 60 * 60) /* the limit of TLS 1.3 */
+
 /*
  * Various timeouts
  */
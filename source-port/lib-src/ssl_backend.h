@@ -53,6 +53,11 @@
  */
 struct tls_session;
 
+/**
+ *  prototype for struct crl_index from ssl_crl.c
+ */
+struct crl_index;
+
 /*
  *
  * Functions implemented in ssl.c for use by the backend SSL library
@@ -159,6 +164,24 @@ bool tls_ctx_initialised(struct tls_root_ctx *ctx);
  */
 bool tls_ctx_set_options(struct tls_root_ctx *ctx, unsigned int ssl_flags);
 
+/**
+ * Let the handshakes of the context resume earlier TLS sessions
+ * (--tls-resume).
+ *
+ * A server keeps the sessions it negotiates for \a lifetime seconds.  A
+ * client keeps the last session it got from the server for as long as
+ * the context lives, which includes SIGUSR1 restarts.  Only TLS 1.3
+ * sessions are resumed, as their handshakes still do a key exchange.
+ *
+ * The peer does not show its certificates in a resumed handshake, see
+ * \c key_state_check_resumed().
+ *
+ * @param ctx           TLS context to set up, must be valid.
+ * @param server        true for the context of a server.
+ * @param lifetime      Seconds a server keeps a session resumable.
+ */
+void tls_ctx_set_session_resumption(struct tls_root_ctx *ctx, bool server, int lifetime);
+
 /**
  * Restrict the list of ciphers that can be used within the TLS context for TLS 1.2
  * and below
@@ -376,6 +399,22 @@ void key_state_ssl_shutdown(struct key_state_ssl *ks_ssl);
  */
 void key_state_ssl_free(struct key_state_ssl *ks_ssl);
 
+#if ENABLE_CRL_INDEX
+/**
+ * Add the CRLs of a file to a CRL index, see ssl_crl.h.  Runs on the
+ * thread building the index: instead of logging, problems are recorded
+ * with \c crl_index_warn().  The signature of each CRL is checked against
+ * the CA certificates of \a ssl_ctx.
+ *
+ * @param ix            The index to fill.
+ * @param ssl_ctx       The TLS context holding the CA certificates.
+ * @param crl_file      The file name to load the CRL from, or
+ *                      an array containing the inline CRL.
+ * @param crl_inline    True if crl_file is an inline CRL.
+ */
+void backend_crl_index_load(struct crl_index *ix, const struct tls_root_ctx *ssl_ctx,
+                            const char *crl_file, bool crl_inline);
+#else
 /**
  * Reload the Certificate Revocation List for the SSL channel
  *
@@ -386,6 +425,7 @@ void key_state_ssl_free(struct key_state_ssl *ks_ssl);
  */
 void backend_tls_ctx_reload_crl(struct tls_root_ctx *ssl_ctx, const char *crl_file,
                                 bool crl_inline);
+#endif
 
 #define EXPORT_KEY_DATA_LABEL          "EXPORTER-OpenVPN-datakeys"
 #define EXPORT_P2P_PEERID_LABEL        "EXPORTER-OpenVPN-p2p-peerid"
@@ -512,6 +552,60 @@ int key_state_write_ciphertext(struct key_state_ssl *ks_ssl, struct buffer *buf)
  */
 int key_state_read_plaintext(struct key_state_ssl *ks_ssl, struct buffer *buf);
 
+/**
+ * Check the peer certificates of a resumed handshake.
+ *
+ * A resumed handshake does not show the certificates of the peer, so the
+ * ones of the resumed session are checked now the way a full handshake
+ * would have: against the CA and CRL loaded at this time, and with \c
+ * verify_cert().  This sets the common name and the certificate hashes
+ * of \a session again, which the locks of \c tls_lock_common_name() and
+ * \c tls_lock_cert_hash_set() are held against.
+ *
+ * @param ks_ssl       - The security parameter state for this %key
+ *                       session, after the handshake.
+ * @param session      - The session the %key belongs to.
+ *
+ * @return false if the handshake was resumed and the certificates fail
+ *     the checks, true otherwise.
+ */
+bool key_state_check_resumed(struct key_state_ssl *ks_ssl, struct tls_session *session);
+
+#if ENABLE_SERVER_TLS_THREADS
+/**
+ * Extract plaintext data from the TLS module on a handshake worker
+ * thread (--server-tls-threads).
+ *
+ * Like \c key_state_read_plaintext(), this drives the TLS handshake, but
+ * it does not log and it does not call \c verify_cert(): what the event
+ * loop has to do is left in \a ks_ssl for \c key_state_read_plaintext_done().
+ *
+ * @param ks_ssl       - The security parameter state for this %key
+ *                       session.
+ * @param buf          - A buffer in which to store the plaintext.
+ *
+ * @return Same as \c key_state_read_plaintext().
+ */
+int key_state_read_plaintext_offload(struct key_state_ssl *ks_ssl, struct buffer *buf);
+
+/**
+ * Finish \c key_state_read_plaintext_offload() on the event loop: check
+ * the peer certificates the handshake saw with \c verify_cert() and log
+ * the errors of the worker.
+ *
+ * @param ks_ssl       - The security parameter state for this %key
+ *                       session.
+ * @param session      - The session the %key belongs to.
+ * @param buf          - The plaintext the worker extracted.
+ * @param status       - What \c key_state_read_plaintext_offload() returned.
+ *
+ * @return What \c key_state_read_plaintext() would have returned; -1 if
+ *     a certificate failed the checks, in which case \a buf is emptied.
+ */
+int key_state_read_plaintext_done(struct key_state_ssl *ks_ssl, struct tls_session *session,
+                                  struct buffer *buf, int status);
+#endif
+
 /** @} name Functions for packets received from a remote OpenVPN peer */
 
 /** @} addtogroup control_tls */
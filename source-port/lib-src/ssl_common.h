@@ -223,6 +223,9 @@ struct key_state
     uint32_t peer_id;
 
     struct key_state_ssl ks_ssl;           /* contains SSL object and BIOs for the control channel */
+#if ENABLE_SERVER_TLS_THREADS
+    struct tls_offload_job *offload;       /* handshake worker job, see ssl_offload.h */
+#endif
 
     time_t initial;                        /* when we created this session */
     time_t established;                    /* when our state went S_ACTIVE */
@@ -453,6 +456,13 @@ struct tls_options
     size_t ekm_size;
 
     bool dco_enabled; /**< Whether keys have to be installed in DCO or not */
+
+#if ENABLE_SERVER_TLS_THREADS
+    struct tls_offload *offload; /**< handshake workers (--server-tls-threads) */
+#endif
+#if ENABLE_AUTH_HELPERS
+    struct auth_helpers *auth_helpers; /**< script helpers (--auth-helpers) */
+#endif
 };
 
 /** @addtogroup control_processor
@@ -0,0 +1,497 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "syshead.h"
+
+#if ENABLE_CRL_INDEX
+
+#include <pthread.h>
+#include <dirent.h>
+
+#include "list.h"
+#include "otime.h"
+#include "platform.h"
+#include "crypto.h"
+#include "ssl_backend.h"
+#include "ssl_crl.h"
+
+#include "memdbg.h"
+
+/* an issuer name or a serial number, as the backend encodes them */
+struct crl_key
+{
+    int len;
+    const uint8_t *data;
+};
+
+struct crl_issuer
+{
+    const struct crl_key *name; /* NULL for the set of the 'dir' mode */
+    time_t this_update;
+    time_t next_update;
+    bool signature_ok;
+    struct hash *serials;
+    struct crl_issuer *next;
+};
+
+struct crl_index
+{
+    struct gc_arena gc; /* the issuers and the keys */
+    struct crl_issuer *issuers;
+    int n_crls;
+    int n_serials;
+
+    /* the first warning of the build, and how many there were */
+    char warning[256];
+    int n_warnings;
+};
+
+struct crl_store
+{
+    const struct tls_root_ctx *ssl_ctx;
+
+    /* the index in use, for the event loop only */
+    struct crl_index *index;
+
+    /* the CRL file the last index, in use or being built, was built from,
+     * and when that build started */
+    time_t mtime;
+    off_t size;
+    time_t built;
+
+    /* the build on a thread; the loop only reads these while building is
+     * false, or after the thread said it is done */
+    bool building;
+    pthread_t thread;
+    char *file;
+    bool file_inline;
+    bool dir;
+
+    pthread_mutex_t lock; /* for the two below */
+    bool build_done;
+    struct crl_index *pending;
+};
+
+static uint32_t
+crl_key_hash(const void *key, uint32_t iv)
+{
+    const struct crl_key *k = key;
+    return hash_func(k->data, k->len, iv);
+}
+
+static bool
+crl_key_equal(const void *key1, const void *key2)
+{
+    const struct crl_key *k1 = key1;
+    const struct crl_key *k2 = key2;
+    return k1->len == k2->len && !memcmp(k1->data, k2->data, k1->len);
+}
+
+static const struct crl_key *
+crl_key_new(const uint8_t *data, int len, struct gc_arena *gc)
+{
+    struct crl_key *k = gc_malloc(sizeof(struct crl_key) + len, false, gc);
+    uint8_t *copy = (uint8_t *)(k + 1);
+
+    memcpy(copy, data, len);
+    k->len = len;
+    k->data = copy;
+    return k;
+}
+
+static struct crl_index *
+crl_index_new(void)
+{
+    struct crl_index *ix;
+
+    ALLOC_OBJ_CLEAR(ix, struct crl_index);
+    ix->gc = gc_new();
+    return ix;
+}
+
+static void
+crl_index_free(struct crl_index *ix)
+{
+    if (!ix)
+    {
+        return;
+    }
+
+    for (struct crl_issuer *issuer = ix->issuers; issuer; issuer = issuer->next)
+    {
+        hash_free(issuer->serials);
+    }
+    gc_free(&ix->gc);
+    free(ix);
+}
+
+struct crl_issuer *
+crl_index_add_issuer(struct crl_index *ix, const uint8_t *name, int name_len, int n_serials,
+                     time_t this_update, time_t next_update, bool signature_ok)
+{
+    struct crl_key key = { name_len, name };
+    struct crl_issuer *issuer;
+
+    for (issuer = ix->issuers; issuer; issuer = issuer->next)
+    {
+        if (name && issuer->name && crl_key_equal(&key, issuer->name))
+        {
+            break;
+        }
+    }
+
+    if (!issuer)
+    {
+        ALLOC_OBJ_CLEAR_GC(issuer, struct crl_issuer, &ix->gc);
+        issuer->name = name ? crl_key_new(name, name_len, &ix->gc) : NULL;
+        issuer->signature_ok = true;
+        issuer->serials = hash_init(max_int(n_serials, 1), 0, crl_key_hash, crl_key_equal);
+        issuer->next = ix->issuers;
+        ix->issuers = issuer;
+    }
+
+    /* the newest CRL of the issuer says until when its list holds */
+    if (this_update >= issuer->this_update)
+    {
+        issuer->this_update = this_update;
+        issuer->next_update = next_update;
+    }
+    issuer->signature_ok = issuer->signature_ok && signature_ok;
+    ix->n_crls++;
+
+    return issuer;
+}
+
+void
+crl_index_add_serial(struct crl_index *ix, struct crl_issuer *issuer, const uint8_t *serial,
+                     int serial_len)
+{
+    struct crl_key key = { serial_len, serial };
+    uint32_t hv = hash_value(issuer->serials, &key);
+    struct hash_bucket *bucket = hash_bucket(issuer->serials, hv);
+
+    if (!hash_lookup_fast(issuer->serials, bucket, &key, hv))
+    {
+        const struct crl_key *k = crl_key_new(serial, serial_len, &ix->gc);
+        hash_add_fast(issuer->serials, bucket, k, hv, (void *)k);
+        ix->n_serials++;
+    }
+}
+
+void
+crl_index_warn(struct crl_index *ix, const char *format, ...)
+{
+    if (ix->n_warnings++ == 0)
+    {
+        va_list arglist;
+        va_start(arglist, format);
+        vsnprintf(ix->warning, sizeof(ix->warning), format, arglist);
+        va_end(arglist);
+    }
+}
+
+/*
+ * The 'dir' mode: every file in the directory is named after a revoked
+ * serial number, in decimal.
+ */
+static void
+crl_index_load_dir(struct crl_index *ix, const char *crl_dir)
+{
+    DIR *dir = opendir(crl_dir);
+    struct dirent *entry;
+    int n = 0;
+
+    if (!dir)
+    {
+        crl_index_warn(ix, "CRL: cannot open directory %s: %s", crl_dir, strerror(errno));
+        return;
+    }
+
+    /* count first, to size the set */
+    while ((entry = readdir(dir)))
+    {
+        n++;
+    }
+    rewinddir(dir);
+
+    struct crl_issuer *issuer = crl_index_add_issuer(ix, NULL, 0, n, 0, 0, true);
+    while ((entry = readdir(dir)))
+    {
+        if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, ".."))
+        {
+            crl_index_add_serial(ix, issuer, (const uint8_t *)entry->d_name,
+                                 (int)strlen(entry->d_name));
+        }
+    }
+    closedir(dir);
+}
+
+static struct crl_index *
+crl_index_build(const struct tls_root_ctx *ssl_ctx, const char *crl_file, bool crl_inline,
+                bool crl_dir)
+{
+    struct crl_index *ix = crl_index_new();
+
+    if (crl_dir)
+    {
+        crl_index_load_dir(ix, crl_file);
+    }
+    else
+    {
+        backend_crl_index_load(ix, ssl_ctx, crl_file, crl_inline);
+    }
+    return ix;
+}
+
+static void
+crl_index_log(const struct crl_index *ix, const char *crl_file, bool crl_inline, bool crl_dir)
+{
+    if (ix->n_warnings)
+    {
+        msg(M_WARN, "%s", ix->warning);
+        if (ix->n_warnings > 1)
+        {
+            msg(M_WARN, "CRL: %d more warnings", ix->n_warnings - 1);
+        }
+    }
+
+    if (crl_dir)
+    {
+        msg(M_INFO, "CRL: loaded %d revoked serials from directory %s", ix->n_serials, crl_file);
+    }
+    else
+    {
+        msg(M_INFO, "CRL: loaded %d CRLs with %d revoked serials from file %s", ix->n_crls,
+            ix->n_serials, print_key_filename(crl_file, crl_inline));
+    }
+}
+
+static void *
+crl_store_thread(void *arg)
+{
+    struct crl_store *cs = arg;
+    struct crl_index *ix = crl_index_build(cs->ssl_ctx, cs->file, cs->file_inline, cs->dir);
+
+    pthread_mutex_lock(&cs->lock);
+    cs->pending = ix;
+    cs->build_done = true;
+    pthread_mutex_unlock(&cs->lock);
+
+    return NULL;
+}
+
+/* take the index of a build that is done, if there is one */
+static void
+crl_store_collect(struct crl_store *cs)
+{
+    if (!cs->building)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&cs->lock);
+    struct crl_index *ix = cs->build_done ? cs->pending : NULL;
+    pthread_mutex_unlock(&cs->lock);
+    if (!ix)
+    {
+        return;
+    }
+
+    pthread_join(cs->thread, NULL);
+    cs->building = false;
+    cs->build_done = false;
+    cs->pending = NULL;
+
+    crl_index_free(cs->index);
+    cs->index = ix;
+    crl_index_log(ix, cs->file, cs->file_inline, cs->dir);
+}
+
+static void
+crl_store_build(struct crl_store *cs, const char *crl_file, bool crl_inline, bool crl_dir)
+{
+    free(cs->file);
+    cs->file = string_alloc(crl_file, NULL);
+    cs->file_inline = crl_inline;
+    cs->dir = crl_dir;
+
+    /* the first index is there before the first handshake */
+    if (!cs->index)
+    {
+        cs->index = crl_index_build(cs->ssl_ctx, crl_file, crl_inline, crl_dir);
+        crl_index_log(cs->index, crl_file, crl_inline, crl_dir);
+        return;
+    }
+
+    cs->building = platform_thread_create(&cs->thread, crl_store_thread, cs) == 0;
+
+    if (!cs->building)
+    {
+        msg(M_WARN, "WARNING: cannot start a thread to reload the CRL, reloading it now");
+        crl_index_free(cs->index);
+        cs->index = crl_index_build(cs->ssl_ctx, crl_file, crl_inline, crl_dir);
+        crl_index_log(cs->index, crl_file, crl_inline, crl_dir);
+    }
+}
+
+void
+crl_store_reload(struct tls_root_ctx *ctx, const char *crl_file, bool crl_inline, bool crl_dir)
+{
+    struct crl_store *cs = ctx->crl_store;
+
+    if (!cs)
+    {
+        ALLOC_OBJ_CLEAR(cs, struct crl_store);
+        cs->ssl_ctx = ctx;
+        pthread_mutex_init(&cs->lock, NULL);
+        ctx->crl_store = cs;
+    }
+
+    crl_store_collect(cs);
+    if (cs->building)
+    {
+        return;
+    }
+
+    /* if something goes wrong with stat(), we'll store 0 as mtime */
+    platform_stat_t crl_stat = { 0 };
+
+    /*
+     * an inline CRL can't change at runtime, therefore there is no need to
+     * reload it. It will be reloaded upon config change + SIGHUP.
+     */
+    if (crl_inline)
+    {
+        crl_stat.st_mtime = 1;
+    }
+    else if (platform_stat(crl_file, &crl_stat) < 0)
+    {
+        if (!cs->index && !crl_dir)
+        {
+            msg(M_FATAL, "ERROR: Failed to stat CRL file during initialization, exiting.");
+        }
+        else
+        {
+            msg(M_WARN, "WARNING: Failed to stat CRL %s, not reloading CRL.",
+                crl_dir ? "directory" : "file");
+        }
+        return;
+    }
+
+    /*
+     * Keep the index if the file did not change since it was built.  A
+     * change within the second the build started would not show in the
+     * mtime, so such an index is built once more.
+     */
+    if (cs->index && cs->size == crl_stat.st_size && cs->mtime == crl_stat.st_mtime
+        && (crl_inline || cs->mtime < cs->built))
+    {
+        return;
+    }
+
+    cs->mtime = crl_stat.st_mtime;
+    cs->size = crl_stat.st_size;
+    cs->built = time(NULL);
+    crl_store_build(cs, crl_file, crl_inline, crl_dir);
+}
+
+void
+crl_store_free(struct crl_store *cs)
+{
+    if (!cs)
+    {
+        return;
+    }
+
+    if (cs->building)
+    {
+        pthread_join(cs->thread, NULL);
+        crl_index_free(cs->pending);
+    }
+    crl_index_free(cs->index);
+    free(cs->file);
+    pthread_mutex_destroy(&cs->lock);
+    free(cs);
+}
+
+bool
+crl_store_loaded(struct crl_store *cs)
+{
+    if (!cs)
+    {
+        return false;
+    }
+
+    crl_store_collect(cs);
+    return cs->index && cs->index->n_crls > 0;
+}
+
+enum crl_status
+crl_store_lookup(struct crl_store *cs, const uint8_t *issuer_name, int issuer_len,
+                 const uint8_t *serial, int serial_len)
+{
+    if (!cs)
+    {
+        return CRL_NOT_REVOKED;
+    }
+
+    crl_store_collect(cs);
+    if (!cs->index)
+    {
+        return CRL_NOT_REVOKED;
+    }
+
+    struct crl_key name = { issuer_len, issuer_name };
+    struct crl_key key = { serial_len, serial };
+
+    for (struct crl_issuer *issuer = cs->index->issuers; issuer; issuer = issuer->next)
+    {
+        if (issuer->name && !crl_key_equal(&name, issuer->name))
+        {
+            continue;
+        }
+
+        if (!issuer->signature_ok)
+        {
+            return CRL_BAD_SIGNATURE;
+        }
+        if (now < issuer->this_update)
+        {
+            return CRL_NOT_YET_VALID;
+        }
+        if (issuer->next_update && now > issuer->next_update)
+        {
+            return CRL_EXPIRED;
+        }
+        return hash_lookup(issuer->serials, &key) ? CRL_REVOKED : CRL_NOT_REVOKED;
+    }
+
+    /* no CRL from this issuer */
+    return CRL_NOT_REVOKED;
+}
+
+#endif /* ENABLE_CRL_INDEX */
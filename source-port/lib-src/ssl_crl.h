@@ -0,0 +1,127 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The revoked certificates of --crl-verify, indexed in memory.
+ *
+ * For each issuer there is a hash set of the serial numbers it revoked,
+ * so verify_cert() checks a certificate with one lookup.  In the
+ * 'dir' mode of --crl-verify, the names of the files in the directory
+ * are the serial numbers of a single set, which stands for any issuer.
+ *
+ * Whether the CRL file or directory changed is checked before each TLS
+ * handshake.  When it did, a new index is built on a thread while the
+ * old one stays in use; the event loop swaps in the new one once it is
+ * complete.  Only the first index, at startup, is built on the event
+ * loop itself.
+ */
+
+#ifndef SSL_CRL_H
+#define SSL_CRL_H
+
+#if ENABLE_CRL_INDEX
+
+struct crl_store;
+struct crl_index;
+struct crl_issuer;
+struct tls_root_ctx;
+
+/** What the index says about a certificate */
+enum crl_status
+{
+    CRL_NOT_REVOKED,
+    CRL_REVOKED,
+    CRL_EXPIRED,       /**< the CRL of the issuer is past its next update */
+    CRL_NOT_YET_VALID, /**< the CRL of the issuer is from the future */
+    CRL_BAD_SIGNATURE  /**< the CRL of the issuer is not signed by it */
+};
+
+/**
+ * Check whether the CRL file or directory of \a ctx changed, and have a
+ * new index built if it did.  The first call builds the index right
+ * away.
+ *
+ * @param ctx           The TLS context the CRL belongs to.  Its store
+ *                      is created on the first call.
+ * @param crl_file      The CRL file or directory, or the inline CRL.
+ * @param crl_inline    True if \a crl_file is an inline CRL.
+ * @param crl_dir       True if \a crl_file is a directory.
+ */
+void crl_store_reload(struct tls_root_ctx *ctx, const char *crl_file, bool crl_inline,
+                      bool crl_dir);
+
+/**
+ * Free the store, waiting for a build in progress.
+ */
+void crl_store_free(struct crl_store *cs);
+
+/**
+ * Does the index in use contain any CRL ?
+ */
+bool crl_store_loaded(struct crl_store *cs);
+
+/**
+ * Look up the certificate with \a serial from \a issuer.  In the 'dir'
+ * mode, \a issuer is ignored and \a serial is the file name to look for.
+ */
+enum crl_status crl_store_lookup(struct crl_store *cs, const uint8_t *issuer, int issuer_len,
+                                 const uint8_t *serial, int serial_len);
+
+/*
+ * For the backend to fill the index with the CRLs of a file.  It runs
+ * on the thread building the index and must not log.
+ */
+
+/**
+ * Add the CRL of \a name to the index, expecting \a n_serials revoked
+ * serials.  The serials of several CRLs from the same issuer are merged.
+ *
+ * @param this_update   When the CRL was issued.
+ * @param next_update   When the next CRL is due, 0 if not given.
+ * @param signature_ok  False if the CRL is not signed by its issuer.
+ */
+struct crl_issuer *crl_index_add_issuer(struct crl_index *ix, const uint8_t *name, int name_len,
+                                        int n_serials, time_t this_update, time_t next_update,
+                                        bool signature_ok);
+
+/**
+ * Add a revoked serial to the CRL of \a issuer.
+ */
+void crl_index_add_serial(struct crl_index *ix, struct crl_issuer *issuer, const uint8_t *serial,
+                          int serial_len);
+
+/**
+ * Record a warning, logged by the event loop when it takes the index.
+ */
+void crl_index_warn(struct crl_index *ix, const char *format, ...)
+#ifdef __GNUC__
+#if __USE_MINGW_ANSI_STDIO
+    __attribute__((format(gnu_printf, 2, 3)))
+#else
+    __attribute__((format(__printf__, 2, 3)))
+#endif
+#endif
+    ;
+
+#endif /* ENABLE_CRL_INDEX */
+
+#endif /* SSL_CRL_H */
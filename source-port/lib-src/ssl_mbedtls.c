@@ -297,6 +297,12 @@ tls_ctx_set_options(struct tls_root_ctx *ctx, unsigned int ssl_flags)
     return true;
 }
 
+void
+tls_ctx_set_session_resumption(struct tls_root_ctx *ctx, bool server, int lifetime)
+{
+    msg(M_WARN, "NOTE: --tls-resume is not supported with mbed TLS, ignored");
+}
+
 static const char *
 tls_translate_cipher_name(const char *cipher_name)
 {
@@ -1465,6 +1471,13 @@ key_state_read_plaintext(struct key_state_ssl *ks, struct buffer *buf)
     return 1;
 }
 
+bool
+key_state_check_resumed(struct key_state_ssl *ks_ssl, struct tls_session *session)
+{
+    /* sessions are never resumed, see tls_ctx_set_session_resumption() */
+    return true;
+}
+
 /* **************************************
  *
  * Information functions
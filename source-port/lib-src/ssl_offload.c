@@ -0,0 +1,372 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "syshead.h"
+
+#if ENABLE_SERVER_TLS_THREADS
+
+#include <pthread.h>
+
+#include "ssl_common.h"
+#include "ssl_backend.h"
+#include "fdmisc.h"
+#include "platform.h"
+#include "ssl_offload.h"
+
+#include "memdbg.h"
+
+enum tls_offload_state
+{
+    TLS_OFFLOAD_IDLE,    /* nothing to do, or the result was taken */
+    TLS_OFFLOAD_QUEUED,  /* waiting for a worker */
+    TLS_OFFLOAD_RUNNING, /* a worker has the TLS object */
+    TLS_OFFLOAD_DONE     /* the event loop can take the result */
+};
+
+/*
+ * The job of a key.  It is allocated on the first read handed to a
+ * worker and freed with the key.  As the key_state may be copied around
+ * while the job runs (e.g. by move_session()), the job keeps its own
+ * copy of the TLS object handles, which do not move.
+ */
+struct tls_offload_job
+{
+    struct tls_offload *o;
+    struct tls_multi *owner;
+    struct key_state_ssl ks_ssl;
+
+    enum tls_offload_state state;
+    struct buffer buf; /* the plaintext read */
+    int status;
+
+    struct tls_offload_job *next; /* in the queue or in the done list */
+};
+
+struct tls_offload
+{
+    pthread_mutex_t lock;
+    pthread_cond_t work;  /* signalled when a job is queued */
+    pthread_cond_t ended; /* signalled when a job is done */
+    bool stopping;
+
+    /* queued jobs, oldest first */
+    struct tls_offload_job *queue_head;
+    struct tls_offload_job *queue_tail;
+
+    /* jobs done, not yet retired */
+    struct tls_offload_job *done;
+
+    /* wakes up the event loop */
+    int wakeup_pipe[2];
+    bool wakeup_pending;
+
+    int n_threads;
+    pthread_t *threads;
+};
+
+/* remove job from the singly linked list at *list, if it is there */
+static void
+tls_offload_unlink(struct tls_offload_job **list, struct tls_offload_job *job)
+{
+    for (struct tls_offload_job **p = list; *p; p = &(*p)->next)
+    {
+        if (*p == job)
+        {
+            *p = job->next;
+            job->next = NULL;
+            return;
+        }
+    }
+}
+
+static void *
+tls_offload_thread(void *arg)
+{
+    struct tls_offload *o = arg;
+
+    pthread_mutex_lock(&o->lock);
+    while (true)
+    {
+        while (!o->queue_head && !o->stopping)
+        {
+            pthread_cond_wait(&o->work, &o->lock);
+        }
+        if (o->stopping)
+        {
+            break;
+        }
+
+        struct tls_offload_job *job = o->queue_head;
+        o->queue_head = job->next;
+        if (!o->queue_head)
+        {
+            o->queue_tail = NULL;
+        }
+        job->next = NULL;
+        job->state = TLS_OFFLOAD_RUNNING;
+        pthread_mutex_unlock(&o->lock);
+
+        ASSERT(buf_init(&job->buf, 0));
+        job->status = key_state_read_plaintext_offload(&job->ks_ssl, &job->buf);
+
+        pthread_mutex_lock(&o->lock);
+        job->state = TLS_OFFLOAD_DONE;
+        job->next = o->done;
+        o->done = job;
+        pthread_cond_broadcast(&o->ended);
+
+        /* no logging here, msg() belongs to the event loop.  A full pipe
+         * means the event loop is woken up anyway. */
+        if (!o->wakeup_pending && write(o->wakeup_pipe[1], "x", 1) == 1)
+        {
+            o->wakeup_pending = true;
+        }
+    }
+    pthread_mutex_unlock(&o->lock);
+
+    return NULL;
+}
+
+struct tls_offload *
+tls_offload_new(int n_threads)
+{
+    struct tls_offload *o;
+
+    ALLOC_OBJ_CLEAR(o, struct tls_offload);
+    pthread_mutex_init(&o->lock, NULL);
+    pthread_cond_init(&o->work, NULL);
+    pthread_cond_init(&o->ended, NULL);
+
+    if (pipe(o->wakeup_pipe) < 0)
+    {
+        msg(M_ERR, "ERROR: cannot create pipe for TLS handshake workers");
+    }
+    set_nonblock(o->wakeup_pipe[0]);
+    set_nonblock(o->wakeup_pipe[1]);
+    set_cloexec(o->wakeup_pipe[0]);
+    set_cloexec(o->wakeup_pipe[1]);
+
+    ALLOC_ARRAY_CLEAR(o->threads, pthread_t, n_threads);
+
+    for (int i = 0; i < n_threads; i++)
+    {
+        if (platform_thread_create(&o->threads[i], tls_offload_thread, o) != 0)
+        {
+            msg(M_ERR, "ERROR: cannot start TLS handshake worker %d", i);
+        }
+        o->n_threads++;
+    }
+
+    msg(M_INFO, "TLS: running the handshakes on %d worker threads", n_threads);
+    return o;
+}
+
+void
+tls_offload_free(struct tls_offload *o)
+{
+    if (!o)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&o->lock);
+    o->stopping = true;
+    pthread_cond_broadcast(&o->work);
+    pthread_mutex_unlock(&o->lock);
+
+    for (int i = 0; i < o->n_threads; i++)
+    {
+        pthread_join(o->threads[i], NULL);
+    }
+    free(o->threads);
+
+    close(o->wakeup_pipe[0]);
+    close(o->wakeup_pipe[1]);
+    pthread_cond_destroy(&o->ended);
+    pthread_cond_destroy(&o->work);
+    pthread_mutex_destroy(&o->lock);
+    free(o);
+}
+
+int
+tls_offload_event_fd(const struct tls_offload *o)
+{
+    return o->wakeup_pipe[0];
+}
+
+int
+tls_offload_retire(struct tls_offload *o, struct tls_multi **owners, int max)
+{
+    int n = 0;
+
+    pthread_mutex_lock(&o->lock);
+    if (o->wakeup_pending)
+    {
+        char drain[64];
+        while (read(o->wakeup_pipe[0], drain, sizeof(drain)) > 0)
+        {
+        }
+        o->wakeup_pending = false;
+    }
+    while (o->done && n < max)
+    {
+        struct tls_offload_job *job = o->done;
+        o->done = job->next;
+        job->next = NULL;
+        owners[n++] = job->owner;
+    }
+    pthread_mutex_unlock(&o->lock);
+
+    return n;
+}
+
+void
+tls_offload_read_plaintext(struct tls_offload *o, struct tls_multi *multi, struct key_state *ks)
+{
+    struct tls_offload_job *job = ks->offload;
+
+    if (!job)
+    {
+        ALLOC_OBJ_CLEAR(job, struct tls_offload_job);
+        job->o = o;
+        job->buf = alloc_buf(TLS_CHANNEL_BUF_SIZE);
+        ks->offload = job;
+    }
+    if (!ks->ks_ssl.offload)
+    {
+        ALLOC_OBJ_CLEAR(ks->ks_ssl.offload, struct key_state_ssl_offload);
+    }
+
+    job->owner = multi;
+    job->ks_ssl = ks->ks_ssl;
+
+    pthread_mutex_lock(&o->lock);
+    ASSERT(job->state == TLS_OFFLOAD_IDLE);
+    job->state = TLS_OFFLOAD_QUEUED;
+    if (o->queue_tail)
+    {
+        o->queue_tail->next = job;
+    }
+    else
+    {
+        o->queue_head = job;
+    }
+    o->queue_tail = job;
+    pthread_cond_signal(&o->work);
+    pthread_mutex_unlock(&o->lock);
+}
+
+bool
+tls_offload_busy(const struct key_state *ks)
+{
+    const struct tls_offload_job *job = ks->offload;
+
+    if (!job)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&job->o->lock);
+    const bool busy = job->state == TLS_OFFLOAD_QUEUED || job->state == TLS_OFFLOAD_RUNNING;
+    pthread_mutex_unlock(&job->o->lock);
+    return busy;
+}
+
+bool
+tls_offload_done(const struct key_state *ks)
+{
+    const struct tls_offload_job *job = ks->offload;
+
+    if (!job)
+    {
+        return false;
+    }
+
+    pthread_mutex_lock(&job->o->lock);
+    const bool done = job->state == TLS_OFFLOAD_DONE;
+    pthread_mutex_unlock(&job->o->lock);
+    return done;
+}
+
+int
+tls_offload_read_plaintext_done(struct key_state *ks, struct tls_session *session,
+                                struct buffer *buf)
+{
+    struct tls_offload_job *job = ks->offload;
+
+    pthread_mutex_lock(&job->o->lock);
+    ASSERT(job->state == TLS_OFFLOAD_DONE);
+    job->state = TLS_OFFLOAD_IDLE;
+    /* no need to tell the owner anymore */
+    tls_offload_unlink(&job->o->done, job);
+    pthread_mutex_unlock(&job->o->lock);
+
+    ASSERT(buf_init(buf, 0));
+    if (job->status == 1)
+    {
+        ASSERT(buf_copy(buf, &job->buf));
+    }
+    return key_state_read_plaintext_done(&ks->ks_ssl, session, buf, job->status);
+}
+
+void
+tls_offload_cancel(struct key_state *ks)
+{
+    struct tls_offload_job *job = ks->offload;
+
+    if (!job)
+    {
+        return;
+    }
+
+    struct tls_offload *o = job->o;
+    pthread_mutex_lock(&o->lock);
+    while (job->state == TLS_OFFLOAD_RUNNING)
+    {
+        pthread_cond_wait(&o->ended, &o->lock);
+    }
+    if (job->state == TLS_OFFLOAD_QUEUED)
+    {
+        tls_offload_unlink(&o->queue_head, job);
+        o->queue_tail = NULL;
+        for (struct tls_offload_job *j = o->queue_head; j; j = j->next)
+        {
+            o->queue_tail = j;
+        }
+    }
+    else
+    {
+        tls_offload_unlink(&o->done, job);
+    }
+    pthread_mutex_unlock(&o->lock);
+
+    free_buf(&job->buf);
+    free(job);
+    ks->offload = NULL;
+}
+
+#endif /* ENABLE_SERVER_TLS_THREADS */
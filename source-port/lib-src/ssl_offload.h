@@ -0,0 +1,115 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * TLS handshake workers for --mode server (--server-tls-threads).
+ *
+ * When many clients connect at once, a server spends its time in the
+ * TLS handshakes: signing with the private key, checking the signatures
+ * of the client's certificate chain, the key exchange.  All of that
+ * happens in the reads of the TLS object that tls_process() does while a
+ * key is in S_START.  With --server-tls-threads, tls_process() hands
+ * such a read to a worker, and leaves the TLS object of the key alone
+ * until the worker is done.  The event loop keeps serving the data
+ * channel and the other clients meanwhile.
+ *
+ * A worker that is done wakes up the event loop, which schedules the
+ * client again.  tls_process() then takes the plaintext the worker read,
+ * runs the checks of verify_cert() on the certificates the handshake saw
+ * and goes on as usual.  So the worker only ever touches the TLS object,
+ * and all of the session state stays with the event loop.
+ */
+
+#ifndef SSL_OFFLOAD_H
+#define SSL_OFFLOAD_H
+
+#if ENABLE_SERVER_TLS_THREADS
+
+#define TLS_OFFLOAD_THREADS_MAX 64
+
+struct tls_offload;
+struct tls_multi;
+struct tls_session;
+struct key_state;
+struct buffer;
+
+/**
+ * Start \a n_threads handshake workers.
+ */
+struct tls_offload *tls_offload_new(int n_threads);
+
+/**
+ * Stop the handshake workers.  Called once all keys that used them were
+ * freed.
+ */
+void tls_offload_free(struct tls_offload *o);
+
+/**
+ * The file descriptor the workers wake up the event loop with; readable
+ * when jobs are done.
+ */
+int tls_offload_event_fd(const struct tls_offload *o);
+
+/**
+ * Collect the \c tls_multi objects whose jobs are done since the last
+ * call, at most \a max of them.
+ *
+ * @return the number of objects stored in \a owners
+ */
+int tls_offload_retire(struct tls_offload *o, struct tls_multi **owners, int max);
+
+/**
+ * Have a worker call \c key_state_read_plaintext_offload() for \a ks,
+ * which belongs to \a multi.  Until the job is done, the TLS object of
+ * the key must be left alone.
+ */
+void tls_offload_read_plaintext(struct tls_offload *o, struct tls_multi *multi,
+                                struct key_state *ks);
+
+/**
+ * Is a worker (about to be) busy with the TLS object of \a ks ?
+ */
+bool tls_offload_busy(const struct key_state *ks);
+
+/**
+ * Is there a read of a worker for \a ks to finish ?
+ */
+bool tls_offload_done(const struct key_state *ks);
+
+/**
+ * Finish the read of a worker for \a ks: store the plaintext in \a buf
+ * and call \c key_state_read_plaintext_done().
+ *
+ * @return Same as \c key_state_read_plaintext().
+ */
+int tls_offload_read_plaintext_done(struct key_state *ks, struct tls_session *session,
+                                    struct buffer *buf);
+
+/**
+ * Drop the job of \a ks, if any, waiting for the worker if it runs.
+ * Called before the TLS object of the key is shut down or freed.
+ */
+void tls_offload_cancel(struct key_state *ks);
+
+#endif /* ENABLE_SERVER_TLS_THREADS */
+
+#endif /* SSL_OFFLOAD_H */
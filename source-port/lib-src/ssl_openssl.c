@@ -41,6 +41,7 @@
 #include "memdbg.h"
 #include "ssl_backend.h"
 #include "ssl_common.h"
+#include "ssl_crl.h"
 #include "base64.h"
 #include "openssl_compat.h"
 #include "xkey_common.h"
@@ -87,11 +88,34 @@ static void unload_xkey_provider(void);
 
 int mydata_index; /* GLOBAL */
 
+#if ENABLE_SERVER_TLS_THREADS
+int offload_index; /* GLOBAL */
+#endif
+
+#if defined(TLS1_3_VERSION)
+/* the session a client resumes, in the ex_data of the SSL_CTX */
+static int resume_index; /* GLOBAL */
+
+static void
+resume_session_free(void *parent, void *ptr, CRYPTO_EX_DATA *ad, int idx, long argl, void *argp)
+{
+    SSL_SESSION_free(ptr);
+}
+#endif
+
 void
 tls_init_lib(void)
 {
     mydata_index = SSL_get_ex_new_index(0, "struct session *", NULL, NULL, NULL);
     ASSERT(mydata_index >= 0);
+#if ENABLE_SERVER_TLS_THREADS
+    offload_index = SSL_get_ex_new_index(0, "struct key_state_ssl_offload *", NULL, NULL, NULL);
+    ASSERT(offload_index >= 0);
+#endif
+#if defined(TLS1_3_VERSION)
+    resume_index = SSL_CTX_get_ex_new_index(0, "SSL_SESSION *", NULL, NULL, resume_session_free);
+    ASSERT(resume_index >= 0);
+#endif
 }
 
 void
@@ -139,6 +163,10 @@ void
 tls_ctx_free(struct tls_root_ctx *ctx)
 {
     ASSERT(NULL != ctx);
+#if ENABLE_CRL_INDEX
+    crl_store_free(ctx->crl_store);
+    ctx->crl_store = NULL;
+#endif
     SSL_CTX_free(ctx->ctx);
     ctx->ctx = NULL;
     unload_xkey_provider(); /* in case it is loaded */
@@ -179,6 +207,13 @@ key_state_export_keying_material(struct tls_session *session, const char *label,
 static void
 info_callback(INFO_CALLBACK_SSL_CONST SSL *s, int where, int ret)
 {
+#if ENABLE_SERVER_TLS_THREADS
+    /* no logging on handshake workers */
+    if (SSL_get_ex_data(s, offload_index))
+    {
+        return;
+    }
+#endif
     if (where & SSL_CB_LOOP)
     {
         dmsg(D_HANDSHAKE_VERBOSE, "SSL state (%s): %s",
@@ -350,6 +385,64 @@ tls_ctx_set_options(struct tls_root_ctx *ctx, unsigned int ssl_flags)
     return true;
 }
 
+#if defined(TLS1_3_VERSION)
+/* A client keeps the last TLS 1.3 session it got */
+static int
+new_session_client_cb(SSL *ssl, SSL_SESSION *sess)
+{
+    if (SSL_SESSION_get_protocol_version(sess) != TLS1_3_VERSION)
+    {
+        return 0;
+    }
+
+    SSL_CTX *ctx = SSL_get_SSL_CTX(ssl);
+    SSL_SESSION_free(SSL_CTX_get_ex_data(ctx, resume_index));
+    SSL_CTX_set_ex_data(ctx, resume_index, sess);
+    return 1;
+}
+
+/* A server drops the sessions of older protocol versions from its cache.
+ * Called on the handshake workers of --server-tls-threads, too. */
+static int
+new_session_server_cb(SSL *ssl, SSL_SESSION *sess)
+{
+    if (SSL_SESSION_get_protocol_version(sess) != TLS1_3_VERSION)
+    {
+        SSL_CTX_remove_session(SSL_get_SSL_CTX(ssl), sess);
+    }
+    return 0;
+}
+#endif /* if defined(TLS1_3_VERSION) */
+
+void
+tls_ctx_set_session_resumption(struct tls_root_ctx *ctx, bool server, int lifetime)
+{
+    ASSERT(NULL != ctx);
+
+#if defined(TLS1_3_VERSION)
+    if (server)
+    {
+        /* SSL_OP_NO_TICKET stays set: the ticket a client gets only names
+         * its session in our cache, where the certificate chain of the
+         * client is kept for key_state_check_resumed() */
+        static const unsigned char sid_ctx[] = "OpenVPN";
+        SSL_CTX_set_session_id_context(ctx->ctx, sid_ctx, sizeof(sid_ctx) - 1);
+        SSL_CTX_set_session_cache_mode(ctx->ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_set_timeout(ctx->ctx, lifetime);
+        SSL_CTX_set_num_tickets(ctx->ctx, 1);
+        SSL_CTX_sess_set_new_cb(ctx->ctx, new_session_server_cb);
+    }
+    else
+    {
+        SSL_CTX_set_session_cache_mode(ctx->ctx,
+                                       SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(ctx->ctx, new_session_client_cb);
+    }
+#else
+    msg(M_WARN, "NOTE: --tls-resume needs TLS 1.3 support in OpenSSL, ignored");
+#endif
+}
+
 static void
 convert_tls_list_to_openssl(char *openssl_ciphers, size_t len, const char *ciphers)
 {
@@ -1314,6 +1407,151 @@ end:
     return ret;
 }
 
+#if ENABLE_CRL_INDEX
+/* convert an ASN1 time to a time_t, 0 if there is none */
+static time_t
+crl_time(const ASN1_TIME *t, time_t now)
+{
+    int days, secs;
+
+    if (!t || !ASN1_TIME_diff(&days, &secs, NULL, t))
+    {
+        return 0;
+    }
+    return now + (time_t)days * 24 * 60 * 60 + secs;
+}
+
+/*
+ * Is crl signed by a certificate of the store named like its issuer ?
+ * *issuer_found tells whether there is such a certificate at all.
+ */
+static bool
+crl_signature_ok(X509_STORE *store, X509_CRL *crl, bool *issuer_found)
+{
+    X509_STORE_CTX *store_ctx = X509_STORE_CTX_new();
+    bool ok = false;
+
+    *issuer_found = false;
+    if (!store_ctx || !X509_STORE_CTX_init(store_ctx, store, NULL, NULL))
+    {
+        X509_STORE_CTX_free(store_ctx);
+        return false;
+    }
+
+    STACK_OF(X509) *certs = X509_STORE_CTX_get1_certs(store_ctx, X509_CRL_get_issuer(crl));
+    for (int i = 0; i < sk_X509_num(certs) && !ok; i++)
+    {
+        *issuer_found = true;
+        ok = X509_CRL_verify(crl, X509_get0_pubkey(sk_X509_value(certs, i))) > 0;
+    }
+    sk_X509_pop_free(certs, X509_free);
+    X509_STORE_CTX_free(store_ctx);
+
+    return ok;
+}
+
+void
+backend_crl_index_load(struct crl_index *ix, const struct tls_root_ctx *ssl_ctx,
+                       const char *crl_file, bool crl_inline)
+{
+    const time_t now = time(NULL);
+    struct gc_arena gc = gc_new();
+    BIO *in = NULL;
+
+    X509_STORE *store = SSL_CTX_get_cert_store(ssl_ctx->ctx);
+    if (!store)
+    {
+        crl_index_warn(ix, "CRL: cannot get certificate store");
+        goto end;
+    }
+
+    if (crl_inline)
+    {
+        in = BIO_new_mem_buf((char *)crl_file, -1);
+    }
+    else
+    {
+        in = BIO_new_file(crl_file, "r");
+    }
+
+    if (in == NULL)
+    {
+        crl_index_warn(ix, "CRL: cannot read: %s", print_key_filename(crl_file, crl_inline));
+        goto end;
+    }
+
+    int num_crls_loaded = 0;
+    while (true)
+    {
+        X509_CRL *crl = PEM_read_bio_X509_CRL(in, NULL, NULL, NULL);
+        if (crl == NULL)
+        {
+            /*
+             * PEM_R_NO_START_LINE can be considered equivalent to EOF,
+             * but warn if no CRLs have been loaded
+             */
+            bool eof = ERR_GET_REASON(ERR_peek_error()) == PEM_R_NO_START_LINE;
+            if (num_crls_loaded == 0 || !eof)
+            {
+                crl_index_warn(ix, "CRL: cannot read CRL from file %s",
+                               print_key_filename(crl_file, crl_inline));
+            }
+            break;
+        }
+
+        /* a CRL of an issuer that is not a CA certificate of ours is
+         * taken as it is, the configuration put it there */
+        bool issuer_found;
+        bool signature_ok = crl_signature_ok(store, crl, &issuer_found);
+        if (!issuer_found)
+        {
+            signature_ok = true;
+            crl_index_warn(ix,
+                           "CRL: the issuer of a CRL in %s is not a --ca certificate, "
+                           "its signature is not checked",
+                           print_key_filename(crl_file, crl_inline));
+        }
+        else if (!signature_ok)
+        {
+            crl_index_warn(ix,
+                           "CRL: bad signature on a CRL in %s, the certificates "
+                           "of its issuer fail verification",
+                           print_key_filename(crl_file, crl_inline));
+        }
+
+        struct buffer issuer_key = x509_crl_issuer_key(X509_CRL_get_issuer(crl), &gc);
+        if (!buf_valid(&issuer_key))
+        {
+            crl_index_warn(ix, "CRL: cannot encode the issuer of a CRL in %s, skipping it",
+                           print_key_filename(crl_file, crl_inline));
+            X509_CRL_free(crl);
+            continue;
+        }
+
+        STACK_OF(X509_REVOKED) *revoked = X509_CRL_get_REVOKED(crl);
+        struct crl_issuer *issuer = crl_index_add_issuer(
+            ix, BPTR(&issuer_key), BLEN(&issuer_key), sk_X509_REVOKED_num(revoked),
+            crl_time(X509_CRL_get0_lastUpdate(crl), now),
+            crl_time(X509_CRL_get0_nextUpdate(crl), now), signature_ok);
+
+        for (int i = 0; i < sk_X509_REVOKED_num(revoked); i++)
+        {
+            const ASN1_INTEGER *serial =
+                X509_REVOKED_get0_serialNumber(sk_X509_REVOKED_value(revoked, i));
+            crl_index_add_serial(ix, issuer, ASN1_STRING_get0_data(serial),
+                                 ASN1_STRING_length(serial));
+        }
+        X509_CRL_free(crl);
+        num_crls_loaded++;
+    }
+
+end:
+    /* the errors are in the queue of this thread */
+    ERR_clear_error();
+    BIO_free(in);
+    gc_free(&gc);
+}
+#else  /* if ENABLE_CRL_INDEX */
 void
 backend_tls_ctx_reload_crl(struct tls_root_ctx *ssl_ctx, const char *crl_file, bool crl_inline)
 {
@@ -1327,7 +1565,9 @@ backend_tls_ctx_reload_crl(struct tls_root_ctx *ssl_ctx, const char *crl_file, b
 
     /* Always start with a cleared CRL list, for that we
      * we need to manually find the CRL object from the stack
-     * and remove it */
+     * and remove it.  Handshake workers may be looking up
+     * objects in the store meanwhile. */
+    X509_STORE_lock(store);
     STACK_OF(X509_OBJECT) *objs = X509_STORE_get0_objects(store);
     for (int i = 0; i < sk_X509_OBJECT_num(objs); i++)
     {
@@ -1339,6 +1579,7 @@ backend_tls_ctx_reload_crl(struct tls_root_ctx *ssl_ctx, const char *crl_file, b
             X509_OBJECT_free(obj);
         }
     }
+    X509_STORE_unlock(store);
 
     X509_STORE_set_flags(store, X509_V_FLAG_CRL_CHECK | X509_V_FLAG_CRL_CHECK_ALL);
 
@@ -1394,6 +1635,7 @@ backend_tls_ctx_reload_crl(struct tls_root_ctx *ssl_ctx, const char *crl_file, b
 end:
     BIO_free(in);
 }
+#endif /* if ENABLE_CRL_INDEX */
 
 
 #if defined(ENABLE_MANAGEMENT) && !defined(HAVE_XKEY_PROVIDER)
@@ -2181,14 +2423,40 @@ key_state_ssl_init(struct key_state_ssl *ks_ssl, const struct tls_root_ctx *ssl_
 
     SSL_set_bio(ks_ssl->ssl, ks_ssl->ct_in, ks_ssl->ct_out);
     BIO_set_ssl(ks_ssl->ssl_bio, ks_ssl->ssl, BIO_NOCLOSE);
+
+#if defined(TLS1_3_VERSION)
+    /* offer the session of the last handshake, if --tls-resume kept one */
+    SSL_SESSION *sess = SSL_CTX_get_ex_data(ssl_ctx->ctx, resume_index);
+    if (!is_server && sess && SSL_SESSION_is_resumable(sess))
+    {
+        SSL_set_session(ks_ssl->ssl, sess);
+    }
+#endif
 }
 
 void
 key_state_ssl_shutdown(struct key_state_ssl *ks_ssl)
 {
+    /* a session that ends in an error is not resumed */
+    SSL_CTX_remove_session(SSL_get_SSL_CTX(ks_ssl->ssl), SSL_get_session(ks_ssl->ssl));
     SSL_set_shutdown(ks_ssl->ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
 }
 
+#if ENABLE_SERVER_TLS_THREADS
+/* forget what a worker left in offload */
+static void
+key_state_ssl_offload_clear(struct key_state_ssl_offload *offload)
+{
+    for (int i = 0; i < offload->n_certs; i++)
+    {
+        X509_free(offload->certs[i].cert);
+    }
+    offload->n_certs = 0;
+    offload->too_many_certs = false;
+    offload->n_errors = 0;
+}
+#endif
+
 void
 key_state_ssl_free(struct key_state_ssl *ks_ssl)
 {
@@ -2199,9 +2467,24 @@ key_state_ssl_free(struct key_state_ssl *ks_ssl)
         bio_debug_oc("close ct_in", ks_ssl->ct_in);
         bio_debug_oc("close ct_out", ks_ssl->ct_out);
 #endif
+        /* There is no close_notify on our TLS sessions, so without this
+         * SSL_free() takes the session for a bad one and drops it from
+         * the cache of --tls-resume.  key_state_ssl_shutdown() dropped
+         * the ones that ended in an error already. */
+        if (SSL_is_init_finished(ks_ssl->ssl))
+        {
+            SSL_set_shutdown(ks_ssl->ssl, SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+        }
         BIO_free_all(ks_ssl->ssl_bio);
         SSL_free(ks_ssl->ssl);
     }
+#if ENABLE_SERVER_TLS_THREADS
+    if (ks_ssl->offload)
+    {
+        key_state_ssl_offload_clear(ks_ssl->offload);
+        free(ks_ssl->offload);
+    }
+#endif
 }
 
 int
@@ -2276,6 +2559,156 @@ key_state_read_plaintext(struct key_state_ssl *ks_ssl, struct buffer *buf)
     return ret;
 }
 
+bool
+key_state_check_resumed(struct key_state_ssl *ks_ssl, struct tls_session *session)
+{
+    SSL *ssl = ks_ssl->ssl;
+
+    if (!SSL_session_reused(ssl))
+    {
+        return true;
+    }
+
+    /* there was none in the full handshake either */
+    X509 *cert = SSL_get_peer_certificate(ssl);
+    if (!cert)
+    {
+        return true;
+    }
+
+    bool ret = false;
+    X509_STORE_CTX *store_ctx = X509_STORE_CTX_new();
+    if (!store_ctx
+        || !X509_STORE_CTX_init(store_ctx, SSL_CTX_get_cert_store(SSL_get_SSL_CTX(ssl)), cert,
+                                SSL_get_peer_cert_chain(ssl)))
+    {
+        crypto_msg(D_TLS_ERRORS, "VERIFY ERROR: cannot check the certificates of a resumed session");
+        goto cleanup;
+    }
+
+    /* set up like libssl does for the certificates of a full handshake,
+     * so verify_callback() finds the session */
+    X509_STORE_CTX_set_ex_data(store_ctx, SSL_get_ex_data_X509_STORE_CTX_idx(), ssl);
+    X509_STORE_CTX_set_default(store_ctx, SSL_is_server(ssl) ? "ssl_client" : "ssl_server");
+    X509_VERIFY_PARAM_set1(X509_STORE_CTX_get0_param(store_ctx), SSL_get0_param(ssl));
+    X509_STORE_CTX_set_verify_cb(store_ctx, verify_callback);
+
+    ret = X509_verify_cert(store_ctx) > 0;
+    ERR_clear_error();
+
+cleanup:
+    X509_STORE_CTX_free(store_ctx);
+    X509_free(cert);
+    return ret;
+}
+
+#if ENABLE_SERVER_TLS_THREADS
+int
+key_state_read_plaintext_offload(struct key_state_ssl *ks_ssl, struct buffer *buf)
+{
+    ASSERT(NULL != ks_ssl);
+    ASSERT(buf->len >= 0);
+
+    if (buf->len)
+    {
+        return 0;
+    }
+
+    struct key_state_ssl_offload *offload = ks_ssl->offload;
+    ASSERT(offload);
+    key_state_ssl_offload_clear(offload);
+
+    /* bio_read() without the logging */
+    SSL_set_ex_data(ks_ssl->ssl, offload_index, offload);
+    int i = BIO_read(ks_ssl->ssl_bio, BPTR(buf), buf_forward_capacity(buf));
+    SSL_set_ex_data(ks_ssl->ssl, offload_index, NULL);
+
+    int ret = 0;
+    if (i < 0)
+    {
+        if (!BIO_should_retry(ks_ssl->ssl_bio))
+        {
+            unsigned long err;
+            int line, errflags;
+            const char *file, *data, *func;
+
+            while ((err = ERR_get_error_all(&file, &line, &func, &data, &errflags)) != 0)
+            {
+                if (offload->n_errors == KS_SSL_OFFLOAD_ERRORS)
+                {
+                    continue;
+                }
+                offload->errors[offload->n_errors].err = err;
+                offload->errors[offload->n_errors].file = file;
+                offload->errors[offload->n_errors].line = line;
+                offload->errors[offload->n_errors].func = func;
+                strncpynt(offload->errors[offload->n_errors].data,
+                          (errflags & ERR_TXT_STRING) ? data : "",
+                          sizeof(offload->errors[offload->n_errors].data));
+                offload->n_errors++;
+            }
+            ret = -1;
+        }
+    }
+    else if (i > 0)
+    {
+        buf->len = i;
+        ret = 1;
+    }
+    ERR_clear_error();
+
+    return ret;
+}
+
+int
+key_state_read_plaintext_done(struct key_state_ssl *ks_ssl, struct tls_session *session,
+                              struct buffer *buf, int status)
+{
+    struct key_state_ssl_offload *offload = ks_ssl->offload;
+    ASSERT(offload);
+
+    /* what verify_callback() would have done during the handshake */
+    bool verified = true;
+    for (int i = 0; i < offload->n_certs && verified; i++)
+    {
+        verified = verify_callback_cert(session, offload->certs[i].cert,
+                                        offload->certs[i].depth, offload->certs[i].preverify_ok,
+                                        offload->certs[i].error);
+    }
+    if (verified && offload->too_many_certs)
+    {
+        msg(D_TLS_ERRORS, "VERIFY ERROR: certificate chain longer than %d", KS_SSL_OFFLOAD_CERTS);
+        verified = false;
+    }
+
+    if (status == -1)
+    {
+        for (int i = 0; i < offload->n_errors; i++)
+        {
+            crypto_print_openssl_error(D_TLS_ERRORS, offload->errors[i].err,
+                                       offload->errors[i].file, offload->errors[i].line,
+                                       offload->errors[i].func, offload->errors[i].data);
+        }
+        msg(D_TLS_ERRORS, "TLS_ERROR: BIO read tls_read_plaintext error");
+    }
+    key_state_ssl_offload_clear(offload);
+
+    if (!verified)
+    {
+        status = -1;
+    }
+    if (status == -1)
+    {
+        buf->len = 0;
+    }
+    else if (status == 1)
+    {
+        dmsg(D_HANDSHAKE_VERBOSE, "BIO read tls_read_plaintext %d bytes", BLEN(buf));
+    }
+    return status;
+}
+#endif /* ENABLE_SERVER_TLS_THREADS */
+
 static void
 print_pkey_details(EVP_PKEY *pkey, char *buf, size_t buflen)
 {
@@ -2495,8 +2928,9 @@ print_details(struct key_state_ssl *ks_ssl, const char *prefix)
 
     s1[0] = s2[0] = s3[0] = s4[0] = s5[0] = 0;
     ciph = SSL_get_current_cipher(ks_ssl->ssl);
-    snprintf(s1, sizeof(s1), "%s %s, cipher %s %s", prefix, SSL_get_version(ks_ssl->ssl),
-             SSL_CIPHER_get_version(ciph), SSL_CIPHER_get_name(ciph));
+    snprintf(s1, sizeof(s1), "%s %s%s, cipher %s %s", prefix, SSL_get_version(ks_ssl->ssl),
+             SSL_session_reused(ks_ssl->ssl) ? " (resumed)" : "", SSL_CIPHER_get_version(ciph),
+             SSL_CIPHER_get_name(ciph));
     X509 *cert = SSL_get_peer_certificate(ks_ssl->ssl);
 
     if (cert)
@@ -39,8 +39,12 @@
 struct tls_root_ctx
 {
     SSL_CTX *ctx;
+#if ENABLE_CRL_INDEX
+    struct crl_store *crl_store;
+#else
     time_t crl_last_mtime;
     off_t crl_last_size;
+#endif
 };
 
 struct key_state_ssl
@@ -49,8 +53,53 @@ struct key_state_ssl
     BIO *ssl_bio; /* read/write plaintext from here */
     BIO *ct_in;   /* write ciphertext to here */
     BIO *ct_out;  /* read ciphertext from here */
+#if ENABLE_SERVER_TLS_THREADS
+    struct key_state_ssl_offload *offload; /* for handshakes on a worker */
+#endif
 };
 
+#if ENABLE_SERVER_TLS_THREADS
+
+#define KS_SSL_OFFLOAD_CERTS  16
+#define KS_SSL_OFFLOAD_ERRORS 8
+
+/**
+ * What a handshake worker (--server-tls-threads) leaves for the event
+ * loop: the peer certificates OpenSSL asked verify_callback() about,
+ * whose checks by verify_cert() are left to the event loop, and the
+ * OpenSSL errors, which are queued per thread.
+ */
+struct key_state_ssl_offload
+{
+    struct
+    {
+        X509 *cert;
+        int depth;
+        int preverify_ok;
+        int error;
+    } certs[KS_SSL_OFFLOAD_CERTS];
+    int n_certs;
+    bool too_many_certs;
+
+    struct
+    {
+        unsigned long err;
+        const char *file;
+        int line;
+        const char *func;
+        char data[128];
+    } errors[KS_SSL_OFFLOAD_ERRORS];
+    int n_errors;
+};
+
+/**
+ * Index of the struct key_state_ssl_offload pointer in SSL objects, set
+ * while a worker drives the handshake.
+ */
+extern int offload_index; /* GLOBAL */
+
+#endif /* ENABLE_SERVER_TLS_THREADS */
+
 /**
  * Allocate space in SSL objects in which to store a struct tls_session
  * pointer back to parent.
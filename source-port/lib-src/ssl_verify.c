@@ -39,6 +39,7 @@
 #include "run_command.h"
 #include "ssl_verify.h"
 #include "ssl_verify_backend.h"
+#include "ssl_crl.h"
 
 #ifdef ENABLE_CRYPTO_OPENSSL
 #include "ssl_verify_openssl.h"
@@ -528,16 +529,71 @@ verify_cert_call_command(const char *verify_command, struct env_set *es, int cer
     return FAILURE; /* Reject connection */
 }
 
+#if ENABLE_CRL_INDEX
+/*
+ * check peer cert against the CRL index of the CRL file
+ */
+static result_t
+verify_check_crl_index(const struct tls_options *opt, openvpn_x509_cert_t *cert,
+                       const char *subject, int cert_depth)
+{
+    result_t ret = FAILURE;
+    struct buffer issuer, serial;
+    struct gc_arena gc = gc_new();
+
+    if (SUCCESS != backend_x509_get_crl_key(cert, &issuer, &serial, &gc))
+    {
+        msg(D_HANDSHAKE, "VERIFY CRL: depth=%d, %s, serial number is not available", cert_depth,
+            subject);
+        goto cleanup;
+    }
+
+    /* the same errors as the TLS library reports without the index */
+    const char *error = NULL;
+    switch (crl_store_lookup(opt->ssl_ctx.crl_store, BPTR(&issuer), BLEN(&issuer),
+                             BPTR(&serial), BLEN(&serial)))
+    {
+        case CRL_NOT_REVOKED:
+            ret = SUCCESS;
+            break;
+
+        case CRL_REVOKED:
+            error = "certificate revoked";
+            break;
+
+        case CRL_EXPIRED:
+            error = "CRL has expired";
+            break;
+
+        case CRL_NOT_YET_VALID:
+            error = "CRL is not yet valid";
+            break;
+
+        case CRL_BAD_SIGNATURE:
+            error = "CRL signature failure";
+            break;
+    }
+
+    if (error)
+    {
+        msg(D_TLS_ERRORS, "VERIFY ERROR: depth=%d, error=%s: %s, serial=%s", cert_depth, error,
+            subject, np(backend_x509_get_serial(cert, &gc)));
+    }
+
+cleanup:
+    gc_free(&gc);
+    return ret;
+}
+#endif /* if ENABLE_CRL_INDEX */
+
 /*
  * check peer cert against CRL directory
  */
 static result_t
-verify_check_crl_dir(const char *crl_dir, openvpn_x509_cert_t *cert, const char *subject,
-                     int cert_depth)
+verify_check_crl_dir(const struct tls_options *opt, openvpn_x509_cert_t *cert,
+                     const char *subject, int cert_depth)
 {
     result_t ret = FAILURE;
-    char fn[256];
-    int fd = -1;
     struct gc_arena gc = gc_new();
 
     char *serial = backend_x509_get_serial(cert, &gc);
@@ -548,13 +604,27 @@ verify_check_crl_dir(const char *crl_dir, openvpn_x509_cert_t *cert, const char
         goto cleanup;
     }
 
-    if (!snprintf(fn, sizeof(fn), "%s%c%s", crl_dir, PATH_SEPARATOR, serial))
+#if ENABLE_CRL_INDEX
+    /* the index has the names of the files in the directory */
+    const bool revoked = crl_store_lookup(opt->ssl_ctx.crl_store, NULL, 0,
+                                          (const uint8_t *)serial, (int)strlen(serial))
+                         == CRL_REVOKED;
+#else
+    char fn[256];
+    if (!snprintf(fn, sizeof(fn), "%s%c%s", opt->crl_file, PATH_SEPARATOR, serial))
     {
         msg(D_HANDSHAKE, "VERIFY CRL: filename overflow");
         goto cleanup;
     }
-    fd = platform_open(fn, O_RDONLY, 0);
+    int fd = platform_open(fn, O_RDONLY, 0);
+    const bool revoked = fd >= 0;
     if (fd >= 0)
+    {
+        close(fd);
+    }
+#endif
+
+    if (revoked)
     {
         msg(D_HANDSHAKE, "VERIFY CRL: depth=%d, %s, serial=%s is revoked", cert_depth, subject,
             serial);
@@ -564,11 +634,6 @@ verify_check_crl_dir(const char *crl_dir, openvpn_x509_cert_t *cert, const char
     ret = SUCCESS;
 
 cleanup:
-
-    if (fd != -1)
-    {
-        close(fd);
-    }
     gc_free(&gc);
     return ret;
 }
@@ -660,6 +725,33 @@ verify_cert(struct tls_session *session, openvpn_x509_cert_t *cert, int cert_dep
         goto cleanup; /* Reject connection */
     }
 
+    /* check peer cert against CRL, before it is exported to plug-ins and
+     * scripts */
+    if (opt->crl_file)
+    {
+        if (opt->ssl_flags & SSLF_CRL_VERIFY_DIR)
+        {
+            if (SUCCESS != verify_check_crl_dir(opt, cert, subject, cert_depth))
+            {
+                goto cleanup;
+            }
+        }
+        else
+        {
+            if (tls_verify_crl_missing(opt))
+            {
+                msg(D_TLS_ERRORS, "VERIFY ERROR: CRL not loaded");
+                goto cleanup;
+            }
+#if ENABLE_CRL_INDEX
+            if (SUCCESS != verify_check_crl_index(opt, cert, subject, cert_depth))
+            {
+                goto cleanup;
+            }
+#endif
+        }
+    }
+
     if (cert_depth == opt->verify_hash_depth && opt->verify_hash)
     {
         struct buffer cert_fp = { 0 };
@@ -757,26 +849,6 @@ verify_cert(struct tls_session *session, openvpn_x509_cert_t *cert, int cert_dep
         goto cleanup;
     }
 
-    /* check peer cert against CRL */
-    if (opt->crl_file)
-    {
-        if (opt->ssl_flags & SSLF_CRL_VERIFY_DIR)
-        {
-            if (SUCCESS != verify_check_crl_dir(opt->crl_file, cert, subject, cert_depth))
-            {
-                goto cleanup;
-            }
-        }
-        else
-        {
-            if (tls_verify_crl_missing(opt))
-            {
-                msg(D_TLS_ERRORS, "VERIFY ERROR: CRL not loaded");
-                goto cleanup;
-            }
-        }
-    }
-
     msg(D_HANDSHAKE, "VERIFY OK: depth=%d, %s", cert_depth, subject);
     session->verified = true;
     ret = SUCCESS;
@@ -1280,6 +1352,118 @@ check_for_client_reason(struct tls_multi *multi, struct auth_deferred_status *st
     }
     gc_free(&gc);
 }
+#if ENABLE_AUTH_HELPERS
+/*
+ * Verify the user name and password using a --auth-helpers helper.  The
+ * result is written to the deferred auth control files once the helper
+ * answers.
+ */
+static int
+verify_user_pass_helper(struct tls_session *session, struct tls_multi *multi,
+                        const struct user_pass *up)
+{
+    struct gc_arena gc = gc_new();
+    int retval = OPENVPN_PLUGIN_FUNC_ERROR;
+    struct key_state *ks = &session->key[KS_PRIMARY]; /* primary key */
+
+    setenv_str(session->opt->es, "script_type", "user-pass-verify");
+
+    if (!key_state_gen_auth_control_files(&ks->script_auth, session->opt))
+    {
+        msg(D_TLS_ERRORS,
+            "TLS Auth Error (%s): "
+            "could not create deferred auth control file",
+            __func__);
+        goto done;
+    }
+
+    /* the pipe to the helper is as private as the via-file file */
+    struct buffer password = alloc_buf_gc(sizeof(up->password) + 16, &gc);
+    buf_printf(&password, "password=%s", up->password);
+    const char *secrets[] = { BSTR(&password), NULL };
+
+    const struct auth_helper_key key = auth_helper_key_of(session, ks);
+    if (auth_helpers_request(session->opt->auth_helpers, AUTH_HELPER_USER_PASS_VERIFY,
+                             session->opt->es, secrets, ks->script_auth.auth_control_file,
+                             ks->script_auth.auth_failed_reason_file, multi, multi->peer_id,
+                             &key))
+    {
+        /* the auth pending file is checked once the helper answers */
+        retval = OPENVPN_PLUGIN_FUNC_DEFERRED;
+    }
+    else
+    {
+        key_state_rm_auth_control_files(&ks->script_auth);
+    }
+    secure_memzero(BPTR(&password), BLEN(&password));
+
+done:
+    gc_free(&gc);
+    return retval;
+}
+
+/*
+ * Find the key state of a request to a helper: its session may have moved
+ * from TM_INITIAL to TM_ACTIVE, and the key to KS_LAME_DUCK, since.
+ */
+static struct key_state *
+auth_helper_key_state(struct tls_multi *multi, const struct auth_helper_key *key,
+                      struct tls_session **session)
+{
+    for (int i = 0; i < TM_SIZE; i++)
+    {
+        struct tls_session *s = &multi->session[i];
+        if (!session_id_equal(&s->session_id, &key->session_id))
+        {
+            continue;
+        }
+        for (int j = 0; j < KS_SIZE; j++)
+        {
+            struct key_state *ks = &s->key[j];
+            if (ks->state != S_UNDEF && ks->key_id == key->key_id)
+            {
+                *session = s;
+                return ks;
+            }
+        }
+    }
+    return NULL;
+}
+
+void
+verify_auth_helper_done(struct tls_multi *multi, enum auth_helper_type type,
+                        const struct auth_helper_key *key, int status)
+{
+    struct tls_session *session = NULL;
+    struct key_state *ks = auth_helper_key_state(multi, key, &session);
+
+    /* the answer to --client-connect is for the client, not a key */
+    if (!ks && type != AUTH_HELPER_CLIENT_CONNECT)
+    {
+        msg(D_TLS_DEBUG_LOW, "auth-helper: dropped the answer for key_id %d, which is gone",
+            key->key_id);
+        return;
+    }
+
+    if (type == AUTH_HELPER_USER_PASS_VERIFY && status == 2)
+    {
+        /* the helper defers, as a script exiting with 2 does */
+        if (!key_state_check_auth_pending_file(&ks->script_auth, multi, session))
+        {
+            ks->authenticated = KS_AUTH_FALSE;
+            key_state_rm_auth_control_files(&ks->script_auth);
+        }
+    }
+    else if (type == AUTH_HELPER_CLIENT_CRRESPONSE && status != 1)
+    {
+        tls_deauthenticate(multi);
+    }
+
+    /* read the auth control files on the next check */
+    multi->tas_cache_last_update = 0;
+}
+#endif /* ENABLE_AUTH_HELPERS */
+
 /*
  * Verify the user name and password using a script
  */
@@ -1414,6 +1598,26 @@ verify_crresponse_script(struct tls_multi *multi, const char *cr_response)
 
     setenv_str(session->opt->es, "script_type", "client-crresponse");
 
+#if ENABLE_AUTH_HELPERS
+    if (auth_helpers_defined(session->opt->auth_helpers, AUTH_HELPER_CLIENT_CRRESPONSE))
+    {
+        /* a failure deauthenticates once the helper answers */
+        struct buffer response = alloc_buf_gc(strlen(cr_response) + 16, &gc);
+        buf_printf(&response, "crresponse=%s", cr_response);
+        const char *secrets[] = { BSTR(&response), NULL };
+        const struct auth_helper_key key = auth_helper_key_of(session, &session->key[KS_PRIMARY]);
+
+        if (!auth_helpers_request(session->opt->auth_helpers, AUTH_HELPER_CLIENT_CRRESPONSE,
+                                  session->opt->es, secrets, NULL, NULL, multi, multi->peer_id,
+                                  &key))
+        {
+            tls_deauthenticate(multi);
+        }
+        secure_memzero(BPTR(&response), BLEN(&response));
+        goto done;
+    }
+#endif
+
     /* Since cr response might be sensitive, like a stupid way to query
      * a password via 2FA, we pass it via file instead environment */
     const char *tmp_file = platform_create_temp_file(session->opt->tmp_dir, "cr", &gc);
@@ -1701,6 +1905,13 @@ verify_user_pass(struct user_pass *up, struct tls_multi *multi, struct tls_sessi
             plugin_status = verify_user_pass_plugin(session, multi, up);
         }
 
+#if ENABLE_AUTH_HELPERS
+        if (auth_helpers_defined(session->opt->auth_helpers, AUTH_HELPER_USER_PASS_VERIFY))
+        {
+            script_status = verify_user_pass_helper(session, multi, up);
+        }
+        else
+#endif
         if (session->opt->auth_user_pass_verify_script)
         {
             script_status = verify_user_pass_script(session, multi, up);
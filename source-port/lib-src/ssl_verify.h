@@ -32,6 +32,7 @@
 #include "syshead.h"
 #include "misc.h"
 #include "ssl_common.h"
+#include "auth_helper.h"
 
 /* Include OpenSSL-specific code */
 #ifdef ENABLE_CRYPTO_OPENSSL
@@ -223,6 +224,35 @@ void verify_crresponse_script(struct tls_multi *multi, const char *cr_response);
  */
 void verify_crresponse_plugin(struct tls_multi *multi, const char *cr_response);
 
+#if ENABLE_AUTH_HELPERS
+/**
+ * Act on the answer of a --auth-helpers helper to a request for \a multi.
+ * The result itself is in the files of the request already; this makes
+ * the next check read them, deauthenticates on a failed
+ * --client-crresponse, and handles a deferring --auth-user-pass-verify.
+ *
+ * An answer for a key state that is gone, after a renegotiation, is
+ * dropped.
+ *
+ * @param multi         The client of the request.
+ * @param type          The script the request was for.
+ * @param key           The key state the request was for.
+ * @param status        The status of the answer, 0 if the helper stopped.
+ */
+void verify_auth_helper_done(struct tls_multi *multi, enum auth_helper_type type,
+                             const struct auth_helper_key *key, int status);
+
+/**
+ * The key state \a ks of \a session, for a request to a helper.
+ */
+static inline struct auth_helper_key
+auth_helper_key_of(const struct tls_session *session, const struct key_state *ks)
+{
+    struct auth_helper_key key = { .session_id = session->session_id, .key_id = ks->key_id };
+    return key;
+}
+#endif
+
 /**
  * Perform final authentication checks, including locking of the cn, the allowed
  * certificate hashes, and whether a client config entry exists in the
@@ -161,6 +161,22 @@ char *backend_x509_get_serial(openvpn_x509_cert_t *cert, struct gc_arena *gc);
  */
 char *backend_x509_get_serial_hex(openvpn_x509_cert_t *cert, struct gc_arena *gc);
 
+#if ENABLE_CRL_INDEX
+/*
+ * Retrieve what the CRL index knows the certificate by: its issuer's
+ * name and its serial number, encoded as backend_crl_index_load() does.
+ *
+ * @param cert          Certificate to retrieve the keys of.
+ * @param issuer        Buffer to return the issuer key in.
+ * @param serial        Buffer to return the serial key in.
+ * @param gc            Garbage collection arena to allocate the buffers in.
+ *
+ * @return              \c SUCCESS, or \c FAILURE on error.
+ */
+result_t backend_x509_get_crl_key(openvpn_x509_cert_t *cert, struct buffer *issuer,
+                                  struct buffer *serial, struct gc_arena *gc);
+#endif
+
 /*
  * Write the certificate to the file in PEM format.
  *
@@ -40,6 +40,7 @@
 #include "ssl_openssl.h"
 #include "ssl_verify.h"
 #include "ssl_verify_backend.h"
+#include "ssl_crl.h"
 #include "openssl_compat.h"
 
 #include <openssl/bn.h>
@@ -47,22 +48,14 @@
 #include <openssl/x509v3.h>
 
 int
-verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
+verify_callback_cert(struct tls_session *session, X509 *current_cert, int depth,
+                     int preverify_ok, int error)
 {
     int ret = 0;
-    struct tls_session *session;
-    SSL *ssl;
     struct gc_arena gc = gc_new();
 
-    /* get the tls_session pointer */
-    ssl = X509_STORE_CTX_get_ex_data(ctx, SSL_get_ex_data_X509_STORE_CTX_idx());
-    ASSERT(ssl);
-    session = (struct tls_session *)SSL_get_ex_data(ssl, mydata_index);
-    ASSERT(session);
-
-    X509 *current_cert = X509_STORE_CTX_get_current_cert(ctx);
     struct buffer cert_hash = x509_get_sha256_fingerprint(current_cert, &gc);
-    cert_hash_remember(session, X509_STORE_CTX_get_error_depth(ctx), &cert_hash);
+    cert_hash_remember(session, depth, &cert_hash);
 
     /* did peer present cert which was signed by our root cert? */
     if (!preverify_ok && !session->opt->verify_hash_no_ca)
@@ -77,20 +70,17 @@ verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
         }
 
         /* Log and ignore missing CRL errors */
-        if (X509_STORE_CTX_get_error(ctx) == X509_V_ERR_UNABLE_TO_GET_CRL)
+        if (error == X509_V_ERR_UNABLE_TO_GET_CRL)
         {
-            msg(D_TLS_DEBUG_LOW, "VERIFY WARNING: depth=%d, %s: %s",
-                X509_STORE_CTX_get_error_depth(ctx),
-                X509_verify_cert_error_string(X509_STORE_CTX_get_error(ctx)), subject);
+            msg(D_TLS_DEBUG_LOW, "VERIFY WARNING: depth=%d, %s: %s", depth,
+                X509_verify_cert_error_string(error), subject);
             ret = 1;
             goto cleanup;
         }
 
         /* Remote site specified a certificate, but it's not correct */
-        msg(D_TLS_ERRORS, "VERIFY ERROR: depth=%d, error=%s: %s, serial=%s",
-            X509_STORE_CTX_get_error_depth(ctx),
-            X509_verify_cert_error_string(X509_STORE_CTX_get_error(ctx)), subject,
-            serial ? serial : "<not available>");
+        msg(D_TLS_ERRORS, "VERIFY ERROR: depth=%d, error=%s: %s, serial=%s", depth,
+            X509_verify_cert_error_string(error), subject, serial ? serial : "<not available>");
 
         ERR_clear_error();
 
@@ -98,7 +88,7 @@ verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
         goto cleanup;
     }
 
-    if (SUCCESS != verify_cert(session, current_cert, X509_STORE_CTX_get_error_depth(ctx)))
+    if (SUCCESS != verify_cert(session, current_cert, depth))
     {
         goto cleanup;
     }
@@ -111,6 +101,67 @@ cleanup:
     return ret;
 }
 
+#if ENABLE_SERVER_TLS_THREADS
+/*
+ * On a handshake worker, remember the certificate for the event loop,
+ * which does the checks of verify_callback_cert() when the worker is done.
+ * Fail right away only what fails there in any case.
+ */
+static int
+verify_callback_offload(struct key_state_ssl_offload *offload, const struct tls_session *session,
+                        int preverify_ok, X509_STORE_CTX *ctx)
+{
+    if (offload->n_certs == KS_SSL_OFFLOAD_CERTS)
+    {
+        offload->too_many_certs = true;
+        return 0;
+    }
+
+    X509 *current_cert = X509_STORE_CTX_get_current_cert(ctx);
+    const int error = X509_STORE_CTX_get_error(ctx);
+
+    X509_up_ref(current_cert);
+    offload->certs[offload->n_certs].cert = current_cert;
+    offload->certs[offload->n_certs].depth = X509_STORE_CTX_get_error_depth(ctx);
+    offload->certs[offload->n_certs].preverify_ok = preverify_ok;
+    offload->certs[offload->n_certs].error = error;
+    offload->n_certs++;
+
+    if (!preverify_ok && !session->opt->verify_hash_no_ca
+        && error != X509_V_ERR_UNABLE_TO_GET_CRL)
+    {
+        ERR_clear_error();
+        return 0;
+    }
+    return 1;
+}
+#endif
+
+int
+verify_callback(int preverify_ok, X509_STORE_CTX *ctx)
+{
+    struct tls_session *session;
+    SSL *ssl;
+
+    /* get the tls_session pointer */
+    ssl = X509_STORE_CTX_get_ex_data(ctx, SSL_get_ex_data_X509_STORE_CTX_idx());
+    ASSERT(ssl);
+    session = (struct tls_session *)SSL_get_ex_data(ssl, mydata_index);
+    ASSERT(session);
+
+#if ENABLE_SERVER_TLS_THREADS
+    struct key_state_ssl_offload *offload = SSL_get_ex_data(ssl, offload_index);
+    if (offload)
+    {
+        return verify_callback_offload(offload, session, preverify_ok, ctx);
+    }
+#endif
+
+    return verify_callback_cert(session, X509_STORE_CTX_get_current_cert(ctx),
+                               X509_STORE_CTX_get_error_depth(ctx), preverify_ok,
+                               X509_STORE_CTX_get_error(ctx));
+}
+
 #ifdef ENABLE_X509ALTUSERNAME
 bool
 x509_username_field_ext_supported(const char *fieldname)
@@ -315,6 +366,47 @@ backend_x509_get_serial_hex(openvpn_x509_cert_t *cert, struct gc_arena *gc)
     return format_hex_ex(asn1_i->data, asn1_i->length, 0, 1, ":", gc);
 }
 
+#if ENABLE_CRL_INDEX
+struct buffer
+x509_crl_issuer_key(X509_NAME *name, struct gc_arena *gc)
+{
+    const int len = i2d_X509_NAME(name, NULL);
+    if (len <= 0)
+    {
+        return clear_buf();
+    }
+
+    struct buffer key = alloc_buf_gc(len, gc);
+    unsigned char *p = BPTR(&key);
+    if (i2d_X509_NAME(name, &p) != len)
+    {
+        return clear_buf();
+    }
+    ASSERT(buf_inc_len(&key, len));
+    return key;
+}
+
+result_t
+backend_x509_get_crl_key(openvpn_x509_cert_t *cert, struct buffer *issuer, struct buffer *serial,
+                         struct gc_arena *gc)
+{
+    const ASN1_INTEGER *asn1_i = X509_get_serialNumber(cert);
+
+    *issuer = x509_crl_issuer_key(X509_get_issuer_name(cert), gc);
+    if (!buf_valid(issuer))
+    {
+        return FAILURE;
+    }
+
+    *serial = alloc_buf_gc(ASN1_STRING_length(asn1_i), gc);
+    if (!buf_write(serial, ASN1_STRING_get0_data(asn1_i), ASN1_STRING_length(asn1_i)))
+    {
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+#endif
+
 result_t
 backend_x509_write_pem(openvpn_x509_cert_t *cert, const char *filename)
 {
@@ -783,6 +875,9 @@ tls_verify_crl_missing(const struct tls_options *opt)
         return false;
     }
 
+#if ENABLE_CRL_INDEX
+    return !crl_store_loaded(opt->ssl_ctx.crl_store);
+#else
     X509_STORE *store = SSL_CTX_get_cert_store(opt->ssl_ctx.ctx);
     if (!store)
     {
@@ -800,6 +895,7 @@ tls_verify_crl_missing(const struct tls_options *opt)
         }
     }
     return true;
+#endif
 }
 
 #endif /* defined(ENABLE_CRYPTO_OPENSSL) */
@@ -32,11 +32,15 @@
 
 #include <openssl/x509.h>
 
+#include "buffer.h"
+
 #ifndef __OPENVPN_X509_CERT_T_DECLARED
 #define __OPENVPN_X509_CERT_T_DECLARED
 typedef X509 openvpn_x509_cert_t;
 #endif
 
+struct tls_session;
+
 /** @name Function for authenticating a new connection from a remote OpenVPN peer
  *  @{ */
 
@@ -70,6 +74,38 @@ typedef X509 openvpn_x509_cert_t;
  */
 int verify_callback(int preverify_ok, X509_STORE_CTX *ctx);
 
+/**
+ * The checks \c verify_callback() does for one certificate of the remote
+ * OpenVPN peer's chain.
+ *
+ * @param session      - The TLS session of the peer.
+ * @param current_cert - The certificate.
+ * @param depth        - Its depth in the chain, 0 for the peer's own one.
+ * @param preverify_ok - Whether the certificate passed the verification
+ *                       of the OpenSSL library.
+ * @param error        - The error of that verification, if any.
+ *
+ * @return Same as \c verify_callback().
+ */
+int verify_callback_cert(struct tls_session *session, X509 *current_cert, int depth,
+                         int preverify_ok, int error);
+
 /** @} name Function for authenticating a new connection from a remote OpenVPN peer */
 
+#if ENABLE_CRL_INDEX
+/**
+ * Compute the key the CRL index knows an issuer by: the DER encoding of
+ * its name, in full, so that two CAs whose names share a hash are kept
+ * apart.  The CRL and the certificates of an issuer carry its name as
+ * the CA copied it from its certificate, so their encodings match.
+ *
+ * @param name          The name of the issuer.
+ * @param gc            Garbage collection arena to allocate the key in.
+ *
+ * @return              The key, or an invalid buffer if the name cannot
+ *                      be encoded.
+ */
+struct buffer x509_crl_issuer_key(X509_NAME *name, struct gc_arena *gc);
+#endif
+
 #endif /* SSL_VERIFY_OPENSSL_H_ */
@@ -209,6 +209,10 @@
 #include <netinet/tcp.h>
 #endif
 
+#ifdef HAVE_NETINET_UDP_H
+#include <netinet/udp.h>
+#endif
+
 #endif /* TARGET_LINUX */
 
 #ifdef TARGET_SOLARIS
@@ -381,6 +385,106 @@ typedef int MIB_TCP_STATE;
 #define ENABLE_IP_PKTINFO 0
 #endif
 
+/*
+ * Can we move several datagrams per system call with
+ * linux-style recvmmsg()/sendmmsg() ?
+ */
+#if defined(TARGET_LINUX) && defined(MSG_WAITFORONE)
+#define ENABLE_UDP_BATCH 1
+#else
+#define ENABLE_UDP_BATCH 0
+#endif
+
+/*
+ * Can the kernel segment (UDP_SEGMENT) and coalesce (UDP_GRO)
+ * runs of same-size datagrams for us ?
+ */
+#if ENABLE_UDP_BATCH && ENABLE_IP_PKTINFO && defined(UDP_SEGMENT) && defined(UDP_GRO)
+#define ENABLE_UDP_OFFLOAD 1
+#else
+#define ENABLE_UDP_OFFLOAD 0
+#endif
+
+/*
+ * Can the sockets be busy polled (SO_BUSY_POLL) and
+ * the event loop pinned to a CPU ?
+ */
+#if defined(TARGET_LINUX) && defined(SO_BUSY_POLL)
+#define ENABLE_BUSY_POLL 1
+#else
+#define ENABLE_BUSY_POLL 0
+#endif
+
+/*
+ * Can we open several queues on one tun/tap device and
+ * serve them from worker threads ?
+ */
+#if defined(TARGET_LINUX) && defined(IFF_MULTI_QUEUE) && defined(TUNSETQUEUE)
+#define ENABLE_TUN_QUEUES 1
+#else
+#define ENABLE_TUN_QUEUES 0
+#endif
+
+/*
+ * Can we serve the data channel of a UDP server
+ * from several threads ?
+ */
+#ifndef _WIN32
+#define ENABLE_SERVER_SHARDS 1
+#else
+#define ENABLE_SERVER_SHARDS 0
+#endif
+
+/*
+ * Can we hand the data channel crypto of a UDP
+ * server to worker threads ?
+ */
+#if !defined(_WIN32) && !defined(__STDC_NO_ATOMICS__)
+#define ENABLE_SERVER_CRYPTO_THREADS 1
+#else
+#define ENABLE_SERVER_CRYPTO_THREADS 0
+#endif
+
+/*
+ * Can we run the TLS handshakes of a server
+ * on worker threads ?
+ */
+#if !defined(_WIN32) && defined(ENABLE_CRYPTO_OPENSSL)
+#define ENABLE_SERVER_TLS_THREADS 1
+#else
+#define ENABLE_SERVER_TLS_THREADS 0
+#endif
+
+/*
+ * Can we keep the CRLs as an index in memory,
+ * rebuilt on a thread when they change ?
+ */
+#if !defined(_WIN32) && defined(ENABLE_CRYPTO_OPENSSL)
+#define ENABLE_CRL_INDEX 1
+#else
+#define ENABLE_CRL_INDEX 0
+#endif
+
+/*
+ * Can we write the log from a thread
+ * of its own ?
+ */
+#if !defined(_WIN32) && !defined(__STDC_NO_ATOMICS__)
+#define ENABLE_ASYNC_LOG 1
+#else
+#define ENABLE_ASYNC_LOG 0
+#endif
+
+/*
+ * Can we run a UDP server as several processes
+ * sharing one port and one tun/tap device ?
+ */
+#if ENABLE_TUN_QUEUES && defined(SO_REUSEPORT)
+#define ENABLE_SERVER_PROCESSES 1
+#else
+#define ENABLE_SERVER_PROCESSES 0
+#endif
+
 /*
  * Does this platform define SOL_IP
  * or only bsd-style IPPROTO_IP ?
@@ -458,6 +562,16 @@ socket_defined(const socket_descriptor_t sd)
 #define ENABLE_FEATURE_EXECVE
 #endif
 
+/*
+ * Can we run the authentication scripts
+ * of a server as long-lived helpers ?
+ */
+#if !defined(_WIN32) && defined(ENABLE_FEATURE_EXECVE)
+#define ENABLE_AUTH_HELPERS 1
+#else
+#define ENABLE_AUTH_HELPERS 0
+#endif
+
 /*
  * HTTPS port sharing capability
  */
@@ -521,6 +635,15 @@ socket_defined(const socket_descriptor_t sd)
 #define EPOLL 0
 #endif
 
+/*
+ * Is io_uring available on this platform?
+ */
+#if defined(TARGET_LINUX) && defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_MMAN_H)
+#define IO_URING 1
+#else
+#define IO_URING 0
+#endif
+
 /*
  * Compression support
  */
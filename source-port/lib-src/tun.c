@@ -1938,6 +1938,13 @@ open_tun_dco_generic(const char *dev, const char *dev_type, struct tuntap *tt,
 static void
 close_tun_generic(struct tuntap *tt)
 {
+#if ENABLE_TUN_QUEUES
+    for (int i = 1; i < tt->n_queues; i++)
+    {
+        close(tt->queue_fds[i]);
+    }
+    free(tt->queue_fds);
+#endif
     if (tt->fd >= 0)
     {
         close(tt->fd);
@@ -2047,6 +2054,56 @@ read_tun(struct tuntap *tt, uint8_t *buf, int len)
 
 #if !PEDANTIC
 
+#if ENABLE_TUN_QUEUES
+bool
+tun_queue_attach(int fd, bool attach)
+{
+    struct ifreq ifr;
+
+    CLEAR(ifr);
+    ifr.ifr_flags = attach ? IFF_ATTACH_QUEUE : IFF_DETACH_QUEUE;
+    if (ioctl(fd, TUNSETQUEUE, (void *)&ifr) < 0)
+    {
+        msg(M_WARN | M_ERRNO, "Note: Cannot %s tun queue", attach ? "attach" : "detach");
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Open the remaining queues of a multi-queue device, tt->fd being the
+ * first one.  The extra queues start out detached, so that all flows go
+ * to tt->fd until tun_queues_start() has a worker thread for them.
+ */
+static void
+open_tun_queues(struct tuntap *tt, const char *node, struct ifreq *ifr)
+{
+    const int n = tt->options.queues;
+
+    ALLOC_ARRAY_CLEAR(tt->queue_fds, int, n);
+    tt->queue_fds[0] = tt->fd;
+    for (int i = 1; i < n; i++)
+    {
+        int fd = open(node, O_RDWR);
+        if (fd < 0)
+        {
+            msg(M_ERR, "ERROR: Cannot open TUN/TAP dev %s", node);
+        }
+        if (ioctl(fd, TUNSETIFF, (void *)ifr) < 0)
+        {
+            msg(M_ERR, "ERROR: Cannot ioctl TUNSETIFF %s (queue %d)", ifr->ifr_name, i);
+        }
+        tt->queue_fds[i] = fd;
+        tt->n_queues = i + 1;
+
+        tun_queue_attach(fd, false);
+        set_nonblock(fd);
+        set_cloexec(fd);
+    }
+    msg(M_INFO, "TUN/TAP device %s has %d queues", ifr->ifr_name, n);
+}
+#endif /* if ENABLE_TUN_QUEUES */
+
 void
 open_tun(const char *dev, const char *dev_type, const char *dev_node, struct tuntap *tt,
          openvpn_net_ctx_t *ctx)
@@ -2102,6 +2159,13 @@ open_tun(const char *dev, const char *dev_type, const char *dev_node, struct tun
             msg(M_FATAL, "I don't recognize device %s as a tun or tap device", dev);
         }
 
+#if ENABLE_TUN_QUEUES
+        if (tt->options.queues > 1 || tt->options.multi_queue)
+        {
+            ifr.ifr_flags |= IFF_MULTI_QUEUE;
+        }
+#endif
+
         /*
          * Set an explicit name, if --dev is not tun or tap
          */
@@ -2121,6 +2185,13 @@ open_tun(const char *dev, const char *dev_type, const char *dev_node, struct tun
 
         msg(M_INFO, "TUN/TAP device %s opened", ifr.ifr_name);
 
+#if ENABLE_TUN_QUEUES
+        if (tt->options.queues > 1)
+        {
+            open_tun_queues(tt, node, &ifr);
+        }
+#endif
+
         /*
          * Try making the TX send queue bigger
          */
@@ -150,9 +150,14 @@ struct tuntap_options
 
 #elif defined(TARGET_LINUX)
 
+/* upper bound for --tun-queues */
+#define TUN_QUEUES_MAX 16
+
 struct tuntap_options
 {
     int txqueuelen;
+    int queues;       /* --tun-queues */
+    bool multi_queue; /* attach to a device shared with --server-processes siblings */
 };
 
 #else  /* if defined(_WIN32) || defined(TARGET_ANDROID) */
@@ -238,6 +243,10 @@ struct tuntap
 
 #else  /* ifdef _WIN32 */
     int fd; /* file descriptor for TUN/TAP dev */
+#if ENABLE_TUN_QUEUES
+    int n_queues;   /* number of IFF_MULTI_QUEUE queues, 0 if single queue */
+    int *queue_fds; /* queue_fds[0] == fd */
+#endif
 #endif /* ifdef _WIN32 */
 
 #ifdef TARGET_SOLARIS
@@ -247,6 +256,9 @@ struct tuntap
     /* used for printing status info only */
     unsigned int rwflags_debug;
 
+    /* the last read found no packet, for --server-edge-triggered */
+    bool read_drained;
+
     dco_context_t dco;
     afunix_context_t afunix;
 };
@@ -279,6 +291,14 @@ int write_tun(struct tuntap *tt, uint8_t *buf, int len);
 
 int read_tun(struct tuntap *tt, uint8_t *buf, int len);
 
+#if ENABLE_TUN_QUEUES
+/**
+ * Attach or detach one queue of a multi-queue tun/tap device.  The
+ * kernel only steers flows to attached queues.
+ */
+bool tun_queue_attach(int fd, bool attach);
+#endif
+
 void tuncfg(const char *dev, const char *dev_type, const char *dev_node, int persist_mode,
             const char *username, const char *groupname, const struct tuntap_options *options,
             openvpn_net_ctx_t *ctx);
@@ -0,0 +1,421 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "syshead.h"
+
+#if ENABLE_TUN_QUEUES
+
+#include <pthread.h>
+#include <poll.h>
+
+#include "openvpn.h"
+#include "forward.h"
+#include "ssl_pkt.h"
+#include "fdmisc.h"
+#include "platform.h"
+#include "tun_queue.h"
+
+#include "memdbg.h"
+
+/* max number of packets a worker reads before it polls again */
+#define TUN_QUEUE_BUDGET 64
+
+struct tun_queue_worker
+{
+    struct tun_queue_set *set;
+    int index; /* queue number, 1 .. n_queues - 1 */
+    int fd;
+    pthread_t thread;
+    bool started;
+    bool attached;
+
+    /* packet buffers, sized for the frame seen under the lock */
+    int buf_size;
+    int payload_size;
+    int headroom;
+    struct buffer read_buf;
+    struct buffer encrypt_buf;
+    struct buffer compress_buf;
+
+    /* private copy of the send cipher */
+    struct cipher_copy cipher;
+
+    /* the last packet written, accounted for under the next lock */
+    struct encrypt_detached last;
+    int last_len;
+    int last_size;
+    int last_errno;
+};
+
+struct tun_queue_set
+{
+    struct context *c;
+    struct link_socket *sock;
+    pthread_mutex_t lock;
+    int stop_pipe[2];
+    bool stopping;
+    int n_workers;
+    struct tun_queue_worker *workers;
+};
+
+/*
+ * The workers bypass everything in the event loop that has per-packet
+ * state other than the crypto; return what stands in the way, if any.
+ */
+static const char *
+tun_queues_unsupported(const struct context *c, const struct link_socket *sock)
+{
+    if (!sock || !proto_is_udp(sock->info.proto))
+    {
+        return "a TCP connection";
+    }
+    if (sock->socks_proxy)
+    {
+        return "--socks-proxy";
+    }
+    if (dco_enabled(&c->options))
+    {
+        return "data channel offload";
+    }
+    if (c->options.shaper)
+    {
+        return "--shaper";
+    }
+    if (c->options.passtos)
+    {
+        return "--passtos";
+    }
+    if (c->options.block_ipv6)
+    {
+        return "--block-ipv6";
+    }
+#ifdef ENABLE_FRAGMENT
+    if (c->c2.fragment)
+    {
+        return "--fragment";
+    }
+#endif
+    return NULL;
+}
+
+/*
+ * Hand the worker's flows back to the event loop if it can no longer
+ * serve them.  Called with the lock held.
+ */
+static bool
+tun_queue_worker_usable(struct tun_queue_worker *w)
+{
+    const char *unsupported = tun_queues_unsupported(w->set->c, w->set->sock);
+    if (unsupported && w->attached)
+    {
+        msg(M_INFO, "TUN/TAP queue %d: %s is in use, passing its flows to the main thread",
+            w->index, unsupported);
+        tun_queue_attach(w->fd, false);
+        w->attached = false;
+    }
+    return !unsupported;
+}
+
+/*
+ * Make sure the worker's buffers fit the current frame, which may
+ * change when the server pushes new MTU settings.  Called with the
+ * lock held.
+ */
+static void
+tun_queue_worker_frame(struct tun_queue_worker *w, const struct frame *frame)
+{
+    w->payload_size = frame->buf.payload_size;
+    w->headroom = frame->buf.headroom;
+
+    if (BUF_SIZE(frame) > w->buf_size)
+    {
+        free_buf(&w->read_buf);
+        free_buf(&w->encrypt_buf);
+        w->buf_size = BUF_SIZE(frame);
+        w->read_buf = alloc_buf(w->buf_size);
+        w->encrypt_buf = alloc_buf(w->buf_size);
+        free_buf(&w->compress_buf);
+        w->compress_buf = alloc_buf(w->buf_size);
+    }
+}
+
+/*
+ * Account for the previous packet written by this worker.  Called with
+ * the lock held.
+ */
+static void
+tun_queue_worker_flush_stats(struct tun_queue_worker *w)
+{
+    if (w->last_len)
+    {
+        link_write_detached_accounting(w->set->c, w->set->sock, &w->last, &w->cipher,
+                                       w->last_len, w->last_size, w->last_errno);
+        w->last_len = 0;
+    }
+}
+
+/*
+ * Read one packet from the worker's queue and send it.  Returns false
+ * when the queue is empty or the worker has to stop.
+ */
+static bool
+tun_queue_worker_packet(struct tun_queue_worker *w)
+{
+    struct tun_queue_set *set = w->set;
+    struct context *c = set->c;
+    struct buffer buf = w->read_buf;
+    struct buffer work = w->encrypt_buf;
+
+    ASSERT(buf_init(&buf, w->headroom));
+    buf.len = read(w->fd, BPTR(&buf), w->payload_size);
+    const int read_errno = errno;
+
+    pthread_mutex_lock(&set->lock);
+
+    tun_queue_worker_flush_stats(w);
+
+    if (set->stopping)
+    {
+        pthread_mutex_unlock(&set->lock);
+        return false;
+    }
+
+    if (buf.len <= 0)
+    {
+        if (buf.len < 0 && read_errno != EAGAIN && read_errno != EWOULDBLOCK)
+        {
+            errno = read_errno;
+            check_status(buf.len, "read from TUN/TAP queue", NULL, c->c1.tuntap);
+        }
+        pthread_mutex_unlock(&set->lock);
+        return false;
+    }
+
+    if (!tun_queue_worker_usable(w))
+    {
+        pthread_mutex_unlock(&set->lock);
+        return false;
+    }
+
+    c->c2.tun_read_bytes += buf.len;
+    dmsg(D_TUN_RW, "TUN READ [%d] (queue %d)", BLEN(&buf), w->index);
+
+    if ((c->options.mode == MODE_POINT_TO_POINT) && (!c->options.allow_recursive_routing))
+    {
+        drop_if_recursive_routing(c, &buf);
+    }
+    if (buf.len > 0)
+    {
+        process_ip_header(c, PIP_MSSFIX | PIPV4_CLIENT_NAT, &buf, set->sock);
+    }
+
+    encrypt_sign_prepare(c, &buf, &work, w->compress_buf, &w->cipher, &w->last);
+
+    pthread_mutex_unlock(&set->lock);
+
+    encrypt_sign_detached(&buf, work, &w->last);
+    if (buf.len > 0)
+    {
+        w->last_len = BLEN(&buf);
+        w->last_size = (int)link_socket_write_udp_direct(set->sock, &buf, &w->last.to);
+        w->last_errno = errno;
+    }
+
+    return true;
+}
+
+static void *
+tun_queue_worker_thread(void *arg)
+{
+    struct tun_queue_worker *w = arg;
+    struct pollfd pfd[2];
+
+    pfd[0].fd = w->fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = w->set->stop_pipe[0];
+    pfd[1].events = POLLIN;
+
+    while (true)
+    {
+        if (poll(pfd, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        if (pfd[1].revents || (pfd[0].revents & (POLLERR | POLLHUP | POLLNVAL)))
+        {
+            break;
+        }
+
+        int n = 0;
+        while (n++ < TUN_QUEUE_BUDGET && tun_queue_worker_packet(w))
+        {
+        }
+
+        /* no packet is in flight now, so the buffers may be replaced */
+        pthread_mutex_lock(&w->set->lock);
+        tun_queue_worker_flush_stats(w);
+        tun_queue_worker_frame(w, &w->set->c->c2.frame);
+        /* a detached or stopping worker has nothing more to do */
+        const bool stop = w->set->stopping || !tun_queue_worker_usable(w);
+        pthread_mutex_unlock(&w->set->lock);
+        if (stop)
+        {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+void
+tun_queues_start(struct context *c)
+{
+    struct tuntap *tt = c->c1.tuntap;
+    struct tun_queue_set *set;
+
+    if (!tt || tt->fd < 0 || c->c2.tun_queues_checked)
+    {
+        return;
+    }
+    c->c2.tun_queues_checked = true;
+    if (tt->n_queues < 2)
+    {
+        return;
+    }
+
+    struct link_socket *sock = c->c2.link_sockets ? c->c2.link_sockets[0] : NULL;
+    const char *unsupported = tun_queues_unsupported(c, sock);
+    if (unsupported)
+    {
+        msg(M_WARN, "NOTE: --tun-queues is not used with %s, reading all flows on one queue",
+            unsupported);
+        return;
+    }
+
+    ALLOC_OBJ_CLEAR(set, struct tun_queue_set);
+    set->c = c;
+    set->sock = sock;
+    set->n_workers = tt->n_queues - 1;
+    ALLOC_ARRAY_CLEAR(set->workers, struct tun_queue_worker, set->n_workers);
+    pthread_mutex_init(&set->lock, NULL);
+    if (pipe(set->stop_pipe) < 0)
+    {
+        msg(M_ERR, "ERROR: cannot create pipe for tun queue workers");
+    }
+    set_cloexec(set->stop_pipe[0]);
+    set_cloexec(set->stop_pipe[1]);
+
+    /* the event loop runs with the lock held */
+    pthread_mutex_lock(&set->lock);
+    c->c2.tun_queues = set;
+
+    for (int i = 0; i < set->n_workers; i++)
+    {
+        struct tun_queue_worker *w = &set->workers[i];
+        w->set = set;
+        w->index = i + 1;
+        w->fd = tt->queue_fds[i + 1];
+        tun_queue_worker_frame(w, &c->c2.frame);
+
+        if (platform_thread_create(&w->thread, tun_queue_worker_thread, w) != 0)
+        {
+            msg(M_WARN, "NOTE: cannot start worker for TUN/TAP queue %d", w->index);
+            continue;
+        }
+        w->started = true;
+        w->attached = tun_queue_attach(w->fd, true);
+    }
+
+    msg(M_INFO, "TUN/TAP: serving %d extra queues from worker threads", set->n_workers);
+}
+
+void
+tun_queues_stop(struct context *c)
+{
+    struct tun_queue_set *set = c->c2.tun_queues;
+
+    if (!set)
+    {
+        return;
+    }
+
+    set->stopping = true;
+    if (write(set->stop_pipe[1], "x", 1) != 1)
+    {
+        msg(M_WARN | M_ERRNO, "NOTE: cannot signal tun queue workers");
+    }
+    pthread_mutex_unlock(&set->lock);
+
+    for (int i = 0; i < set->n_workers; i++)
+    {
+        struct tun_queue_worker *w = &set->workers[i];
+        if (w->started)
+        {
+            pthread_join(w->thread, NULL);
+        }
+        if (w->attached)
+        {
+            tun_queue_attach(w->fd, false);
+        }
+        tun_queue_worker_flush_stats(w);
+        free_buf(&w->read_buf);
+        free_buf(&w->encrypt_buf);
+        free_buf(&w->compress_buf);
+        cipher_copy_free(&w->cipher);
+    }
+
+    close(set->stop_pipe[0]);
+    close(set->stop_pipe[1]);
+    pthread_mutex_destroy(&set->lock);
+    free(set->workers);
+    free(set);
+    c->c2.tun_queues = NULL;
+}
+
+void
+tun_queues_unlock(struct context *c)
+{
+    if (c->c2.tun_queues)
+    {
+        pthread_mutex_unlock(&c->c2.tun_queues->lock);
+    }
+}
+
+void
+tun_queues_lock(struct context *c)
+{
+    if (c->c2.tun_queues)
+    {
+        pthread_mutex_lock(&c->c2.tun_queues->lock);
+    }
+}
+
+#endif /* ENABLE_TUN_QUEUES */
@@ -0,0 +1,74 @@
+/*
+ *  OpenVPN -- An application to securely tunnel IP networks
+ *             over a single TCP/UDP port, with support for SSL/TLS-based
+ *             session authentication and key exchange,
+ *             packet encryption, packet authentication, and
+ *             packet compression.
+ *
+ *  Copyright (C) 2002-2025 OpenVPN Inc <sales@openvpn.net>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License version 2
+ *  as published by the Free Software Foundation.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * Worker threads for the extra queues of a multi-queue tun/tap
+ * device (--tun-queues, Linux only, point-to-point/client mode).
+ *
+ * The kernel spreads the flows leaving the tun device over all queues.
+ * Queue 0 is the ordinary tun fd served by the event loop; each extra
+ * queue gets a thread that reads, encrypts and sends its packets.  The
+ * event loop thread keeps doing everything else (link input, TLS,
+ * timers) and holds the data channel lock while it does so; it drops
+ * the lock only while it sleeps in event_wait().
+ *
+ * A worker takes the lock to pick the key and reserve a packet ID,
+ * then encrypts with a private copy of the send cipher and writes to
+ * the link socket without holding the lock.
+ */
+
+#ifndef TUN_QUEUE_H
+#define TUN_QUEUE_H
+
+#if ENABLE_TUN_QUEUES
+
+struct context;
+
+/**
+ * Start one worker per extra tun queue, if the device has any and the
+ * configuration allows the workers to bypass the event loop.  Does
+ * nothing until the tun device is open, and only checks once per
+ * context after that.  The calling thread holds the data channel lock
+ * when this returns.
+ */
+void tun_queues_start(struct context *c);
+
+/**
+ * Stop the workers and detach their queues, so that all flows go
+ * through the event loop again.  Called with the lock held.
+ */
+void tun_queues_stop(struct context *c);
+
+/**
+ * Release the data channel lock before the event loop goes to sleep.
+ */
+void tun_queues_unlock(struct context *c);
+
+/**
+ * Take the data channel lock again after waking up.
+ */
+void tun_queues_lock(struct context *c);
+
+#endif /* ENABLE_TUN_QUEUES */
+
+#endif /* TUN_QUEUE_H */